@@ -0,0 +1,71 @@
+/*
+ * arena.h
+ *
+ * This header file defines a simple arena (region) allocator.
+ *
+ * An arena hands out memory by bumping a pointer through large blocks and
+ * releases everything at once with arena_reset() or arena_free(). The
+ * programs use one arena for their input text, decoded output and record
+ * batches, so memory use is predictable and nothing can leak.
+ *
+ * Key Features:
+ * 1. Bump Allocation: Each allocation is a pointer increment in the
+ *    current block (16-byte aligned)
+ * 2. Bulk Reset: All allocations are released together
+ * 3. Large Regions: Allocations of ARENA_HUGE_THRESHOLD bytes or more get
+ *    their own mmap() region, marked with MADV_HUGEPAGE so scans over
+ *    multi-GB buffers take fewer TLB misses
+ * 4. Growth: The most recent allocation can be grown in place (mremap for
+ *    large regions), which is how whole input streams are read
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>   /* For size_t */
+#include <stdio.h>    /* For FILE */
+
+/* Default size of a bump block */
+#define ARENA_BLOCK_SIZE (256 * 1024)
+
+/* Allocations at least this large are placed in their own mmap() region */
+#define ARENA_HUGE_THRESHOLD (2 * 1024 * 1024)
+
+typedef struct arena_block arena_block;
+
+/* An arena; initialise with arena_init() before use */
+typedef struct arena {
+    arena_block * blocks;    /* Bump blocks, the current one first */
+    arena_block * large;     /* Regions holding one large allocation each */
+    size_t block_size;       /* Size of new bump blocks */
+    void * last;             /* Most recent bump allocation (may be grown) */
+    size_t reserved;         /* Bytes currently obtained from the system */
+} arena;
+
+/* Starts an empty arena (block_size 0 selects ARENA_BLOCK_SIZE) */
+void arena_init(arena * a, size_t block_size);
+
+/* Returns size bytes of 16-byte aligned memory, or NULL if out of memory */
+void * arena_alloc(arena * a, size_t size);
+
+/*
+ * Grows an allocation from old_size to new_size bytes, keeping its
+ * contents. Works in place when ptr is the newest allocation or has its
+ * own region; otherwise copies. Returns NULL if out of memory.
+ */
+void * arena_grow(arena * a, void * ptr, size_t old_size, size_t new_size);
+
+/* Releases every allocation but keeps the first block for reuse */
+void arena_reset(arena * a);
+
+/* Releases every allocation and all memory held by the arena */
+void arena_free(arena * a);
+
+/*
+ * Reads the rest of a stream into one NUL-terminated buffer allocated from
+ * the arena. The number of bytes read (not counting the NUL) is stored in
+ * length. Returns NULL on a read error or if out of memory.
+ */
+char * arena_read_file(arena * a, FILE * fp, size_t * length);
+
+#endif
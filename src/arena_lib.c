@@ -0,0 +1,339 @@
+/*
+ * arena_lib.c
+ *
+ * This file implements the arena allocator declared in arena.h.
+ *
+ * Key Implementation Details:
+ * 1. Blocks: Each block starts with a small header followed by its data
+ * 2. Small Allocations: Carved from the current bump block; a new block is
+ *    started when it is full
+ * 3. Large Allocations: Anything over a quarter of a block gets a block of
+ *    its own, from mmap() when it reaches ARENA_HUGE_THRESHOLD
+ * 4. Reading Streams: Regular files are read with one allocation of the
+ *    right size; pipes grow their buffer by doubling
+ */
+
+#define _GNU_SOURCE   /* For mremap(), MADV_HUGEPAGE and fileno() */
+
+#include "arena.h"
+#include <stdlib.h>     /* For malloc() and free() */
+#include <string.h>     /* For memcpy() */
+#include <sys/mman.h>   /* For mmap(), mremap() and madvise() */
+#include <sys/stat.h>   /* For fstat() */
+
+/* Alignment of every allocation */
+#define ARENA_ALIGN 16
+
+/* Rounds n up to a multiple of ARENA_ALIGN */
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1))
+
+/* Bytes read at a time from streams of unknown size */
+#define ARENA_READ_CHUNK (64 * 1024)
+
+struct arena_block {
+    arena_block * next;   /* Next block in the same list */
+    size_t size;          /* Usable bytes after the header */
+    size_t used;          /* Bytes handed out so far */
+    int mapped;           /* Non-zero if the block came from mmap() */
+};
+
+/* Size of the block header, rounded so that data stays aligned */
+#define ARENA_HEADER ARENA_ROUND(sizeof(arena_block))
+
+/* Start of a block's data */
+#define BLOCK_DATA(b) ((char *) (b) + ARENA_HEADER)
+
+/*
+ * block_new
+ *
+ * Purpose: Obtains a block with at least size usable bytes
+ *
+ * How it works:
+ *   Blocks of ARENA_HUGE_THRESHOLD or more are mapped directly and marked
+ *   with MADV_HUGEPAGE; smaller blocks come from malloc()
+ */
+static arena_block * block_new(arena * a, size_t size) {
+    size_t total = ARENA_HEADER + size;
+    arena_block * block;
+    int mapped = size >= ARENA_HUGE_THRESHOLD;
+
+    if (mapped) {
+        void * p = mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            return NULL;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(p, total, MADV_HUGEPAGE);  /* Only a hint; failure is harmless */
+#endif
+        block = p;
+    } else {
+        block = malloc(total);
+        if (block == NULL) {
+            return NULL;
+        }
+    }
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    block->mapped = mapped;
+    a->reserved += total;
+    return block;
+}
+
+/*
+ * block_release
+ *
+ * Purpose: Returns a block to the system
+ */
+static void block_release(arena * a, arena_block * block) {
+    size_t total = ARENA_HEADER + block->size;
+    a->reserved -= total;
+    if (block->mapped) {
+        munmap(block, total);
+    } else {
+        free(block);
+    }
+}
+
+/*
+ * arena_init
+ *
+ * Purpose: Starts an empty arena
+ *
+ * Parameters:
+ *   a          - The arena
+ *   block_size - Size of bump blocks (0 for ARENA_BLOCK_SIZE)
+ */
+void arena_init(arena * a, size_t block_size) {
+    memset(a, 0, sizeof(*a));
+    a->block_size = block_size > 0 ? ARENA_ROUND(block_size) : ARENA_BLOCK_SIZE;
+}
+
+/*
+ * arena_alloc
+ *
+ * Purpose: Allocates memory from the arena
+ *
+ * Parameters:
+ *   a    - The arena
+ *   size - Bytes wanted
+ *
+ * Returns:
+ *   16-byte aligned memory that stays valid until the arena is reset or
+ *   freed, or NULL if out of memory
+ */
+void * arena_alloc(arena * a, size_t size) {
+    size = ARENA_ROUND(size > 0 ? size : 1);
+
+    /* Large allocations get a block of their own */
+    if (size > a->block_size / 4) {
+        arena_block * block = block_new(a, size);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->used = size;
+        block->next = a->large;
+        a->large = block;
+        return BLOCK_DATA(block);
+    }
+
+    arena_block * current = a->blocks;
+    if (current == NULL || current->size - current->used < size) {
+        arena_block * block = block_new(a, a->block_size);
+        if (block == NULL) {
+            return NULL;
+        }
+        block->next = current;
+        a->blocks = block;
+        current = block;
+    }
+
+    void * p = BLOCK_DATA(current) + current->used;
+    current->used += size;
+    a->last = p;
+    return p;
+}
+
+/*
+ * arena_grow
+ *
+ * Purpose: Makes an allocation larger, keeping its contents
+ *
+ * Parameters:
+ *   a        - The arena
+ *   ptr      - Allocation to grow (NULL behaves like arena_alloc)
+ *   old_size - Size it was allocated with
+ *   new_size - Size wanted
+ *
+ * Returns:
+ *   The (possibly moved) allocation, or NULL if out of memory
+ *
+ * How it works:
+ * 1. A large allocation is resized with mremap() or realloc()
+ * 2. The newest bump allocation is extended if its block has room
+ * 3. Anything else is copied into a new allocation
+ */
+void * arena_grow(arena * a, void * ptr, size_t old_size, size_t new_size) {
+    if (ptr == NULL) {
+        return arena_alloc(a, new_size);
+    }
+    new_size = ARENA_ROUND(new_size);
+    old_size = ARENA_ROUND(old_size);
+    if (new_size <= old_size) {
+        return ptr;
+    }
+
+    /* Large allocations own their block and can be resized directly */
+    for (arena_block ** link = &a->large; *link != NULL; link = &(*link)->next) {
+        arena_block * block = *link;
+        if (BLOCK_DATA(block) != (char *) ptr) {
+            continue;
+        }
+        size_t old_total = ARENA_HEADER + block->size;
+        size_t new_total = ARENA_HEADER + new_size;
+        arena_block * moved;
+        if (block->mapped) {
+            void * p = mremap(block, old_total, new_total, MREMAP_MAYMOVE);
+            if (p == MAP_FAILED) {
+                return NULL;
+            }
+#ifdef MADV_HUGEPAGE
+            madvise(p, new_total, MADV_HUGEPAGE);
+#endif
+            moved = p;
+        } else if (new_size >= ARENA_HUGE_THRESHOLD) {
+            /* Crossing the threshold: move the data into a mapped region */
+            moved = block_new(a, new_size);
+            if (moved == NULL) {
+                return NULL;
+            }
+            memcpy(BLOCK_DATA(moved), ptr, block->used);
+            moved->next = block->next;
+            block_release(a, block);
+            *link = moved;
+            moved->used = new_size;
+            return BLOCK_DATA(moved);
+        } else {
+            moved = realloc(block, new_total);
+            if (moved == NULL) {
+                return NULL;
+            }
+        }
+        a->reserved += new_total - old_total;
+        moved->size = new_size;
+        moved->used = new_size;
+        *link = moved;
+        return BLOCK_DATA(moved);
+    }
+
+    /* The newest small allocation can grow into the rest of its block */
+    arena_block * current = a->blocks;
+    if (ptr == a->last && current != NULL &&
+        (char *) ptr + old_size == BLOCK_DATA(current) + current->used &&
+        current->size - current->used >= new_size - old_size) {
+        current->used += new_size - old_size;
+        return ptr;
+    }
+
+    void * p = arena_alloc(a, new_size);
+    if (p != NULL) {
+        memcpy(p, ptr, old_size);
+    }
+    return p;
+}
+
+/*
+ * arena_reset
+ *
+ * Purpose: Releases every allocation at once
+ *
+ * How it works:
+ *   Large regions are returned to the system; the oldest bump block is
+ *   kept and emptied so the next round of allocations needs no new memory
+ */
+void arena_reset(arena * a) {
+    while (a->large != NULL) {
+        arena_block * next = a->large->next;
+        block_release(a, a->large);
+        a->large = next;
+    }
+    while (a->blocks != NULL && a->blocks->next != NULL) {
+        arena_block * next = a->blocks->next;
+        block_release(a, a->blocks);
+        a->blocks = next;
+    }
+    if (a->blocks != NULL) {
+        a->blocks->used = 0;
+    }
+    a->last = NULL;
+}
+
+/*
+ * arena_free
+ *
+ * Purpose: Releases all memory held by the arena
+ */
+void arena_free(arena * a) {
+    arena_reset(a);
+    if (a->blocks != NULL) {
+        block_release(a, a->blocks);
+        a->blocks = NULL;
+    }
+}
+
+/*
+ * arena_read_file
+ *
+ * Purpose: Reads the rest of a stream into a single buffer
+ *
+ * Parameters:
+ *   a      - Arena the buffer is allocated from
+ *   fp     - Stream to read (a file or standard input)
+ *   length - Receives the number of bytes read
+ *
+ * Returns:
+ *   The NUL-terminated contents, or NULL on a read error or out of memory
+ *
+ * How it works:
+ * 1. For regular files the size is known, so one allocation is enough
+ * 2. Otherwise the buffer starts at ARENA_READ_CHUNK and doubles when it
+ *    is full and more data follows
+ * 3. Data is read with fread() straight into the buffer, without
+ *    intermediate line buffers
+ */
+char * arena_read_file(arena * a, FILE * fp, size_t * length) {
+    struct stat st;
+    size_t capacity = ARENA_READ_CHUNK;
+    size_t used = 0;
+
+    if (fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        capacity = (size_t) st.st_size;
+    }
+
+    char * text = arena_alloc(a, capacity + 1);
+    while (text != NULL) {
+        used += fread(text + used, 1, capacity - used, fp);
+        if (used < capacity) {
+            break;  /* End of file or error */
+        }
+
+        /* The buffer is full; only grow it if there really is more data */
+        int c = getc(fp);
+        if (c == EOF) {
+            break;
+        }
+        text = arena_grow(a, text, capacity + 1, capacity * 2 + 1);
+        capacity *= 2;
+        if (text != NULL) {
+            text[used++] = (char) c;
+        }
+    }
+
+    if (text == NULL || ferror(fp)) {
+        return NULL;
+    }
+    text[used] = '\0';
+    *length = used;
+    return text;
+}
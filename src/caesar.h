@@ -0,0 +1,168 @@
+/*
+ * caesar.h
+ *
+ * This header file is the public interface of libcaesar.so, the analysis
+ * and decoding functions of decode and copyrecords packaged for programs
+ * that want to call them in-process (a service decoding many requests at
+ * once) instead of running decode for every request.
+ *
+ * It is self-contained: it includes only standard headers, and none of the
+ * library's own types appear in it, so the layout of the internals can
+ * change without breaking programs built against it.
+ *
+ * Key Features:
+ * 1. Contexts: A caesar_ctx holds the language profiles (English first,
+ *    then any added with caesar_ctx_add_profile or caesar_ctx_load_profile)
+ *    and their precomputed weight and shift tables. It is built once and
+ *    then only read
+ * 2. Reentrancy: The library keeps no mutable global state. Once a
+ *    context's profiles are added it may be shared by any number of
+ *    threads; every other call reads the context and writes only the
+ *    caller's buffers and histograms
+ * 3. Streaming: A caesar_hist is updated chunk by chunk and histograms
+ *    counted on different threads are merged, so a text never has to be
+ *    held in one piece to be scored
+ * 4. No hidden allocation: Only caesar_ctx_new and the profile calls
+ *    allocate; counting, scoring and transforming never do
+ * 5. Records: The 408-byte records of copyrecords are decoded in batches
+ *    (str1 and str2 only; the numeric fields are not touched)
+ *
+ * Versioning: CAESAR_VERSION_* describe the header a program was built
+ * with and caesar_version() the library it runs with. The major version is
+ * the library's soname (libcaesar.so.1) and changes only when the
+ * interface does in an incompatible way.
+ *
+ * Example:
+ *   caesar_ctx * ctx = caesar_ctx_new();
+ *   caesar_hist hist;
+ *   caesar_hist_init(&hist);
+ *   caesar_hist_update(&hist, text, length);   (as many times as needed)
+ *   int profile;
+ *   int shift = caesar_best_shift(ctx, &hist, &profile);
+ *   caesar_transform(ctx, text, length, caesar_decode_shift(shift));
+ *   caesar_ctx_free(ctx);
+ */
+
+#ifndef CAESAR_H
+#define CAESAR_H
+
+#include <stddef.h>   /* For size_t */
+#include <stdint.h>   /* For uint64_t */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAESAR_VERSION_MAJOR 1
+#define CAESAR_VERSION_MINOR 0
+#define CAESAR_VERSION_PATCH 0
+
+/* The header's version as one number (10000 * major + 100 * minor + patch) */
+#define CAESAR_VERSION (CAESAR_VERSION_MAJOR * 10000 + CAESAR_VERSION_MINOR * 100 + CAESAR_VERSION_PATCH)
+
+/* Marks the functions the library exports; everything else in it is hidden */
+#if defined(__GNUC__)
+#define CAESAR_API __attribute__((visibility("default")))
+#else
+#define CAESAR_API
+#endif
+
+/* Most profiles a context holds, English included */
+#define CAESAR_MAX_PROFILES 32
+
+/* Longest profile name, including the terminating NUL */
+#define CAESAR_NAME_MAX 32
+
+/* Record layout used by caesar_transform_records (see copyrecords.h) */
+#define CAESAR_RECORD_SIZE 408
+#define CAESAR_RECORD_STR1_OFFSET 0
+#define CAESAR_RECORD_STR1_SIZE 24
+#define CAESAR_RECORD_STR2_OFFSET 216
+#define CAESAR_RECORD_STR2_SIZE 144
+
+/* Errors of caesar_ctx_load_profile besides those of caesar_ctx_add_profile (-1) */
+#define CAESAR_ERR_OPEN   -2   /* The profile file could not be opened */
+#define CAESAR_ERR_FORMAT -3   /* The file is not a valid profile */
+
+/* Profiles and tables; its layout is private to the library */
+typedef struct caesar_ctx caesar_ctx;
+
+/* Letter histogram; lives wherever the caller likes (usually the stack) */
+typedef struct caesar_hist {
+    uint64_t counts[26];  /* Occurrences of each letter (index 0 is 'A' or 'a') */
+    uint64_t letters;     /* Total letters counted (sum of counts) */
+    uint64_t bytes;       /* Total bytes examined */
+} caesar_hist;
+
+/* Version of the library in use, in the form of CAESAR_VERSION */
+CAESAR_API int caesar_version(void);
+
+/* Creates a context holding the English profile (index 0); NULL if out of memory */
+CAESAR_API caesar_ctx * caesar_ctx_new(void);
+
+/*
+ * Adds a language with the given letter frequencies (all positive; they
+ * are scaled to sum to 1). Not thread-safe: add every profile before the
+ * context is shared. Returns the profile's index, or -1 if the name is too
+ * long, a frequency is not positive, the context is full or memory runs out.
+ */
+CAESAR_API int caesar_ctx_add_profile(caesar_ctx * ctx, const char * name, const double expected[26]);
+
+/*
+ * Adds a profile file (the format frequency_table --train writes), with the
+ * same thread-safety as caesar_ctx_add_profile. Nothing is printed; returns
+ * the profile's index, CAESAR_ERR_OPEN, CAESAR_ERR_FORMAT, or -1 as
+ * caesar_ctx_add_profile does.
+ */
+CAESAR_API int caesar_ctx_load_profile(caesar_ctx * ctx, const char * path);
+
+/* Number of profiles in a context */
+CAESAR_API int caesar_ctx_profiles(const caesar_ctx * ctx);
+
+/* Name of a profile ("english" for index 0), or NULL if there is no such profile */
+CAESAR_API const char * caesar_ctx_profile_name(const caesar_ctx * ctx, int profile);
+
+/* Releases a context and its profiles */
+CAESAR_API void caesar_ctx_free(caesar_ctx * ctx);
+
+/* Resets a histogram to zero */
+CAESAR_API void caesar_hist_init(caesar_hist * hist);
+
+/* Counts length more bytes of text into a histogram */
+CAESAR_API void caesar_hist_update(caesar_hist * hist, const void * data, size_t length);
+
+/* Adds the counts of one histogram to another */
+CAESAR_API void caesar_hist_merge(caesar_hist * into, const caesar_hist * from);
+
+/*
+ * Chi-squared value of every shift for one profile (lower is better;
+ * scores[s] is for text encoded with shift s). Returns 0, or -1 if there is
+ * no such profile.
+ */
+CAESAR_API int caesar_score(const caesar_ctx * ctx, int profile, const caesar_hist * hist, double scores[26]);
+
+/*
+ * Most likely shift the text was encoded with, over all the context's
+ * profiles. *profile (if not NULL) gets the best profile's index, or -1 if
+ * none fits, in which case 0 is returned.
+ */
+CAESAR_API int caesar_best_shift(const caesar_ctx * ctx, const caesar_hist * hist, int * profile);
+
+/* The shift that undoes an encoding shift (3 -> 23) */
+CAESAR_API int caesar_decode_shift(int shift);
+
+/* Applies a shift in place to length bytes; letters move, other bytes are kept */
+CAESAR_API void caesar_transform(const caesar_ctx * ctx, void * data, size_t length, int shift);
+
+/*
+ * Applies a shift in place to the str1 and str2 fields (up to their first
+ * NUL) of count consecutive CAESAR_RECORD_SIZE-byte records. The buffer
+ * needs no particular alignment.
+ */
+CAESAR_API void caesar_transform_records(const caesar_ctx * ctx, void * records, size_t count, int shift);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,257 @@
+/*
+ * caesar_lib.c
+ *
+ * This file implements the libcaesar.so interface declared in caesar.h on
+ * top of decode_lib.c, frequency_lib.c and profile_lib.c.
+ *
+ * Key Implementation Details:
+ * 1. Contexts: A caesar_ctx is an array of decode_ctx, one per profile,
+ *    and their names. Each decode_ctx already holds the rotated weight
+ *    tables and the 26 shift tables, so scoring all profiles is one
+ *    decode_best_language() call and a transform is a table lookup per byte
+ * 2. No shared state: Nothing here is global; decode_lib's own shared data
+ *    (the English frequencies, the context behind the older string
+ *    functions and the choice of scoring kernel) is read-only or built once
+ *    under pthread_once()
+ * 3. Histograms: caesar_hist mirrors freq_hist field for field but is a
+ *    separate type, so the public header stays free of internal ones;
+ *    values are copied across, which costs 28 moves per call
+ * 4. Symbols: The library is built with hidden visibility, so only the
+ *    CAESAR_API functions are exported
+ */
+
+#include "caesar.h"
+#include "decode_lib.h"   /* For decode_ctx and the scoring functions */
+#include "profile.h"      /* For profile_read() */
+#include "copyrecords.h"  /* For the record layout */
+#include <stddef.h>       /* For offsetof() */
+#include <stdlib.h>       /* For memory management */
+#include <string.h>       /* For memchr() and strlen() */
+
+#if CAESAR_MAX_PROFILES > DECODE_MAX_LANGUAGES
+#error "CAESAR_MAX_PROFILES must not exceed DECODE_MAX_LANGUAGES"
+#endif
+
+#if CAESAR_NAME_MAX > PROFILE_NAME_MAX
+#error "CAESAR_NAME_MAX must not exceed PROFILE_NAME_MAX"
+#endif
+
+/* The record layout in caesar.h must be copyrecords' (fails to compile otherwise) */
+typedef char caesar_record_layout_check[(sizeof(record) == CAESAR_RECORD_SIZE &&
+    offsetof(record, str1) == CAESAR_RECORD_STR1_OFFSET && sizeof(((record *) 0)->str1) == CAESAR_RECORD_STR1_SIZE &&
+    offsetof(record, str2) == CAESAR_RECORD_STR2_OFFSET && sizeof(((record *) 0)->str2) == CAESAR_RECORD_STR2_SIZE) ? 1 : -1];
+
+/* Profiles of a context, English first */
+struct caesar_ctx {
+    int count;                                        /* Profiles in use */
+    decode_ctx * languages[CAESAR_MAX_PROFILES];      /* Tables of each profile */
+    char names[CAESAR_MAX_PROFILES][CAESAR_NAME_MAX];
+};
+
+/* Copies a public histogram into the internal type */
+static void to_freq_hist(const caesar_hist * from, freq_hist * to) {
+    memcpy(to->counts, from->counts, sizeof(to->counts));
+    to->letters = from->letters;
+    to->bytes = from->bytes;
+}
+
+/* Length of a string stored in a fixed-size field (up to its first NUL) */
+static size_t field_length(const char * field, size_t size) {
+    const char * end = memchr(field, '\0', size);
+    return end == NULL ? size : (size_t) (end - field);
+}
+
+int caesar_version(void) {
+    return CAESAR_VERSION;
+}
+
+/*
+ * caesar_ctx_new
+ *
+ * Purpose: Creates a context with English as profile 0
+ *
+ * Returns:
+ *   A new context (free with caesar_ctx_free), or NULL if out of memory
+ */
+caesar_ctx * caesar_ctx_new(void) {
+    caesar_ctx * ctx = calloc(1, sizeof(caesar_ctx));
+    if (ctx == NULL) {
+        return NULL;
+    }
+    ctx->languages[0] = decode_ctx_new();
+    if (ctx->languages[0] == NULL) {
+        free(ctx);
+        return NULL;
+    }
+    strcpy(ctx->names[0], "english");
+    ctx->count = 1;
+    return ctx;
+}
+
+/*
+ * caesar_ctx_add_profile
+ *
+ * Purpose: Adds a language to a context
+ *
+ * How it works:
+ * 1. Checks the name and that every frequency is positive and finite
+ * 2. Scales the frequencies to sum to 1, as profile_load() does
+ * 3. Builds the language's tables with decode_ctx_new_profile()
+ */
+int caesar_ctx_add_profile(caesar_ctx * ctx, const char * name, const double expected[26]) {
+    double scaled[26];
+    double total = 0;
+
+    if (ctx->count >= CAESAR_MAX_PROFILES || name == NULL || strlen(name) >= CAESAR_NAME_MAX) {
+        return -1;
+    }
+    for (int ch = 0; ch < 26; ch++) {
+        if (!(expected[ch] > 0 && expected[ch] < 1e300)) {
+            return -1;
+        }
+        total += expected[ch];
+    }
+    for (int ch = 0; ch < 26; ch++) {
+        scaled[ch] = expected[ch] / total;
+    }
+
+    decode_ctx * language = decode_ctx_new_profile(scaled);
+    if (language == NULL) {
+        return -1;
+    }
+    ctx->languages[ctx->count] = language;
+    strcpy(ctx->names[ctx->count], name);
+    return ctx->count++;
+}
+
+/*
+ * caesar_ctx_load_profile
+ *
+ * Purpose: Adds a language from a profile file (see profile.h)
+ *
+ * How it works:
+ *   The file is parsed by profile_read() with no error stream, so a
+ *   library caller's stderr is left alone; its result becomes the error code
+ */
+int caesar_ctx_load_profile(caesar_ctx * ctx, const char * path) {
+    freq_profile profile;
+
+    switch (profile_read(path, &profile, NULL)) {
+    case 0:
+        return caesar_ctx_add_profile(ctx, profile.name, profile.expected);
+    case PROFILE_ERR_OPEN:
+        return CAESAR_ERR_OPEN;
+    default:
+        return CAESAR_ERR_FORMAT;
+    }
+}
+
+int caesar_ctx_profiles(const caesar_ctx * ctx) {
+    return ctx->count;
+}
+
+const char * caesar_ctx_profile_name(const caesar_ctx * ctx, int profile) {
+    if (profile < 0 || profile >= ctx->count) {
+        return NULL;
+    }
+    return ctx->names[profile];
+}
+
+void caesar_ctx_free(caesar_ctx * ctx) {
+    if (ctx == NULL) {
+        return;
+    }
+    for (int i = 0; i < ctx->count; i++) {
+        decode_ctx_free(ctx->languages[i]);
+    }
+    free(ctx);
+}
+
+void caesar_hist_init(caesar_hist * hist) {
+    memset(hist, 0, sizeof(*hist));
+}
+
+/*
+ * caesar_hist_update
+ *
+ * Purpose: Counts another chunk of text into a histogram
+ *
+ * How it works:
+ *   The chunk is counted into a histogram on the stack by
+ *   freq_hist_update(), then added to the caller's
+ */
+void caesar_hist_update(caesar_hist * hist, const void * data, size_t length) {
+    freq_hist chunk;
+
+    freq_hist_clear(&chunk);
+    freq_hist_update(&chunk, data, length);
+    for (int ch = 0; ch < 26; ch++) {
+        hist->counts[ch] += chunk.counts[ch];
+    }
+    hist->letters += chunk.letters;
+    hist->bytes += chunk.bytes;
+}
+
+void caesar_hist_merge(caesar_hist * into, const caesar_hist * from) {
+    for (int ch = 0; ch < 26; ch++) {
+        into->counts[ch] += from->counts[ch];
+    }
+    into->letters += from->letters;
+    into->bytes += from->bytes;
+}
+
+int caesar_score(const caesar_ctx * ctx, int profile, const caesar_hist * hist, double scores[26]) {
+    freq_hist counts;
+
+    if (profile < 0 || profile >= ctx->count) {
+        return -1;
+    }
+    to_freq_hist(hist, &counts);
+    decode_scores(ctx->languages[profile], &counts, scores);
+    return 0;
+}
+
+int caesar_best_shift(const caesar_ctx * ctx, const caesar_hist * hist, int * profile) {
+    freq_hist counts;
+    int language;
+
+    to_freq_hist(hist, &counts);
+    int shift = decode_best_language(ctx->languages, ctx->count, &counts, &language);
+    if (profile != NULL) {
+        *profile = language;
+    }
+    return shift;
+}
+
+int caesar_decode_shift(int shift) {
+    return to_decode(((shift % 26) + 26) % 26);
+}
+
+void caesar_transform(const caesar_ctx * ctx, void * data, size_t length, int shift) {
+    decode_apply(ctx->languages[0], data, length, shift);
+}
+
+/*
+ * caesar_transform_records
+ *
+ * Purpose: Applies a shift to the string fields of a batch of records
+ *
+ * How it works:
+ *   The same as decode_records() in copyrecords_lib.c, but by byte offset,
+ *   so the caller's buffer does not have to be aligned for the doubles in
+ *   the record
+ */
+void caesar_transform_records(const caesar_ctx * ctx, void * records, size_t count, int shift) {
+    const decode_ctx * tables = ctx->languages[0];
+    char * record = records;
+
+    if (((shift % 26) + 26) % 26 == 0) {
+        return;  /* Nothing to do */
+    }
+    for (size_t i = 0; i < count; i++, record += CAESAR_RECORD_SIZE) {
+        char * str1 = record + CAESAR_RECORD_STR1_OFFSET;
+        char * str2 = record + CAESAR_RECORD_STR2_OFFSET;
+        decode_apply(tables, str1, field_length(str1, CAESAR_RECORD_STR1_SIZE), shift);
+        decode_apply(tables, str2, field_length(str2, CAESAR_RECORD_STR2_SIZE), shift);
+    }
+}
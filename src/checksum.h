@@ -0,0 +1,122 @@
+/*
+ * checksum.h
+ *
+ * This header file defines the interface for per-block archive checksums.
+ *
+ * A record archive is split into blocks of CHECKSUM_BLOCK_RECORDS records
+ * and a CRC32C is kept for each block. The checksums live in a sidecar file
+ * next to the archive (archive name + ".crc"), so the archive itself keeps
+ * the plain record format every other tool already reads.
+ *
+ * Sidecar Layout:
+ * - "RCRC" magic, format version, block size in records, record size
+ * - Number of records in the archive
+ * - One CRC32C per block
+ * - A CRC32C of everything above, so a damaged sidecar is also detected
+ *
+ * A restartable copy keeps its sidecar on disk as it grows (a checksum
+ * stream): a header with its own magic, then the CRCs of the finished
+ * blocks, appended at each checkpoint. It is not a valid sidecar until
+ * checksum_save() replaces it with the finished table.
+ *
+ * The functions defined here are used to:
+ * - Build the checksum table while an archive is being written
+ * - Check each block as an archive is read back
+ * - Verify a whole archive in parallel without copying it
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stddef.h>   /* For size_t */
+#include <stdint.h>   /* For fixed-width integers */
+#include <stdio.h>    /* For FILE */
+
+/* Records covered by one checksum (about 100KB of 408-byte records) */
+#define CHECKSUM_BLOCK_RECORDS 256
+
+/* Checksums for one archive */
+typedef struct checksum_table {
+    uint32_t block_records;  /* Records per block */
+    uint32_t record_size;    /* Size of one record in bytes */
+    uint64_t num_records;    /* Records in the archive */
+    uint64_t num_blocks;     /* Entries in crcs */
+    uint32_t * crcs;         /* One CRC32C per block */
+} checksum_table;
+
+/* Builds a checksum table as records are written in order */
+typedef struct checksum_writer {
+    checksum_table table;    /* Table being built */
+    uint64_t capacity;       /* Allocated entries in table.crcs */
+    uint32_t crc;            /* CRC of the current, unfinished block */
+    uint32_t filled;         /* Records in the current block */
+} checksum_writer;
+
+/* A sidecar written as its table grows, for copies that can be resumed */
+typedef struct checksum_stream {
+    FILE * fp;               /* The sidecar, open for writing */
+    uint64_t blocks;         /* Block CRCs written to it */
+    uint32_t crc;            /* CRC32C of those block CRCs */
+} checksum_stream;
+
+/* Returns a newly allocated sidecar name for an archive (archive + ".crc") */
+char * checksum_path(const char * archive);
+
+/* Reads a sidecar; returns 0 on success, -1 if missing or invalid */
+int checksum_load(const char * path, checksum_table * table);
+
+/* Writes a sidecar; returns 0 on success, -1 on failure */
+int checksum_save(const char * path, const checksum_table * table);
+
+/* Releases the memory held by a table */
+void checksum_free(checksum_table * table);
+
+/* Returns true if count records starting at block matches the stored CRC */
+int checksum_block_ok(const checksum_table * table, uint64_t block,
+                      const void * records, size_t count);
+
+/* Starts an empty table for records of the given size */
+void checksum_writer_init(checksum_writer * writer, uint32_t record_size);
+
+/* Adds count records (in output order); returns 0, or -1 if out of memory */
+int checksum_writer_add(checksum_writer * writer, const void * records, size_t count);
+
+/* Closes the final partial block; returns 0, or -1 if out of memory */
+int checksum_writer_finish(checksum_writer * writer);
+
+/*
+ * Replaces the writer's table with a complete one built elsewhere (every
+ * block finished, its CRCs allocated with malloc()). The writer takes over
+ * the CRC array and table is left empty.
+ */
+void checksum_writer_adopt(checksum_writer * writer, checksum_table * table);
+
+/* Starts a checksum stream at path for writer's table; returns 0, or -1 on failure */
+int checksum_stream_open(checksum_stream * stream, const char * path, const checksum_writer * writer);
+
+/*
+ * Appends the CRCs of writer's finished blocks that the stream does not
+ * hold yet and makes the file durable; returns 0, or -1 on failure.
+ */
+int checksum_stream_sync(checksum_stream * stream, const checksum_writer * writer);
+
+/*
+ * Reopens the checksum stream at path after an interrupted copy: cuts it
+ * back to stream->blocks CRCs, checks them against stream->crc and reads
+ * them into writer's table (whose other state the caller restores).
+ * Returns 0, or -1 if the file is missing, short or does not match.
+ */
+int checksum_stream_resume(checksum_stream * stream, const char * path, checksum_writer * writer);
+
+/* Closes a checksum stream; returns 0, or -1 if the file could not be written */
+int checksum_stream_close(checksum_stream * stream);
+
+/*
+ * Checks every block of an archive against its table using the given
+ * number of threads. Mismatches are reported to the report stream.
+ * Returns the number of bad blocks, or -1 if the archive could not be read.
+ */
+long checksum_verify(const char * archive, const checksum_table * table,
+                     int threads, FILE * report);
+
+#endif
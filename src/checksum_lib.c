@@ -0,0 +1,536 @@
+/*
+ * checksum_lib.c
+ *
+ * This file implements the per-block archive checksums declared in checksum.h.
+ *
+ * Key Implementation Details:
+ * 1. Checksums: CRC32C from crc32c_lib.c (hardware accelerated when possible)
+ * 2. Sidecar Files: Small binary files written next to the archive
+ * 3. Parallel Verification: Each thread reads a contiguous range of blocks
+ *    with pread(), so threads never share a file position
+ * 4. Checksum Streams: The same header under CHECKSUM_STREAM_MAGIC, so
+ *    checksum_load() never takes a half-written table, followed by the
+ *    CRCs appended so far and no trailing CRC; the journal of the copy
+ *    keeps their count and CRC instead
+ */
+
+#define _GNU_SOURCE   /* For pread(), fdatasync() and fseeko() */
+
+#include "checksum.h"
+#include "crc32c.h"     /* For crc32c() and crc32c_update() */
+#include "parallel.h"   /* For parallel_run() */
+#include <stdio.h>      /* For file operations */
+#include <stdlib.h>     /* For memory management */
+#include <string.h>     /* For string operations */
+#include <fcntl.h>      /* For open() */
+#include <unistd.h>     /* For pread(), fdatasync(), ftruncate() and close() */
+#include <sys/stat.h>   /* For fstat() */
+#include <sys/types.h>  /* For off_t */
+
+#define CHECKSUM_MAGIC "RCRC"
+#define CHECKSUM_VERSION 1
+#define CHECKSUM_STREAM_MAGIC "RCRS"
+
+/* Blocks read by one pread() while verifying */
+#define VERIFY_BATCH_BLOCKS 64
+
+/* Fixed-size start of a sidecar file */
+typedef struct checksum_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t block_records;
+    uint32_t record_size;
+    uint64_t num_records;
+} checksum_header;
+
+/*
+ * checksum_path
+ *
+ * Purpose: Builds the sidecar name for an archive
+ *
+ * Returns:
+ *   A newly allocated string (caller frees), or NULL if out of memory
+ */
+char * checksum_path(const char * archive) {
+    char * path = malloc(strlen(archive) + strlen(".crc") + 1);
+    if (path != NULL) {
+        strcpy(path, archive);
+        strcat(path, ".crc");
+    }
+    return path;
+}
+
+/*
+ * checksum_load
+ *
+ * Purpose: Reads and validates a sidecar file
+ *
+ * Parameters:
+ *   path  - Sidecar file name
+ *   table - Filled in on success (caller frees with checksum_free)
+ *
+ * Returns:
+ *   0 on success, -1 if the file is missing, truncated or damaged
+ */
+int checksum_load(const char * path, checksum_table * table) {
+    checksum_header header;
+    uint32_t stored;
+
+    memset(table, 0, sizeof(*table));
+    FILE * fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return -1;
+    }
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, CHECKSUM_MAGIC, 4) != 0 ||
+        header.version != CHECKSUM_VERSION || header.block_records == 0) {
+        fclose(fp);
+        return -1;
+    }
+
+    table->block_records = header.block_records;
+    table->record_size = header.record_size;
+    table->num_records = header.num_records;
+    table->num_blocks = (header.num_records + header.block_records - 1) / header.block_records;
+    table->crcs = malloc(sizeof(uint32_t) * (table->num_blocks + 1));
+    if (table->crcs == NULL ||
+        fread(table->crcs, sizeof(uint32_t), table->num_blocks, fp) != table->num_blocks ||
+        fread(&stored, sizeof(stored), 1, fp) != 1) {
+        fclose(fp);
+        checksum_free(table);
+        return -1;
+    }
+    fclose(fp);
+
+    /* The sidecar protects itself with a trailing CRC */
+    uint32_t crc = crc32c(&header, sizeof(header));
+    crc = crc32c_update(crc, table->crcs, sizeof(uint32_t) * table->num_blocks);
+    if (crc != stored) {
+        checksum_free(table);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * checksum_save
+ *
+ * Purpose: Writes a sidecar file for a finished table
+ *
+ * Returns:
+ *   0 on success, -1 if the file could not be written
+ */
+int checksum_save(const char * path, const checksum_table * table) {
+    checksum_header header;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKSUM_MAGIC, 4);
+    header.version = CHECKSUM_VERSION;
+    header.block_records = table->block_records;
+    header.record_size = table->record_size;
+    header.num_records = table->num_records;
+
+    uint32_t crc = crc32c(&header, sizeof(header));
+    crc = crc32c_update(crc, table->crcs, sizeof(uint32_t) * table->num_blocks);
+
+    FILE * fp = fopen(path, "wb");
+    if (fp == NULL) {
+        return -1;
+    }
+    int ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+             fwrite(table->crcs, sizeof(uint32_t), table->num_blocks, fp) == table->num_blocks &&
+             fwrite(&crc, sizeof(crc), 1, fp) == 1;
+    if (fclose(fp) != 0) {
+        ok = 0;
+    }
+    return ok ? 0 : -1;
+}
+
+/*
+ * checksum_free
+ *
+ * Purpose: Releases the CRC array of a table
+ */
+void checksum_free(checksum_table * table) {
+    free(table->crcs);
+    table->crcs = NULL;
+    table->num_blocks = 0;
+}
+
+/*
+ * checksum_block_ok
+ *
+ * Purpose: Checks one block of records read from an archive
+ *
+ * Parameters:
+ *   table   - Checksums of the archive
+ *   block   - Index of the block
+ *   records - The block's records, exactly as stored in the archive
+ *   count   - Number of records in the block (the last block may be short)
+ *
+ * Returns:
+ *   Non-zero if the block matches its checksum
+ */
+int checksum_block_ok(const checksum_table * table, uint64_t block,
+                      const void * records, size_t count) {
+    if (block >= table->num_blocks) {
+        return 0;
+    }
+    return crc32c(records, count * table->record_size) == table->crcs[block];
+}
+
+/*
+ * checksum_writer_init
+ *
+ * Purpose: Starts building a table for an archive being written
+ */
+void checksum_writer_init(checksum_writer * writer, uint32_t record_size) {
+    memset(writer, 0, sizeof(*writer));
+    writer->table.block_records = CHECKSUM_BLOCK_RECORDS;
+    writer->table.record_size = record_size;
+}
+
+/*
+ * checksum_push
+ *
+ * Purpose: Appends a finished block CRC to the writer's table
+ */
+static int checksum_push(checksum_writer * writer, uint32_t crc) {
+    checksum_table * table = &writer->table;
+    if (table->num_blocks == writer->capacity) {
+        uint64_t capacity = writer->capacity == 0 ? 64 : writer->capacity * 2;
+        uint32_t * temp = realloc(table->crcs, sizeof(uint32_t) * capacity);
+        if (temp == NULL) {
+            return -1;
+        }
+        table->crcs = temp;
+        writer->capacity = capacity;
+    }
+    table->crcs[table->num_blocks++] = crc;
+    return 0;
+}
+
+/*
+ * checksum_writer_add
+ *
+ * Purpose: Adds records to the table in the order they are written
+ *
+ * How it works:
+ * 1. Records are folded into the running CRC of the current block
+ * 2. Whenever a block fills up its CRC is stored and a new block begins
+ *
+ * Records may be added in any batch size; block boundaries are tracked
+ * by record count, so a batch can span several blocks.
+ */
+int checksum_writer_add(checksum_writer * writer, const void * records, size_t count) {
+    const char * p = records;
+    uint32_t size = writer->table.record_size;
+
+    while (count > 0) {
+        size_t room = writer->table.block_records - writer->filled;
+        size_t take = count < room ? count : room;
+
+        writer->crc = crc32c_update(writer->crc, p, take * size);
+        writer->filled += take;
+        writer->table.num_records += take;
+        p += take * size;
+        count -= take;
+
+        if (writer->filled == writer->table.block_records) {
+            if (checksum_push(writer, writer->crc) != 0) {
+                return -1;
+            }
+            writer->crc = 0;
+            writer->filled = 0;
+        }
+    }
+    return 0;
+}
+
+/*
+ * checksum_writer_finish
+ *
+ * Purpose: Stores the CRC of the last, partially filled block
+ */
+int checksum_writer_finish(checksum_writer * writer) {
+    if (writer->filled > 0) {
+        if (checksum_push(writer, writer->crc) != 0) {
+            return -1;
+        }
+        writer->crc = 0;
+        writer->filled = 0;
+    }
+    return 0;
+}
+
+/*
+ * checksum_writer_adopt
+ *
+ * Purpose: Takes over a finished table, e.g. one filled in by workers
+ * that each computed the CRCs of their own blocks
+ */
+void checksum_writer_adopt(checksum_writer * writer, checksum_table * table) {
+    free(writer->table.crcs);
+    writer->table = *table;
+    writer->capacity = table->num_blocks;
+    writer->crc = 0;
+    writer->filled = 0;
+    memset(table, 0, sizeof(*table));
+}
+
+/* Header of a checksum stream for writer's table */
+static void checksum_stream_header(const checksum_writer * writer, checksum_header * header) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, CHECKSUM_STREAM_MAGIC, 4);
+    header->version = CHECKSUM_VERSION;
+    header->block_records = writer->table.block_records;
+    header->record_size = writer->table.record_size;
+}
+
+/*
+ * checksum_stream_open
+ *
+ * Purpose: Starts a sidecar that grows with its table
+ *
+ * Returns:
+ *   0 on success, -1 if the file could not be created
+ */
+int checksum_stream_open(checksum_stream * stream, const char * path, const checksum_writer * writer) {
+    checksum_header header;
+
+    checksum_stream_header(writer, &header);
+    stream->blocks = 0;
+    stream->crc = 0;
+    stream->fp = fopen(path, "wb");
+    if (stream->fp == NULL || fwrite(&header, sizeof(header), 1, stream->fp) != 1) {
+        if (stream->fp != NULL) {
+            fclose(stream->fp);
+            stream->fp = NULL;
+        }
+        return -1;
+    }
+    return checksum_stream_sync(stream, writer);
+}
+
+/*
+ * checksum_stream_sync
+ *
+ * Purpose: Brings a checksum stream up to date with its table
+ *
+ * How it works:
+ *   Writes the CRCs from stream->blocks to the table's end, folds them into
+ *   stream->crc, then flushes and fdatasync()s the file
+ */
+int checksum_stream_sync(checksum_stream * stream, const checksum_writer * writer) {
+    const checksum_table * table = &writer->table;
+    uint64_t count = table->num_blocks - stream->blocks;
+
+    if (count > 0 && fwrite(table->crcs + stream->blocks, sizeof(uint32_t), count, stream->fp) != count) {
+        return -1;
+    }
+    stream->crc = crc32c_update(stream->crc, table->crcs + stream->blocks, sizeof(uint32_t) * count);
+    stream->blocks = table->num_blocks;
+    if (fflush(stream->fp) != 0 || fdatasync(fileno(stream->fp)) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * checksum_stream_resume
+ *
+ * Purpose: Picks a checksum stream up where a checkpoint left it
+ *
+ * Parameters:
+ *   stream - Holds the CRC count and CRC the checkpoint recorded
+ *   path   - Sidecar file name
+ *   writer - Its table receives the CRCs
+ *
+ * Returns:
+ *   0 on success, -1 on failure
+ *
+ * How it works:
+ * 1. Checks the header and reads the recorded number of CRCs, which must
+ *    match the recorded CRC (anything after them was written after the
+ *    checkpoint)
+ * 2. Cuts the file after them and leaves it positioned for appending
+ */
+int checksum_stream_resume(checksum_stream * stream, const char * path, checksum_writer * writer) {
+    checksum_header expected;
+    checksum_header header;
+
+    checksum_stream_header(writer, &expected);
+    FILE * fp = fopen(path, "r+b");
+    if (fp == NULL) {
+        return -1;
+    }
+    uint32_t * crcs = malloc(sizeof(uint32_t) * (stream->blocks + 1));
+    int ok = crcs != NULL &&
+             fread(&header, sizeof(header), 1, fp) == 1 && memcmp(&header, &expected, sizeof(header)) == 0 &&
+             fread(crcs, sizeof(uint32_t), stream->blocks, fp) == stream->blocks &&
+             crc32c_update(0, crcs, sizeof(uint32_t) * stream->blocks) == stream->crc;
+    off_t end = (off_t) (sizeof(header) + sizeof(uint32_t) * stream->blocks);
+    if (!ok || fflush(fp) != 0 || ftruncate(fileno(fp), end) != 0 || fseeko(fp, end, SEEK_SET) != 0) {
+        free(crcs);
+        fclose(fp);
+        return -1;
+    }
+
+    free(writer->table.crcs);
+    writer->table.crcs = crcs;
+    writer->table.num_blocks = stream->blocks;
+    writer->capacity = stream->blocks + 1;
+    stream->fp = fp;
+    return 0;
+}
+
+/*
+ * checksum_stream_close
+ *
+ * Purpose: Closes a checksum stream
+ */
+int checksum_stream_close(checksum_stream * stream) {
+    int status = stream->fp != NULL && fclose(stream->fp) != 0 ? -1 : 0;
+    stream->fp = NULL;
+    return status;
+}
+
+/* Work given to one verification thread */
+typedef struct verify_task {
+    int fd;                          /* Archive, opened read-only */
+    const checksum_table * table;    /* Expected checksums */
+    uint64_t first_block;            /* First block to check */
+    uint64_t end_block;              /* One past the last block to check */
+    FILE * report;                   /* Where mismatches are reported */
+    long bad;                        /* Result: bad blocks found */
+    int failed;                      /* Result: non-zero on read error */
+    char pad[PARALLEL_CACHE_LINE];   /* Keeps neighbouring tasks' results apart */
+} verify_task;
+
+/*
+ * verify_worker
+ *
+ * Purpose: Checks one contiguous range of blocks
+ *
+ * How it works:
+ * 1. Reads VERIFY_BATCH_BLOCKS blocks at a time with pread()
+ * 2. Computes the CRC of each block and compares it with the table
+ */
+static void * verify_worker(void * arg) {
+    verify_task * task = arg;
+    const checksum_table * table = task->table;
+    size_t block_bytes = (size_t) table->block_records * table->record_size;
+    char * buffer = malloc(block_bytes * VERIFY_BATCH_BLOCKS);
+
+    if (buffer == NULL) {
+        task->failed = 1;
+        return NULL;
+    }
+
+    for (uint64_t b = task->first_block; b < task->end_block; b += VERIFY_BATCH_BLOCKS) {
+        uint64_t blocks = task->end_block - b;
+        if (blocks > VERIFY_BATCH_BLOCKS) {
+            blocks = VERIFY_BATCH_BLOCKS;
+        }
+        uint64_t first_record = b * table->block_records;
+        uint64_t records = blocks * table->block_records;
+        if (first_record + records > table->num_records) {
+            records = table->num_records - first_record;
+        }
+
+        size_t want = records * table->record_size;
+        size_t got = 0;
+        while (got < want) {
+            ssize_t n = pread(task->fd, buffer + got, want - got,
+                              (off_t) (first_record * table->record_size + got));
+            if (n <= 0) {
+                task->failed = 1;
+                free(buffer);
+                return NULL;
+            }
+            got += n;
+        }
+
+        for (uint64_t i = 0; i < blocks; i++) {
+            uint64_t count = records - i * table->block_records;
+            if (count > table->block_records) {
+                count = table->block_records;
+            }
+            if (!checksum_block_ok(table, b + i, buffer + i * block_bytes, count)) {
+                fprintf(task->report, "Checksum mismatch in block %llu (records %llu-%llu)\n",
+                        (unsigned long long) (b + i),
+                        (unsigned long long) ((b + i) * table->block_records),
+                        (unsigned long long) ((b + i) * table->block_records + count - 1));
+                task->bad++;
+            }
+        }
+    }
+
+    free(buffer);
+    return NULL;
+}
+
+/*
+ * checksum_verify
+ *
+ * Purpose: Verifies a whole archive against its checksum table
+ *
+ * Parameters:
+ *   archive - Archive file name
+ *   table   - Checksums loaded from the archive's sidecar
+ *   threads - Number of threads to use
+ *   report  - Stream that mismatches are written to
+ *
+ * Returns:
+ *   Number of bad blocks (0 means the archive is intact), or -1 if the
+ *   archive could not be read or its size does not match the table
+ */
+long checksum_verify(const char * archive, const checksum_table * table,
+                     int threads, FILE * report) {
+    struct stat st;
+    int fd = open(archive, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 ||
+        (uint64_t) st.st_size != table->num_records * table->record_size) {
+        fprintf(report, "Archive size does not match its checksums\n");
+        close(fd);
+        return -1;
+    }
+
+    if (threads < 1) {
+        threads = 1;
+    }
+    if ((uint64_t) threads > table->num_blocks) {
+        threads = table->num_blocks > 0 ? (int) table->num_blocks : 1;
+    }
+
+    verify_task * tasks = calloc(threads, sizeof(verify_task));
+    if (tasks == NULL) {
+        close(fd);
+        return -1;
+    }
+    for (int i = 0; i < threads; i++) {
+        tasks[i].fd = fd;
+        tasks[i].table = table;
+        tasks[i].first_block = table->num_blocks * i / threads;
+        tasks[i].end_block = table->num_blocks * (i + 1) / threads;
+        tasks[i].report = report;
+    }
+
+    parallel_run(threads, verify_worker, tasks, sizeof(verify_task));
+
+    long bad = 0;
+    for (int i = 0; i < threads; i++) {
+        if (tasks[i].failed) {
+            bad = -1;
+            break;
+        }
+        bad += tasks[i].bad;
+    }
+
+    free(tasks);
+    close(fd);
+    return bad;
+}
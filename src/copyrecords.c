@@ -1,18 +1,71 @@
+#define _POSIX_C_SOURCE 200809L  // For fseeko()
+
 #include <stdio.h>
 #include "copyrecords.h"
 #include "decode_lib.h"
 #include "frequency_table.h"
+#include "checksum.h"
+#include "parallel.h"
+#include "arena.h"
+#include "recsort.h"
+#include "recstats.h"
+#include "rectext.h"
+#include "recpack.h"
+#include "shiftcache.h"
+#include "recshard.h"
+#include "recrekey.h"
+#include "schema.h"
+#include "iopolicy.h"
+#include "recjournal.h"
+#include "recpart.h"
+#include "crc32c.h"
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
 #include <stdbool.h>
 
 
+// Where copied records go: the output file, and its checksums when -C is given,
+// or a packed archive with --pack
+
+typedef struct output_sink {
+   FILE * fp;
+   checksum_writer * sums;
+   pack_writer * pack;
+} output_sink;
+
+static int write_records(void * arg, const record * records, size_t count) {
+   output_sink * out = arg;
+   if (out->pack != NULL) {
+       return pack_writer_add(out->pack, records, count);
+   }
+   if (fwrite(records, sizeof(record), count, out->fp) != count) {
+       return -1;
+   }
+   if (out->sums != NULL && checksum_writer_add(out->sums, records, count) != 0) {
+       return -1;
+   }
+   return 0;
+}
+
+
+// records per --io window: 32 checksum blocks, and a whole number of
+// IO_ALIGN pages, so direct reads and writes of a window stay aligned
+
+#define IO_COPY_RECORDS (32 * CHECKSUM_BLOCK_RECORDS)
+
+
 // Variable declarations
 
 
 int main(int argc, char ** argv) {
    int r_present = false;
+   int c_present = false;
+   int verify_present = false;
+   int stats_present = false;
+   int pack_present = false;
+   int in_place_present = false;
+   int threads = parallel_threads();
    // int shift = 0;
    FILE * input_file = NULL;
    FILE * output_file = NULL;
@@ -20,13 +73,35 @@ int main(int argc, char ** argv) {
    char * o_flag = NULL;
    char * f_flag = NULL;
    char * d_flag = NULL;
+   char * sort_flag = NULL;
+   char * tmp_dir = NULL;
+   char * group_flag = NULL;
+   char * export_flag = NULL;
+   char * import_flag = NULL;
+   char * key_flag = NULL;
+   int shard_count = 0;
+   char * rekey_flag = NULL;
+   int rekey_from = 0;
+   int rekey_to = 0;
+   char * schema_flag = NULL;
+   char * where_flag = NULL;
+   const record_schema * schema = NULL;
+   schema_filter filter;
+   char * io_flag = NULL;
+   io_policy policy = IO_BUFFERED;
+   int io_depth = IO_DEFAULT_DEPTH;
+   int io_stats_present = false;
+   long checkpoint_records = 0;
+   int resume_present = false;
+   char * journal_file = NULL;
+   int partitioned_present = false;
+   size_t partition_records = PART_DEFAULT_RECORDS;
+   size_t sort_memory = SORT_DEFAULT_MEMORY;
    int decode_shift = 0;
-   int total = 0;
-   int num_of_records = 0;
-   char * buffer = malloc(sizeof(char) * 100);
-   strcpy(buffer, "");
-   char * file_contents = malloc(sizeof(char) * 100);
-   strcpy(file_contents, "");
+   int64_t total = 0;
+   int64_t num_of_records = 0;
+   arena mem;
+   arena_init(&mem, 0);
 
 
    //Checking command line flags that user can use in the program
@@ -38,26 +113,304 @@ int main(int argc, char ** argv) {
 
 
    for (int i = 1; i < argc; i++) {
-       if (strcmp(argv[i], "-O") == 0) {
+       if (strcmp(argv[i], "-O") == 0 && i + 1 < argc) {
            i++;
-           o_flag = malloc(sizeof(char) * strlen(argv[i]) + 1);
-           strcpy(o_flag, argv[i]);
+           o_flag = argv[i];
        }
-       else if (strcmp(argv[i], "-F") == 0) {
+       else if (strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
            i++;
-           f_flag = malloc(sizeof(char) * (strlen(argv[i])+ 1));
-           strcpy(f_flag, argv[i]);
+           f_flag = argv[i];
        }
-       else if (strcmp(argv[i], "-D") == 0) {
+       else if (strcmp(argv[i], "-D") == 0 && i + 1 < argc) {
            i++;
-           d_flag = malloc(sizeof(char) * (strlen(argv[i])+ 1));
-           strcpy(d_flag, argv[i]);
+           d_flag = argv[i];
        }
        else if (strcmp(argv[i], "-r") == 0) {
            r_present = true;
        }
+       else if (strcmp(argv[i], "-C") == 0) {
+           c_present = true;
+       }
+       else if (strcmp(argv[i], "--verify") == 0) {
+           verify_present = true;
+       }
+       else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+           i++;
+           threads = atoi(argv[i]);
+       }
+       else if (strcmp(argv[i], "--sort-by") == 0 && i + 1 < argc) {
+           i++;
+           sort_flag = argv[i];
+       }
+       else if (strcmp(argv[i], "--sort-mem") == 0 && i + 1 < argc) {
+           i++;
+           sort_memory = (size_t) atol(argv[i]) * 1024 * 1024;
+       }
+       else if (strcmp(argv[i], "--tmp-dir") == 0 && i + 1 < argc) {
+           i++;
+           tmp_dir = argv[i];
+       }
+       else if (strcmp(argv[i], "--stats") == 0) {
+           stats_present = true;
+       }
+       else if (strcmp(argv[i], "--group-by") == 0 && i + 1 < argc) {
+           i++;
+           group_flag = argv[i];
+       }
+       else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+           i++;
+           export_flag = argv[i];
+       }
+       else if (strcmp(argv[i], "--import") == 0 && i + 1 < argc) {
+           i++;
+           import_flag = argv[i];
+       }
+       else if (strcmp(argv[i], "--pack") == 0) {
+           pack_present = true;
+       }
+       else if (strcmp(argv[i], "--shard") == 0 && i + 1 < argc) {
+           i++;
+           shard_count = atoi(argv[i]);
+           if (shard_count < 1 || shard_count > SHARD_MAX) {
+               fprintf(stderr, "--shard needs 1 to %d shards.\n", SHARD_MAX);
+               return 1;
+           }
+       }
+       else if (strcmp(argv[i], "--key") == 0 && i + 1 < argc) {
+           i++;
+           key_flag = argv[i];
+       }
+       else if (strcmp(argv[i], "--rekey") == 0 && i + 1 < argc) {
+           i++;
+           rekey_flag = argv[i];
+           if (rekey_parse(rekey_flag, &rekey_from, &rekey_to) != 0) {
+               fprintf(stderr, "Cannot re-key %s (use from:to, two shifts 0-25).\n", rekey_flag);
+               return 1;
+           }
+       }
+       else if (strcmp(argv[i], "--in-place") == 0) {
+           in_place_present = true;
+       }
+       else if (strcmp(argv[i], "--schema") == 0 && i + 1 < argc) {
+           i++;
+           schema_flag = argv[i];
+       }
+       else if (strcmp(argv[i], "--where") == 0 && i + 1 < argc) {
+           i++;
+           where_flag = argv[i];
+       }
+       else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+           i++;
+           io_flag = argv[i];
+           if (io_policy_parse(io_flag, &policy) != 0) {
+               fprintf(stderr, "Unknown I/O policy %s (use buffered, stream or direct).\n", io_flag);
+               return 1;
+           }
+       }
+       else if (strcmp(argv[i], "--io-depth") == 0 && i + 1 < argc) {
+           i++;
+           io_depth = atoi(argv[i]);
+           if (io_depth < 1 || io_depth > IO_MAX_DEPTH) {
+               fprintf(stderr, "--io-depth needs 1 to %d requests.\n", IO_MAX_DEPTH);
+               return 1;
+           }
+       }
+       else if (strcmp(argv[i], "--io-stats") == 0) {
+           io_stats_present = true;
+       }
+       else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+           i++;
+           checkpoint_records = atol(argv[i]);
+           if (checkpoint_records < 1) {
+               fprintf(stderr, "--checkpoint needs a positive number of records.\n");
+               return 1;
+           }
+       }
+       else if (strcmp(argv[i], "--resume") == 0) {
+           resume_present = true;
+       }
+       else if (strcmp(argv[i], "--partitioned") == 0) {
+           partitioned_present = true;
+       }
+       else if (strcmp(argv[i], "--partition-mb") == 0 && i + 1 < argc) {
+           i++;
+           long megabytes = atol(argv[i]);
+           if (megabytes < 1) {
+               fprintf(stderr, "--partition-mb needs a positive size.\n");
+               return 1;
+           }
+           partition_records = part_records_for(megabytes);
+           partitioned_present = true;
+       }
+   }
+
+   // --io (and --io-stats, which implies --io buffered) only applies to a plain copy
+
+   if (io_stats_present && io_flag == NULL) {
+       io_flag = "buffered";
+   }
+   if (io_flag != NULL && (verify_present || stats_present || in_place_present || pack_present || shard_count > 0 ||
+                           sort_flag != NULL || export_flag != NULL || import_flag != NULL || schema_flag != NULL || where_flag != NULL)) {
+       fprintf(stderr, "--io only works for a plain copy (with -r, -C, -D and --rekey).\n");
+       return 1;
+   }
+
+   // --checkpoint and --resume make a plain copy restartable (see recjournal.h)
+
+   if ((checkpoint_records > 0 || resume_present) &&
+       (io_flag != NULL || verify_present || stats_present || in_place_present || pack_present || shard_count > 0 ||
+        sort_flag != NULL || export_flag != NULL || import_flag != NULL || schema_flag != NULL || where_flag != NULL)) {
+       fprintf(stderr, "--checkpoint and --resume only work for a plain copy (with -r, -C, -D and --rekey).\n");
+       return 1;
+   }
+
+   // --partitioned copies large partitions on -j threads with pread() and
+   // pwrite() (see recpart.h)
+
+   if (partitioned_present &&
+       (io_flag != NULL || checkpoint_records > 0 || resume_present || verify_present || stats_present || in_place_present ||
+        pack_present || shard_count > 0 || sort_flag != NULL || export_flag != NULL || import_flag != NULL ||
+        schema_flag != NULL || where_flag != NULL)) {
+       fprintf(stderr, "--partitioned only works for a plain copy (with -r, -C, -D and --rekey).\n");
+       return 1;
+   }
+
+   // --schema names the layout of the records (default: struct record) and
+   // --where filters them; both are checked before any file is opened
+
+   if (schema_flag != NULL || where_flag != NULL) {
+       schema = schema_find(schema_flag != NULL ? schema_flag : "default");
+       if (schema == NULL) {
+           fprintf(stderr, "Unknown schema %s; the schemas are:\n", schema_flag);
+           schema_list(stderr);
+           return 1;
+       }
+       if (where_flag != NULL && schema_filter_parse(schema, where_flag, &filter) != 0) {
+           return 1;
+       }
+       if (verify_present || stats_present || in_place_present || pack_present || shard_count > 0 ||
+           sort_flag != NULL || export_flag != NULL || import_flag != NULL) {
+           fprintf(stderr, "--schema and --where only work with -r, -C, -D and --rekey.\n");
+           return 1;
+       }
+   }
+
+   // --verify checks an archive against its checksums without copying it
+
+   if (verify_present) {
+       checksum_table sums;
+       if (f_flag == NULL) {
+           fprintf(stderr, "Input file has not been given.\n");
+           return 1;
+       }
+       if (pack_is_packed(f_flag)) {
+           // packed archives carry a CRC for every block
+           pack_reader reader;
+           if (pack_open(&reader, f_flag) != 0) {
+               fprintf(stderr, "%s is not a valid packed archive\n", f_flag);
+               return 1;
+           }
+           long bad = pack_verify(&reader, threads, stderr);
+           if (bad < 0) {
+               fprintf(stderr, "Could not verify %s\n", f_flag);
+               return 1;
+           }
+           printf("%llu records in %llu packed blocks, %ld bad\n",
+                  (unsigned long long) reader.num_records, (unsigned long long) reader.num_blocks, bad);
+           pack_close(&reader);
+           return bad == 0 ? 0 : 1;
+       }
+       char * sum_path = checksum_path(f_flag);
+       if (sum_path == NULL || checksum_load(sum_path, &sums) != 0) {
+           fprintf(stderr, "No valid checksums found for %s\n", f_flag);
+           return 1;
+       }
+       long bad = checksum_verify(f_flag, &sums, threads, stderr);
+       if (bad < 0) {
+           fprintf(stderr, "Could not verify %s\n", f_flag);
+           return 1;
+       }
+       printf("%llu records in %llu blocks, %ld bad\n",
+              (unsigned long long) sums.num_records, (unsigned long long) sums.num_blocks, bad);
+       checksum_free(&sums);
+       free(sum_path);
+       return bad == 0 ? 0 : 1;
+   }
+
+   // --stats prints a summary of the numeric fields without copying the archive
+
+   if (stats_present) {
+       stats_options options;
+       stats_result result;
+       checksum_table sums;
+       if (f_flag == NULL) {
+           fprintf(stderr, "Input file has not been given.\n");
+           return 1;
+       }
+       if (pack_is_packed(f_flag)) {
+           fprintf(stderr, "%s is packed; copy it to a plain archive first.\n", f_flag);
+           return 1;
+       }
+       options.group_by = -1;
+       if (group_flag != NULL) {
+           sort_key key;
+           if (sort_key_parse(group_flag, &key) != 0 || key.field != SORT_NUMS) {
+               fprintf(stderr, "Cannot group by %s (use nums[0-11]).\n", group_flag);
+               return 1;
+           }
+           options.group_by = key.index;
+       }
+       input_file = fopen(f_flag, "rb");
+       if (input_file == NULL) {
+           fprintf(stderr, "Could not open input file %s\n", f_flag);
+           return 1;
+       }
+       num_of_records = file_size(input_file) / sizeof(record);
+       fclose(input_file);
+
+       char * sum_path = checksum_path(f_flag);
+       int have_sums = sum_path != NULL && checksum_load(sum_path, &sums) == 0;
+       free(sum_path);
+       if (have_sums && (sums.record_size != sizeof(record) || sums.num_records != (uint64_t) num_of_records)) {
+           fprintf(stderr, "Checksums for %s do not match the archive.\n", f_flag);
+           return 1;
+       }
+       options.threads = threads;
+       options.verify = have_sums ? &sums : NULL;
+       if (stats_compute(f_flag, num_of_records, &options, &result) != 0) {
+           fprintf(stderr, "Could not compute statistics for %s\n", f_flag);
+           return 1;
+       }
+       stats_print(stdout, &result, &options);
+       stats_free(&result);
+       if (have_sums) {
+           checksum_free(&sums);
+       }
+       return 0;
+   }
+
+   // --rekey from:to --in-place re-encodes the strings of -F where they lie;
+   // without --in-place, --rekey is a copy that decodes and re-encodes
+
+   if (in_place_present) {
+       if (rekey_flag == NULL || f_flag == NULL || o_flag != NULL || d_flag != NULL) {
+           fprintf(stderr, "--in-place needs --rekey and -F, and no -O or -D.\n");
+           return 1;
+       }
+       if (pack_is_packed(f_flag)) {
+           fprintf(stderr, "%s is packed; copy it to a plain archive first.\n", f_flag);
+           return 1;
+       }
+       decode_ctx * rekey_ctx = decode_ctx_new();
+       if (rekey_ctx == NULL) {
+           fprintf(stderr, "Out of memory.\n");
+           return 1;
+       }
+       int failed = rekey_archive(f_flag, rekey_ctx, rekey_shift(rekey_from, rekey_to), threads);
+       decode_ctx_free(rekey_ctx);
+       return failed != 0 ? 1 : 0;
    }
- 
+
   // conditions for -F flag
 
 
@@ -67,11 +420,15 @@ int main(int argc, char ** argv) {
    }
   
    else {
-       input_file = fopen(f_flag, "r");
+        input_file = fopen(f_flag, "rb");
+        if (input_file == NULL) {
+            fprintf(stderr, "Could not open input file %s\n", f_flag);
+            return 1;
+        }
    }
 
 
-   // conditions for -O flag
+   // conditions for -O flag (with --shard it only names the shards)
 
 
    if (o_flag == NULL) {
@@ -80,42 +437,578 @@ int main(int argc, char ** argv) {
    }
 
 
-   else {
-       output_file = fopen(o_flag, "wb");
+   else if (shard_count == 0 && io_flag == NULL && !partitioned_present) {
+       // a fresh checkpointed copy starts a new journal; --resume keeps the
+       // output and the journal of the interrupted run
+       if (checkpoint_records > 0 || resume_present) {
+           journal_file = journal_path(o_flag);
+           if (journal_file == NULL) {
+               fprintf(stderr, "Out of memory.\n");
+               return 1;
+           }
+           if (!resume_present) {
+               remove(journal_file);
+           }
+       }
+       output_file = fopen(o_flag, resume_present ? "r+b" : "wb");
+       if (output_file == NULL) {
+           fprintf(stderr, "Could not open output file %s\n", o_flag);
+           return 1;
+       }
    }
 
 
+   decode_ctx * ctx = decode_ctx_new();
+   if (ctx == NULL) {
+       fprintf(stderr, "Out of memory.\n");
+       return 1;
+   }
+
    //conditions for -D flag
 
 
    if (d_flag != NULL) {
        cipher_file = fopen(d_flag, "r");
-       while (fgets(buffer, 100, cipher_file) != NULL) {
-           file_contents = realloc(file_contents, sizeof(char) * (strlen(file_contents) + strlen(buffer) + 3));
-           strcat(file_contents, buffer);
+       if (cipher_file == NULL) {
+           fprintf(stderr, "Could not open cipher file %s\n", d_flag);
+           return 1;
+       }
+       // a cipher file analysed before is not read again
+       shift_analysis analysis;
+       uint64_t file_key;
+       int have_file_key = shift_cache_file_key(fileno(cipher_file), shift_cache_seed(&ctx, 1), &file_key) == 0;
+       if (!have_file_key || shift_cache_lookup(file_key, &analysis) != 0) {
+           size_t length = 0;
+           char * file_contents = arena_read_file(&mem, cipher_file, &length);
+           if (file_contents == NULL) {
+               fprintf(stderr, "Could not read cipher file %s\n", d_flag);
+               fclose(cipher_file);
+               return 1;
+           }
+           shift_analyse_cached(&ctx, 1, file_contents, length,
+                                have_file_key ? &file_key : NULL, &analysis);
        }
-       decode_shift = to_decode(encode_shift(file_contents));
        fclose(cipher_file);
+       decode_shift = to_decode(analysis.shift);
    }
 
+   if (rekey_flag != NULL) {
+       if (d_flag != NULL) {
+           fprintf(stderr, "--rekey cannot be used with -D.\n");
+           return 1;
+       }
+       decode_shift = rekey_shift(rekey_from, rekey_to);
+   }
 
-   num_of_records = file_size(input_file) / sizeof(record);
-   fseek(input_file, 0L, SEEK_SET);
+   // with --schema or --where the records are copied by the schema's
+   // generated code, a checksum block at a time
 
+   if (schema != NULL) {
+       if (pack_is_packed(f_flag)) {
+           fprintf(stderr, "%s is packed; copy it to a plain archive first.\n", f_flag);
+           return 1;
+       }
+       int64_t schema_records = file_size(input_file) / (int64_t) schema->record_size;
+       checksum_table schema_sums;
+       checksum_writer schema_out;
+       char * sum_path = checksum_path(f_flag);
+       int have_sums = sum_path != NULL && checksum_load(sum_path, &schema_sums) == 0;
+       free(sum_path);
+       if (have_sums && (schema_sums.record_size != schema->record_size ||
+                         schema_sums.num_records != (uint64_t) schema_records)) {
+           fprintf(stderr, "Checksums for %s do not match the archive (is it a %s archive?).\n", f_flag, schema->name);
+           return 1;
+       }
+       checksum_writer_init(&schema_out, (uint32_t) schema->record_size);
 
-   // conditions for -R flag
-  
-   while (total < num_of_records) {
-       if (r_present) {
-           fseek(input_file, -sizeof(record) * (total + 1), SEEK_END);
+       schema_copy_options options;
+       options.ctx = ctx;
+       options.shift = decode_shift;
+       options.reverse = r_present;
+       options.filter = where_flag != NULL ? &filter : NULL;
+       options.verify = have_sums ? &schema_sums : NULL;
+       options.sums = c_present ? &schema_out : NULL;
+       if (schema_copy(input_file, output_file, schema_records, schema, &options) != 0) {
+           fprintf(stderr, "Could not copy %s to %s\n", f_flag, o_flag);
+           return 1;
+       }
+       fclose(input_file);
+       if (fclose(output_file) != 0) {
+           fprintf(stderr, "Could not write output file %s\n", o_flag);
+           return 1;
        }
-       record * temp = malloc(sizeof(record));
-       fread(temp, sizeof(record), 1, input_file);
-       encode_string(temp -> str1, decode_shift);
-       encode_string(temp -> str2, decode_shift);
-       fwrite(temp, sizeof(record), 1, output_file);
-       total++;
+
+       char * out_sum_path = checksum_path(o_flag);
+       if (!c_present && out_sum_path != NULL) {
+           remove(out_sum_path);
+       }
+       if (c_present && (checksum_writer_finish(&schema_out) != 0 || out_sum_path == NULL ||
+                         checksum_save(out_sum_path, &schema_out.table) != 0)) {
+           fprintf(stderr, "Could not write checksums for %s\n", o_flag);
+           return 1;
+       }
+       free(out_sum_path);
+       checksum_free(&schema_out.table);
+       if (have_sums) {
+           checksum_free(&schema_sums);
+       }
+       decode_ctx_free(ctx);
+       arena_free(&mem);
+       return 0;
+   }
+
+
+   // a packed input is read through its block index; only a plain copy
+   // (forward or -r, with -D) can read one
+
+   pack_reader reader;
+   int packed_input = import_flag == NULL && pack_is_packed(f_flag);
+   if (packed_input) {
+       if (export_flag != NULL || sort_flag != NULL || io_flag != NULL || journal_file != NULL || partitioned_present) {
+           fprintf(stderr, "%s is packed; copy it to a plain archive first.\n", f_flag);
+           return 1;
+       }
+       if (pack_open(&reader, f_flag) != 0) {
+           fprintf(stderr, "%s is not a valid packed archive\n", f_flag);
+           return 1;
+       }
+       num_of_records = reader.num_records;
+   }
+   else {
+       num_of_records = file_size(input_file) / sizeof(record);
+       fseeko(input_file, 0, SEEK_SET);
    }
-}
 
+   // checksums of the input are verified on read if it has a sidecar
 
+   checksum_table in_sums;
+   checksum_writer out_sums;
+   char * in_sum_path = checksum_path(f_flag);
+   int verify_input = !packed_input && in_sum_path != NULL && checksum_load(in_sum_path, &in_sums) == 0;
+   if (verify_input && (in_sums.record_size != sizeof(record) || in_sums.num_records != (uint64_t) num_of_records)) {
+       fprintf(stderr, "Checksums for %s do not match the archive.\n", f_flag);
+       return 1;
+   }
+   checksum_writer_init(&out_sums, sizeof(record));
+
+   // --shard splits the input into -O.0 ... -O.(N-1) by a hash of --key
+   // (str1, nums[k] or the record index), decoding with -D as it goes
+
+   if (shard_count > 0) {
+       shard_options options;
+       if (packed_input || r_present || c_present || pack_present ||
+           sort_flag != NULL || export_flag != NULL || import_flag != NULL) {
+           fprintf(stderr, "--shard only works on a plain archive, without -r, -C, --pack, --sort-by, --export or --import.\n");
+           return 1;
+       }
+       if (shard_key_parse(key_flag != NULL ? key_flag : "index", &options.key) != 0) {
+           fprintf(stderr, "Cannot shard by %s (use str1, nums[0-11] or index).\n", key_flag);
+           return 1;
+       }
+       options.shards = shard_count;
+       options.threads = threads;
+       options.ctx = ctx;
+       options.shift = decode_shift;
+       options.verify = verify_input ? &in_sums : NULL;
+       if (shard_records(fileno(input_file), num_of_records, &options, o_flag) != 0) {
+           return 1;
+       }
+       fclose(input_file);
+       if (verify_input) {
+           checksum_free(&in_sums);
+       }
+       free(in_sum_path);
+       decode_ctx_free(ctx);
+       arena_free(&mem);
+       return 0;
+   }
+
+   output_sink sink;
+   pack_writer packer;
+   sink.fp = output_file;
+   sink.sums = c_present ? &out_sums : NULL;
+   sink.pack = NULL;
+
+   // --pack writes a packed archive, which has its own per-block CRCs
+
+   if (pack_present) {
+       if (c_present || export_flag != NULL) {
+           fprintf(stderr, "--pack cannot be used with -C or --export.\n");
+           return 1;
+       }
+       if (pack_writer_init(&packer, output_file, threads) != 0) {
+           fprintf(stderr, "Could not write output file %s\n", o_flag);
+           return 1;
+       }
+       sink.pack = &packer;
+   }
+
+   // --import reads CSV/NDJSON text from -F and writes it to -O as records;
+   // --export writes the records of -F to -O as text (decoded with -D)
+
+   if (import_flag != NULL) {
+       import_options options;
+       int64_t imported = 0;
+       if (text_format_parse(import_flag, &options.format) != 0) {
+           fprintf(stderr, "Cannot import %s (use csv or json).\n", import_flag);
+           return 1;
+       }
+       options.threads = threads;
+       if (import_records(input_file, &options, write_records, &sink, &imported) != 0) {
+           return 1;
+       }
+   }
+   else if (export_flag != NULL) {
+       export_options options;
+       if (text_format_parse(export_flag, &options.format) != 0) {
+           fprintf(stderr, "Cannot export %s (use csv or json).\n", export_flag);
+           return 1;
+       }
+       if (c_present) {
+           fprintf(stderr, "-C cannot be used with --export.\n");
+           return 1;
+       }
+       options.threads = threads;
+       options.ctx = ctx;
+       options.shift = decode_shift;
+       options.verify = verify_input ? &in_sums : NULL;
+       if (export_records(input_file, num_of_records, &options, output_file) != 0) {
+           return 1;
+       }
+   }
+
+   // --sort-by writes the records ordered by a field instead of copying them
+   // in file order; -r then gives descending order
+
+   else if (sort_flag != NULL) {
+       sort_options options;
+       char * out_dir = NULL;
+       if (sort_key_parse(sort_flag, &options.key) != 0) {
+           fprintf(stderr, "Cannot sort by %s (use str1, nums[0-11] or dbl[0-23]).\n", sort_flag);
+           return 1;
+       }
+       if (tmp_dir == NULL) {
+           // spill runs next to the output, where there is room for the archive anyway
+           out_dir = arena_alloc(&mem, strlen(o_flag) + 2);
+           strcpy(out_dir, o_flag);
+           char * slash = strrchr(out_dir, '/');
+           if (slash != NULL) {
+               *slash = '\0';
+           } else {
+               strcpy(out_dir, ".");
+           }
+           tmp_dir = out_dir;
+       }
+       options.descending = r_present;
+       options.memory = sort_memory;
+       options.threads = threads;
+       options.tmp_dir = tmp_dir;
+       options.ctx = ctx;
+       options.shift = decode_shift;
+       options.verify = verify_input ? &in_sums : NULL;
+       if (sort_records(input_file, num_of_records, &options, write_records, &sink) != 0) {
+           return 1;
+       }
+   }
+   else if (packed_input) {
+      // a packed input is decoded one round of blocks at a time, a block per
+      // thread; for -r the rounds run from the end and each one is reversed
+
+      uint64_t round = threads > 0 ? (uint64_t) threads : 1;
+      uint64_t done = 0;
+      record * batch = arena_alloc(&mem, sizeof(record) * PACK_BLOCK_RECORDS * round);
+      if (batch == NULL) {
+          fprintf(stderr, "Out of memory.\n");
+          return 1;
+      }
+
+      while (done < reader.num_blocks) {
+          uint64_t count = reader.num_blocks - done < round ? reader.num_blocks - done : round;
+          uint64_t first = r_present ? reader.num_blocks - done - count : done;
+          int64_t n = pack_read_blocks(&reader, first, count, batch, threads);
+          if (n < 0) {
+              fprintf(stderr, "Could not read records from %s\n", f_flag);
+              return 1;
+          }
+
+          decode_records(ctx, batch, (size_t) n, decode_shift);
+          if (r_present) {
+              for (int64_t j = 0; j < n / 2; j++) {
+                  record swap = batch[j];
+                  batch[j] = batch[n - 1 - j];
+                  batch[n - 1 - j] = swap;
+              }
+          }
+
+          if (write_records(&sink, batch, (size_t) n) != 0) {
+              fprintf(stderr, "Could not write output file %s\n", o_flag);
+              return 1;
+          }
+          done += count;
+      }
+      pack_close(&reader);
+   }
+   else if (partitioned_present) {
+      // each partition of the output is one pread() of its input range (the
+      // mirrored one for -r), a decode and one pwrite(), on -j threads
+
+      part_options options;
+      checksum_table part_sums;
+      memset(&part_sums, 0, sizeof(part_sums));
+      options.threads = threads;
+      options.partition_records = partition_records;
+      options.reverse = r_present;
+      options.ctx = ctx;
+      options.shift = decode_shift;
+      options.verify = verify_input ? &in_sums : NULL;
+      options.sums = c_present ? &part_sums : NULL;
+      if (part_copy(fileno(input_file), num_of_records, &options, o_flag) != 0) {
+          return 1;
+      }
+      if (c_present) {
+          checksum_writer_adopt(&out_sums, &part_sums);
+      }
+   }
+   else if (io_flag != NULL) {
+      // with --io the records are copied a window at a time under the chosen
+      // policy; for -r the windows are read from the end and each one is
+      // reversed, and the output is always written in order
+
+      io_file in_io;
+      io_file out_io;
+      if (io_open(&in_io, f_flag, 0, policy, io_depth) != 0 || io_open(&out_io, o_flag, 1, policy, io_depth) != 0) {
+          return 1;
+      }
+      record * window = io_alloc(sizeof(record) * IO_COPY_RECORDS);
+      if (window == NULL) {
+          fprintf(stderr, "Out of memory.\n");
+          return 1;
+      }
+      int64_t num_of_windows = (num_of_records + IO_COPY_RECORDS - 1) / IO_COPY_RECORDS;
+
+      for (int64_t w = 0; w < num_of_windows; w++) {
+          int64_t index = r_present ? num_of_windows - 1 - w : w;
+          int64_t first = index * IO_COPY_RECORDS;
+          size_t count = num_of_records - first < IO_COPY_RECORDS ? (size_t) (num_of_records - first) : IO_COPY_RECORDS;
+          if (w + 1 < num_of_windows) {
+              int64_t next = r_present ? index - 1 : index + 1;
+              io_prefetch(&in_io, (off_t) next * IO_COPY_RECORDS * (off_t) sizeof(record), sizeof(record) * IO_COPY_RECORDS);
+          }
+
+          if (io_read_at(&in_io, window, count * sizeof(record), (off_t) first * (off_t) sizeof(record)) != (ssize_t) (count * sizeof(record))) {
+              fprintf(stderr, "Could not read records from %s\n", f_flag);
+              return 1;
+          }
+          for (size_t b = 0; verify_input && b < count; b += CHECKSUM_BLOCK_RECORDS) {
+              int64_t block = (first + (int64_t) b) / CHECKSUM_BLOCK_RECORDS;
+              size_t n = count - b < CHECKSUM_BLOCK_RECORDS ? count - b : CHECKSUM_BLOCK_RECORDS;
+              if (!checksum_block_ok(&in_sums, block, window + b, n)) {
+                  fprintf(stderr, "Checksum mismatch in block %lld (records %lld-%lld) of %s\n",
+                          (long long) block, (long long) (first + b), (long long) (first + b + n - 1), f_flag);
+                  return 1;
+              }
+          }
+
+          decode_records(ctx, window, count, decode_shift);
+          if (r_present) {
+              for (size_t j = 0; j < count / 2; j++) {
+                  record swap = window[j];
+                  window[j] = window[count - 1 - j];
+                  window[count - 1 - j] = swap;
+              }
+          }
+
+          if (io_append(&out_io, window, count * sizeof(record)) != 0 ||
+              (c_present && checksum_writer_add(&out_sums, window, count) != 0)) {
+              fprintf(stderr, "Could not write output file %s\n", o_flag);
+              return 1;
+          }
+      }
+      free(window);
+
+      io_close(&in_io);
+      if (io_close(&out_io) != 0) {
+          fprintf(stderr, "Could not write output file %s\n", o_flag);
+          return 1;
+      }
+      if (io_stats_present) {
+          io_report(stderr, &in_io);
+          io_report(stderr, &out_io);
+      }
+   }
+   else {
+      // records are copied one checksum block at a time; for -r the blocks are
+      // read from the end of the file and the records in each block are reversed
+
+      record * batch = arena_alloc(&mem, sizeof(record) * CHECKSUM_BLOCK_RECORDS);
+      if (batch == NULL) {
+          fprintf(stderr, "Out of memory.\n");
+          return 1;
+      }
+      int64_t num_of_blocks = (num_of_records + CHECKSUM_BLOCK_RECORDS - 1) / CHECKSUM_BLOCK_RECORDS;
+
+      // with a journal, every interval_blocks blocks the output is made
+      // durable and the progress recorded; --resume starts from the last one.
+      // With -C the finished block CRCs go to the output's sidecar as they
+      // are checkpointed, and the journal only says how many there are
+
+      copy_journal journal;
+      checksum_stream sidecar;
+      char * sidecar_path = NULL;
+      uint32_t stretch_crc = 0;
+      memset(&journal, 0, sizeof(journal));
+      memset(&sidecar, 0, sizeof(sidecar));
+      if (journal_file != NULL && c_present) {
+          sidecar_path = checksum_path(o_flag);
+          if (sidecar_path == NULL) {
+              fprintf(stderr, "Out of memory.\n");
+              return 1;
+          }
+      }
+      if (journal_file != NULL && resume_present) {
+          if (journal_load(journal_file, &journal, &out_sums, &sidecar) != 0) {
+              fprintf(stderr, "No usable journal %s to resume from (a finished copy leaves none).\n", journal_file);
+              return 1;
+          }
+          if (journal.num_records != (uint64_t) num_of_records || !journal_same_input(fileno(input_file), &journal)) {
+              fprintf(stderr, "%s has changed since the journal was written.\n", f_flag);
+              return 1;
+          }
+          if (journal.reverse != r_present || journal.shift != decode_shift || journal.sums != c_present) {
+              fprintf(stderr, "--resume needs the same -r, -C, -D and --rekey as the interrupted copy.\n");
+              return 1;
+          }
+          if (journal_rewind(output_file, &journal) != 0) {
+              return 1;
+          }
+          if (c_present && checksum_stream_resume(&sidecar, sidecar_path, &out_sums) != 0) {
+              fprintf(stderr, "The checksums in %s do not match the journal's last checkpoint.\n", sidecar_path);
+              return 1;
+          }
+          total = (int64_t) journal.blocks_done;
+      }
+      else if (journal_file != NULL) {
+          if (journal_identify(fileno(input_file), &journal) != 0) {
+              fprintf(stderr, "Could not read input file %s\n", f_flag);
+              return 1;
+          }
+          journal.num_records = (uint64_t) num_of_records;
+          journal.shift = decode_shift;
+          journal.reverse = r_present;
+          journal.sums = c_present;
+          if (c_present && checksum_stream_open(&sidecar, sidecar_path, &out_sums) != 0) {
+              fprintf(stderr, "Could not write checksums for %s\n", o_flag);
+              return 1;
+          }
+      }
+      if (checkpoint_records > 0) {
+          journal.interval_blocks = (uint64_t) (checkpoint_records + CHECKSUM_BLOCK_RECORDS - 1) / CHECKSUM_BLOCK_RECORDS;
+      }
+      else if (journal.interval_blocks == 0) {
+          journal.interval_blocks = 1;
+      }
+      uint64_t written = journal.output_offset;
+
+      while (total < num_of_blocks) {
+          int64_t block = r_present ? num_of_blocks - 1 - total : total;
+          int64_t first = block * CHECKSUM_BLOCK_RECORDS;
+          size_t count = num_of_records - first < CHECKSUM_BLOCK_RECORDS ? (size_t) (num_of_records - first) : CHECKSUM_BLOCK_RECORDS;
+
+          fseeko(input_file, (off_t) first * (off_t) sizeof(record), SEEK_SET);
+          if (fread(batch, sizeof(record), count, input_file) != count) {
+              fprintf(stderr, "Could not read records from %s\n", f_flag);
+              return 1;
+          }
+          if (verify_input && !checksum_block_ok(&in_sums, block, batch, count)) {
+              fprintf(stderr, "Checksum mismatch in block %lld (records %lld-%lld) of %s\n",
+                      (long long) block, (long long) first, (long long) (first + count - 1), f_flag);
+              return 1;
+          }
+
+          decode_records(ctx, batch, count, decode_shift);
+          if (r_present) {
+              for (size_t j = 0; j < count / 2; j++) {
+                  record swap = batch[j];
+                  batch[j] = batch[count - 1 - j];
+                  batch[count - 1 - j] = swap;
+              }
+          }
+
+          if (write_records(&sink, batch, count) != 0) {
+              fprintf(stderr, "Could not write output file %s\n", o_flag);
+              return 1;
+          }
+          total++;
+
+          if (journal_file != NULL) {
+              stretch_crc = crc32c_update(stretch_crc, batch, count * sizeof(record));
+              written += count * sizeof(record);
+              if ((uint64_t) total % journal.interval_blocks == 0 && total < num_of_blocks) {
+                  int64_t next = r_present ? num_of_blocks - total : total;
+                  journal.blocks_done = (uint64_t) total;
+                  journal.input_offset = (uint64_t) next * CHECKSUM_BLOCK_RECORDS * sizeof(record);
+                  journal.last_offset = journal.output_offset;
+                  journal.output_offset = written;
+                  journal.last_crc = stretch_crc;
+                  if (journal_checkpoint(output_file, journal_file, &journal, &out_sums, &sidecar) != 0) {
+                      return 1;
+                  }
+                  stretch_crc = 0;
+              }
+          }
+      }
+
+      // the finished sidecar is written over the stream below
+      if (checksum_stream_close(&sidecar) != 0) {
+          fprintf(stderr, "Could not write checksums for %s\n", o_flag);
+          return 1;
+      }
+      free(sidecar_path);
+
+   }
+
+   if (pack_present) {
+       if (pack_writer_finish(&packer) != 0) {
+           fprintf(stderr, "Could not write output file %s\n", o_flag);
+           return 1;
+       }
+       pack_writer_free(&packer);
+   }
+
+   fclose(input_file);
+   if (output_file != NULL && fclose(output_file) != 0) {
+       fprintf(stderr, "Could not write output file %s\n", o_flag);
+       return 1;
+   }
+
+   // -C writes the output's checksums to its sidecar; without it any old
+   // sidecar is removed so it cannot be mistaken for the new archive's
+
+   char * out_sum_path = checksum_path(o_flag);
+   if (!c_present && out_sum_path != NULL) {
+       remove(out_sum_path);
+   }
+   if (c_present) {
+       if (checksum_writer_finish(&out_sums) != 0 || out_sum_path == NULL ||
+           checksum_save(out_sum_path, &out_sums.table) != 0) {
+           fprintf(stderr, "Could not write checksums for %s\n", o_flag);
+           return 1;
+       }
+   }
+   free(out_sum_path);
+
+   // the copy is complete, so there is nothing left to resume
+   if (journal_file != NULL) {
+       remove(journal_file);
+       free(journal_file);
+   }
+
+   checksum_free(&out_sums.table);
+   if (verify_input) {
+       checksum_free(&in_sums);
+   }
+   free(in_sum_path);
+   decode_ctx_free(ctx);
+   arena_free(&mem);
+   return 0;
+}
@@ -26,7 +26,12 @@
  *   -r: Optional flag to copy records in reverse order
  */
 
+#ifndef COPYRECORDS_H
+#define COPYRECORDS_H
+
 #include <stdio.h>    /* For file operations */
+#include <stdint.h>   /* For 64-bit record counts */
+#include <sys/types.h>  /* For off_t (64-bit with _FILE_OFFSET_BITS=64) */
 #include "decode_lib.h"  /* For Caesar cipher functions */
 #include "frequency_table.h"  /* For frequency analysis */
 #include <stdlib.h>   /* For memory management */
@@ -53,6 +58,12 @@ typedef struct record {
     int nums[12];     /* Array of 12 integers */
 } record;
 
+/*
+ * Receives records in order (from a sort or an import); returns 0, or -1 to
+ * stop the producer
+ */
+typedef int (*record_sink)(void * arg, const record * records, size_t count);
+
 /* 
  * file_size
  * 
@@ -62,7 +73,7 @@ typedef struct record {
  *   fp - File pointer to the file to measure
  * 
  * Returns:
- *   Total size of file in bytes
+ *   Total size of file in bytes (64-bit, so archives over 2 GB work)
  * 
  * How it works:
  * 1. Seeks to end of file
@@ -70,7 +81,7 @@ typedef struct record {
  * 3. Rewinds file pointer to start
  * 4. Returns size
  */
-int file_size(FILE * fp);
+off_t file_size(FILE * fp);
 
 /* 
  * readRecords
@@ -92,3 +103,20 @@ int file_size(FILE * fp);
  */
 struct record ** readRecords(FILE * fp);
 
+/* 
+ * decode_records
+ * 
+ * Purpose: Apply a Caesar shift to the string fields of a batch of records
+ * 
+ * Parameters:
+ *   ctx     - Analysis context holding the shift tables
+ *   records - Records to change in place
+ *   count   - Number of records
+ *   shift   - Shift to apply to str1 and str2
+ * 
+ * Each string stops at its first NUL or at the end of its field, whichever
+ * comes first, so an unterminated field never spills into the next one.
+ */
+void decode_records(const decode_ctx * ctx, record * records, size_t count, int shift);
+
+#endif
@@ -7,7 +7,7 @@
  * 2. Reading binary records from files
  * 
  * Key Implementation Details:
- * 1. Binary File Operations: Using fseek, ftell, and fread
+ * 1. Binary File Operations: Using fseeko, ftello, and fread
  * 2. Memory Management: Dynamic allocation of record arrays
  * 3. File Position Management: Proper handling of file pointers
  * 
@@ -15,6 +15,8 @@
  * The commented code shows a partial implementation that can be used as a reference.
  */
 
+#define _POSIX_C_SOURCE 200809L  /* For fseeko() and ftello() */
+
 #include "frequency_table.h"  /* For frequency analysis */
 #include "decode_lib.h"       /* For Caesar cipher functions */
 #include "copyrecords.h"      /* For record structure and function declarations */
@@ -36,24 +38,27 @@
  *   Total size of file in bytes
  * 
  * Implementation Details:
- * 1. Uses fseek to move to end of file (SEEK_END)
- * 2. Uses ftell to get current position (file size)
+ * 1. Uses fseeko to move to end of file (SEEK_END)
+ * 2. Uses ftello to get current position (file size)
  * 3. Uses rewind to restore file pointer to start
  * 4. Returns the size in bytes
  * 
+ * fseeko/ftello work with off_t, which is 64 bits wide when the program is
+ * built with _FILE_OFFSET_BITS=64, so sizes over 2 GB are not truncated.
+ * 
  * Example:
  *   FILE *fp = fopen("data.bin", "rb");
- *   int size = file_size(fp);  // Gets total bytes in file
- *   int records = size / sizeof(record);  // Gets number of records
+ *   off_t size = file_size(fp);  // Gets total bytes in file
+ *   int64_t records = size / sizeof(record);  // Gets number of records
  */
-int file_size(FILE * fp) {
-    int sz = 0;  /* Size of file in bytes */
+off_t file_size(FILE * fp) {
+    off_t sz = 0;  /* Size of file in bytes */
     
     /* Move to end of file */
-    fseek(fp, 0L, SEEK_END);
+    fseeko(fp, 0, SEEK_END);
     
     /* Get current position (file size) */
-    sz = ftell(fp);
+    sz = ftello(fp);
     
     /* Reset file pointer to start */
     rewind(fp);
@@ -61,6 +66,44 @@ int file_size(FILE * fp) {
     return sz;
 }
 
+/*
+ * field_length
+ * 
+ * Purpose: Length of a string stored in a fixed-size field
+ * 
+ * Returns:
+ *   Bytes before the first NUL, or the field size if there is none
+ */
+static size_t field_length(const char * field, size_t size) {
+    const char * end = memchr(field, '\0', size);
+    return end == NULL ? size : (size_t) (end - field);
+}
+
+/*
+ * decode_records
+ * 
+ * Purpose: Apply a Caesar shift to the string fields of a batch of records
+ * 
+ * Parameters:
+ *   ctx     - Analysis context holding the shift tables
+ *   records - Records to change in place
+ *   count   - Number of records
+ *   shift   - Shift to apply to str1 and str2
+ * 
+ * How it works:
+ *   For each record, the used part of str1 and str2 is passed to
+ *   decode_apply(); the numeric fields are not touched
+ */
+void decode_records(const decode_ctx * ctx, record * records, size_t count, int shift) {
+    if (shift == 0) {
+        return;  /* Nothing to do */
+    }
+    for (size_t i = 0; i < count; i++) {
+        decode_apply(ctx, records[i].str1, field_length(records[i].str1, sizeof(records[i].str1)), shift);
+        decode_apply(ctx, records[i].str2, field_length(records[i].str2, sizeof(records[i].str2)), shift);
+    }
+}
+
 /*
  * readRecords
  * 
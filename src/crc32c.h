@@ -0,0 +1,31 @@
+/*
+ * crc32c.h
+ *
+ * This header file defines the interface for computing CRC32C (Castagnoli)
+ * checksums. They are used to detect silent corruption in record archives
+ * written and read by copyrecords.
+ *
+ * Two implementations are provided behind the same functions:
+ * 1. The SSE4.2 crc32 instruction, used when the CPU supports it
+ * 2. A portable slicing-by-8 table implementation used everywhere else
+ *
+ * The implementation is chosen once at runtime, so callers never need to
+ * know which one is in use.
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+#include <stddef.h>   /* For size_t */
+#include <stdint.h>   /* For uint32_t */
+
+/* Continues a CRC32C over len more bytes (start with crc = 0) */
+uint32_t crc32c_update(uint32_t crc, const void * buf, size_t len);
+
+/* Computes the CRC32C of a single buffer */
+uint32_t crc32c(const void * buf, size_t len);
+
+/* Returns the name of the implementation in use ("sse4.2" or "slicing-by-8") */
+const char * crc32c_impl(void);
+
+#endif
@@ -0,0 +1,166 @@
+/*
+ * crc32c_lib.c
+ *
+ * This file implements the CRC32C checksum functions declared in crc32c.h.
+ *
+ * Key Implementation Details:
+ * 1. Hardware Path: On x86-64 CPUs with SSE4.2 the crc32 instruction
+ *    processes 8 bytes per instruction
+ * 2. Software Path: Slicing-by-8 uses eight 256-entry tables so that each
+ *    8-byte word needs eight table lookups instead of 64 bit-steps
+ * 3. Dispatch: The path is chosen once, the first time a checksum is taken
+ *
+ * Both paths produce identical results, so archives written on one machine
+ * verify on any other.
+ */
+
+#include "crc32c.h"
+#include <pthread.h>  /* For pthread_once() - one-time table setup */
+#include <string.h>   /* For memcpy() */
+#include <stdbool.h>  /* For boolean type */
+
+/* Reflected Castagnoli polynomial */
+#define CRC32C_POLY 0x82F63B78u
+
+static uint32_t crc_table[8][256];        /* Slicing-by-8 lookup tables */
+static bool use_hw = false;              /* True if SSE4.2 is available */
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+
+/*
+ * crc32c_init
+ *
+ * Purpose: Builds the slicing-by-8 tables and picks the implementation
+ *
+ * How it works:
+ * 1. Table 0 is the classic byte-at-a-time table for the polynomial
+ * 2. Table k gives the effect of a byte followed by k zero bytes, which
+ *    lets eight bytes be folded into the CRC at once
+ */
+static void crc32c_init(void) {
+    for (int i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        crc_table[0][i] = c;
+    }
+    for (int i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            uint32_t prev = crc_table[t - 1][i];
+            crc_table[t][i] = (prev >> 8) ^ crc_table[0][prev & 0xff];
+        }
+    }
+#if defined(__x86_64__) && defined(__GNUC__)
+    __builtin_cpu_init();
+    use_hw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+/*
+ * crc32c_sw
+ *
+ * Purpose: Portable slicing-by-8 CRC32C over a buffer
+ *
+ * Parameters:
+ *   crc - Running (already inverted) CRC value
+ *   p   - Bytes to process
+ *   len - Number of bytes
+ *
+ * Returns:
+ *   The updated (still inverted) CRC value
+ */
+static uint32_t crc32c_sw(uint32_t crc, const unsigned char * p, size_t len) {
+    while (len >= 8) {
+        /* Load the word byte by byte so the result does not depend on endianness */
+        uint32_t lo = crc ^ ((uint32_t) p[0] | (uint32_t) p[1] << 8 |
+                             (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24);
+        uint32_t hi = (uint32_t) p[4] | (uint32_t) p[5] << 8 |
+                      (uint32_t) p[6] << 16 | (uint32_t) p[7] << 24;
+        crc = crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff] ^
+              crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][hi & 0xff] ^ crc_table[2][(hi >> 8) & 0xff] ^
+              crc_table[1][(hi >> 16) & 0xff] ^ crc_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        crc = (crc >> 8) ^ crc_table[0][(crc ^ *p++) & 0xff];
+    }
+    return crc;
+}
+
+#if defined(__x86_64__) && defined(__GNUC__)
+/*
+ * crc32c_hw
+ *
+ * Purpose: CRC32C using the SSE4.2 crc32 instruction
+ *
+ * How it works:
+ * 1. Single bytes are processed until the pointer is 8-byte aligned
+ * 2. The bulk of the buffer is processed 8 bytes per instruction
+ * 3. Any trailing bytes are processed one at a time
+ */
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw(uint32_t crc, const unsigned char * p, size_t len) {
+    uint64_t c = crc;
+    while (len > 0 && ((uintptr_t) p & 7) != 0) {
+        c = __builtin_ia32_crc32qi((uint32_t) c, *p++);
+        len--;
+    }
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        c = __builtin_ia32_crc32di(c, word);
+        p += 8;
+        len -= 8;
+    }
+    while (len-- > 0) {
+        c = __builtin_ia32_crc32qi((uint32_t) c, *p++);
+    }
+    return (uint32_t) c;
+}
+#endif
+
+/*
+ * crc32c_update
+ *
+ * Purpose: Continues a CRC32C over more bytes
+ *
+ * Parameters:
+ *   crc - CRC of the bytes seen so far (0 for none)
+ *   buf - Next bytes to include
+ *   len - Number of bytes
+ *
+ * Returns:
+ *   The CRC of all bytes seen so far, so that
+ *   crc32c_update(crc32c(a), b) == crc32c(a followed by b)
+ */
+uint32_t crc32c_update(uint32_t crc, const void * buf, size_t len) {
+    pthread_once(&crc_once, crc32c_init);
+    crc = ~crc;
+#if defined(__x86_64__) && defined(__GNUC__)
+    if (use_hw) {
+        return ~crc32c_hw(crc, buf, len);
+    }
+#endif
+    return ~crc32c_sw(crc, buf, len);
+}
+
+/*
+ * crc32c
+ *
+ * Purpose: Computes the CRC32C of a single buffer
+ */
+uint32_t crc32c(const void * buf, size_t len) {
+    return crc32c_update(0, buf, len);
+}
+
+/*
+ * crc32c_impl
+ *
+ * Purpose: Reports which implementation is in use (for diagnostics)
+ */
+const char * crc32c_impl(void) {
+    pthread_once(&crc_once, crc32c_init);
+    return use_hw ? "sse4.2" : "slicing-by-8";
+}
@@ -21,27 +21,236 @@
  *    - -t: Show frequency table
  *    - -x: Show chi-squared values for all shifts
  *    - -n: Suppress decoded text output
+ *    - -l: Show the detected language
+ * 4. Several languages:
+ *    - -L profile: Also consider the language in a profile file (see
+ *      profile.h); may be given several times. English is always included
+ *      and every (language, shift) pair is scored in one pass
+ * 5. Message mode (see linedecode.h):
+ *    - --per-line: Each line is a separate message with its own shift;
+ *      lines are decoded independently as they stream in
+ *    - --delim C: Use C (a character, or \n, \t or \0) instead of newline
+ *    - -j N: Threads to use (default: all CPUs)
+ *    - -S, -s and -l put the shift or language before each message
+ * 6. Segmentation mode (see segment.h):
+ *    - --segment: The shift may change within the text; a sliding window
+ *      finds where, and each segment is decoded with its own shift
+ *    - --window N, --stride N: Window size and scoring interval in bytes
+ *    - -S, -s and -l list the segments (start, end, shift, language) on
+ *      standard output, or on standard error if the text goes there
+ * 7. Verification (see dictionary.h):
+ *    - --top k: Keep the k shifts with the lowest chi-squared values, check
+ *      each by looking up a sample of decoded words in the built-in English
+ *      dictionary and decode with the best; with -x the candidates are
+ *      listed by combined score after the chi-squared table
+ * 8. Follow mode (see follow.h):
+ *    - --follow: Keep reading -F as it grows, decoding only the new bytes;
+ *      the letter counts are kept and the shift is chosen again only when
+ *      new letters have arrived
+ *    - -S, -s and -l list each change of shift (start, shift, language)
+ * 9. I/O policy (see iopolicy.h):
+ *    - --io buffered|stream|direct: How -F is read and -O written: through
+ *      the page cache, through it but dropped behind the cursor, or with
+ *      O_DIRECT, bypassing it
+ *    - --io-depth N: Direct requests in flight at once
+ *    - --io-stats: Report bytes read and written and how much of each
+ *      file is in the page cache
  * 
  * Usage Examples:
  *   ./decode -F encoded.txt -O decoded.txt -s -t
  *   ./decode -F encoded.txt -S -x
  *   ./decode < encoded.txt
+ *   ./decode -F encoded.txt -L french.prof -L german.prof -l -s
+ *   producer | ./decode --per-line -S -j 4
+ *   ./decode -F short.txt --top 3
  * 
  * Key Programming Concepts:
  * 1. Command Line Arguments: Processing multiple flags and options
  * 2. File I/O: Reading from files and standard input
- * 3. Dynamic Memory: Managing buffers for file contents
+ * 3. Dynamic Memory: All buffers come from one arena and are released together
  * 4. Statistical Analysis: Using chi-squared testing
  * 5. String Manipulation: Encoding/decoding text
+ * 6. Caching: Analysis results are kept on disk (see shiftcache.h), so
+ *    analysing the same text again is answered from the cache
+ * 7. Output: The text is decoded in place and written with system calls
+ *    (see output.h): vmsplice() into a pipe, pwrite() to a file, each block
+ *    going out while the next is decoded
  */
 
+#define _POSIX_C_SOURCE 200809L   /* For fileno() */
+
 #include <stdio.h>    /* For file operations and printf */
 #include <string.h>   /* For string manipulation */
 #include "decode_lib.h"  /* For decoding functions */
 #include "frequency_table.h"  /* For frequency analysis */
+#include "arena.h"    /* For the arena holding input and output text */
+#include "shiftcache.h"  /* For cached shift analysis */
+#include "profile.h"  /* For loading language profiles */
+#include "iopolicy.h"  /* For --io */
+#include "linedecode.h"  /* For message mode */
+#include "segment.h"  /* For segmentation mode */
+#include "parallel.h" /* For parallel_threads() */
+#include "dictionary.h"  /* For verifying candidate shifts */
+#include "output.h"   /* For writing the decoded text */
+#include "follow.h"   /* For follow mode */
 #include <stdlib.h>   /* For memory management */
 #include <ctype.h>    /* For character type checking */
 #include <stdbool.h>  /* For boolean type */
+#include <fcntl.h>    /* For open() */
+#include <unistd.h>   /* For close() and STDOUT_FILENO */
+#include <sys/stat.h> /* For fstat() before an --io read */
+
+/* What decode --segment lists for each segment */
+typedef struct segment_listing {
+    FILE * out;
+    int show_shift;            /* 'S', 's' or 0 */
+    int show_language;
+    const char * const * names;
+} segment_listing;
+
+/* Prints one segment as: start, end, shift and language, separated by tabs */
+static void list_segment(uint64_t start, uint64_t end, int shift, int language, void * arg) {
+    segment_listing * listing = arg;
+    fprintf(listing->out, "%llu\t%llu", (unsigned long long) start, (unsigned long long) end);
+    if (listing->show_shift != 0) {
+        fprintf(listing->out, "\t%d", listing->show_shift == 'S' ? shift : to_decode(shift));
+    }
+    if (listing->show_language) {
+        fprintf(listing->out, "\t%s", language >= 0 ? listing->names[language] : "unknown");
+    }
+    fprintf(listing->out, "\n");
+}
+
+/* The shift output_stream() decodes each block with */
+typedef struct decode_job {
+    const decode_ctx * ctx;
+    int shift;                 /* Decoding shift */
+} decode_job;
+
+/* Decodes one block of the text in place (an output_fill for output_stream()) */
+static void decode_block(char * block, size_t length, void * arg) {
+    const decode_job * job = arg;
+    decode_apply(job->ctx, block, length, job->shift);
+}
+
+/* Prints a change of shift in follow mode: where it starts, the shift and the language */
+static void list_follow(const segment_listing * listing, uint64_t start, int shift, int language) {
+    fprintf(listing->out, "%llu", (unsigned long long) start);
+    if (listing->show_shift != 0) {
+        fprintf(listing->out, "\t%d", listing->show_shift == 'S' ? shift : to_decode(shift));
+    }
+    if (listing->show_language) {
+        fprintf(listing->out, "\t%s", language >= 0 ? listing->names[language] : "unknown");
+    }
+    fprintf(listing->out, "\n");
+    fflush(listing->out);
+}
+
+/* What decode --follow keeps between pieces of the file */
+typedef struct follow_decoder {
+    decode_ctx * const * ctxs;
+    int languages;
+    int out_fd;                        /* Where decoded text goes, or -1 with -n */
+    const segment_listing * listing;   /* Where shift changes are listed, or NULL */
+    freq_hist hist;                    /* Letters of everything seen so far */
+    uint64_t decided;                  /* hist.letters when the shift was last chosen */
+    uint64_t position;                 /* Bytes seen so far */
+    int shift;                         /* Encoding shift, or -1 until it settles */
+    int language;
+    char * pending;                    /* Text held back until the shift settles */
+    size_t pending_length;
+    size_t pending_capacity;
+} follow_decoder;
+
+/*
+ * Writes text decoded with the current shift; returns 0, or -1 on an error
+ */
+static int follow_emit(follow_decoder * follower, char * text, size_t length) {
+    if (follower->out_fd < 0 || length == 0) {
+        return 0;
+    }
+    decode_apply(follower->ctxs[0], text, length, to_decode(follower->shift));
+    return output_write(follower->out_fd, text, length);
+}
+
+/* Chooses the shift again from the letters seen so far, listing it if it changed */
+static void follow_decide(follow_decoder * follower, uint64_t start) {
+    int language = -1;
+    int shift = decode_best_language(follower->ctxs, follower->languages, &follower->hist, &language);
+    follower->decided = follower->hist.letters;
+    if (shift != follower->shift || language != follower->language) {
+        follower->shift = shift;
+        follower->language = language;
+        if (follower->listing != NULL) {
+            list_follow(follower->listing, start, shift, language);
+        }
+    }
+}
+
+/*
+ * follow_piece
+ *
+ * Purpose: Handles one newly appended piece of the followed file (a follow_fn)
+ *
+ * How it works:
+ * 1. A truncated file starts everything over
+ * 2. The piece's letters are added to the running counts; once there are
+ *    FOLLOW_SETTLE_LETTERS, the shift is chosen again whenever the count
+ *    has grown, which costs 26 scores, not a pass over the file
+ * 3. Until the shift settles the text is held back; after that each piece
+ *    is decoded in place and written at once
+ */
+static int follow_piece(char * data, size_t length, int restart, void * arg) {
+    follow_decoder * follower = arg;
+
+    if (restart) {
+        freq_hist_clear(&follower->hist);
+        follower->decided = 0;
+        follower->position = 0;
+        follower->shift = -1;
+        follower->language = -1;
+        follower->pending_length = 0;
+    }
+    if (data == NULL) {
+        return 0;
+    }
+
+    freq_hist_update(&follower->hist, data, length);
+    if (follower->hist.letters != follower->decided && follower->hist.letters >= FOLLOW_SETTLE_LETTERS) {
+        follow_decide(follower, follower->shift < 0 ? 0 : follower->position);
+    }
+    follower->position += length;
+
+    if (follower->shift < 0) {
+        if (follower->pending_length + length > follower->pending_capacity) {
+            size_t capacity = 2 * (follower->pending_length + length);
+            char * grown = realloc(follower->pending, capacity);
+            if (grown == NULL) {
+                fprintf(stderr, "Error: Out of memory\n");
+                return -1;
+            }
+            follower->pending = grown;
+            follower->pending_capacity = capacity;
+        }
+        memcpy(follower->pending + follower->pending_length, data, length);
+        follower->pending_length += length;
+        return 0;
+    }
+    if (follower->pending_length > 0) {
+        if (follow_emit(follower, follower->pending, follower->pending_length) != 0) {
+            return -1;
+        }
+        follower->pending_length = 0;
+    }
+    return follow_emit(follower, data, length);
+}
+
+/* Releases the first count language contexts */
+static void free_contexts(decode_ctx ** ctxs, int count) {
+    for (int i = 0; i < count; i++) {
+        decode_ctx_free(ctxs[i]);
+    }
+}
 
 int main(int argc, char ** argv) {
     /* Command line flag variables */
@@ -52,32 +261,36 @@ int main(int argc, char ** argv) {
     int S_present = false;  /* Show encode shift flag (-S) */
     int t_present = false;  /* Show frequency table flag (-t) */
     int x_present = false;  /* Show chi-squared values flag (-x) */
+    int l_present = false;  /* Show language flag (-l) */
+    char * lFlags[DECODE_MAX_LANGUAGES];  /* Profile files (-L) */
+    int num_profiles = 0;
+    int per_line = false;  /* Message mode flag (--per-line) */
+    char delimiter = '\n';  /* Message delimiter (--delim) */
+    int threads = parallel_threads();  /* Threads for message mode (-j) */
+    int segment = false;  /* Segmentation mode flag (--segment) */
+    long window = SEGMENT_WINDOW;  /* Segmentation window (--window) */
+    long stride = SEGMENT_STRIDE;  /* Segmentation stride (--stride) */
+    int top_k = 0;  /* Candidate shifts to verify (--top), 0 for none */
+    int follow = false;  /* Follow mode flag (--follow) */
+    char * ioFlag = NULL;  /* I/O policy for -F and -O (--io) */
+    io_policy policy = IO_BUFFERED;
+    int io_depth = IO_DEFAULT_DEPTH;  /* Direct requests in flight (--io-depth) */
+    int io_stats = false;  /* Report bytes and cache residency (--io-stats) */
+    char * io_buffer = NULL;  /* Input read under the policy (not from the arena) */
     
     /* File handling variables */
     FILE * f = NULL;  /* Input file pointer */
+    size_t length = 0;  /* Bytes held in file_contents */
     
-    /* Buffer for reading input in chunks */
-    char * buffer = malloc(sizeof(char) * 100);
-    if (buffer == NULL) {
-        fprintf(stderr, "Error: Failed to allocate memory for buffer\n");
-        return 1;
-    }
-    strcpy(buffer, "");
-    
-    /* Storage for complete input text */
-    char * file_contents = malloc(sizeof(char) * 100);
-    if (file_contents == NULL) {
-        fprintf(stderr, "Error: Failed to allocate memory for file contents\n");
-        free(buffer);
-        return 1;
-    }
-    strcpy(file_contents, "");
+    /* Every buffer below is allocated from this arena and freed with it */
+    arena mem;
+    arena_init(&mem, 0);
 
     /* Process command line arguments */
     if (argc > 0) {
         for (int i = 1; i < argc; i++) {
             /* Handle combined flags (e.g., -stx) */
-            if (strlen(argv[i]) > 2 && argv[i][0] == '-') {
+            if (strlen(argv[i]) > 2 && argv[i][0] == '-' && argv[i][1] != '-') {
                 for (int j = 1; j < strlen(argv[i]); j++) {
                     switch (argv[i][j]) {
                         case 'n': n_present = true; break;
@@ -85,117 +298,367 @@ int main(int argc, char ** argv) {
                         case 'S': S_present = true; break;
                         case 't': t_present = true; break;
                         case 'x': x_present = true; break;
+                        case 'l': l_present = true; break;
                     }
                 }
             }
             
             /* Handle individual flags and their arguments */
-            if (strcmp(argv[i], "-O") == 0) {
+            if (strcmp(argv[i], "-O") == 0 && i + 1 < argc) {
                 /* Get output filename */
                 i++;
-                oFlag = malloc(sizeof(char) * (strlen(argv[i]) + 1));
-                if (oFlag == NULL) {
-                    fprintf(stderr, "Error: Failed to allocate memory for output filename\n");
-                    free(buffer);
-                    free(file_contents);
+                oFlag = argv[i];
+            }
+            else if (strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
+                /* Get input filename */
+                i++;
+                fFlag = argv[i];
+            }
+            else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc) {
+                /* Get a language profile (English is always the first language) */
+                i++;
+                if (num_profiles + 1 >= DECODE_MAX_LANGUAGES) {
+                    fprintf(stderr, "Error: At most %d profiles can be given\n", DECODE_MAX_LANGUAGES - 1);
                     return 1;
                 }
-                strcpy(oFlag, argv[i]);
+                lFlags[num_profiles++] = argv[i];
             }
-            else if (strcmp(argv[i], "-F") == 0) {
-                /* Get input filename */
+            else if (strcmp(argv[i], "--per-line") == 0) per_line = true;
+            else if (strcmp(argv[i], "--delim") == 0 && i + 1 < argc) {
+                /* Get the message delimiter */
+                i++;
+                if (strcmp(argv[i], "\\n") == 0) delimiter = '\n';
+                else if (strcmp(argv[i], "\\t") == 0) delimiter = '\t';
+                else if (strcmp(argv[i], "\\0") == 0) delimiter = '\0';
+                else if (strlen(argv[i]) == 1) delimiter = argv[i][0];
+                else {
+                    fprintf(stderr, "Error: The delimiter must be one character, \\n, \\t or \\0\n");
+                    return 1;
+                }
+                per_line = true;
+            }
+            else if (strcmp(argv[i], "--segment") == 0) segment = true;
+            else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
                 i++;
-                fFlag = malloc(sizeof(char) * (strlen(argv[i]) + 1));
-                if (fFlag == NULL) {
-                    fprintf(stderr, "Error: Failed to allocate memory for input filename\n");
-                    free(buffer);
-                    free(file_contents);
+                window = atol(argv[i]);
+                segment = true;
+            }
+            else if (strcmp(argv[i], "--stride") == 0 && i + 1 < argc) {
+                i++;
+                stride = atol(argv[i]);
+                segment = true;
+            }
+            else if (strcmp(argv[i], "--top") == 0 && i + 1 < argc) {
+                /* Get the number of candidate shifts */
+                i++;
+                top_k = atoi(argv[i]);
+                if (top_k < 1 || top_k > 26) {
+                    fprintf(stderr, "Error: --top takes a number of shifts from 1 to 26\n");
+                    return 1;
+                }
+            }
+            else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+                /* Get the number of threads */
+                i++;
+                threads = atoi(argv[i]);
+            }
+            else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+                /* Get the I/O policy */
+                i++;
+                ioFlag = argv[i];
+                if (io_policy_parse(ioFlag, &policy) != 0) {
+                    fprintf(stderr, "Error: Unknown I/O policy %s (use buffered, stream or direct)\n", ioFlag);
+                    return 1;
+                }
+            }
+            else if (strcmp(argv[i], "--io-depth") == 0 && i + 1 < argc) {
+                i++;
+                io_depth = atoi(argv[i]);
+                if (io_depth < 1 || io_depth > IO_MAX_DEPTH) {
+                    fprintf(stderr, "Error: --io-depth takes 1 to %d requests\n", IO_MAX_DEPTH);
                     return 1;
                 }
-                strcpy(fFlag, argv[i]);
             }
             /* Handle individual flags */
+            else if (strcmp(argv[i], "--io-stats") == 0) io_stats = true;
+            else if (strcmp(argv[i], "--follow") == 0) follow = true;
             else if (strcmp(argv[i], "-n") == 0) n_present = true;
             else if (strcmp(argv[i], "-s") == 0) s_present = true;
             else if (strcmp(argv[i], "-S") == 0) S_present = true;
             else if (strcmp(argv[i], "-t") == 0) t_present = true;
             else if (strcmp(argv[i], "-x") == 0) x_present = true;
+            else if (strcmp(argv[i], "-l") == 0) l_present = true;
         }
 
-        /* Read input text */
-        if (fFlag == NULL) {
-            /* Read from standard input */
-            while (fgets(buffer, 100, stdin) != NULL) {
-                char * temp = realloc(file_contents, 
-                                    sizeof(char) * (strlen(file_contents) + strlen(buffer) + 3));
-                if (temp == NULL) {
-                    fprintf(stderr, "Error: Failed to allocate memory for file contents\n");
-                    free(buffer);
-                    free(file_contents);
-                    return 1;
-                }
-                file_contents = temp;
-                strcat(file_contents, buffer);
-            }
-        } else {
-            /* Read from file */
+        if (segment && (window < 1 || stride < 1 || stride > window)) {
+            fprintf(stderr, "Error: The window and stride must be positive, with the stride at most the window\n");
+            return 1;
+        }
+        if (segment && per_line) {
+            fprintf(stderr, "Error: --segment and --per-line cannot be combined\n");
+            return 1;
+        }
+        if (top_k > 0 && (segment || per_line)) {
+            fprintf(stderr, "Error: --top cannot be combined with --segment or --per-line\n");
+            return 1;
+        }
+
+        if (follow && (fFlag == NULL || segment || per_line || top_k > 0)) {
+            fprintf(stderr, "Error: --follow needs -F and cannot be combined with --segment, --per-line or --top\n");
+            return 1;
+        }
+
+        if (io_stats && ioFlag == NULL) {
+            ioFlag = "buffered";
+        }
+        if (ioFlag != NULL && (fFlag == NULL || segment || per_line || follow)) {
+            fprintf(stderr, "Error: --io needs -F and cannot be combined with --segment, --per-line or --follow\n");
+            return 1;
+        }
+
+        /* Read input text from the file, or standard input if none was given */
+        if (fFlag != NULL) {
             f = fopen(fFlag, "r");
             if (f == NULL) {
                 fprintf(stderr, "Error: Could not open input file %s\n", fFlag);
-                free(buffer);
-                free(file_contents);
-                free(fFlag);
                 return 1;
             }
-            while (fgets(buffer, 100, f) != NULL) {
-                char * temp = realloc(file_contents, 
-                                    sizeof(char) * (strlen(file_contents) + strlen(buffer) + 3));
-                if (temp == NULL) {
-                    fprintf(stderr, "Error: Failed to allocate memory for file contents\n");
-                    free(buffer);
-                    free(file_contents);
-                    free(fFlag);
-                    fclose(f);
-                    return 1;
+        }
+        FILE * in = f != NULL ? f : stdin;
+
+        /* One analysis context per language, English first */
+        decode_ctx * ctxs[DECODE_MAX_LANGUAGES];
+        const char * names[DECODE_MAX_LANGUAGES];
+        freq_profile profiles[DECODE_MAX_LANGUAGES];
+        int languages = 0;
+        int failed = false;
+        ctxs[languages] = decode_ctx_new();
+        names[languages] = "english";
+        failed = ctxs[languages] == NULL;
+        if (!failed) {
+            languages++;
+        }
+        for (int i = 0; i < num_profiles && !failed; i++) {
+            if (profile_load(lFlags[i], &profiles[i]) != 0) {
+                failed = true;
+                break;
+            }
+            ctxs[languages] = decode_ctx_new_profile(profiles[i].expected);
+            names[languages] = profiles[i].name;
+            failed = ctxs[languages] == NULL;
+            if (!failed) {
+                languages++;
+            }
+        }
+        if (failed) {
+            fprintf(stderr, "Error: Failed to set up the languages for decoding\n");
+            free_contexts(ctxs, languages);
+            if (f != NULL) {
+                fclose(f);
+            }
+            arena_free(&mem);
+            return 1;
+        }
+
+        /* Message mode: every message is analysed and decoded on its own */
+        if (per_line) {
+            line_options options;
+            options.delimiter = delimiter;
+            options.threads = threads;
+            options.ctxs = ctxs;
+            options.languages = languages;
+            options.names = names;
+            options.show_shift = S_present ? 'S' : (s_present ? 's' : 0);
+            options.show_language = l_present;
+
+            FILE * out = oFlag != NULL ? fopen(oFlag, "w") : (n_present ? NULL : stdout);
+            if (oFlag != NULL && out == NULL) {
+                fprintf(stderr, "Error: Could not open output file %s\n", oFlag);
+                failed = true;
+            }
+            if (!failed && decode_lines(in, out, &options) != 0) {
+                failed = true;
+            }
+            if (out != NULL && out != stdout && fclose(out) != 0) {
+                fprintf(stderr, "Error: Could not write output file %s\n", oFlag);
+                failed = true;
+            }
+            if (f != NULL) {
+                fclose(f);
+            }
+            free_contexts(ctxs, languages);
+            arena_free(&mem);
+            return failed ? 1 : 0;
+        }
+
+        /* Follow mode: the file keeps growing and only new bytes are read */
+        if (follow) {
+            follow_decoder state;
+            memset(&state, 0, sizeof(state));
+            state.ctxs = ctxs;
+            state.languages = languages;
+            state.shift = -1;
+            state.language = -1;
+            state.out_fd = n_present && oFlag == NULL ? -1 : STDOUT_FILENO;
+            if (oFlag != NULL) {
+                state.out_fd = open(oFlag, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+                if (state.out_fd < 0) {
+                    fprintf(stderr, "Error: Could not open output file %s\n", oFlag);
+                    failed = true;
                 }
-                file_contents = temp;
-                strcat(file_contents, buffer);
             }
+            segment_listing listing;
+            listing.out = state.out_fd == STDOUT_FILENO ? stderr : stdout;
+            listing.show_shift = S_present ? 'S' : (s_present ? 's' : 0);
+            listing.show_language = l_present;
+            listing.names = names;
+            state.listing = listing.show_shift != 0 || listing.show_language ? &listing : NULL;
+
             fclose(f);
+            if (!failed && follow_file(fFlag, FOLLOW_POLL_MS, follow_piece, &state) != 0) {
+                failed = true;
+            }
+            /* A file that ended before the shift settled is decoded with what there is */
+            if (!failed && state.shift < 0 && state.pending_length > 0) {
+                follow_decide(&state, 0);
+                failed = follow_emit(&state, state.pending, state.pending_length) != 0;
+            }
+            if (oFlag != NULL && state.out_fd >= 0 && close(state.out_fd) != 0 && !failed) {
+                fprintf(stderr, "Error: Could not write output file %s\n", oFlag);
+                failed = true;
+            }
+            free(state.pending);
+            free_contexts(ctxs, languages);
+            arena_free(&mem);
+            return failed ? 1 : 0;
+        }
+
+        /* Segmentation mode: the shift may change within the text */
+        if (segment) {
+            segment_options options;
+            options.window = (size_t) window;
+            options.stride = (size_t) stride;
+            options.confirm = 0;
+            options.ctxs = ctxs;
+            options.languages = languages;
+
+            FILE * out = oFlag != NULL ? fopen(oFlag, "w") : (n_present ? NULL : stdout);
+            segment_listing listing;
+            listing.out = out == stdout ? stderr : stdout;
+            listing.show_shift = S_present ? 'S' : (s_present ? 's' : 0);
+            listing.show_language = l_present;
+            listing.names = names;
+            int listed = listing.show_shift != 0 || listing.show_language;
+
+            if (oFlag != NULL && out == NULL) {
+                fprintf(stderr, "Error: Could not open output file %s\n", oFlag);
+                failed = true;
+            }
+            if (!failed && decode_segments(in, out, &options, listed ? list_segment : NULL, &listing) != 0) {
+                failed = true;
+            }
+            if (out != NULL && out != stdout && fclose(out) != 0) {
+                fprintf(stderr, "Error: Could not write output file %s\n", oFlag);
+                failed = true;
+            }
+            if (f != NULL) {
+                fclose(f);
+            }
+            free_contexts(ctxs, languages);
+            arena_free(&mem);
+            return failed ? 1 : 0;
+        }
+
+        /*
+         * A regular file analysed before is recognised by its identity, so
+         * when only the analysis is wanted (-n without -O) it is not read
+         */
+        shift_analysis analysis;
+        uint64_t file_key;
+        int have_file_key = shift_cache_file_key(fileno(in), shift_cache_seed(ctxs, languages), &file_key) == 0;
+        int known = have_file_key && shift_cache_lookup(file_key, &analysis) == 0;
+        int need_text = !n_present || oFlag != NULL;
+        int need_read = !known || need_text || top_k > 0;  /* --top samples the text */
+
+        char * file_contents = NULL;
+        io_file in_io;
+        if (need_read && ioFlag != NULL) {
+            /* Read in one request (split by --io-depth) into an aligned buffer */
+            struct stat st;
+            if (fstat(fileno(in), &st) == 0 && io_open(&in_io, fFlag, 0, policy, io_depth) == 0) {
+                io_buffer = io_alloc((size_t) st.st_size + 1);
+                ssize_t got = io_buffer != NULL ? io_read_at(&in_io, io_buffer, (size_t) st.st_size, 0) : -1;
+                if (got >= 0) {
+                    length = (size_t) got;
+                    io_buffer[length] = '\0';
+                    file_contents = io_buffer;
+                }
+                io_close(&in_io);
+                if (io_stats) {
+                    io_report(stderr, &in_io);
+                }
+            }
+        }
+        else if (need_read) {
+            file_contents = arena_read_file(&mem, in, &length);
+        }
+        if (f != NULL) {
+            fclose(f);
+        }
+        if (need_read && file_contents == NULL) {
+            fprintf(stderr, "Error: Failed to read input text\n");
+            free_contexts(ctxs, languages);
+            arena_free(&mem);
+            return 1;
+        }
+
+        /* Analyse the text once (or fetch the earlier result); every option below reuses it */
+        if (!known) {
+            shift_analyse_cached(ctxs, languages, file_contents, length,
+                                 have_file_key ? &file_key : NULL, &analysis);
+        }
+        int shift = analysis.shift;
+
+        /*
+         * Verify the best candidates against the dictionary; the winner
+         * decodes the text. Without letters every shift scores the same
+         * and there is nothing to rank, so the analysis' shift stands
+         */
+        shift_candidate top[26];
+        int candidates = 0;
+        if (top_k > 0 && analysis.hist.letters > 0) {
+            candidates = dict_rank_shifts(analysis.scores, file_contents, length, top_k, top);
+            shift = top[0].shift;
         }
 
         /* Process output flags */
+        if (l_present) {
+            /* Show the language the text was recognised as */
+            printf("Language: %s\n\n", analysis.language >= 0 ? names[analysis.language] : "unknown");
+        }
+
         if (S_present) {
             /* Show original encoding shift */
-            int min_shift = encode_shift(file_contents);
-            printf("Encoded Shift: %d\n\n", min_shift);
+            printf("Encoded Shift: %d\n\n", shift);
         }
 
         if (s_present) {
             /* Show decoding shift */
-            int min_shift = to_decode(encode_shift(file_contents));
-            printf("Decoded Shift: %d\n\n", min_shift);
+            printf("Decoded Shift: %d\n\n", to_decode(shift));
         }
 
         if (t_present) {
             /* Show frequency table */
-            int * freq_table = frequency_table(file_contents);
-            if (freq_table != NULL) {
-                printf("Letter Frequency Table:\n");
-                printf("Letter\tCount\n");
-                printf("-----\t-----\n");
-                for (int i = 0; i < 26; i++) {
-                    printf("%c\t%d\n", i + 65, freq_table[i]);
-                }
-                
-                /* Show character counts */
-                int count = letter_count(file_contents);
-                printf("\nLetter Count: %d\n", count);
-                int character_count = strlen(file_contents);
-                printf("Character Count: %d\n\n", character_count);
-                
-                free(freq_table);
+            printf("Letter Frequency Table:\n");
+            printf("Letter\tCount\n");
+            printf("-----\t-----\n");
+            for (int i = 0; i < 26; i++) {
+                printf("%c\t%llu\n", i + 65, (unsigned long long) analysis.hist.counts[i]);
             }
+            
+            /* Show character counts */
+            printf("\nLetter Count: %llu\n", (unsigned long long) analysis.hist.letters);
+            printf("Character Count: %llu\n\n", (unsigned long long) analysis.hist.bytes);
         }
 
         if (x_present) {
@@ -204,57 +667,92 @@ int main(int argc, char ** argv) {
             printf("Shift\tChi-Squared Value\n");
             printf("-----\t----------------\n");
             for (int i = 0; i < 26; i++) {
-                printf("%d\t%f\n", i, chi_sq(file_contents, i));
+                printf("%d\t%f\n", i, analysis.scores[i]);
             }
             printf("\n");
         }
 
-        /* Decode the text */
-        char * decoded = malloc(sizeof(char) * (strlen(file_contents) + 1));
-        if (decoded == NULL) {
-            fprintf(stderr, "Error: Failed to allocate memory for decoded text\n");
-            free(buffer);
-            free(file_contents);
-            free(fFlag);
-            free(oFlag);
-            return 1;
+        if (x_present && candidates > 0) {
+            /* Show the verified candidates, best first */
+            printf("Top Shifts:\n");
+            printf("Rank\tShift\tChi-Squared\tWords\tScore\n");
+            printf("----\t-----\t-----------\t-----\t-----\n");
+            for (int i = 0; i < candidates; i++) {
+                printf("%d\t%d\t%f\t%d/%d\t%f\n", i + 1, top[i].shift, top[i].chi,
+                       top[i].hits, top[i].words, top[i].score);
+            }
+            printf("\n");
         }
-        strcpy(decoded, file_contents);
-        
-        /* Find and apply the decoding shift */
-        int shift = encode_shift(decoded);
-        int decode_shift = to_decode(shift);
-        encode_string(decoded, decode_shift);
-        
-        /* Output decoded text */
-        if (oFlag == NULL && !n_present) {
-            /* Print to standard output */
-            printf("%s", decoded);
-        } else if (oFlag != NULL) {
-            /* Write to output file */
-            FILE * new_file = fopen(oFlag, "w");
-            if (new_file == NULL) {
+
+        /* Only the analysis was wanted */
+        if (!need_text) {
+            free_contexts(ctxs, languages);
+            free(io_buffer);
+            arena_free(&mem);
+            return 0;
+        }
+
+        /* With --io, -O is written under the policy, a block at a time as it is decoded */
+        if (ioFlag != NULL && oFlag != NULL) {
+            io_file out_io;
+            decode_job job;
+            job.ctx = ctxs[0];
+            job.shift = to_decode(shift);
+            failed = io_open(&out_io, oFlag, 1, policy, io_depth) != 0;
+            for (size_t done = 0; !failed && done < length; done += OUTPUT_BLOCK) {
+                size_t block = length - done < OUTPUT_BLOCK ? length - done : OUTPUT_BLOCK;
+                decode_block(file_contents + done, block, &job);
+                if (io_append(&out_io, file_contents + done, block) != 0) {
+                    fprintf(stderr, "Error: Could not write output file %s\n", oFlag);
+                    failed = true;
+                }
+            }
+            if (out_io.fd >= 0 && io_close(&out_io) != 0 && !failed) {
+                fprintf(stderr, "Error: Could not write output file %s\n", oFlag);
+                failed = true;
+            }
+            if (!failed && io_stats) {
+                io_report(stderr, &out_io);
+            }
+            free_contexts(ctxs, languages);
+            free(io_buffer);
+            arena_free(&mem);
+            return failed ? 1 : 0;
+        }
+
+        /* Output goes to the file given with -O, or after the analysis on standard output */
+        int out_fd = STDOUT_FILENO;
+        if (oFlag != NULL) {
+            out_fd = open(oFlag, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (out_fd < 0) {
                 fprintf(stderr, "Error: Could not open output file %s\n", oFlag);
-                free(buffer);
-                free(file_contents);
-                free(fFlag);
-                free(oFlag);
-                free(decoded);
+                free_contexts(ctxs, languages);
+                arena_free(&mem);
                 return 1;
             }
-            fprintf(new_file, "%s", decoded);
-            fclose(new_file);
+        } else {
+            fflush(stdout);
+        }
+
+        /* Decode the text in place, block by block, each block written while the next is decoded */
+        decode_job job;
+        job.ctx = ctxs[0];
+        job.shift = to_decode(shift);
+        failed = output_stream(out_fd, file_contents, length, decode_block, &job) != 0;
+        free_contexts(ctxs, languages);
+        free(io_buffer);
+        if (oFlag != NULL && close(out_fd) != 0 && !failed) {
+            fprintf(stderr, "Error: Could not write output file %s\n", oFlag);
+            failed = true;
+        }
+        if (failed) {
+            arena_free(&mem);
+            return 1;
         }
-        
-        /* Clean up allocated memory */
-        free(decoded);
     }
     
-    /* Clean up remaining allocated memory */
-    free(buffer);
-    free(file_contents);
-    free(fFlag);
-    free(oFlag);
+    /* Clean up allocated memory */
+    arena_free(&mem);
     
     return 0;
 }
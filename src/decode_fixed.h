@@ -0,0 +1,55 @@
+/*
+ * decode_fixed.h
+ *
+ * This header file defines the fixed-point format of the chi-squared
+ * scores and the conversions from a language's letter frequencies to its
+ * weights. It is shared by decode_lib.c, which builds the weights of loaded
+ * profiles at run time, and by mkweights.c, which builds English's at build
+ * time, so the two always agree.
+ *
+ * With p[c] the share of letter c in the text and e[c] the expected share,
+ *     chi²(s) = Σ p[c+s]² / e[c] + (Σ e[c] - 2)
+ * and every term is an integer:
+ * 1. Squared shares p² are Q30 (DECODE_SQUARE_BITS), rounded to nearest,
+ *    so they fit in 32 bits and sum to at most a hair over 1.0
+ * 2. Weights 1/e are Q16 (DECODE_WEIGHT_BITS), rounded to nearest and at
+ *    most DECODE_WEIGHT_MAX, so they fit in 32 bits and a sum of 26
+ *    products fits in 63
+ * 3. Scores are Q46 (DECODE_SCORE_BITS) in an int64_t, the constant
+ *    included, so any two scores compare exactly; both inputs are exact to
+ *    about 1 part in 10^5 or better, so the chi-squared values agree with
+ *    the floating-point formula to about six significant digits
+ */
+
+#ifndef DECODE_FIXED_H
+#define DECODE_FIXED_H
+
+#include <stdint.h>   /* For fixed-width integers */
+
+#define DECODE_SQUARE_BITS 30
+#define DECODE_WEIGHT_BITS 16
+#define DECODE_SCORE_BITS (DECODE_SQUARE_BITS + DECODE_WEIGHT_BITS)
+
+/* Entries per weight row and per squares array: 26, then zeros up to a multiple of 4 */
+#define DECODE_ROW 28
+
+/* Largest weight; letters rarer than about 1 in 65536 are scored as that rare */
+#define DECODE_WEIGHT_MAX ((uint32_t) 0xFFFFFFFF)
+
+/* Weight of a letter with expected share e (0 < e <= 1) */
+static inline uint32_t decode_fixed_weight(double e) {
+    double w = (double) (1 << DECODE_WEIGHT_BITS) / e + 0.5;
+    return w >= (double) DECODE_WEIGHT_MAX ? DECODE_WEIGHT_MAX : (uint32_t) w;
+}
+
+/* Constant term Σ e - 2 of a language, in score units */
+static inline int64_t decode_fixed_bias(const double expected[26]) {
+    double sum = -2;
+    for (int c = 0; c < 26; c++) {
+        sum += expected[c];
+    }
+    double scaled = sum * (double) ((int64_t) 1 << DECODE_SCORE_BITS);
+    return (int64_t) (scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+#endif
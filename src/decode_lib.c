@@ -6,10 +6,21 @@
  * letter frequencies in the encoded text with known English letter frequencies.
  * 
  * Key Implementation Details:
- * 1. English Letter Frequencies: Stored in EF[] array (percentages of each letter in English text)
+ * 1. English Letter Frequencies: Stored in the read-only EF[] array (share of each letter in English text);
+ *    the library has no writable global state, so contexts can be shared between threads (see caesar.h)
  * 2. Chi-Squared Analysis: Used to find the most likely shift value
  * 3. Character Encoding: Handles both uppercase and lowercase letters
- * 4. Memory Management: Properly allocates and frees frequency tables
+ * 4. Memory Management: Scoring works on caller-provided histograms, so the
+ *    hot path does not allocate
+ * 5. Contexts: A decode_ctx holds the expected frequencies and a translation
+ *    table for every shift, built once and reused for every call
+ * 6. Several Languages: One context per language profile; all (language,
+ *    shift) scores of a histogram come from one matrix product
+ * 7. Fixed Point: Scores are integers (see decode_fixed.h) from a
+ *    histogram's squared letter shares and each context's 26 rotated weight
+ *    tables, so they are the same on every compiler, optimisation level
+ *    and CPU, and ties are decided exactly. English's tables are generated
+ *    at build time by mkweights (english_weights.h)
  * 
  * The chi-squared test works by:
  * 1. Taking a guess at the shift value
@@ -25,24 +36,98 @@
 #include <string.h>   /* For string operations */
 #include <ctype.h>    /* For character type checking */
 #include <stdio.h>    /* For debugging output */
+#include <pthread.h>  /* For pthread_once() - builds the default context */
+#include "decode_fixed.h"     /* For the fixed-point score format */
+#include "english.h"          /* For ENGLISH_FREQUENCIES */
+#include "english_weights.h"  /* Generated: English's rotated weight tables */
 
-/* 
- * English letter frequencies (as percentages) from most to least common:
- * E(12.7%), T(9.1%), A(8.2%), O(7.7%), I(7.0%), N(6.7%), S(6.3%), H(6.1%),
- * R(6.0%), D(4.3%), L(4.0%), C(2.8%), U(2.8%), M(2.4%), W(2.4%), F(2.2%),
- * G(2.0%), Y(2.0%), P(1.9%), B(1.5%), V(1.0%), K(0.8%), J(0.2%), X(0.2%),
- * Q(0.1%), Z(0.1%)
+#if defined(__x86_64__) && defined(__GNUC__)
+#define DECODE_HAVE_AVX2 1
+#endif
+
+/* English letter frequencies (see english.h) */
+static const double EF[26] = ENGLISH_FREQUENCIES;
+
+/*
+ * Analysis context
+ * 
+ * expected holds the letter frequencies the text is compared against and
+ * shift_table[s][b] is the byte b encoded with shift s, so applying a shift
+ * is a single table lookup per byte. weights[s][c] is the fixed-point
+ * weight 1 / expected[c - s], so the score of shift s is the dot product
+ * of row s with the text's squared letter shares.
  */
-double EF[26] = {
-    0.08167,  /* A */ 0.01492,  /* B */ 0.02782,  /* C */ 0.04253,  /* D */
-    0.12702,  /* E */ 0.02228,  /* F */ 0.02015,  /* G */ 0.06094,  /* H */
-    0.06966,  /* I */ 0.00153,  /* J */ 0.00772,  /* K */ 0.04025,  /* L */
-    0.02406,  /* M */ 0.06749,  /* N */ 0.07707,  /* O */ 0.01929,  /* P */
-    0.00095,  /* Q */ 0.05987,  /* R */ 0.06327,  /* S */ 0.09056,  /* T */
-    0.02758,  /* U */ 0.00978,  /* V */ 0.02360,  /* W */ 0.00150,  /* X */
-    0.01974,  /* Y */ 0.00074   /* Z */
+struct decode_ctx {
+    double expected[26];                 /* Expected frequency of each letter */
+    uint32_t weights[26][DECODE_ROW];    /* Weights rotated for every shift, then zeros (see decode_fixed.h) */
+    int64_t bias;                        /* Sum of expected - 2, in score units */
+    unsigned char shift_table[26][256];  /* Byte translation for every shift */
 };
 
+/* Context used by the older string functions */
+static decode_ctx default_ctx;
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+
+/* A best score of this or more (0.5) means the text fits no language */
+#define SCORE_LIMIT ((int64_t) 1 << (DECODE_SCORE_BITS - 1))
+
+/* Score of a histogram without letters, which fits nothing */
+#define SCORE_NONE INT64_MAX
+
+/* Whether the scores use the AVX2 build of the kernel (decided on first use) */
+static int use_avx2 = 0;
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+/*
+ * decode_ctx_init
+ * 
+ * Purpose: Fills in a context for a language
+ * 
+ * Parameters:
+ *   expected - The language's letter frequencies (EF[] for English)
+ *   weights  - Its rotated weight tables, or NULL to compute them
+ *   bias     - Its constant term (ignored if weights is NULL)
+ * 
+ * How it works:
+ * 1. Copies the letter frequencies and the weight tables (English's come
+ *    from english_weights.h; a profile's are computed with the same
+ *    functions, from decode_fixed.h)
+ * 2. Builds the translation table for each shift from encode(), so the
+ *    table and the single-character function always agree
+ */
+static void decode_ctx_init(decode_ctx * ctx, const double expected[26],
+                            const uint32_t weights[26][DECODE_ROW], int64_t bias) {
+    memcpy(ctx->expected, expected, sizeof(ctx->expected));
+    if (weights != NULL) {
+        memcpy(ctx->weights, weights, sizeof(ctx->weights));
+        ctx->bias = bias;
+    } else {
+        for (int shift = 0; shift < 26; shift++) {
+            for (int ch = 0; ch < DECODE_ROW; ch++) {
+                ctx->weights[shift][ch] = ch < 26 ? decode_fixed_weight(expected[(ch - shift + 26) % 26]) : 0;
+            }
+        }
+        ctx->bias = decode_fixed_bias(expected);
+    }
+    for (int shift = 0; shift < 26; shift++) {
+        for (int b = 0; b < 256; b++) {
+            unsigned char c = (unsigned char) b;
+            int letter = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z');
+            ctx->shift_table[shift][b] = letter ? (unsigned char) encode((char) c, shift) : c;
+        }
+    }
+}
+
+static void default_ctx_init(void) {
+    decode_ctx_init(&default_ctx, EF, english_weights, ENGLISH_BIAS);
+}
+
+/* Returns the shared English context, building it on first use */
+static const decode_ctx * get_default_ctx(void) {
+    pthread_once(&default_once, default_ctx_init);
+    return &default_ctx;
+}
+
 /*
  * encode
  * 
@@ -57,7 +142,7 @@ double EF[26] = {
  * 
  * How it works:
  * 1. Convert character to uppercase for processing
- * 2. If it's a letter:
+ * 2. If it's a letter (by freq_class[], so bytes above 0x7F never are):
  *    - If shift doesn't wrap around alphabet, simply add shift
  *    - If shift wraps around, calculate new position from start of alphabet
  * 3. Preserve case (uppercase/lowercase) of original character
@@ -69,10 +154,11 @@ double EF[26] = {
  *   encode('!', 3) returns '!'
  */
 char encode(char c, int shift) {
-    int l = toupper(c);  /* Convert to uppercase for processing */
+    unsigned char u = (unsigned char) c;
+    int l = (freq_class[u] & FREQ_LOWER) ? u - 'a' + 'A' : u;  /* Convert to uppercase for processing */
     int tot = shift;     /* Total shift to apply */
     
-    if (isalpha(l)) {    /* Only process letters */
+    if (freq_class[u] & FREQ_ALPHA) {    /* Only process letters, whatever the locale */
         if (l + shift <= 'Z') {
             /* Simple case: shift doesn't wrap around alphabet */
             c += shift;
@@ -101,14 +187,13 @@ char encode(char c, int shift) {
  *   shift  - How many positions to shift each letter
  * 
  * How it works:
- * 1. Process each character in the string
- * 2. Apply encode() function to each character
+ * 1. Measure the string once
+ * 2. Translate every byte through the shared context's table for this shift
+ *    (the same result as applying encode() to each character)
  * 3. Modify string in place
  */
 void encode_string(char * string, int shift) {
-    for (int i = 0; i < strlen(string); i++) {
-        string[i] = encode(string[i], shift);
-    }
+    decode_apply(get_default_ctx(), string, strlen(string), shift);
 }
 
 /*
@@ -183,12 +268,229 @@ int to_decode(int shift) {
  *   Chi-squared value (lower is better match)
  * 
  * How it works:
- * 1. Get letter count and frequency table for input text
- * 2. For each letter in alphabet:
- *    - Calculate expected frequency (n * EF[letter])
- *    - Calculate observed frequency after applying shift
- *    - Add to sum: ((expected - observed)²) / (n * expected)
- * 3. Return final chi-squared value
+ *   Builds a histogram of the text on the stack and scores it with
+ *   decode_chi_sq() using the shared English context
+ */
+double chi_sq(char * c, int shift) {
+    freq_hist hist;
+
+    freq_hist_clear(&hist);
+    freq_hist_update(&hist, c, strlen(c));
+    return decode_chi_sq(get_default_ctx(), &hist, shift);
+}
+
+/*
+ * encode_shift
+ * 
+ * Purpose: Determines most likely shift used to encode the text
+ * 
+ * Parameters:
+ *   c - The encoded text to analyze
+ * 
+ * Returns:
+ *   The most likely shift value (0-25)
+ * 
+ * How it works:
+ *   Builds one histogram of the text and hands it to decode_best_shift(),
+ *   so the text is scanned once rather than once per shift
+ */
+int encode_shift(char * c) {
+    freq_hist hist;
+
+    freq_hist_clear(&hist);
+    freq_hist_update(&hist, c, strlen(c));
+    return decode_best_shift(get_default_ctx(), &hist);
+}
+
+/*
+ * decode_ctx_new
+ * 
+ * Purpose: Creates a reusable analysis context for English text
+ * 
+ * Returns:
+ *   A new context (free with decode_ctx_free), or NULL if out of memory
+ */
+decode_ctx * decode_ctx_new(void) {
+    decode_ctx * ctx = malloc(sizeof(decode_ctx));
+    if (ctx != NULL) {
+        decode_ctx_init(ctx, EF, english_weights, ENGLISH_BIAS);
+    }
+    return ctx;
+}
+
+/*
+ * decode_ctx_new_profile
+ * 
+ * Purpose: Creates a context for another language
+ * 
+ * Parameters:
+ *   expected - Frequency of each letter in the language (all positive,
+ *              summing to 1; see profile.h)
+ * 
+ * Returns:
+ *   A new context (free with decode_ctx_free), or NULL if out of memory
+ */
+decode_ctx * decode_ctx_new_profile(const double expected[26]) {
+    decode_ctx * ctx = malloc(sizeof(decode_ctx));
+    if (ctx != NULL) {
+        decode_ctx_init(ctx, expected, NULL, 0);
+    }
+    return ctx;
+}
+
+/*
+ * decode_ctx_free
+ * 
+ * Purpose: Releases a context created by decode_ctx_new
+ */
+void decode_ctx_free(decode_ctx * ctx) {
+    free(ctx);
+}
+
+/*
+ * decode_ctx_expected
+ *
+ * Purpose: Gives read access to a context's expected frequencies (used to
+ * tell results for different profiles apart)
+ */
+const double * decode_ctx_expected(const decode_ctx * ctx) {
+    return ctx->expected;
+}
+
+/*
+ * fixed_squares
+ * 
+ * Purpose: Squares of a histogram's letter shares, in fixed point
+ * 
+ * Returns:
+ *   1, or 0 if the histogram has no letters
+ * 
+ * How it works:
+ *   Counts (and the total) are first halved until the total fits in 32
+ *   bits. One division gives the reciprocal 2^63 / total; each share is
+ *   then count * reciprocal / 2^32, in Q31, and its square is rounded to
+ *   Q30
+ */
+static int fixed_squares(const freq_hist * hist, uint32_t squares[DECODE_ROW]) {
+    uint64_t n = hist->letters;
+    int drop = 0;
+
+    if (n == 0) {
+        return 0;
+    }
+    while ((n >> drop) >> 32 != 0) {
+        drop++;
+    }
+    uint64_t reciprocal = ((uint64_t) 1 << 63) / (n >> drop);
+    for (int ch = 0; ch < 26; ch++) {
+        uint64_t share = ((hist->counts[ch] >> drop) * reciprocal + ((uint64_t) 1 << 31)) >> 32;
+        squares[ch] = (uint32_t) ((share * share + ((uint64_t) 1 << 31)) >> 32);
+    }
+    for (int ch = 26; ch < DECODE_ROW; ch++) {
+        squares[ch] = 0;
+    }
+    return 1;
+}
+
+/*
+ * fixed_scores
+ * 
+ * Purpose: The 26 scores of one language, the kernel every entry point uses
+ * 
+ * How it works:
+ *   Row s of the context's weights times the squared shares, plus the
+ *   constant: 26 x 28 widening 32-bit multiplies into 64-bit sums, with no
+ *   branches or floating point. The rows are padded to a multiple of four
+ *   so compilers vectorise the inner loop without a remainder; integer
+ *   sums are exact, so every compiled form gives the same bits
+ */
+static inline __attribute__((always_inline))
+void fixed_scores_body(const decode_ctx * ctx, const uint32_t squares[DECODE_ROW], int64_t scores[26]) {
+    for (int shift = 0; shift < 26; shift++) {
+        const uint32_t * weights = ctx->weights[shift];
+        uint64_t sum = 0;
+        for (int ch = 0; ch < DECODE_ROW; ch++) {
+            sum += (uint64_t) squares[ch] * weights[ch];
+        }
+        scores[shift] = (int64_t) sum + ctx->bias;
+    }
+}
+
+static void fixed_scores_generic(const decode_ctx * ctx, const uint32_t squares[DECODE_ROW], int64_t scores[26]) {
+    fixed_scores_body(ctx, squares, scores);
+}
+
+#ifdef DECODE_HAVE_AVX2
+/* The same loop compiled for AVX2 (four 32 x 32 -> 64-bit multiplies per instruction) */
+__attribute__((target("avx2")))
+static void fixed_scores_avx2(const decode_ctx * ctx, const uint32_t squares[DECODE_ROW], int64_t scores[26]) {
+    fixed_scores_body(ctx, squares, scores);
+}
+#endif
+
+static void detect_kernel(void) {
+#ifdef DECODE_HAVE_AVX2
+    __builtin_cpu_init();
+    use_avx2 = __builtin_cpu_supports("avx2");
+#endif
+}
+
+/* Scores one language with the widest build of the kernel the CPU supports */
+static void fixed_scores(const decode_ctx * ctx, const uint32_t squares[DECODE_ROW], int64_t scores[26]) {
+    pthread_once(&kernel_once, detect_kernel);
+#ifdef DECODE_HAVE_AVX2
+    if (use_avx2) {
+        fixed_scores_avx2(ctx, squares, scores);
+        return;
+    }
+#endif
+    fixed_scores_generic(ctx, squares, scores);
+}
+
+/* Converts a score to the chi-squared value it stands for (NaN if the text has no letters) */
+static double score_value(int64_t score) {
+    if (score == SCORE_NONE) {
+        return NAN;
+    }
+    return (double) score / (double) ((int64_t) 1 << DECODE_SCORE_BITS);
+}
+
+/*
+ * decode_scores_fixed
+ * 
+ * Purpose: The chi-squared value of a histogram for every shift, as exact
+ * fixed-point integers (see decode_fixed.h)
+ * 
+ * Parameters:
+ *   ctx    - Analysis context
+ *   hist   - Letter histogram of the text
+ *   scores - Receives one score per shift; all are INT64_MAX if the
+ *            histogram has no letters
+ */
+void decode_scores_fixed(const decode_ctx * ctx, const freq_hist * hist, int64_t scores[26]) {
+    uint32_t squares[DECODE_ROW];
+
+    if (!fixed_squares(hist, squares)) {
+        for (int shift = 0; shift < 26; shift++) {
+            scores[shift] = SCORE_NONE;
+        }
+        return;
+    }
+    fixed_scores(ctx, squares, scores);
+}
+
+/*
+ * decode_chi_sq
+ * 
+ * Purpose: Calculates the chi-squared value of a histogram for one shift
+ * 
+ * Parameters:
+ *   ctx   - Analysis context
+ *   hist  - Letter histogram of the text
+ *   shift - The shift value to test
+ * 
+ * Returns:
+ *   Chi-squared value (lower is better match)
  * 
  * The formula used is:
  * χ² = Σ((n * EF[c] - text_freq[encode(c,shift)])²) / (n * n * EF[c])
@@ -196,67 +498,226 @@ int to_decode(int shift) {
  * - n is total letter count
  * - EF[c] is expected frequency of letter c
  * - text_freq[encode(c,shift)] is observed frequency after shift
+ * which is computed in its expanded, fixed-point form (see
+ * decode_scores_matrix)
  */
-double chi_sq(char * c, int shift) {
-    double sum = 0;  /* Running sum for chi-squared calculation */
-    
-    /* Get total letter count and frequency table */
-    int n = letter_count(c);
-    int * text_freq = frequency_table(c);
-    if (text_freq == NULL) {
-        return -1;  /* Error case */
+double decode_chi_sq(const decode_ctx * ctx, const freq_hist * hist, int shift) {
+    int64_t scores[26];
+
+    decode_scores_fixed(ctx, hist, scores);
+    return score_value(scores[((shift % 26) + 26) % 26]);
+}
+
+/*
+ * decode_scores
+ * 
+ * Purpose: Calculates the chi-squared value of a histogram for every shift
+ * 
+ * Parameters:
+ *   ctx    - Analysis context
+ *   hist   - Letter histogram of the text
+ *   scores - Caller-provided array that receives one value per shift
+ */
+void decode_scores(const decode_ctx * ctx, const freq_hist * hist, double scores[26]) {
+    int64_t fixed[26];
+
+    decode_scores_fixed(ctx, hist, fixed);
+    for (int shift = 0; shift < 26; shift++) {
+        scores[shift] = score_value(fixed[shift]);
     }
-    
-    /* Calculate chi-squared value for each letter */
-    for (int ch = 0; ch < 26; ch++) {
-        double expected = n * EF[offset('a' + ch)];
-        double observed = text_freq[offset(encode('a' + ch, shift))];
-        double diff = expected - observed;
-        sum += (diff * diff) / (n * n * EF[offset('a' + ch)]);
+}
+
+/*
+ * best_pair
+ * 
+ * Purpose: Picks the lowest of count * 26 scores, earlier pairs winning
+ * ties. A lowest score of 0.5 or more means no language fits, and 0 is
+ * returned with *language set to -1.
+ * 
+ * Note: The scores are integers, so a tie is a true tie and is decided the
+ * same way by every build.
+ */
+static int best_pair(const int64_t * scores, int count, int * language) {
+    int best = 0;        /* Pair (language * 26 + shift) with the lowest score */
+
+    for (int i = 1; i < count * 26; i++) {
+        if (scores[i] < scores[best]) {
+            best = i;
+        }
     }
-    
-    free(text_freq);  /* Clean up frequency table */
-    return sum;
+
+    if (scores[best] >= SCORE_LIMIT) {
+        *language = -1;
+        return 0;
+    }
+    *language = best / 26;
+    return best % 26;
 }
 
 /*
- * encode_shift
+ * decode_best_shift
  * 
  * Purpose: Determines most likely shift used to encode the text
  * 
  * Parameters:
- *   c - The encoded text to analyze
+ *   ctx  - Analysis context
+ *   hist - Letter histogram of the encoded text
  * 
  * Returns:
  *   The most likely shift value (0-25)
  * 
  * How it works:
- * 1. Try each possible shift (0-25)
- * 2. Calculate chi-squared value for each shift
- * 3. Remember the shift that gave the lowest chi-squared value
- * 4. Return that shift
+ * 1. Score all 26 shifts from the one histogram
+ * 2. Remember the shift that gave the lowest score (the first, on a tie)
+ * 3. Return that shift
  * 
  * Note: If the lowest chi-squared value is too high (>= 0.5),
  * the text might not be English, and 0 is returned.
  */
-int encode_shift(char * c) {
-    float value = -1;    /* Best chi-squared value found so far */
-    float chi = 0;       /* Current chi-squared value */
-    int num_shift = 0;   /* Shift that gave best value */
-    
-    /* Try each possible shift */
-    for (int i = 0; i < 26; i++) {
-        chi = chi_sq(c, i);
-        if (value == -1 || value > chi) {
-            value = chi;
-            num_shift = i;
+int decode_best_shift(const decode_ctx * ctx, const freq_hist * hist) {
+    int64_t scores[26];   /* Score of every shift */
+    int language;
+
+    decode_scores_fixed(ctx, hist, scores);
+    return best_pair(scores, 1, &language);
+}
+
+/*
+ * scores_matrix
+ * 
+ * Purpose: Fixed-point scores of one histogram for count languages
+ */
+static void scores_matrix(decode_ctx * const * ctxs, int count,
+                          const freq_hist * hist, int64_t * scores) {
+    uint32_t squares[DECODE_ROW];
+
+    if (!fixed_squares(hist, squares)) {
+        for (int i = 0; i < count * 26; i++) {
+            scores[i] = SCORE_NONE;
         }
+        return;
     }
-    
-    /* If chi-squared value is too high, text might not be English */
-    if (value >= 0.5) {
-        return 0;
+    for (int l = 0; l < count; l++) {
+        fixed_scores(ctxs[l], squares, scores + l * 26);
     }
-    
-    return num_shift;
-}
\ No newline at end of file
+}
+
+/*
+ * decode_scores_matrix
+ * 
+ * Purpose: Calculates the chi-squared value of one histogram for every
+ * (language, shift) pair in one pass
+ * 
+ * Parameters:
+ *   ctxs   - One context per language
+ *   count  - Number of languages (at most DECODE_MAX_LANGUAGES)
+ *   hist   - Letter histogram of the text
+ *   scores - Caller-provided array of count * 26 values; the value for
+ *            language l and shift s goes to scores[l * 26 + s]
+ * 
+ * How it works:
+ *   With p[c] the observed share of letter c and e[c] the expected one,
+ *   the chi-squared sum expands to
+ *       Σ (e[c] - p[c+s])² / e[c] = Σ p[c+s]² / e[c] + Σ e[c] - 2
+ *   because p sums to 1. So the whole table is a matrix product: each
+ *   language's rotated weight rows (1/e, one row per shift) times p²,
+ *   which is computed once and shared by all languages, plus the
+ *   language's constant.
+ */
+void decode_scores_matrix(decode_ctx * const * ctxs, int count,
+                          const freq_hist * hist, double * scores) {
+    int64_t fixed[DECODE_MAX_LANGUAGES * 26];
+
+    if (count > DECODE_MAX_LANGUAGES) {
+        count = DECODE_MAX_LANGUAGES;
+    }
+    scores_matrix(ctxs, count, hist, fixed);
+    for (int i = 0; i < count * 26; i++) {
+        scores[i] = score_value(fixed[i]);
+    }
+}
+
+/*
+ * decode_best_language
+ * 
+ * Purpose: Determines the most likely language and shift of a text
+ * 
+ * Parameters:
+ *   ctxs     - One context per language
+ *   count    - Number of languages (at most DECODE_MAX_LANGUAGES)
+ *   hist     - Letter histogram of the encoded text
+ *   language - Receives the index of the best language, or -1 if no
+ *              language fits
+ * 
+ * Returns:
+ *   The most likely shift value (0-25)
+ */
+int decode_best_language(decode_ctx * const * ctxs, int count,
+                         const freq_hist * hist, int * language) {
+    int64_t scores[DECODE_MAX_LANGUAGES * 26];
+
+    if (count > DECODE_MAX_LANGUAGES) {
+        count = DECODE_MAX_LANGUAGES;
+    }
+    scores_matrix(ctxs, count, hist, scores);
+    return best_pair(scores, count, language);
+}
+
+/*
+ * decode_best_languages
+ * 
+ * Purpose: decode_best_language() for a batch of histograms (e.g. one per
+ * message of a stream)
+ * 
+ * Parameters:
+ *   ctxs, count - Languages, as for decode_best_language
+ *   hists       - n histograms
+ *   shifts      - Receives the most likely shift of each histogram
+ *   languages   - Receives the best language of each histogram (or -1);
+ *                 may be NULL
+ * 
+ * How it works:
+ *   The weights stay in cache from one histogram to the next, so a short
+ *   message costs little more than its 26 x 26 multiply-adds
+ */
+void decode_best_languages(decode_ctx * const * ctxs, int count,
+                           const freq_hist * hists, size_t n,
+                           int * shifts, int * languages) {
+    int64_t scores[DECODE_MAX_LANGUAGES * 26];
+
+    if (count > DECODE_MAX_LANGUAGES) {
+        count = DECODE_MAX_LANGUAGES;
+    }
+    for (size_t i = 0; i < n; i++) {
+        int language;
+        scores_matrix(ctxs, count, &hists[i], scores);
+        shifts[i] = best_pair(scores, count, &language);
+        if (languages != NULL) {
+            languages[i] = language;
+        }
+    }
+}
+
+/*
+ * decode_apply
+ * 
+ * Purpose: Applies a Caesar shift to a piece of text in place
+ * 
+ * Parameters:
+ *   ctx    - Analysis context
+ *   text   - Text to change; it does not need to be NUL-terminated
+ *   length - Number of bytes to change
+ *   shift  - Shift to apply (0-25)
+ * 
+ * How it works:
+ *   Each byte is replaced by its entry in the context's table for the
+ *   shift; letters move, everything else maps to itself
+ */
+void decode_apply(const decode_ctx * ctx, char * text, size_t length, int shift) {
+    const unsigned char * table = ctx->shift_table[((shift % 26) + 26) % 26];
+    unsigned char * p = (unsigned char *) text;
+
+    for (size_t i = 0; i < length; i++) {
+        p[i] = table[p[i]];
+    }
+}
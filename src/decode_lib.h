@@ -17,6 +17,18 @@
  * 4. chi_sq: Calculates the chi-squared value for a given shift
  * 5. encode_shift: Determines the most likely shift used to encode the text
  * 6. to_decode: Converts an encoding shift to a decoding shift
+ * 7. decode_ctx_*: An opaque, reusable context holding the expected letter
+ *    frequencies and precomputed shift tables. Its scoring and transform
+ *    functions work on (pointer, length) views and caller-provided
+ *    histograms, and never allocate
+ * 8. decode_scores_matrix, decode_best_language: Score several languages
+ *    (one context each, see profile.h) against one histogram at once
+ * 9. decode_scores_fixed: The scores as the fixed-point integers every
+ *    other function is computed from (see decode_fixed.h), identical on
+ *    every build
+ * 
+ * The older functions (encode_string, chi_sq, encode_shift) are thin
+ * wrappers over the context functions.
  * 
  * These functions work together to:
  * - Analyze encoded text using statistical methods
@@ -25,12 +37,16 @@
  * - Handle both encoding and decoding operations
  */
 
+#ifndef DECODE_LIB_H
+#define DECODE_LIB_H
+
 #include <stdio.h>    /* For file operations */
 #include <string.h>   /* For string manipulation */
 #include <ctype.h>    /* For character type checking */
 #include <stdbool.h>  /* For boolean type */
 #include "frequency_table.h"  /* For letter frequency analysis */
 #include <stdlib.h>   /* For memory management */
+#include <stdint.h>   /* For int64_t */
 
 /* Encodes a single character using Caesar cipher with given shift */
 char encode(char c, int shift);
@@ -49,3 +65,51 @@ int encode_shift(char * c);
 
 /* Converts encoding shift to decoding shift (e.g., shift 3 -> shift 23) */
 int to_decode(int shift);
+
+/* Reusable analysis context; its layout is private to decode_lib.c */
+typedef struct decode_ctx decode_ctx;
+
+/* Most languages decode_best_language compares at once */
+#define DECODE_MAX_LANGUAGES 32
+
+/* Creates a context for English text (the only heap allocation of the API) */
+decode_ctx * decode_ctx_new(void);
+
+/* Creates a context for a language with the given letter frequencies */
+decode_ctx * decode_ctx_new_profile(const double expected[26]);
+
+/* Releases a context created by decode_ctx_new */
+void decode_ctx_free(decode_ctx * ctx);
+
+/* Expected frequency of each letter used by a context */
+const double * decode_ctx_expected(const decode_ctx * ctx);
+
+/* Chi-squared value of a histogram for one shift (lower is better) */
+double decode_chi_sq(const decode_ctx * ctx, const freq_hist * hist, int shift);
+
+/* Fixed-point chi-squared values for all 26 shifts (see decode_fixed.h; INT64_MAX each if there are no letters) */
+void decode_scores_fixed(const decode_ctx * ctx, const freq_hist * hist, int64_t scores[26]);
+
+/* Chi-squared values of a histogram for all 26 shifts */
+void decode_scores(const decode_ctx * ctx, const freq_hist * hist, double scores[26]);
+
+/* Most likely encoding shift for a histogram (same rules as encode_shift) */
+int decode_best_shift(const decode_ctx * ctx, const freq_hist * hist);
+
+/* Chi-squared values for every (language, shift) pair: scores[language * 26 + shift] */
+void decode_scores_matrix(decode_ctx * const * ctxs, int count,
+                          const freq_hist * hist, double * scores);
+
+/* Most likely shift over several languages; *language gets the best one's index, or -1 if none fits */
+int decode_best_language(decode_ctx * const * ctxs, int count,
+                         const freq_hist * hist, int * language);
+
+/* decode_best_language for n histograms at once; languages may be NULL */
+void decode_best_languages(decode_ctx * const * ctxs, int count,
+                           const freq_hist * hists, size_t n,
+                           int * shifts, int * languages);
+
+/* Applies a Caesar shift in place to length bytes of text */
+void decode_apply(const decode_ctx * ctx, char * text, size_t length, int shift);
+
+#endif
@@ -0,0 +1,33 @@
+/*
+ * dict_hash.h
+ *
+ * This header file holds the hash function of the embedded dictionary
+ * (see dictionary.h). It is shared by the generator, mkdict.c, which picks
+ * the displacement of every bucket at build time, and by the lookup in
+ * dictionary_lib.c, so the two always agree.
+ */
+
+#ifndef DICT_HASH_H
+#define DICT_HASH_H
+
+#include <stddef.h>   /* For size_t */
+#include <stdint.h>   /* For fixed-width integers */
+
+/*
+ * FNV-1a over the bytes of a word, started from a seed (the bucket's
+ * displacement, or 0 to choose the bucket) and finished with a
+ * multiply-xorshift so that the low bits depend on every byte
+ */
+static inline uint32_t dict_hash(const char * word, size_t length, uint32_t seed) {
+    uint64_t h = 0xcbf29ce484222325ULL ^ ((uint64_t) seed * 0x9e3779b97f4a7c15ULL);
+    for (size_t i = 0; i < length; i++) {
+        h ^= (unsigned char) word[i];
+        h *= 0x100000001b3ULL;
+    }
+    h ^= h >> 29;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 32;
+    return (uint32_t) h;
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * dictionary.h
+ *
+ * This header file defines the interface to the embedded English
+ * dictionary and to candidate ranking for decode --top.
+ *
+ * Letter frequencies alone can rank two shifts almost equally on a short
+ * or unusual text. The dictionary settles it: a handful of words is taken
+ * from the text, decoded with each candidate shift and looked up, and a
+ * shift that turns them into English words is almost certainly right.
+ *
+ * Key Features:
+ * 1. Embedded: The word list (words.txt) is turned into a perfect hash
+ *    table by mkdict at build time and compiled in, so there is
+ *    nothing to load or build at run time and a lookup is one hash, one
+ *    table read and one comparison
+ * 2. Bounded: Only DICT_SAMPLE_WORDS words are taken, from evenly spaced
+ *    points of the text, and at most DICT_SAMPLE_SCAN bytes are looked at
+ *    for each, so verifying a candidate costs the same for any text size
+ */
+
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+#include <stddef.h>   /* For size_t */
+
+/* Words taken from the text, and bytes looked at to find each */
+#define DICT_SAMPLE_WORDS 64
+#define DICT_SAMPLE_SCAN 64
+
+/* Words this long or longer are not in the dictionary and are not sampled */
+#define DICT_MAX_WORD 16
+
+/* Words taken from a text for verification (letters only, as in the text) */
+typedef struct dict_sample {
+    int count;
+    unsigned char lengths[DICT_SAMPLE_WORDS];
+    char words[DICT_SAMPLE_WORDS][DICT_MAX_WORD];
+} dict_sample;
+
+/* One candidate shift of decode --top */
+typedef struct shift_candidate {
+    int shift;          /* Encoding shift */
+    double chi;         /* Chi-squared value of the shift */
+    int hits;           /* Sampled words found in the dictionary once decoded */
+    int words;          /* Sampled words */
+    double score;       /* Combined score; higher is better */
+} shift_candidate;
+
+/* Returns non-zero if the lower-case word is in the dictionary */
+int dict_contains(const char * word, size_t length);
+
+/* Returns the number of words in the dictionary */
+size_t dict_size(void);
+
+/* Takes up to DICT_SAMPLE_WORDS words of 2 or more letters from text */
+void dict_sample_words(const char * text, size_t length, dict_sample * sample);
+
+/* Returns how many sampled words are in the dictionary once decoded with shift */
+int dict_count_hits(const dict_sample * sample, int decode_shift);
+
+/*
+ * Keeps the k (at most 26) shifts with the lowest chi-squared values,
+ * verifies each against a sample of the text and sorts them by combined
+ * score, best first, into top. Returns the number of candidates kept.
+ */
+int dict_rank_shifts(const double scores[26], const char * text, size_t length,
+                     int k, shift_candidate * top);
+
+#endif
@@ -0,0 +1,165 @@
+/*
+ * dictionary_lib.c
+ *
+ * This file implements the embedded dictionary and candidate ranking,
+ * declared in dictionary.h.
+ *
+ * Key Implementation Details:
+ * 1. Table: dict_table.h is generated from words.txt by mkdict at build
+ *    time (see mkdict.c). A word's bucket gives a displacement, and the
+ *    displaced hash gives the one slot the word can be in
+ * 2. Sampling: The text is probed at DICT_SAMPLE_WORDS evenly spaced
+ *    offsets; from each, the partial word under the probe is skipped and the
+ *    next whole word is taken, looking at no more than DICT_SAMPLE_SCAN
+ *    bytes plus the word itself
+ * 3. Combined score: The share of sampled words found in the dictionary
+ *    minus chi / (1 + chi), which maps any chi-squared value into [0, 1) so
+ *    that neither term can swamp the other. A right shift typically finds
+ *    over half its words, a wrong one almost none, so the words decide
+ *    whenever the sample has any; chi-squared breaks ties and alone ranks
+ *    texts without words
+ */
+
+#include "dictionary.h"
+#include "dict_hash.h"     /* For dict_hash() */
+#include <stdint.h>        /* For fixed-width integers */
+#include <string.h>        /* For memcmp() */
+#include "dict_table.h"    /* Generated: the tables and DICT_WORDS */
+
+/* Letter index of a byte, or 26 or more for anything else */
+static unsigned int letter_of(unsigned char c) {
+    return (unsigned int) ((c | 0x20) - 'a');
+}
+
+int dict_contains(const char * word, size_t length) {
+    if (length < 2 || length >= DICT_MAX_WORD) {
+        return 0;
+    }
+    unsigned int bucket = dict_hash(word, length, 0) % DICT_BUCKETS;
+    unsigned int slot = dict_hash(word, length, dict_displace[bucket]) % DICT_SLOTS;
+    return dict_lengths[slot] == length && memcmp(dict_pool + dict_offsets[slot], word, length) == 0;
+}
+
+size_t dict_size(void) {
+    return DICT_WORDS;
+}
+
+/*
+ * dict_sample_words
+ *
+ * Purpose: Takes a bounded sample of words from a text
+ *
+ * How it works:
+ *   Probe p starts at p / DICT_SAMPLE_WORDS of the way through the text (or
+ *   after the previous word, if that is further on). The rest of any word
+ *   under the probe is skipped, then any non-letters, and the word that
+ *   follows is kept if it has 2 to DICT_MAX_WORD - 1 letters. Letters are
+ *   kept lower-case.
+ */
+void dict_sample_words(const char * text, size_t length, dict_sample * sample) {
+    const unsigned char * p = (const unsigned char *) text;
+    size_t next = 0;
+    sample->count = 0;
+    for (int probe = 0; probe < DICT_SAMPLE_WORDS && next < length; probe++) {
+        size_t i = length / DICT_SAMPLE_WORDS * probe;
+        if (i < next) {
+            i = next;
+        }
+        size_t limit = length - i > DICT_SAMPLE_SCAN ? i + DICT_SAMPLE_SCAN : length;
+        if (i > 0 && letter_of(p[i - 1]) < 26) {
+            while (i < limit && letter_of(p[i]) < 26) {
+                i++;
+            }
+        }
+        while (i < limit && letter_of(p[i]) >= 26) {
+            i++;
+        }
+        size_t start = i;
+        while (i < length && i - start < DICT_MAX_WORD && letter_of(p[i]) < 26) {
+            i++;
+        }
+        next = i;
+        size_t word = i - start;
+        if (word < 2 || word >= DICT_MAX_WORD) {
+            continue;
+        }
+        for (size_t j = 0; j < word; j++) {
+            sample->words[sample->count][j] = (char) ('a' + letter_of(p[start + j]));
+        }
+        sample->lengths[sample->count] = (unsigned char) word;
+        sample->count++;
+    }
+}
+
+int dict_count_hits(const dict_sample * sample, int decode_shift) {
+    int shift = ((decode_shift % 26) + 26) % 26;
+    int hits = 0;
+    for (int w = 0; w < sample->count; w++) {
+        char word[DICT_MAX_WORD];
+        for (int j = 0; j < sample->lengths[w]; j++) {
+            word[j] = (char) ('a' + (sample->words[w][j] - 'a' + shift) % 26);
+        }
+        hits += dict_contains(word, sample->lengths[w]);
+    }
+    return hits;
+}
+
+/*
+ * dict_rank_shifts
+ *
+ * Purpose: Picks and verifies the best candidate shifts for decode --top
+ *
+ * Parameters:
+ *   scores - Chi-squared value of every encoding shift
+ *   text   - The encoded text and its length (only a sample is read)
+ *   k      - Candidates wanted (1 to 26)
+ *   top    - Receives the candidates, best first
+ *
+ * How it works:
+ * 1. Selects the k lowest chi-squared values (ties to the lower shift)
+ * 2. Samples the text once and counts dictionary hits for each candidate
+ * 3. Sorts by combined score; equal scores keep the chi-squared order
+ *
+ * Returns:
+ *   The number of candidates in top
+ */
+int dict_rank_shifts(const double scores[26], const char * text, size_t length,
+                     int k, shift_candidate * top) {
+    if (k > 26) {
+        k = 26;
+    }
+    int taken[26] = {0};
+    for (int c = 0; c < k; c++) {
+        int best = -1;
+        for (int s = 0; s < 26; s++) {
+            if (!taken[s] && (best < 0 || scores[s] < scores[best])) {
+                best = s;
+            }
+        }
+        taken[best] = 1;
+        top[c].shift = best;
+        top[c].chi = scores[best];
+    }
+
+    dict_sample sample;
+    dict_sample_words(text, length, &sample);
+    for (int c = 0; c < k; c++) {
+        /* Decoding shift, as for decode_apply() */
+        top[c].hits = dict_count_hits(&sample, top[c].shift == 0 ? 0 : 26 - top[c].shift);
+        top[c].words = sample.count;
+        double found = sample.count > 0 ? (double) top[c].hits / sample.count : 0;
+        top[c].score = found - top[c].chi / (1 + top[c].chi);
+    }
+
+    /* Insertion sort, stable, so equal scores stay in chi-squared order */
+    for (int c = 1; c < k; c++) {
+        shift_candidate moving = top[c];
+        int j = c;
+        while (j > 0 && top[j - 1].score < moving.score) {
+            top[j] = top[j - 1];
+            j--;
+        }
+        top[j] = moving;
+    }
+    return k < 0 ? 0 : k;
+}
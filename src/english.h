@@ -0,0 +1,29 @@
+/*
+ * english.h
+ *
+ * This header file holds the English letter frequencies, shared by
+ * decode_lib.c (EF[]) and by mkweights.c, which turns them into the
+ * fixed-point scoring tables at build time.
+ *
+ * English letter frequencies (as fractions) from most to least common:
+ * E(12.7%), T(9.1%), A(8.2%), O(7.7%), I(7.0%), N(6.7%), S(6.3%), H(6.1%),
+ * R(6.0%), D(4.3%), L(4.0%), C(2.8%), U(2.8%), M(2.4%), W(2.4%), F(2.2%),
+ * G(2.0%), Y(2.0%), P(1.9%), B(1.5%), V(1.0%), K(0.8%), J(0.2%), X(0.2%),
+ * Q(0.1%), Z(0.1%)
+ */
+
+#ifndef ENGLISH_H
+#define ENGLISH_H
+
+/* Initializer for a double[26], 'A' first */
+#define ENGLISH_FREQUENCIES { \
+    0.08167,  /* A */ 0.01492,  /* B */ 0.02782,  /* C */ 0.04253,  /* D */ \
+    0.12702,  /* E */ 0.02228,  /* F */ 0.02015,  /* G */ 0.06094,  /* H */ \
+    0.06966,  /* I */ 0.00153,  /* J */ 0.00772,  /* K */ 0.04025,  /* L */ \
+    0.02406,  /* M */ 0.06749,  /* N */ 0.07707,  /* O */ 0.01929,  /* P */ \
+    0.00095,  /* Q */ 0.05987,  /* R */ 0.06327,  /* S */ 0.09056,  /* T */ \
+    0.02758,  /* U */ 0.00978,  /* V */ 0.02360,  /* W */ 0.00150,  /* X */ \
+    0.01974,  /* Y */ 0.00074   /* Z */ \
+}
+
+#endif
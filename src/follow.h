@@ -0,0 +1,50 @@
+/*
+ * follow.h
+ *
+ * This header file defines the follow mode of decode and frequency_table
+ * (--follow): a growing file, such as a log, is watched and only the bytes
+ * appended since the last look are handed on, so keeping a result up to
+ * date costs time in proportion to what was added, not to the whole file.
+ *
+ * Key Features:
+ * 1. Waiting: inotify wakes the follower when the file is written; where
+ *    inotify is not available the file's size is polled instead
+ * 2. Incremental: The caller keeps its state (a histogram, a shift) and
+ *    receives each new piece once
+ * 3. Truncation: If the file shrinks (copytruncate log rotation), it is
+ *    read again from the start and the caller is told to start over
+ * 4. End: Following stops once the file has been deleted and everything
+ *    written before that has been handed on, or when the caller says so;
+ *    a file renamed away is still followed, like tail --follow=descriptor
+ */
+
+#ifndef FOLLOW_H
+#define FOLLOW_H
+
+#include <stddef.h>   /* For size_t */
+
+/* Default wait, in milliseconds, between checks of the file's size */
+#define FOLLOW_POLL_MS 250
+
+/* Letters a follower should see before it trusts a shift decision */
+#define FOLLOW_SETTLE_LETTERS 200
+
+/*
+ * Receives each newly appended piece of the file, in a buffer the function
+ * may change (decode decodes it in place) but must not keep. restart is
+ * non-zero for the first piece after the file was truncated, when
+ * everything before it should be forgotten. After the last piece of a
+ * burst of writes the function is called once more with data NULL and
+ * length 0. Returns 0 to keep following, or non-zero to stop.
+ */
+typedef int (*follow_fn)(char * data, size_t length, int restart, void * arg);
+
+/*
+ * Hands the current contents of path to fn and then everything appended
+ * to it, waiting up to poll_ms milliseconds between checks. Returns 0 when
+ * following ended normally, or -1 if the file could not be opened or read
+ * (a message is printed to stderr).
+ */
+int follow_file(const char * path, int poll_ms, follow_fn fn, void * arg);
+
+#endif
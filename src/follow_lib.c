@@ -0,0 +1,168 @@
+/*
+ * follow_lib.c
+ *
+ * This file implements the follow mode declared in follow.h.
+ *
+ * Key Implementation Details:
+ * 1. Reading: New bytes are read with pread() from the offset reached so
+ *    far, FOLLOW_READ bytes at a time, until the end of the file
+ * 2. Waiting: With inotify, poll() waits for a write, attribute, close,
+ *    move or delete event on the file, with poll_ms as a timeout so that a
+ *    missed event only delays the follower; without it, the follower
+ *    sleeps poll_ms and checks the size again
+ * 3. Checks: After catching up, fstat() tells whether the file shrank
+ *    (start again from offset 0) or has no links left (deleted: stop)
+ */
+
+#define _GNU_SOURCE   /* For pread() and inotify_init1() */
+
+#include "follow.h"
+#include <stdio.h>          /* For fprintf() */
+#include <stdlib.h>         /* For malloc() */
+#include <errno.h>          /* For EINTR */
+#include <fcntl.h>          /* For open() */
+#include <poll.h>           /* For poll() */
+#include <time.h>           /* For nanosleep() */
+#include <unistd.h>         /* For pread(), read() and close() */
+#include <sys/inotify.h>    /* For inotify */
+#include <sys/stat.h>       /* For fstat() */
+#include <sys/types.h>      /* For off_t */
+
+/* Bytes read and handed on at a time */
+#define FOLLOW_READ (1024 * 1024)
+
+/* Events that may mean the file changed */
+#define FOLLOW_EVENTS (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF)
+
+/*
+ * follow_wait
+ *
+ * Purpose: Waits until the file may have changed, or poll_ms has passed
+ *
+ * How it works:
+ *   With an inotify descriptor, polls it and drains whatever events are
+ *   queued (which event it was does not matter: the size is checked
+ *   next); otherwise just sleeps
+ */
+static void follow_wait(int watch_fd, int poll_ms) {
+    if (watch_fd >= 0) {
+        struct pollfd pfd;
+        pfd.fd = watch_fd;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, poll_ms) > 0) {
+            char events[4096];
+            while (read(watch_fd, events, sizeof(events)) > 0) {
+                /* Drained; the events themselves are not needed */
+            }
+        }
+        return;
+    }
+    struct timespec pause;
+    pause.tv_sec = poll_ms / 1000;
+    pause.tv_nsec = (long) (poll_ms % 1000) * 1000000L;
+    nanosleep(&pause, NULL);
+}
+
+/*
+ * follow_file
+ *
+ * Purpose: Follows a growing file, handing on only what is new
+ *
+ * Parameters:
+ *   path    - File to follow
+ *   poll_ms - Longest wait between checks (FOLLOW_POLL_MS if not positive)
+ *   fn      - Receives each new piece, and a NULL piece after each burst
+ *   arg     - Passed to fn
+ *
+ * Returns:
+ *   0 when the file was deleted or fn asked to stop, -1 on an error
+ *
+ * How it works:
+ * 1. Opens the file and sets up an inotify watch on it, if it can
+ * 2. Reads and hands on everything from the current offset to the end
+ * 3. Checks for truncation and deletion, then waits and repeats
+ */
+int follow_file(const char * path, int poll_ms, follow_fn fn, void * arg) {
+    if (poll_ms <= 0) {
+        poll_ms = FOLLOW_POLL_MS;
+    }
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Error: Could not open input file %s\n", path);
+        return -1;
+    }
+    char * buffer = malloc(FOLLOW_READ);
+    if (buffer == NULL) {
+        fprintf(stderr, "Error: Out of memory\n");
+        close(fd);
+        return -1;
+    }
+
+    /* Without inotify (or a watch on this file system) the size is polled */
+    int watch_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watch_fd >= 0 && inotify_add_watch(watch_fd, path, FOLLOW_EVENTS) < 0) {
+        close(watch_fd);
+        watch_fd = -1;
+    }
+
+    off_t offset = 0;
+    int restart = 0;
+    int status = 0;
+    int stop = 0;
+    while (!stop) {
+        int got_any = 0;
+        for (;;) {
+            ssize_t n = pread(fd, buffer, FOLLOW_READ, offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                fprintf(stderr, "Error: Could not read %s\n", path);
+                status = -1;
+                stop = 1;
+            }
+            if (n <= 0) {
+                break;
+            }
+            offset += n;
+            got_any = 1;
+            if (fn(buffer, (size_t) n, restart, arg) != 0) {
+                stop = 1;
+                break;
+            }
+            restart = 0;
+        }
+        if (!stop && got_any && fn(NULL, 0, 0, arg) != 0) {
+            stop = 1;
+        }
+        if (stop) {
+            break;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            fprintf(stderr, "Error: Could not read %s\n", path);
+            status = -1;
+            break;
+        }
+        if (st.st_size < offset) {
+            /* Truncated: everything is read again */
+            offset = 0;
+            restart = 1;
+            continue;
+        }
+        if (st.st_nlink == 0 && st.st_size == offset) {
+            break;
+        }
+        if (st.st_size == offset) {
+            follow_wait(watch_fd, poll_ms);
+        }
+    }
+
+    if (watch_fd >= 0) {
+        close(watch_fd);
+    }
+    close(fd);
+    free(buffer);
+    return status;
+}
@@ -0,0 +1,76 @@
+/*
+ * freqbytes.h
+ *
+ * This header file defines the complete histograms of frequency_table
+ * --bytes and --utf8, for payloads that are not only letters: every byte
+ * value, or every Unicode code point, is counted.
+ *
+ * Key Features:
+ * 1. Bytes: 256 bins, counted into four interleaved sub-histograms so that
+ *    runs of the same byte do not stall on one counter
+ * 2. UTF-8: A validating decoder with an ASCII fast path; overlong forms,
+ *    surrogates, values past U+10FFFF and truncated sequences are counted
+ *    as invalid (one per maximal invalid subpart) instead of as characters
+ * 3. Classes: Totals per freq_class[] class, which does not depend on the
+ *    locale
+ * 4. Parallel: Each thread counts a slice of the text and the histograms
+ *    are added up; UTF-8 slices start on character boundaries
+ */
+
+#ifndef FREQBYTES_H
+#define FREQBYTES_H
+
+#include <stddef.h>   /* For size_t */
+#include <stdint.h>   /* For 64-bit counters */
+
+/* Code points U+0000 to U+10FFFF */
+#define FREQ_CODE_POINTS 0x110000
+
+/* Histogram of byte values */
+typedef struct freq_bytes {
+    uint64_t counts[256];   /* Occurrences of each byte value */
+    uint64_t bytes;         /* Total bytes counted */
+} freq_bytes;
+
+/* Histogram of code points */
+typedef struct freq_utf8 {
+    uint64_t * counts;      /* FREQ_CODE_POINTS counters (see freq_utf8_init) */
+    uint64_t code_points;   /* Valid characters counted */
+    uint64_t invalid;       /* Invalid sequences skipped */
+    uint64_t bytes;         /* Total bytes examined */
+} freq_utf8;
+
+void freq_bytes_clear(freq_bytes * hist);                                      /* Resets all counters */
+void freq_bytes_update(freq_bytes * hist, const char * text, size_t length);  /* Adds length bytes */
+void freq_bytes_merge(freq_bytes * into, const freq_bytes * from);            /* Adds one histogram to another */
+
+/* Returns how many counted bytes have a class in mask (FREQ_* bits) */
+uint64_t freq_bytes_class(const freq_bytes * hist, unsigned int mask);
+
+/* Adds text to hist, counting it on up to threads threads */
+void freq_bytes_count(freq_bytes * hist, const char * text, size_t length, int threads);
+
+/*
+ * Sets up an empty histogram; returns 0, or -1 if out of memory. The
+ * counters are zeroed pages that the system only backs once they are used.
+ */
+int freq_utf8_init(freq_utf8 * hist);
+void freq_utf8_free(freq_utf8 * hist);
+
+/*
+ * Adds length bytes of UTF-8. A sequence cut off by the end of the text is
+ * invalid, so pieces should be split where freq_utf8_boundary() says.
+ */
+void freq_utf8_update(freq_utf8 * hist, const char * text, size_t length);
+void freq_utf8_merge(freq_utf8 * into, const freq_utf8 * from);
+
+/* Returns the first position at or after pos (at most length) that does not split a character */
+size_t freq_utf8_boundary(const char * text, size_t length, size_t pos);
+
+/* Adds text to hist (set up with freq_utf8_init) on up to threads threads; returns 0, or -1 if out of memory */
+int freq_utf8_count(freq_utf8 * hist, const char * text, size_t length, int threads);
+
+/* Writes the UTF-8 form of code point cp to out (4 bytes of room); returns its length */
+int freq_utf8_encode(uint32_t cp, char * out);
+
+#endif
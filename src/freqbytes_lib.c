@@ -0,0 +1,391 @@
+/*
+ * freqbytes_lib.c
+ *
+ * This file implements the byte and code point histograms declared in
+ * freqbytes.h.
+ *
+ * Key Implementation Details:
+ * 1. Interleaving: Bytes are read eight at a time and spread over four
+ *    tables of 32-bit counters, so consecutive increments of the same
+ *    value go to different counters and do not wait for each other; the
+ *    tables are added into the 64-bit result every FREQ_BYTES_CHUNK bytes,
+ *    before any counter can overflow
+ * 2. ASCII fast path: While eight bytes at a time have no high bit, the
+ *    UTF-8 decoder counts them directly without decoding
+ * 3. Validation: The lead byte gives the sequence length (0 for bytes that
+ *    can never start one) and the range of the second byte, which is what
+ *    rules out overlong forms, surrogates and values past U+10FFFF; every
+ *    other continuation byte must be 0x80-0xBF
+ * 4. Slices: Per-thread results are merged in slice order, so the result
+ *    is the same for any number of threads
+ */
+
+#include "freqbytes.h"
+#include "frequency_table.h"   /* For freq_class[] */
+#include "parallel.h"          /* For parallel_run() */
+#include <stdlib.h>            /* For memory management */
+#include <string.h>            /* For memset() and memcpy() */
+
+/* Bytes counted between flushes of the 32-bit counters (each table gets a quarter) */
+#define FREQ_BYTES_CHUNK ((size_t) 1 << 30)
+
+/* Smallest slice worth a thread of its own */
+#define FREQ_MIN_SLICE (1024 * 1024)
+
+/* Length of the UTF-8 sequence each byte starts (0: not a valid lead byte) */
+static const unsigned char utf8_length[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 0x00 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 0x10 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 0x20 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 0x30 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 0x40 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 0x50 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 0x60 */
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,   /* 0x70 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,   /* 0x80 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,   /* 0x90 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,   /* 0xA0 */
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,   /* 0xB0 */
+    0, 0, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,   /* 0xC0 */
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2,   /* 0xD0 */
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3, 3,   /* 0xE0 */
+    4, 4, 4, 4, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0    /* 0xF0 */
+};
+
+/* Work for one thread: a slice and its histogram */
+typedef struct bytes_task {
+    const char * text;
+    size_t length;
+    freq_bytes hist;
+    char pad[PARALLEL_CACHE_LINE];   /* Keeps the next task's histogram off this one's last line */
+} bytes_task;
+
+typedef struct utf8_task {
+    const char * text;
+    size_t length;
+    freq_utf8 * hist;
+} utf8_task;
+
+/* Resets a byte histogram so it can be reused */
+void freq_bytes_clear(freq_bytes * hist) {
+    memset(hist, 0, sizeof(*hist));
+}
+
+/*
+ * freq_bytes_update
+ *
+ * Purpose: Adds every byte of a piece of text to a byte histogram
+ *
+ * Parameters:
+ *   hist   - Histogram to add to
+ *   text   - Start of the bytes; NULs and high bytes are counted like any other
+ *   length - Number of bytes
+ *
+ * How it works:
+ * 1. Each 8-byte word adds two bytes to each of the four tables
+ * 2. The tail (fewer than 8 bytes) goes to the first table
+ * 3. The four tables are summed into hist after each chunk
+ */
+void freq_bytes_update(freq_bytes * hist, const char * text, size_t length) {
+    uint32_t counts[4][256];
+    const unsigned char * p = (const unsigned char *) text;
+
+    hist->bytes += length;
+    while (length > 0) {
+        size_t n = length < FREQ_BYTES_CHUNK ? length : FREQ_BYTES_CHUNK;
+        size_t i = 0;
+
+        memset(counts, 0, sizeof(counts));
+        for (; i + 8 <= n; i += 8) {
+            uint64_t w;
+            memcpy(&w, p + i, 8);
+            counts[0][w & 0xFF]++;
+            counts[1][(w >> 8) & 0xFF]++;
+            counts[2][(w >> 16) & 0xFF]++;
+            counts[3][(w >> 24) & 0xFF]++;
+            counts[0][(w >> 32) & 0xFF]++;
+            counts[1][(w >> 40) & 0xFF]++;
+            counts[2][(w >> 48) & 0xFF]++;
+            counts[3][w >> 56]++;
+        }
+        for (; i < n; i++) {
+            counts[0][p[i]]++;
+        }
+        for (int b = 0; b < 256; b++) {
+            hist->counts[b] += (uint64_t) counts[0][b] + counts[1][b] + counts[2][b] + counts[3][b];
+        }
+        p += n;
+        length -= n;
+    }
+}
+
+/* Adds one byte histogram into another (e.g. per-thread partial results) */
+void freq_bytes_merge(freq_bytes * into, const freq_bytes * from) {
+    for (int b = 0; b < 256; b++) {
+        into->counts[b] += from->counts[b];
+    }
+    into->bytes += from->bytes;
+}
+
+/* Returns how many counted bytes belong to any of the classes in mask */
+uint64_t freq_bytes_class(const freq_bytes * hist, unsigned int mask) {
+    uint64_t total = 0;
+    for (int b = 0; b < 256; b++) {
+        if (freq_class[b] & mask) {
+            total += hist->counts[b];
+        }
+    }
+    return total;
+}
+
+/* Thread body of freq_bytes_count */
+static void * bytes_worker(void * arg) {
+    bytes_task * task = arg;
+    freq_bytes_update(&task->hist, task->text, task->length);
+    return NULL;
+}
+
+/* Returns how many threads are worth starting for length bytes */
+static int slice_threads(size_t length, int threads) {
+    size_t most = length / FREQ_MIN_SLICE + 1;
+    if (threads < 1) {
+        threads = 1;
+    }
+    return (size_t) threads > most ? (int) most : threads;
+}
+
+/*
+ * freq_bytes_count
+ *
+ * Purpose: Adds a whole buffer to a byte histogram using several threads
+ *
+ * How it works:
+ *   The buffer is cut into one equal slice per thread; each thread counts
+ *   its slice into its own histogram and the results are merged
+ */
+void freq_bytes_count(freq_bytes * hist, const char * text, size_t length, int threads) {
+    threads = slice_threads(length, threads);
+    bytes_task * tasks = calloc(threads, sizeof(bytes_task));
+    if (tasks == NULL) {
+        freq_bytes_update(hist, text, length);
+        return;
+    }
+    for (int i = 0; i < threads; i++) {
+        size_t from = length / threads * i;
+        size_t to = i == threads - 1 ? length : length / threads * (i + 1);
+        tasks[i].text = text + from;
+        tasks[i].length = to - from;
+    }
+    parallel_run(threads, bytes_worker, tasks, sizeof(bytes_task));
+    for (int i = 0; i < threads; i++) {
+        freq_bytes_merge(hist, &tasks[i].hist);
+    }
+    free(tasks);
+}
+
+/* Sets up an empty code point histogram */
+int freq_utf8_init(freq_utf8 * hist) {
+    memset(hist, 0, sizeof(*hist));
+    hist->counts = calloc(FREQ_CODE_POINTS, sizeof(uint64_t));
+    return hist->counts != NULL ? 0 : -1;
+}
+
+/* Releases a code point histogram */
+void freq_utf8_free(freq_utf8 * hist) {
+    free(hist->counts);
+    hist->counts = NULL;
+}
+
+/*
+ * freq_utf8_update
+ *
+ * Purpose: Decodes a piece of UTF-8 and adds its code points to a histogram
+ *
+ * Parameters:
+ *   hist   - Histogram to add to
+ *   text   - Start of the bytes
+ *   length - Number of bytes
+ *
+ * How it works:
+ * 1. Runs of eight ASCII bytes are counted as they are
+ * 2. Otherwise the lead byte gives the sequence length and the allowed
+ *    range of the next byte, and the continuation bytes are checked one
+ *    at a time as the code point is built
+ * 3. If a byte does not fit, everything before it is one invalid sequence
+ *    and decoding resumes at that byte (a lone bad lead byte is skipped)
+ */
+void freq_utf8_update(freq_utf8 * hist, const char * text, size_t length) {
+    const unsigned char * p = (const unsigned char *) text;
+    uint64_t * counts = hist->counts;
+    uint64_t chars = 0;
+    uint64_t invalid = 0;
+    size_t i = 0;
+
+    while (i < length) {
+        for (; i + 8 <= length; i += 8) {
+            uint64_t w;
+            memcpy(&w, p + i, 8);
+            if (w & 0x8080808080808080ULL) {
+                break;
+            }
+            counts[p[i]]++;
+            counts[p[i + 1]]++;
+            counts[p[i + 2]]++;
+            counts[p[i + 3]]++;
+            counts[p[i + 4]]++;
+            counts[p[i + 5]]++;
+            counts[p[i + 6]]++;
+            counts[p[i + 7]]++;
+            chars += 8;
+        }
+        if (i >= length) {
+            break;
+        }
+
+        unsigned int c = p[i];
+        size_t need = utf8_length[c];
+        if (need == 1) {
+            counts[c]++;
+            chars++;
+            i++;
+            continue;
+        }
+        if (need == 0) {
+            invalid++;
+            i++;
+            continue;
+        }
+
+        unsigned int lo = c == 0xE0 ? 0xA0 : c == 0xF0 ? 0x90 : 0x80;
+        unsigned int hi = c == 0xED ? 0x9F : c == 0xF4 ? 0x8F : 0xBF;
+        uint32_t cp = c & (0x7F >> need);
+        size_t k = 1;
+        for (; k < need && i + k < length; k++) {
+            unsigned int b = p[i + k];
+            if (b < lo || b > hi) {
+                break;
+            }
+            cp = (cp << 6) | (b & 0x3F);
+            lo = 0x80;
+            hi = 0xBF;
+        }
+        if (k == need) {
+            counts[cp]++;
+            chars++;
+        } else {
+            invalid++;
+        }
+        i += k;
+    }
+
+    hist->code_points += chars;
+    hist->invalid += invalid;
+    hist->bytes += length;
+}
+
+/* Adds one code point histogram into another */
+void freq_utf8_merge(freq_utf8 * into, const freq_utf8 * from) {
+    for (uint32_t cp = 0; cp < FREQ_CODE_POINTS; cp++) {
+        into->counts[cp] += from->counts[cp];
+    }
+    into->code_points += from->code_points;
+    into->invalid += from->invalid;
+    into->bytes += from->bytes;
+}
+
+/*
+ * freq_utf8_boundary
+ *
+ * Purpose: Finds where a UTF-8 text can be split without changing what it decodes to
+ *
+ * How it works:
+ *   Skips at most three continuation bytes (10xxxxxx): no sequence, valid
+ *   or not, reaches further past its lead byte, so a fourth one can only
+ *   be a stray byte that is invalid on either side of the split
+ */
+size_t freq_utf8_boundary(const char * text, size_t length, size_t pos) {
+    for (int k = 0; k < 3 && pos < length && ((unsigned char) text[pos] & 0xC0) == 0x80; k++) {
+        pos++;
+    }
+    return pos;
+}
+
+/* Thread body of freq_utf8_count */
+static void * utf8_worker(void * arg) {
+    utf8_task * task = arg;
+    freq_utf8_update(task->hist, task->text, task->length);
+    return NULL;
+}
+
+/*
+ * freq_utf8_count
+ *
+ * Purpose: Adds a whole buffer to a code point histogram using several threads
+ *
+ * How it works:
+ *   The buffer is cut into slices at character boundaries near equal
+ *   shares; the first slice is counted into hist itself, every other into
+ *   a histogram of its own that is merged and released afterwards
+ */
+int freq_utf8_count(freq_utf8 * hist, const char * text, size_t length, int threads) {
+    threads = slice_threads(length, threads);
+    utf8_task * tasks = calloc(threads, sizeof(utf8_task));
+    freq_utf8 * partial = threads > 1 ? calloc(threads - 1, sizeof(freq_utf8)) : NULL;
+    int status = 0;
+
+    if (tasks == NULL || (threads > 1 && partial == NULL)) {
+        free(tasks);
+        free(partial);
+        return -1;
+    }
+    size_t from = 0;
+    for (int i = 0; i < threads; i++) {
+        size_t to = i == threads - 1 ? length : freq_utf8_boundary(text, length, length / threads * (i + 1));
+        to = to < from ? from : to;
+        tasks[i].text = text + from;
+        tasks[i].length = to - from;
+        tasks[i].hist = i == 0 ? hist : &partial[i - 1];
+        if (i > 0 && freq_utf8_init(&partial[i - 1]) != 0) {
+            status = -1;
+        }
+        from = to;
+    }
+
+    if (status == 0) {
+        parallel_run(threads, utf8_worker, tasks, sizeof(utf8_task));
+        for (int i = 1; i < threads; i++) {
+            freq_utf8_merge(hist, &partial[i - 1]);
+        }
+    }
+    for (int i = 1; i < threads; i++) {
+        freq_utf8_free(&partial[i - 1]);
+    }
+    free(tasks);
+    free(partial);
+    return status;
+}
+
+/* Writes the UTF-8 form of cp (at most U+10FFFF) and returns its length */
+int freq_utf8_encode(uint32_t cp, char * out) {
+    unsigned char * o = (unsigned char *) out;
+    if (cp < 0x80) {
+        o[0] = (unsigned char) cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        o[0] = (unsigned char) (0xC0 | (cp >> 6));
+        o[1] = (unsigned char) (0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        o[0] = (unsigned char) (0xE0 | (cp >> 12));
+        o[1] = (unsigned char) (0x80 | ((cp >> 6) & 0x3F));
+        o[2] = (unsigned char) (0x80 | (cp & 0x3F));
+        return 3;
+    }
+    o[0] = (unsigned char) (0xF0 | (cp >> 18));
+    o[1] = (unsigned char) (0x80 | ((cp >> 12) & 0x3F));
+    o[2] = (unsigned char) (0x80 | ((cp >> 6) & 0x3F));
+    o[3] = (unsigned char) (0x80 | (cp & 0x3F));
+    return 4;
+}
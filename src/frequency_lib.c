@@ -5,18 +5,125 @@
  * These functions are essential for breaking Caesar ciphers by analyzing letter patterns.
  * 
  * Key Concepts Used:
- * 1. String Handling: Using C's string functions to process text
- * 2. Memory Management: Dynamic allocation for the frequency table
+ * 1. String Handling: Text is passed as (pointer, length) views
+ * 2. Memory Management: Histograms are written into caller-provided structs;
+ *    only the old frequency_table() wrapper allocates
  * 3. ASCII Manipulation: Converting between characters and their ASCII values
- * 4. Character Classification: Using ctype.h functions to identify letters
+ * 4. Character Classification: Letters are recognised by their ASCII codes,
+ *    which matches isalpha() in the default "C" locale; freq_class[] gives
+ *    the class of any byte the same way, so no lookup ever depends on the
+ *    locale or reads past a 26-entry table
  */
 
 #include "frequency_table.h"
-#include <ctype.h>    /* For isalpha() - checks if a character is a letter */
 #include <string.h>   /* For strlen() - gets length of strings */
 #include <stdlib.h>   /* For malloc() - dynamic memory allocation */
 #include <stdio.h>    /* For printf() - debugging output */
 
+/* Short names for the rows of freq_class[] */
+#define U FREQ_UPPER
+#define L FREQ_LOWER
+#define D FREQ_DIGIT
+#define S FREQ_SPACE
+#define P FREQ_PUNCT
+#define C FREQ_CNTRL
+#define H FREQ_HIGH
+
+/*
+ * freq_class
+ *
+ * Class of each byte value, indexed by the byte as an unsigned char. Each
+ * byte has exactly one class: what isupper(), islower(), isdigit(),
+ * isspace(), ispunct() and iscntrl() answer in the "C" locale, with the
+ * whitespace control codes counted as FREQ_SPACE only.
+ */
+const unsigned char freq_class[256] = {
+    C, C, C, C, C, C, C, C, C, S, S, S, S, S, C, C,   /* 0x00 */
+    C, C, C, C, C, C, C, C, C, C, C, C, C, C, C, C,   /* 0x10 */
+    S, P, P, P, P, P, P, P, P, P, P, P, P, P, P, P,   /* 0x20 */
+    D, D, D, D, D, D, D, D, D, D, P, P, P, P, P, P,   /* 0x30 */
+    P, U, U, U, U, U, U, U, U, U, U, U, U, U, U, U,   /* 0x40 */
+    U, U, U, U, U, U, U, U, U, U, U, P, P, P, P, P,   /* 0x50 */
+    P, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L,   /* 0x60 */
+    L, L, L, L, L, L, L, L, L, L, L, P, P, P, P, C,   /* 0x70 */
+    H, H, H, H, H, H, H, H, H, H, H, H, H, H, H, H,   /* 0x80 */
+    H, H, H, H, H, H, H, H, H, H, H, H, H, H, H, H,   /* 0x90 */
+    H, H, H, H, H, H, H, H, H, H, H, H, H, H, H, H,   /* 0xA0 */
+    H, H, H, H, H, H, H, H, H, H, H, H, H, H, H, H,   /* 0xB0 */
+    H, H, H, H, H, H, H, H, H, H, H, H, H, H, H, H,   /* 0xC0 */
+    H, H, H, H, H, H, H, H, H, H, H, H, H, H, H, H,   /* 0xD0 */
+    H, H, H, H, H, H, H, H, H, H, H, H, H, H, H, H,   /* 0xE0 */
+    H, H, H, H, H, H, H, H, H, H, H, H, H, H, H, H    /* 0xF0 */
+};
+
+#undef U
+#undef L
+#undef D
+#undef S
+#undef P
+#undef C
+#undef H
+
+/*
+ * freq_hist_clear
+ * 
+ * Purpose: Resets a histogram so it can be reused
+ * 
+ * Parameters:
+ *   hist - The histogram to clear
+ */
+void freq_hist_clear(freq_hist * hist) {
+    memset(hist, 0, sizeof(*hist));
+}
+
+/*
+ * freq_hist_update
+ * 
+ * Purpose: Adds the letters of a piece of text to a histogram
+ * 
+ * Parameters:
+ *   hist   - Histogram to add to (caller-provided, usually on the stack)
+ *   text   - Start of the text; it does not need to be NUL-terminated
+ *   length - Number of bytes to examine
+ * 
+ * How it works:
+ * 1. Setting bit 5 (| 0x20) turns 'A'-'Z' into 'a'-'z'
+ * 2. Subtracting 'a' maps letters to 0-25; every other byte lands on 26 or
+ *    above and is sent to a spare bin, so the loop has no branches
+ * 3. The local counters are added into hist at the end
+ * 
+ * Calling it several times on consecutive pieces of a text gives the same
+ * result as calling it once on the whole text.
+ */
+void freq_hist_update(freq_hist * hist, const char * text, size_t length) {
+    uint64_t counts[27] = {0};  /* 26 letters plus one bin for everything else */
+    const unsigned char * p = (const unsigned char *) text;
+
+    for (size_t i = 0; i < length; i++) {
+        unsigned int index = (unsigned int) ((p[i] | 0x20) - 'a');
+        counts[index < 26 ? index : 26]++;
+    }
+
+    for (int i = 0; i < 26; i++) {
+        hist->counts[i] += counts[i];
+    }
+    hist->letters += length - counts[26];
+    hist->bytes += length;
+}
+
+/*
+ * freq_hist_merge
+ * 
+ * Purpose: Adds one histogram into another (e.g. per-thread partial results)
+ */
+void freq_hist_merge(freq_hist * into, const freq_hist * from) {
+    for (int i = 0; i < 26; i++) {
+        into->counts[i] += from->counts[i];
+    }
+    into->letters += from->letters;
+    into->bytes += from->bytes;
+}
+
 /*
  * letter_count
  * 
@@ -29,27 +136,18 @@
  *   The total number of letters found in the string
  * 
  * How it works:
- * 1. Initialize a counter to 0
- * 2. Loop through each character in the string
- * 3. For each character, check if it's a letter using isalpha()
- * 4. If it is a letter, increment the counter
- * 5. Return the final count
+ *   Builds a histogram of the string on the stack and returns its letter total
  * 
  * Example:
  *   Input: "Hello123"
  *   Output: 5 (counts 'H', 'e', 'l', 'l', 'o')
  */
-int letter_count(char * string) {
-    int count = 0;  /* Counter for letters found */
-    
-    /* Loop through each character in the string */
-    for (int i = 0; i < strlen(string); i++) {
-        /* isalpha() returns non-zero if character is a letter, 0 otherwise */
-        if (isalpha(string[i]) > 0) {
-            count++;  /* Found a letter, increment counter */
-        }
-    }
-    return count;  /* Return total number of letters found */
+uint64_t letter_count(char * string) {
+    freq_hist hist;
+
+    freq_hist_clear(&hist);
+    freq_hist_update(&hist, string, strlen(string));
+    return hist.letters;  /* Return total number of letters found */
 }
 
 /*
@@ -61,52 +159,32 @@ int letter_count(char * string) {
  *   string - A pointer to the text we want to analyze
  * 
  * Returns:
- *   A pointer to an array of 26 integers, where:
+ *   A pointer to an array of 26 64-bit counters, where:
  *   - Index 0 represents 'A' or 'a'
  *   - Index 1 represents 'B' or 'b'
  *   - And so on until index 25 for 'Z' or 'z'
  * 
- * How it works:
- * 1. Allocate memory for 26 integers (one for each letter)
- * 2. Initialize all counts to 0
- * 3. Loop through each character in the string
- * 4. For each letter found:
- *    - Convert to uppercase using toupper()
- *    - Subtract 'A' (ASCII 65) to get index 0-25
- *    - Increment the count at that index
- * 5. Return the frequency table
- * 
  * Memory Management:
  * - Uses malloc() to create the table
  * - Caller is responsible for freeing the memory when done
+ * - Code that runs often should use freq_hist_update() instead, which
+ *   does not allocate
  * 
  * Example:
  *   Input: "Hello"
  *   Output: [0,0,0,0,1,0,0,1,0,0,0,2,0,0,1,0,0,0,0,0,0,0,0,0,0,0]
  *           (counts for A-Z: H=1, E=1, L=2, O=1)
  */
-int * frequency_table(char * string) {
-    int * freq_table;  /* Pointer to our frequency table */
-    
-    /* Allocate memory for 26 integers (one for each letter) */
-    freq_table = malloc(sizeof(int) * 26);
+uint64_t * frequency_table(char * string) {
+    freq_hist hist;
+    uint64_t * freq_table = malloc(sizeof(uint64_t) * 26);
     if (freq_table == NULL) {
         /* Handle memory allocation failure */
         return NULL;
     }
-    
-    /* Initialize all counts to 0 */
-    for (int i = 0; i < 26; i++) {
-        freq_table[i] = 0;
-    }
-    
-    /* Process each character in the string */
-    for (int i = 0; i < strlen(string); i++) {
-        if (isalpha(string[i]) > 0) {  /* If character is a letter */
-            /* Convert to uppercase and subtract 'A' (65) to get index 0-25 */
-            freq_table[toupper(string[i]) - 65] += 1;
-        }
-    }
-    
+
+    freq_hist_clear(&hist);
+    freq_hist_update(&hist, string, strlen(string));
+    memcpy(freq_table, hist.counts, sizeof(hist.counts));
     return freq_table;  /* Return the completed frequency table */
 }
@@ -9,7 +9,7 @@
  * 1. Can read input from either:
  *    - A file specified with -F command line argument
  *    - Standard input (keyboard) if no file is specified
- * 2. Handles files of any size by dynamically allocating memory
+ * 2. Handles files of any size by reading them into an arena
  * 3. Prints a detailed report showing:
  *    - Total number of letters found
  *    - Total number of characters
@@ -22,7 +22,7 @@
  * Key Programming Concepts Used:
  * 1. Command Line Arguments: Processing -F flag and filename
  * 2. File I/O: Reading from files and standard input
- * 3. Dynamic Memory: Managing buffers for file contents
+ * 3. Dynamic Memory: Input is held in an arena that is freed in one call
  * 4. String Handling: Concatenating and manipulating text
  */
 
@@ -32,30 +32,20 @@
 #include <stdbool.h>  /* For boolean type */
 #include <ctype.h>    /* For character type checking */
 #include "frequency_table.h"  /* Our frequency analysis functions */
+#include "arena.h"  /* For the arena holding the input text */
 
 int main(int argc, char ** argv) {
     /* Variables for input handling */
     int USE_STDIN = true;     /* Flag: true if reading from keyboard */
     int in_file = 0;          /* Index of input filename in argv */
     
-    /* Buffer for reading file in chunks */
-    char * buffer = malloc(sizeof(char) * 100);
-    if (buffer == NULL) {
-        fprintf(stderr, "Error: Failed to allocate memory for buffer\n");
-        return 1;
-    }
-    strcpy(buffer, "");
-    
-    /* Storage for complete file contents */
-    char * file_contents = malloc(sizeof(char) * 100);
-    if (file_contents == NULL) {
-        fprintf(stderr, "Error: Failed to allocate memory for file contents\n");
-        free(buffer);
-        return 1;
-    }
-    strcpy(file_contents, "");
+    /* Storage for complete file contents, allocated from an arena */
+    char * file_contents = NULL;
+    arena mem;
+    arena_init(&mem, 0);
     
     FILE * fp = NULL;  /* File pointer for reading from file */
+    size_t length = 0;  /* Bytes held in file_contents */
 
     /* Process command line arguments */
     if (argc >= 2) {
@@ -78,42 +68,36 @@ int main(int argc, char ** argv) {
 
     /* Read input based on whether we're using file or stdin */
     if (USE_STDIN == true) {
-        /* Read from keyboard (standard input) */
-        if (fgets(file_contents, 100, stdin) == NULL) {
+        /* Read one line from keyboard (standard input) */
+        file_contents = arena_alloc(&mem, 100);
+        if (file_contents == NULL || fgets(file_contents, 100, stdin) == NULL) {
             fprintf(stderr, "Error: Failed to read from standard input\n");
-            free(buffer);
-            free(file_contents);
+            arena_free(&mem);
             return 1;
         }
         
         /* Remove newline if present */
-        if (file_contents[strlen(file_contents) - 1] == '\n') {
-            file_contents[strlen(file_contents) - 1] = '\0';
+        length = strlen(file_contents);
+        if (length > 0 && file_contents[length - 1] == '\n') {
+            file_contents[--length] = '\0';
         }
     } else {
         /* Read from file */
         fp = fopen(argv[in_file], "r");
         if (fp == NULL) {
             fprintf(stderr, "Error: Could not open file %s\n", argv[in_file]);
-            free(buffer);
-            free(file_contents);
+            arena_free(&mem);
             return 1;
         }
         
-        /* Read file in chunks and append to file_contents */
-        while (fgets(buffer, 100, fp) != NULL) {
-            /* Expand file_contents if needed */
-            char * temp = realloc(file_contents, 
-                                sizeof(char) * (strlen(file_contents) + strlen(buffer) + 1));
-            if (temp == NULL) {
-                fprintf(stderr, "Error: Failed to allocate memory for file contents\n");
-                free(buffer);
-                free(file_contents);
-                fclose(fp);
-                return 1;
-            }
-            file_contents = temp;
-            strcat(file_contents, buffer);
+        /* Read the whole file into one arena buffer */
+        file_contents = arena_read_file(&mem, fp, &length);
+        fclose(fp);
+        fp = NULL;
+        if (file_contents == NULL) {
+            fprintf(stderr, "Error: Failed to read file %s\n", argv[in_file]);
+            arena_free(&mem);
+            return 1;
         }
     }
 
@@ -121,31 +105,27 @@ int main(int argc, char ** argv) {
     printf("\n=== Letter Frequency Analysis ===\n\n");
     
     /* Count and print total letters */
-    int count = letter_count(file_contents);
-    printf("Letter Count: %d\n", count);
+    uint64_t count = letter_count(file_contents);
+    printf("Letter Count: %llu\n", (unsigned long long) count);
     
     /* Count and print total characters */
-    int character_count = strlen(file_contents);
-    printf("Character Count: %d\n\n", character_count);
+    size_t character_count = length;
+    printf("Character Count: %zu\n\n", character_count);
     
     /* Generate and print frequency table */
     printf("Letter Frequency Table:\n");
     printf("Letter\tCount\n");
     printf("-----\t-----\n");
-    int * freq_table = frequency_table(file_contents);
+    uint64_t * freq_table = frequency_table(file_contents);
     if (freq_table != NULL) {
         for (int i = 0; i < 26; i++) {
-            printf("%c\t%d\n", i + 65, freq_table[i]);  /* i + 65 converts 0-25 to A-Z */
+            printf("%c\t%llu\n", i + 65, (unsigned long long) freq_table[i]);  /* i + 65 converts 0-25 to A-Z */
         }
         free(freq_table);  /* Clean up frequency table */
     }
 
     /* Clean up allocated memory */
-    free(buffer);
-    free(file_contents);
-    if (fp != NULL) {
-        fclose(fp);
-    }
+    arena_free(&mem);
     
     return 0;
 }
@@ -4,16 +4,56 @@
 #include <stdbool.h>
 #include <ctype.h>
 #include "frequency_table.h"
+#include "arena.h"
+#include "profile.h"
+#include "parallel.h"
+#include "freqbytes.h"
+#include "follow.h"
+
+
+// prints a letter histogram: the totals, then one line per letter
+
+static void print_table(const freq_hist * hist) {
+   printf("Letter Count: %llu\n", (unsigned long long) hist->letters);
+   printf("Character Count: %llu\n", (unsigned long long) hist->bytes);
+   for (int i = 0; i < 26; i++) {
+       printf("%c\t%llu\n", i + 65, (unsigned long long) hist->counts[i]);
+   }
+}
+
+// --follow: each new piece of the file is added to the running histogram,
+// which is printed again once the writer pauses
+
+static int follow_count(char * data, size_t length, int restart, void * arg) {
+   freq_hist * hist = arg;
+   if (restart) {
+       freq_hist_clear(hist);
+   }
+   if (data == NULL) {
+       print_table(hist);
+       printf("\n");
+       fflush(stdout);
+       return 0;
+   }
+   freq_hist_update(hist, data, length);
+   return 0;
+}
 
 
 int main( int argc, char ** argv) {
    int USE_STDIN = true;
    int in_file = 0;
-   char * buffer = malloc(sizeof(char) * 100);
-   strcpy(buffer, "");
-   char * file_contents = malloc(sizeof(char) * 100);
-   strcpy(file_contents, "");
+   size_t length = 0;
+   char * file_contents = NULL;
    FILE * fp = NULL;
+   char * train_name = NULL;
+   char * out_name = NULL;
+   int threads = parallel_threads();
+   int bytes_mode = false;
+   int utf8_mode = false;
+   int follow = false;
+   arena mem;
+   arena_init(&mem, 0);
   
 /*if (argc == 1) {
        fprintf(stderr, "%s\n", "Not enough arguments.");
@@ -33,50 +73,160 @@ int main( int argc, char ** argv) {
            if (strcmp(argv[i], "-F") == 0) {
                next_is_input = true;
            }
+           // --train NAME builds a profile for the language NAME
+           else if (strcmp(argv[i], "--train") == 0 && i + 1 < argc) {
+               train_name = argv[++i];
+           }
+           else if (strcmp(argv[i], "-O") == 0 && i + 1 < argc) {
+               out_name = argv[++i];
+           }
+           else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+               threads = atoi(argv[++i]);
+           }
+           // --bytes counts all 256 byte values, --utf8 every code point
+           else if (strcmp(argv[i], "--bytes") == 0) {
+               bytes_mode = true;
+           }
+           else if (strcmp(argv[i], "--utf8") == 0) {
+               utf8_mode = true;
+           }
+           // --follow keeps counting as the file grows
+           else if (strcmp(argv[i], "--follow") == 0) {
+               follow = true;
+           }
        }
        /*USE_STDOUT = false;
        if (fp == NULL) {
            USE_STDIN = true;
        }*/
    }
-   if (USE_STDIN == true) {
-       // if (file_contents[strlen(file_contents)] == '\n') {
-       //     file_contents[strlen(file_contents)] = '\0';
-       while (fgets(buffer, 100, stdin) != NULL) {
-           file_contents = realloc(file_contents, sizeof(char) * (strlen(file_contents) + strlen(buffer) + 1));
-           strcat(file_contents, buffer);
+   // training counts the corpus in parallel without holding it in memory
+   if (train_name != NULL) {
+       if (USE_STDIN == false) {
+           fp = fopen(argv[in_file], "r");
+           if (fp == NULL) {
+               fprintf(stderr, "Could not open %s\n", argv[in_file]);
+               return 1;
+           }
+       }
+       freq_hist hist;
+       freq_profile profile;
+       int failed = profile_train(fp != NULL ? fp : stdin, threads, &hist);
+       if (fp != NULL) {
+           fclose(fp);
+       }
+       if (failed != 0) {
+           fprintf(stderr, "Could not read the corpus\n");
+           return 1;
+       }
+       if (profile_from_hist(&hist, train_name, &profile) != 0) {
+           fprintf(stderr, "Invalid language name %s\n", train_name);
+           return 1;
+       }
+       FILE * out = out_name != NULL ? fopen(out_name, "w") : stdout;
+       if (out == NULL) {
+           fprintf(stderr, "Could not open %s\n", out_name);
+           return 1;
+       }
+       fprintf(out, "# Trained on %llu letters\n", (unsigned long long) hist.letters);
+       failed = profile_write(out, &profile);
+       if (out != stdout && fclose(out) != 0) {
+           failed = -1;
        }
+       if (failed != 0) {
+           fprintf(stderr, "Could not write the profile\n");
+           return 1;
+       }
+       arena_free(&mem);
+       return 0;
+   }
+   if (follow) {
+       if (USE_STDIN == true || bytes_mode || utf8_mode) {
+           fprintf(stderr, "--follow needs -F and counts letters only\n");
+           return 1;
+       }
+       freq_hist hist;
+       freq_hist_clear(&hist);
+       int failed = follow_file(argv[in_file], FOLLOW_POLL_MS, follow_count, &hist);
+       arena_free(&mem);
+       return failed != 0 ? 1 : 0;
+   }
+   if (USE_STDIN == true) {
+       file_contents = arena_read_file(&mem, stdin, &length);
    }
    else {
        fp = fopen(argv[in_file], "r");
-       while (fgets(buffer, 100, fp) != NULL) {
-           file_contents = realloc(file_contents, sizeof(char) * (strlen(file_contents) + strlen(buffer) + 1));
-           strcat(file_contents, buffer);
+       if (fp == NULL) {
+           fprintf(stderr, "Could not open %s\n", argv[in_file]);
+           return 1;
+       }
+       file_contents = arena_read_file(&mem, fp, &length);
+       if (file_contents != NULL && !bytes_mode && !utf8_mode) {
+           printf("File Contents: %s\n", file_contents);
        }
-       printf("File Contents: %s\n", file_contents);
        fclose(fp);
    }
-
-
- 
-   int count = letter_count(file_contents);
-   printf("Letter Count: %d\n", count);
-
-
-   int character_count = strlen(file_contents);
-   printf("Character Count: %d\n", character_count);
-
-
-   int * freq_table = frequency_table(file_contents);
-   for (int i = 0; i < 26; i++) {
-       printf("%c\t", i + 65);
-       printf("%d\n", freq_table[i]);
+   if (file_contents == NULL) {
+       fprintf(stderr, "Could not read input\n");
+       arena_free(&mem);
+       return 1;
    }
 
+   // the complete profiles list only the values that occur, in order
+
+   if (bytes_mode) {
+       freq_bytes hist;
+       freq_bytes_clear(&hist);
+       freq_bytes_count(&hist, file_contents, length, threads);
+       printf("Byte Count: %llu\n", (unsigned long long) hist.bytes);
+       printf("Letters: %llu\n", (unsigned long long) freq_bytes_class(&hist, FREQ_ALPHA));
+       printf("Digits: %llu\n", (unsigned long long) freq_bytes_class(&hist, FREQ_DIGIT));
+       printf("Whitespace: %llu\n", (unsigned long long) freq_bytes_class(&hist, FREQ_SPACE));
+       printf("Punctuation: %llu\n", (unsigned long long) freq_bytes_class(&hist, FREQ_PUNCT));
+       printf("Control: %llu\n", (unsigned long long) freq_bytes_class(&hist, FREQ_CNTRL));
+       printf("Non-ASCII: %llu\n", (unsigned long long) freq_bytes_class(&hist, FREQ_HIGH));
+       for (int b = 0; b < 256; b++) {
+           if (hist.counts[b] != 0) {
+               int shown = freq_class[b] & (FREQ_ALPHA | FREQ_DIGIT | FREQ_PUNCT) || b == ' ';
+               printf("0x%02X\t%c\t%llu\n", b, shown ? b : '.', (unsigned long long) hist.counts[b]);
+           }
+       }
+       arena_free(&mem);
+       return 0;
+   }
+   if (utf8_mode) {
+       freq_utf8 hist;
+       if (freq_utf8_init(&hist) != 0 || freq_utf8_count(&hist, file_contents, length, threads) != 0) {
+           fprintf(stderr, "Out of memory\n");
+           return 1;
+       }
+       printf("Byte Count: %llu\n", (unsigned long long) hist.bytes);
+       printf("Code Points: %llu\n", (unsigned long long) hist.code_points);
+       printf("Invalid Sequences: %llu\n", (unsigned long long) hist.invalid);
+       for (uint32_t cp = 0; cp < FREQ_CODE_POINTS; cp++) {
+           if (hist.counts[cp] != 0) {
+               // control characters are shown as '.', everything else as itself
+               char shown[5] = ".";
+               if (cp >= 0x20 && cp != 0x7F && (cp < 0x80 || cp >= 0xA0)) {
+                   shown[freq_utf8_encode(cp, shown)] = '\0';
+               }
+               printf("U+%04X\t%s\t%llu\n", (unsigned int) cp, shown, (unsigned long long) hist.counts[cp]);
+           }
+       }
+       freq_utf8_free(&hist);
+       arena_free(&mem);
+       return 0;
+   }
 
-   free(buffer);
-   free(file_contents);
-   free(freq_table);
+ 
+   // the whole buffer is counted by length, so letters after a NUL byte (in a
+   // sparse or binary file) are counted too
+
+   freq_hist hist;
+   freq_hist_clear(&hist);
+   freq_hist_update(&hist, file_contents, length);
+   print_table(&hist);
+   arena_free(&mem);
 
 
   
@@ -8,6 +8,15 @@
  * The functions defined here are:
  * 1. letter_count: Counts how many letters (a-z, A-Z) are in a given text
  * 2. frequency_table: Creates a table showing how many times each letter appears
+ * 3. freq_hist_*: The same analysis over (pointer, length) views, writing
+ *    into a caller-provided freq_hist so nothing is allocated
+ * 4. freq_class: A locale-independent classification of every byte value,
+ *    used instead of isalpha() and friends, whose answers for bytes above
+ *    0x7F depend on the locale
+ * 
+ * letter_count and frequency_table are thin wrappers over freq_hist_update.
+ * 
+ * Counts are 64 bits wide so that inputs larger than 2 GB do not overflow.
  * 
  * These functions are used to:
  * - Analyze the distribution of letters in English text
@@ -15,5 +24,37 @@
  * - Help determine if text is actually English (by comparing letter frequencies)
  */
 
-int letter_count(char * );  /* Counts total number of letters in a string */
-int * frequency_table(char *);  /* Creates a frequency table of letter occurrences */
+#ifndef FREQUENCY_TABLE_H
+#define FREQUENCY_TABLE_H
+
+#include <stddef.h>   /* For size_t */
+#include <stdint.h>   /* For 64-bit counters */
+
+/* Letter histogram; usually lives on the caller's stack */
+typedef struct freq_hist {
+    uint64_t counts[26];  /* Occurrences of each letter (index 0 is 'A' or 'a') */
+    uint64_t letters;     /* Total letters counted (sum of counts) */
+    uint64_t bytes;       /* Total bytes examined */
+} freq_hist;
+
+/* Byte classes in freq_class[]; bytes 0x80-0xFF are FREQ_HIGH and nothing else */
+#define FREQ_UPPER 0x01   /* A-Z */
+#define FREQ_LOWER 0x02   /* a-z */
+#define FREQ_DIGIT 0x04   /* 0-9 */
+#define FREQ_SPACE 0x08   /* Space, \t, \n, \v, \f and \r */
+#define FREQ_PUNCT 0x10   /* Other printable ASCII */
+#define FREQ_CNTRL 0x20   /* Other ASCII control codes, including DEL */
+#define FREQ_HIGH  0x40   /* Not ASCII */
+#define FREQ_ALPHA (FREQ_UPPER | FREQ_LOWER)
+
+/* Class of every byte value, the same in every locale */
+extern const unsigned char freq_class[256];
+
+void freq_hist_clear(freq_hist * hist);  /* Resets all counters to zero */
+void freq_hist_update(freq_hist * hist, const char * text, size_t length);  /* Adds length bytes */
+void freq_hist_merge(freq_hist * into, const freq_hist * from);  /* Adds one histogram to another */
+
+uint64_t letter_count(char * );  /* Counts total number of letters in a string */
+uint64_t * frequency_table(char *);  /* Creates a frequency table of letter occurrences */
+
+#endif
@@ -0,0 +1,106 @@
+/*
+ * iopolicy.h
+ *
+ * This header file defines the I/O policies copyrecords and decode can read
+ * and write large files with (--io). Reading a big archive through the page
+ * cache pushes everything else on the host out of it, so a one-off copy can
+ * slow down unrelated services for long after it has finished.
+ *
+ * Policies:
+ *   buffered - Plain reads and writes through the page cache (the default)
+ *   stream   - Through the page cache, but announced as sequential, read
+ *              ahead of the cursor, and dropped (POSIX_FADV_DONTNEED) behind
+ *              it: the input once it has been read, the output once it has
+ *              been written back
+ *   direct   - O_DIRECT: the page cache is bypassed; reads and writes use
+ *              aligned buffers and are split into several requests in flight
+ *              at once (the queue depth, --io-depth)
+ *
+ * Key Features:
+ * 1. One interface: Files are read with io_read_at() and written in order
+ *    with io_append(), whatever the policy
+ * 2. Fallback: A file system that refuses O_DIRECT (tmpfs) gets the stream
+ *    policy instead, with a note on stderr
+ * 3. Report: io_report() prints the bytes moved and how much of the file is
+ *    in the page cache (--io-stats), so the policies can be compared
+ */
+
+#ifndef IOPOLICY_H
+#define IOPOLICY_H
+
+#include <stdio.h>       /* For FILE */
+#include <stdint.h>      /* For uint64_t */
+#include <sys/types.h>   /* For off_t and ssize_t */
+
+/* Alignment of O_DIRECT offsets, lengths and buffers */
+#define IO_ALIGN 4096
+
+/* Default number of direct requests in flight */
+#define IO_DEFAULT_DEPTH 4
+
+/* Most direct requests in flight */
+#define IO_MAX_DEPTH 64
+
+/* How a file is read or written */
+typedef enum io_policy {
+    IO_BUFFERED,
+    IO_STREAM,
+    IO_DIRECT
+} io_policy;
+
+/* An open file and its counters */
+typedef struct io_file {
+    int fd;
+    const char * path;
+    io_policy policy;        /* Policy in use (direct may have fallen back to stream) */
+    int depth;               /* Direct requests in flight */
+    int writing;             /* Non-zero if opened for io_append() */
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    off_t offset;            /* End of what io_append() has written */
+    off_t dropped;           /* Output before this has been written back and dropped (stream) */
+    char * stage;            /* Direct writes: aligned staging buffer */
+    size_t staged;           /* Bytes waiting in stage */
+    double resident_before;  /* Fraction of the file cached when opened, or -1 */
+} io_file;
+
+/* Parses "buffered", "stream" or "direct"; returns 0, or -1 if unknown */
+int io_policy_parse(const char * text, io_policy * policy);
+
+/* Returns the name of a policy */
+const char * io_policy_name(io_policy policy);
+
+/* Allocates a buffer usable for direct I/O (aligned, rounded up to IO_ALIGN); free with free() */
+void * io_alloc(size_t bytes);
+
+/*
+ * Opens path for reading (writing == 0) or for writing from the start,
+ * truncating it. Returns 0, or -1 if it cannot be opened (a message is
+ * printed to stderr).
+ */
+int io_open(io_file * file, const char * path, int writing, io_policy policy, int depth);
+
+/*
+ * Reads up to length bytes at offset into buffer, stopping early only at
+ * the end of the file. With the direct policy, buffer must come from
+ * io_alloc() with room for length rounded up to IO_ALIGN, and offset must
+ * be a multiple of IO_ALIGN. Returns the bytes read, or -1 on an error.
+ */
+ssize_t io_read_at(io_file * file, void * buffer, size_t length, off_t offset);
+
+/* Hints that length bytes at offset will be read next (stream policy) */
+void io_prefetch(io_file * file, off_t offset, size_t length);
+
+/* Writes length bytes after what was written before; returns 0, or -1 on an error */
+int io_append(io_file * file, const void * data, size_t length);
+
+/* Writes out anything staged and closes the file; returns 0, or -1 on an error */
+int io_close(io_file * file);
+
+/* Returns the fraction of path's pages in the page cache, or -1 if unknown */
+double io_residency(const char * path);
+
+/* Prints a file's policy, bytes moved and page cache residency (before and now) */
+void io_report(FILE * out, const io_file * file);
+
+#endif
@@ -0,0 +1,415 @@
+/*
+ * iopolicy_lib.c
+ *
+ * This file implements the I/O policies declared in iopolicy.h.
+ *
+ * Key Implementation Details:
+ * 1. Stream reads: posix_fadvise(SEQUENTIAL) when the file is opened,
+ *    WILLNEED for the range the caller will read next, and DONTNEED for
+ *    each range as soon as it has been copied out
+ * 2. Stream writes: Each write is followed by sync_file_range(WRITE), which
+ *    starts writeback without waiting; once IO_DROP_BYTES more have been
+ *    written, the older range is waited for and dropped, so dirty pages
+ *    never pile up and clean ones do not linger
+ * 3. Direct reads: A read is rounded up to IO_ALIGN and split into up to
+ *    depth aligned pieces, each read by its own thread (parallel_run()), so
+ *    that many requests reach the device at once
+ * 4. Direct writes: Aligned data is written straight from the caller's
+ *    buffer; anything else goes through an aligned staging buffer. The
+ *    last, partial page is written after clearing O_DIRECT with fcntl()
+ * 5. Residency: The file is mapped and mincore() tells which of its pages
+ *    are in the page cache; the mapping itself reads nothing
+ */
+
+#define _GNU_SOURCE   /* For O_DIRECT, sync_file_range() and mincore() */
+
+#include "iopolicy.h"
+#include "parallel.h"    /* For parallel_run() */
+#include <stdlib.h>      /* For posix_memalign() */
+#include <string.h>      /* For memcpy() */
+#include <errno.h>       /* For EINVAL and EINTR */
+#include <fcntl.h>       /* For open() and posix_fadvise() */
+#include <unistd.h>      /* For pread() and pwrite() */
+#include <sys/mman.h>    /* For mmap() and mincore() */
+#include <sys/stat.h>    /* For fstat() */
+
+/* Stream writes: written-back output is dropped this much at a time */
+#define IO_DROP_BYTES (8 * 1024 * 1024)
+
+/* Direct writes: size of the staging buffer */
+#define IO_STAGE_BYTES (8 * 1024 * 1024)
+
+/* Direct requests are not split below this size */
+#define IO_PIECE_MIN (256 * 1024)
+
+/* Residency: pages checked per mincore() call */
+#define IO_RESIDENCY_PAGES 65536
+
+/* One direct request, run on its own thread */
+typedef struct io_piece {
+    int fd;
+    char * buffer;
+    size_t length;
+    off_t offset;
+    int writing;
+    ssize_t done;     /* Bytes moved, or -1 on an error */
+} io_piece;
+
+/* Parses a policy name */
+int io_policy_parse(const char * text, io_policy * policy) {
+    if (strcmp(text, "buffered") == 0) {
+        *policy = IO_BUFFERED;
+    } else if (strcmp(text, "stream") == 0) {
+        *policy = IO_STREAM;
+    } else if (strcmp(text, "direct") == 0) {
+        *policy = IO_DIRECT;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* Returns the name of a policy */
+const char * io_policy_name(io_policy policy) {
+    return policy == IO_DIRECT ? "direct" : policy == IO_STREAM ? "stream" : "buffered";
+}
+
+/* Allocates an aligned buffer, rounded up to a whole number of IO_ALIGN blocks */
+void * io_alloc(size_t bytes) {
+    void * buffer = NULL;
+    size_t rounded = (bytes + IO_ALIGN - 1) / IO_ALIGN * IO_ALIGN;
+    if (posix_memalign(&buffer, IO_ALIGN, rounded > 0 ? rounded : IO_ALIGN) != 0) {
+        return NULL;
+    }
+    return buffer;
+}
+
+/* Thread body: moves one piece, retrying short transfers until the end of the file */
+static void * io_piece_run(void * arg) {
+    io_piece * piece = arg;
+    size_t done = 0;
+    while (done < piece->length) {
+        ssize_t n = piece->writing
+            ? pwrite(piece->fd, piece->buffer + done, piece->length - done, piece->offset + (off_t) done)
+            : pread(piece->fd, piece->buffer + done, piece->length - done, piece->offset + (off_t) done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            piece->done = -1;
+            return NULL;
+        }
+        if (n == 0) {
+            break;
+        }
+        done += (size_t) n;
+    }
+    piece->done = (ssize_t) done;
+    return NULL;
+}
+
+/*
+ * io_transfer
+ *
+ * Purpose: Reads or writes a range as up to depth pieces in flight at once
+ *
+ * Returns:
+ *   The bytes moved (for a read, up to the end of the file), or -1
+ */
+static ssize_t io_transfer(const io_file * file, char * buffer, size_t length, off_t offset, int writing) {
+    io_piece pieces[IO_MAX_DEPTH];
+    int count = 1;
+    if (file->policy == IO_DIRECT) {
+        size_t most = length / IO_PIECE_MIN;
+        count = most < (size_t) file->depth ? (int) most : file->depth;
+        count = count < 1 ? 1 : count;
+    }
+    size_t blocks = (length + IO_ALIGN - 1) / IO_ALIGN;
+    for (int i = 0; i < count; i++) {
+        size_t first = count == 1 ? 0 : blocks * i / count * IO_ALIGN;
+        size_t end = count == 1 ? length : blocks * (i + 1) / count * IO_ALIGN;
+        if (end > length) {
+            end = length;
+        }
+        pieces[i].fd = file->fd;
+        pieces[i].buffer = buffer + first;
+        pieces[i].length = end - first;
+        pieces[i].offset = offset + (off_t) first;
+        pieces[i].writing = writing;
+        pieces[i].done = 0;
+    }
+    parallel_run(count, io_piece_run, pieces, sizeof(io_piece));
+
+    /* The pieces are contiguous: the transfer ends at the first short piece */
+    size_t total = 0;
+    for (int i = 0; i < count; i++) {
+        if (pieces[i].done < 0) {
+            return -1;
+        }
+        total += (size_t) pieces[i].done;
+        if ((size_t) pieces[i].done < pieces[i].length) {
+            if (writing) {
+                return -1;
+            }
+            break;
+        }
+    }
+    return (ssize_t) total;
+}
+
+/*
+ * io_open
+ *
+ * Purpose: Opens a file with a policy
+ *
+ * How it works:
+ * 1. Notes how much of an existing input is cached, for the report
+ * 2. For direct I/O, opens with O_DIRECT; if the file system refuses it,
+ *    falls back to the stream policy
+ * 3. For streaming, announces sequential access
+ */
+int io_open(io_file * file, const char * path, int writing, io_policy policy, int depth) {
+    int flags = writing ? O_WRONLY | O_CREAT | O_TRUNC : O_RDONLY;
+    memset(file, 0, sizeof(*file));
+    file->path = path;
+    file->policy = policy;
+    file->depth = depth < 1 ? 1 : depth > IO_MAX_DEPTH ? IO_MAX_DEPTH : depth;
+    file->writing = writing;
+    file->resident_before = writing ? -1 : io_residency(path);
+    file->fd = -1;
+
+    if (policy == IO_DIRECT) {
+        file->fd = open(path, flags | O_DIRECT, 0666);
+        if (file->fd < 0 && errno == EINVAL) {
+            fprintf(stderr, "%s does not support direct I/O; streaming it instead.\n", path);
+            file->policy = IO_STREAM;
+        }
+        if (file->fd >= 0 && writing) {
+            file->stage = io_alloc(IO_STAGE_BYTES);
+            if (file->stage == NULL) {
+                fprintf(stderr, "Out of memory.\n");
+                close(file->fd);
+                file->fd = -1;
+                return -1;
+            }
+        }
+    }
+    if (file->policy != IO_DIRECT) {
+        file->fd = open(path, flags, 0666);
+    }
+    if (file->fd < 0) {
+        fprintf(stderr, "Could not open %s file %s\n", writing ? "output" : "input", path);
+        return -1;
+    }
+    if (file->policy == IO_STREAM && !writing) {
+        posix_fadvise(file->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+    return 0;
+}
+
+/* Reads a range; with streaming, the range is dropped from the cache once copied */
+ssize_t io_read_at(io_file * file, void * buffer, size_t length, off_t offset) {
+    size_t want = length;
+    if (file->policy == IO_DIRECT) {
+        want = (length + IO_ALIGN - 1) / IO_ALIGN * IO_ALIGN;
+    }
+    ssize_t got = io_transfer(file, buffer, want, offset, 0);
+    if (got < 0) {
+        return -1;
+    }
+    if ((size_t) got > length) {
+        got = (ssize_t) length;
+    }
+    if (file->policy == IO_STREAM && got > 0) {
+        posix_fadvise(file->fd, offset, got, POSIX_FADV_DONTNEED);
+    }
+    file->bytes_read += (uint64_t) got;
+    return got;
+}
+
+/* Starts reading a range into the cache ahead of the cursor */
+void io_prefetch(io_file * file, off_t offset, size_t length) {
+    if (file->policy == IO_STREAM && length > 0) {
+        posix_fadvise(file->fd, offset, (off_t) length, POSIX_FADV_WILLNEED);
+    }
+}
+
+/* Streaming: waits for the written-back range before the newest write and drops it */
+static void io_drop_behind(io_file * file, off_t end, int all) {
+    if (end - file->dropped >= IO_DROP_BYTES || (all && end > file->dropped)) {
+        sync_file_range(file->fd, file->dropped, end - file->dropped,
+                        SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+        posix_fadvise(file->fd, file->dropped, end - file->dropped, POSIX_FADV_DONTNEED);
+        file->dropped = end;
+    }
+}
+
+/* Direct: writes the whole blocks of the staging buffer and keeps the rest */
+static int io_flush_stage(io_file * file) {
+    size_t whole = file->staged / IO_ALIGN * IO_ALIGN;
+    if (whole == 0) {
+        return 0;
+    }
+    if (io_transfer(file, file->stage, whole, file->offset, 1) < 0) {
+        return -1;
+    }
+    file->offset += (off_t) whole;
+    memmove(file->stage, file->stage + whole, file->staged - whole);
+    file->staged -= whole;
+    return 0;
+}
+
+/*
+ * io_append
+ *
+ * Purpose: Writes data after everything written before
+ *
+ * How it works:
+ *   Buffered and stream writes go straight to the file (streaming then
+ *   starts writeback and drops older output). Direct writes of aligned data
+ *   with nothing staged go straight from data; the rest is staged
+ */
+int io_append(io_file * file, const void * data, size_t length) {
+    const char * p = data;
+    file->bytes_written += length;
+
+    if (file->policy != IO_DIRECT) {
+        off_t start = file->offset;
+        io_piece piece = { file->fd, (char *) p, length, start, 1, 0 };
+        io_piece_run(&piece);
+        if (piece.done != (ssize_t) length) {
+            return -1;
+        }
+        file->offset += (off_t) length;
+        if (file->policy == IO_STREAM) {
+            sync_file_range(file->fd, start, (off_t) length, SYNC_FILE_RANGE_WRITE);
+            io_drop_behind(file, start, 0);
+        }
+        return 0;
+    }
+
+    if (file->staged == 0 && ((uintptr_t) p % IO_ALIGN) == 0 && length >= IO_ALIGN) {
+        size_t whole = length / IO_ALIGN * IO_ALIGN;
+        if (io_transfer(file, (char *) p, whole, file->offset, 1) < 0) {
+            return -1;
+        }
+        file->offset += (off_t) whole;
+        p += whole;
+        length -= whole;
+    }
+    while (length > 0) {
+        size_t room = IO_STAGE_BYTES - file->staged;
+        size_t part = length < room ? length : room;
+        memcpy(file->stage + file->staged, p, part);
+        file->staged += part;
+        p += part;
+        length -= part;
+        if (file->staged == IO_STAGE_BYTES && io_flush_stage(file) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * io_close
+ *
+ * Purpose: Finishes a file
+ *
+ * How it works:
+ *   Direct: writes the staged whole blocks, then clears O_DIRECT and writes
+ *   the last partial block normally. Stream: waits for the rest of the
+ *   output to be written back and drops it
+ */
+int io_close(io_file * file) {
+    int status = 0;
+    if (file->writing && file->policy == IO_DIRECT) {
+        status = io_flush_stage(file);
+        if (status == 0 && file->staged > 0) {
+            int flags = fcntl(file->fd, F_GETFL);
+            io_piece piece = { file->fd, file->stage, file->staged, file->offset, 1, 0 };
+            if (flags < 0 || fcntl(file->fd, F_SETFL, flags & ~O_DIRECT) != 0) {
+                status = -1;
+            } else {
+                io_piece_run(&piece);
+                status = piece.done == (ssize_t) file->staged ? 0 : -1;
+                file->offset += (off_t) file->staged;
+                file->staged = 0;
+            }
+        }
+        free(file->stage);
+        file->stage = NULL;
+    }
+    if (file->writing && file->policy == IO_STREAM) {
+        io_drop_behind(file, file->offset, 1);
+    }
+    if (close(file->fd) != 0) {
+        status = -1;
+    }
+    file->fd = -1;
+    return status;
+}
+
+/*
+ * io_residency
+ *
+ * Purpose: Measures how much of a file is in the page cache
+ *
+ * Returns:
+ *   Resident pages over all pages (1 for an empty file), or -1 if the file
+ *   cannot be opened or mapped
+ */
+double io_residency(const char * path) {
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return -1;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return 1;
+    }
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t pages = ((size_t) st.st_size + page - 1) / page;
+    char * map = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    unsigned char vector[IO_RESIDENCY_PAGES];
+    size_t resident = 0;
+    int failed = 0;
+    for (size_t first = 0; first < pages && !failed; first += IO_RESIDENCY_PAGES) {
+        size_t count = pages - first < IO_RESIDENCY_PAGES ? pages - first : IO_RESIDENCY_PAGES;
+        size_t bytes = first + count == pages ? (size_t) st.st_size - first * page : count * page;
+        if (mincore(map + first * page, bytes, vector) != 0) {
+            failed = 1;
+            break;
+        }
+        for (size_t i = 0; i < count; i++) {
+            resident += vector[i] & 1;
+        }
+    }
+    munmap(map, (size_t) st.st_size);
+    return failed ? -1 : (double) resident / (double) pages;
+}
+
+/* Prints one line about a file: policy, bytes and cache residency */
+void io_report(FILE * out, const io_file * file) {
+    double now = io_residency(file->path);
+    fprintf(out, "%s: %s, %llu bytes %s", file->path, io_policy_name(file->policy),
+            (unsigned long long) (file->writing ? file->bytes_written : file->bytes_read),
+            file->writing ? "written" : "read");
+    if (file->resident_before >= 0) {
+        fprintf(out, ", %.1f%% cached before", 100.0 * file->resident_before);
+    }
+    if (now >= 0) {
+        fprintf(out, ", %.1f%% cached now", 100.0 * now);
+    }
+    fprintf(out, "\n");
+}
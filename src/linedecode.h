@@ -0,0 +1,48 @@
+/*
+ * linedecode.h
+ *
+ * This header file defines the interface for message mode (decode
+ * --per-line): the input is a stream of messages separated by a delimiter
+ * (a newline by default), each encoded with its own shift. Every message is
+ * analysed and decoded on its own and written out in the same order, with
+ * the same delimiters.
+ *
+ * Key Features:
+ * 1. Streaming: The input is read in blocks and written as soon as each
+ *    block is decoded, so memory stays bounded (by the block size, or by
+ *    the longest message if that is larger) and output keeps up with a
+ *    slow producer
+ * 2. Batched: Messages are counted into histograms and scored in batches
+ *    of LINE_BATCH with decode_best_languages()
+ * 3. Parallel: Each block is split at delimiters into one part per thread
+ */
+
+#ifndef LINEDECODE_H
+#define LINEDECODE_H
+
+#include "decode_lib.h"   /* For decode_ctx */
+#include <stdio.h>        /* For FILE */
+
+/* Messages scored together */
+#define LINE_BATCH 256
+
+/* What to do with each message */
+typedef struct line_options {
+    char delimiter;                  /* Byte ending each message */
+    int threads;                     /* Threads decoding parts of a block */
+    decode_ctx * const * ctxs;       /* Languages to try (see decode_best_languages) */
+    int languages;
+    const char * const * names;      /* Name of each language, for show_language */
+    int show_shift;                  /* 'S' or 's' to put the encoding or decoding shift before each message, else 0 */
+    int show_language;               /* Non-zero to put the language before each message */
+} line_options;
+
+/*
+ * Decodes every message of in and writes it to out (out may be NULL to
+ * only analyse). Prefixes requested by the options are followed by a tab.
+ * Returns 0 on success, -1 on an I/O or memory error (a message is printed
+ * to stderr).
+ */
+int decode_lines(FILE * in, FILE * out, const line_options * options);
+
+#endif
@@ -0,0 +1,325 @@
+/*
+ * linedecode_lib.c
+ *
+ * This file implements message mode, declared in linedecode.h.
+ *
+ * Key Implementation Details:
+ * 1. Reading: read() on the input's descriptor. After each read, more is
+ *    read straight away only while poll() says data is waiting, so a busy
+ *    stream is handled in full blocks and a quiet one without delay
+ * 2. Blocks: Everything up to the last delimiter read so far is decoded in
+ *    place; the unfinished message after it is moved to the front of the
+ *    buffer for the next block. A message longer than the buffer doubles it
+ * 3. Parts: A block big enough to be worth it is cut into one part per
+ *    thread, each cut moved forward to just after a delimiter, and the
+ *    parts are decoded by parallel_run() and written in order
+ * 4. Batches: Within a part, up to LINE_BATCH messages are counted with
+ *    freq_hist_update(), scored together and then shifted with
+ *    decode_apply()
+ */
+
+#define _GNU_SOURCE   /* For memrchr() */
+
+#include "linedecode.h"
+#include "frequency_table.h"  /* For freq_hist */
+#include "parallel.h"         /* For parallel_run() */
+#include <stdlib.h>           /* For memory management */
+#include <string.h>           /* For memchr() and memrchr() */
+#include <stdint.h>           /* For fixed-width integers */
+#include <errno.h>            /* For EINTR */
+#include <poll.h>             /* For poll() */
+#include <unistd.h>           /* For read() */
+
+/* Bytes read per thread for each block */
+#define LINE_CHUNK (1 << 20)
+
+/* Smallest part worth its own thread */
+#define LINE_MIN_PART (64 * 1024)
+
+/* One thread's share of a block */
+typedef struct line_part {
+    const line_options * options;
+    char * start;                 /* Whole messages; the last may lack a delimiter at the end of input */
+    size_t length;
+    size_t messages;              /* Messages in the part (filled in when prefixes are wanted) */
+    size_t capacity;              /* Entries allocated below */
+    size_t * ends;                /* Offset just past each message and its delimiter */
+    unsigned char * shifts;       /* Encoding shift of each message */
+    signed char * languages;      /* Language of each message (-1 if none fits) */
+    int failed;
+    char pad[PARALLEL_CACHE_LINE];   /* Keeps neighbouring parts' results apart */
+} line_part;
+
+/*
+ * record_batch
+ *
+ * Purpose: Keeps the results of a batch for the prefixes written later
+ *
+ * Returns:
+ *   0, or -1 if out of memory
+ */
+static int record_batch(line_part * part, const size_t * ends, const int * shifts,
+                        const int * languages, size_t n) {
+    if (part->messages + n > part->capacity) {
+        size_t grown = part->capacity == 0 ? 4096 : part->capacity * 2;
+        while (grown < part->messages + n) {
+            grown *= 2;
+        }
+        size_t * new_ends = realloc(part->ends, grown * sizeof(size_t));
+        if (new_ends != NULL) {
+            part->ends = new_ends;
+        }
+        unsigned char * new_shifts = realloc(part->shifts, grown);
+        if (new_shifts != NULL) {
+            part->shifts = new_shifts;
+        }
+        signed char * new_languages = realloc(part->languages, grown);
+        if (new_languages != NULL) {
+            part->languages = new_languages;
+        }
+        if (new_ends == NULL || new_shifts == NULL || new_languages == NULL) {
+            return -1;
+        }
+        part->capacity = grown;
+    }
+    for (size_t i = 0; i < n; i++) {
+        part->ends[part->messages + i] = ends[i];
+        part->shifts[part->messages + i] = (unsigned char) shifts[i];
+        part->languages[part->messages + i] = (signed char) languages[i];
+    }
+    part->messages += n;
+    return 0;
+}
+
+/*
+ * decode_part
+ *
+ * Purpose: Thread body; decodes every message of one part in place
+ *
+ * How it works:
+ * 1. Finds each delimiter with memchr() and counts the message into the
+ *    next histogram of the batch
+ * 2. When the batch is full (or the part ends), scores the whole batch at
+ *    once and shifts each message back by its own shift
+ */
+static void * decode_part(void * arg) {
+    line_part * part = arg;
+    const line_options * options = part->options;
+    int keep = options->show_shift != 0 || options->show_language;
+
+    freq_hist hists[LINE_BATCH];
+    char * texts[LINE_BATCH];
+    size_t lengths[LINE_BATCH];
+    size_t ends[LINE_BATCH];
+    int shifts[LINE_BATCH];
+    int languages[LINE_BATCH];
+
+    part->messages = 0;
+    char * p = part->start;
+    char * end = part->start + part->length;
+    while (p < end) {
+        size_t n = 0;
+        while (n < LINE_BATCH && p < end) {
+            char * stop = memchr(p, options->delimiter, (size_t) (end - p));
+            char * next = stop != NULL ? stop + 1 : end;
+            texts[n] = p;
+            lengths[n] = (size_t) ((stop != NULL ? stop : end) - p);
+            ends[n] = (size_t) (next - part->start);
+            freq_hist_clear(&hists[n]);
+            freq_hist_update(&hists[n], p, lengths[n]);
+            n++;
+            p = next;
+        }
+
+        decode_best_languages(options->ctxs, options->languages, hists, n, shifts, languages);
+        for (size_t i = 0; i < n; i++) {
+            decode_apply(options->ctxs[0], texts[i], lengths[i], to_decode(shifts[i]));
+        }
+        if (keep && record_batch(part, ends, shifts, languages, n) != 0) {
+            part->failed = 1;
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * write_part
+ *
+ * Purpose: Writes a decoded part, with the requested prefixes
+ *
+ * Returns:
+ *   0, or -1 on a write error
+ */
+static int write_part(const line_part * part, FILE * out) {
+    const line_options * options = part->options;
+    if (options->show_shift == 0 && !options->show_language) {
+        return fwrite(part->start, 1, part->length, out) == part->length ? 0 : -1;
+    }
+
+    size_t begin = 0;
+    for (size_t i = 0; i < part->messages; i++) {
+        if (options->show_language) {
+            int language = part->languages[i];
+            fprintf(out, "%s\t", language >= 0 ? options->names[language] : "unknown");
+        }
+        if (options->show_shift == 'S') {
+            fprintf(out, "%d\t", part->shifts[i]);
+        } else if (options->show_shift == 's') {
+            fprintf(out, "%d\t", to_decode(part->shifts[i]));
+        }
+        fwrite(part->start + begin, 1, part->ends[i] - begin, out);
+        begin = part->ends[i];
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+/*
+ * decode_block
+ *
+ * Purpose: Decodes length bytes of whole messages and writes them out
+ *
+ * How it works:
+ *   Uses one part per LINE_MIN_PART bytes, up to the thread count; each
+ *   cut is moved forward to just after the next delimiter, so no message
+ *   is split between parts
+ */
+static int decode_block(char * block, size_t length, line_part * parts, int threads,
+                        const line_options * options, FILE * out) {
+    size_t wanted = length / LINE_MIN_PART;
+    int n = wanted < (size_t) threads ? (int) wanted : threads;
+    if (n < 1) {
+        n = 1;
+    }
+
+    size_t from = 0;
+    for (int t = 0; t < n; t++) {
+        size_t to = length;
+        if (t + 1 < n) {
+            size_t cut = length / n * (t + 1);
+            if (cut < from) {
+                cut = from;
+            }
+            char * stop = memchr(block + cut, options->delimiter, length - cut);
+            to = stop != NULL ? (size_t) (stop - block) + 1 : length;
+        }
+        parts[t].start = block + from;
+        parts[t].length = to - from;
+        from = to;
+    }
+    parallel_run(n, decode_part, parts, sizeof(line_part));
+
+    for (int t = 0; t < n; t++) {
+        if (parts[t].failed) {
+            fprintf(stderr, "Out of memory.\n");
+            return -1;
+        }
+        if (out != NULL && write_part(&parts[t], out) != 0) {
+            fprintf(stderr, "Could not write decoded messages\n");
+            return -1;
+        }
+    }
+    if (out != NULL) {
+        fflush(out);
+    }
+    return 0;
+}
+
+/* Returns non-zero if a read from fd would not wait */
+static int input_waiting(int fd) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) > 0;
+}
+
+/*
+ * decode_lines
+ *
+ * Purpose: Runs message mode over a whole stream
+ *
+ * How it works:
+ * 1. Reads into the buffer after any unfinished message from last time
+ * 2. Decodes up to the last delimiter (everything, at the end of input)
+ * 3. Moves the unfinished message to the front and repeats
+ */
+int decode_lines(FILE * in, FILE * out, const line_options * options) {
+    int threads = options->threads > 0 ? options->threads : 1;
+    int fd = fileno(in);
+    size_t capacity = (size_t) LINE_CHUNK * threads;
+    char * buffer = malloc(capacity);
+    line_part * parts = calloc((size_t) threads, sizeof(line_part));
+    if (buffer == NULL || parts == NULL) {
+        free(buffer);
+        free(parts);
+        fprintf(stderr, "Out of memory.\n");
+        return -1;
+    }
+    for (int t = 0; t < threads; t++) {
+        parts[t].options = options;
+    }
+
+    size_t filled = 0;
+    int eof = 0;
+    int failed = 0;
+    while (!failed && !eof) {
+        size_t old = filled;
+        do {
+            ssize_t got = read(fd, buffer + filled, capacity - filled);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            if (got < 0) {
+                fprintf(stderr, "Could not read input\n");
+                failed = 1;
+                break;
+            }
+            if (got == 0) {
+                eof = 1;
+                break;
+            }
+            filled += (size_t) got;
+        } while (filled < capacity && input_waiting(fd));
+        if (failed) {
+            break;
+        }
+
+        size_t length = filled;
+        if (!eof) {
+            /* The carried bytes before old hold no delimiter */
+            char * last = memrchr(buffer + old, options->delimiter, filled - old);
+            if (last == NULL) {
+                /* No complete message yet: make room for a longer one if full */
+                if (filled == capacity) {
+                    char * bigger = realloc(buffer, capacity * 2);
+                    if (bigger == NULL) {
+                        fprintf(stderr, "Out of memory.\n");
+                        failed = 1;
+                        break;
+                    }
+                    buffer = bigger;
+                    capacity *= 2;
+                }
+                continue;
+            }
+            length = (size_t) (last - buffer) + 1;
+        }
+
+        if (length > 0 && decode_block(buffer, length, parts, threads, options, out) != 0) {
+            failed = 1;
+            break;
+        }
+        memmove(buffer, buffer + length, filled - length);
+        filled -= length;
+    }
+
+    for (int t = 0; t < threads; t++) {
+        free(parts[t].ends);
+        free(parts[t].shifts);
+        free(parts[t].languages);
+    }
+    free(parts);
+    free(buffer);
+    return failed ? -1 : 0;
+}
@@ -0,0 +1,285 @@
+/*
+ * mkdict.c
+ *
+ * This is a build-time tool: it turns the word list (words.txt) into the
+ * perfect hash table that dictionary_lib.c compiles in (dict_table.h).
+ *
+ * Usage:
+ *   ./mkdict words.txt dict_table.h
+ *
+ * Key Implementation Details:
+ * 1. Hash and displace: Words are put into buckets of about four by
+ *    dict_hash(word, 0). Buckets are placed largest first; for each, the
+ *    smallest displacement d is found for which dict_hash(word, d) sends
+ *    every word of the bucket to a different free slot. A lookup therefore
+ *    reads exactly one slot
+ * 2. Size: The table has a quarter more slots than words, which keeps the
+ *    search short; each slot is a 16-bit offset into one string of all the
+ *    words and a length byte (0 for an empty slot)
+ * 3. Checks: Blank lines and lines starting with '#' are skipped; a word
+ *    that is not all lower-case letters, too long, or repeated is an error,
+ *    so a bad list fails the build instead of producing a bad table
+ */
+
+#include "dict_hash.h"     /* For dict_hash() */
+#include "dictionary.h"    /* For DICT_MAX_WORD */
+#include <stdio.h>         /* For file operations */
+#include <stdlib.h>        /* For memory management */
+#include <string.h>        /* For strlen() and memcmp() */
+
+/* Largest displacement tried for a bucket, and most words a bucket may get */
+#define MAX_DISPLACEMENT 65535
+#define MAX_BUCKET 64
+
+typedef struct word_entry {
+    char text[DICT_MAX_WORD];
+    size_t length;
+    size_t offset;          /* Offset in the string of all words */
+    unsigned int bucket;
+} word_entry;
+
+typedef struct bucket_entry {
+    unsigned int index;
+    unsigned int size;
+    unsigned int first;     /* First of its words in the sorted list */
+} bucket_entry;
+
+static unsigned int num_buckets;
+
+/* Orders words by bucket, so each bucket's words are together */
+static int by_bucket(const void * a, const void * b) {
+    const word_entry * x = a;
+    const word_entry * y = b;
+    if (x->bucket != y->bucket) {
+        return x->bucket < y->bucket ? -1 : 1;
+    }
+    return strcmp(x->text, y->text);
+}
+
+/* Orders buckets largest first (then by index, so the output is reproducible) */
+static int by_size(const void * a, const void * b) {
+    const bucket_entry * x = a;
+    const bucket_entry * y = b;
+    if (x->size != y->size) {
+        return x->size > y->size ? -1 : 1;
+    }
+    return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+/*
+ * read_words
+ *
+ * Purpose: Reads and checks the word list
+ *
+ * Returns:
+ *   The number of words (entries are allocated into *words), or -1 on error
+ */
+static long read_words(const char * path, word_entry ** words) {
+    FILE * in = fopen(path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "mkdict: Could not open %s\n", path);
+        return -1;
+    }
+    size_t count = 0;
+    size_t capacity = 0;
+    word_entry * list = NULL;
+    char line[256];
+    int line_number = 0;
+    while (fgets(line, sizeof(line), in) != NULL) {
+        line_number++;
+        size_t length = strcspn(line, "\r\n");
+        line[length] = '\0';
+        if (length == 0 || line[0] == '#') {
+            continue;
+        }
+        int valid = length >= 2 && length < DICT_MAX_WORD;
+        for (size_t i = 0; i < length && valid; i++) {
+            valid = line[i] >= 'a' && line[i] <= 'z';
+        }
+        if (!valid) {
+            fprintf(stderr, "mkdict: %s:%d: \"%s\" is not a lower-case word of 2 to %d letters\n",
+                    path, line_number, line, DICT_MAX_WORD - 1);
+            free(list);
+            fclose(in);
+            return -1;
+        }
+        if (count == capacity) {
+            capacity = capacity == 0 ? 1024 : capacity * 2;
+            word_entry * bigger = realloc(list, capacity * sizeof(word_entry));
+            if (bigger == NULL) {
+                fprintf(stderr, "mkdict: Out of memory\n");
+                free(list);
+                fclose(in);
+                return -1;
+            }
+            list = bigger;
+        }
+        memcpy(list[count].text, line, length + 1);
+        list[count].length = length;
+        count++;
+    }
+    fclose(in);
+    *words = list;
+    return (long) count;
+}
+
+int main(int argc, char ** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s words.txt dict_table.h\n", argv[0]);
+        return 1;
+    }
+    word_entry * words = NULL;
+    long n = read_words(argv[1], &words);
+    if (n <= 0) {
+        if (n == 0) {
+            fprintf(stderr, "mkdict: %s holds no words\n", argv[1]);
+        }
+        return 1;
+    }
+
+    num_buckets = (unsigned int) ((n + 3) / 4);
+    unsigned int num_slots = (unsigned int) (n + n / 4 + 1);
+    for (long i = 0; i < n; i++) {
+        words[i].bucket = dict_hash(words[i].text, words[i].length, 0) % num_buckets;
+    }
+    qsort(words, (size_t) n, sizeof(word_entry), by_bucket);
+
+    /* Offsets follow the sorted order; a repeated word sorts next to its twin */
+    size_t pool_size = 0;
+    for (long i = 0; i < n; i++) {
+        if (i > 0 && strcmp(words[i].text, words[i - 1].text) == 0) {
+            fprintf(stderr, "mkdict: \"%s\" is listed twice\n", words[i].text);
+            free(words);
+            return 1;
+        }
+        words[i].offset = pool_size;
+        pool_size += words[i].length;
+    }
+    if (pool_size > 65535) {
+        fprintf(stderr, "mkdict: The words are too long in total for 16-bit offsets\n");
+        free(words);
+        return 1;
+    }
+
+    bucket_entry * buckets = calloc(num_buckets, sizeof(bucket_entry));
+    unsigned int * displace = calloc(num_buckets, sizeof(unsigned int));
+    long * slots = malloc(num_slots * sizeof(long));
+    if (buckets == NULL || displace == NULL || slots == NULL) {
+        fprintf(stderr, "mkdict: Out of memory\n");
+        free(words);
+        free(buckets);
+        free(displace);
+        free(slots);
+        return 1;
+    }
+    for (unsigned int b = 0; b < num_buckets; b++) {
+        buckets[b].index = b;
+    }
+    for (long i = n - 1; i >= 0; i--) {
+        buckets[words[i].bucket].size++;
+        buckets[words[i].bucket].first = (unsigned int) i;
+    }
+    qsort(buckets, num_buckets, sizeof(bucket_entry), by_size);
+    for (unsigned int s = 0; s < num_slots; s++) {
+        slots[s] = -1;
+    }
+
+    /* Place each bucket at the first displacement that fits all its words */
+    for (unsigned int b = 0; b < num_buckets && buckets[b].size > 0; b++) {
+        const bucket_entry * bucket = &buckets[b];
+        unsigned int chosen[MAX_BUCKET];
+        unsigned int d;
+        for (d = 1; d <= MAX_DISPLACEMENT; d++) {
+            unsigned int k;
+            for (k = 0; k < bucket->size; k++) {
+                const word_entry * w = &words[bucket->first + k];
+                unsigned int slot = dict_hash(w->text, w->length, d) % num_slots;
+                int clash = slots[slot] >= 0;
+                for (unsigned int j = 0; j < k && !clash; j++) {
+                    clash = chosen[j] == slot;
+                }
+                if (clash || k >= MAX_BUCKET) {
+                    break;
+                }
+                chosen[k] = slot;
+            }
+            if (k == bucket->size) {
+                break;
+            }
+        }
+        if (d > MAX_DISPLACEMENT) {
+            fprintf(stderr, "mkdict: No displacement fits bucket %u\n", bucket->index);
+            free(words);
+            free(buckets);
+            free(displace);
+            free(slots);
+            return 1;
+        }
+        displace[bucket->index] = d;
+        for (unsigned int k = 0; k < bucket->size; k++) {
+            slots[chosen[k]] = (long) (bucket->first + k);
+        }
+    }
+
+    FILE * out = fopen(argv[2], "w");
+    if (out == NULL) {
+        fprintf(stderr, "mkdict: Could not create %s\n", argv[2]);
+        free(words);
+        free(buckets);
+        free(displace);
+        free(slots);
+        return 1;
+    }
+    const char * name = strrchr(argv[1], '/');
+    fprintf(out, "/* Generated by mkdict from %s; do not edit */\n\n", name != NULL ? name + 1 : argv[1]);
+    fprintf(out, "#define DICT_WORDS %ld\n", n);
+    fprintf(out, "#define DICT_BUCKETS %u\n", num_buckets);
+    fprintf(out, "#define DICT_SLOTS %u\n\n", num_slots);
+
+    fprintf(out, "static const uint16_t dict_displace[DICT_BUCKETS] = {");
+    for (unsigned int b = 0; b < num_buckets; b++) {
+        fprintf(out, "%s%u,", b % 12 == 0 ? "\n    " : " ", displace[b]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const uint16_t dict_offsets[DICT_SLOTS] = {");
+    for (unsigned int s = 0; s < num_slots; s++) {
+        fprintf(out, "%s%lu,", s % 12 == 0 ? "\n    " : " ",
+                slots[s] >= 0 ? (unsigned long) words[slots[s]].offset : 0UL);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const unsigned char dict_lengths[DICT_SLOTS] = {");
+    for (unsigned int s = 0; s < num_slots; s++) {
+        fprintf(out, "%s%lu,", s % 16 == 0 ? "\n    " : " ",
+                slots[s] >= 0 ? (unsigned long) words[slots[s]].length : 0UL);
+    }
+    fprintf(out, "\n};\n\n");
+
+    fprintf(out, "static const char dict_pool[] =");
+    size_t column = 0;
+    for (long i = 0; i < n; i++) {
+        if (column == 0) {
+            fprintf(out, "\n    \"");
+        }
+        fprintf(out, "%s", words[i].text);
+        column += words[i].length;
+        if (column >= 64 || i == n - 1) {
+            fprintf(out, "\"");
+            column = 0;
+        }
+    }
+    fprintf(out, ";\n");
+
+    int failed = ferror(out);
+    if (fclose(out) != 0 || failed) {
+        fprintf(stderr, "mkdict: Could not write %s\n", argv[2]);
+        remove(argv[2]);
+        failed = 1;
+    }
+    free(words);
+    free(buckets);
+    free(displace);
+    free(slots);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,229 @@
+/*
+ * mkschema.c
+ *
+ * This is a build-time tool: it turns the record schemas in src/schemas
+ * (described in schema.h) into the field tables and decoders that
+ * schema_lib.c compiles in (schema_table.h).
+ *
+ * Usage:
+ *   ./mkschema schema_table.h default.schema events.schema ...
+ *
+ * Key Implementation Details:
+ * 1. Layout: Offsets are assigned in field order with no padding, and the
+ *    record size is their sum
+ * 2. Decoders: Each schema gets a function that decodes its string fields
+ *    with their offsets, widths and the record size written as constants;
+ *    a schema without strings gets one that does nothing
+ * 3. Checks: A bad line, a repeated schema or field name, a zero width or
+ *    count, or a schema with no fields is an error, so a bad schema fails
+ *    the build instead of producing a bad table
+ */
+
+#include <stdio.h>         /* For file operations */
+#include <stdlib.h>        /* For strtoul() */
+#include <string.h>        /* For strcmp() */
+#include <ctype.h>         /* For isalnum() on names */
+
+/* Limits of one build */
+#define MAX_SCHEMAS 32
+#define MAX_FIELDS 64
+#define MAX_NAME 32
+
+typedef struct field_def {
+    char name[MAX_NAME];
+    const char * type;      /* "string", "int" or "double" */
+    size_t offset;
+    size_t width;           /* Bytes per element */
+    size_t count;
+} field_def;
+
+typedef struct schema_def {
+    char name[MAX_NAME];
+    field_def fields[MAX_FIELDS];
+    size_t num_fields;
+    size_t size;
+} schema_def;
+
+static schema_def schemas[MAX_SCHEMAS];
+static size_t num_schemas;
+
+/* Returns non-zero if text is a C identifier that fits in MAX_NAME */
+static int valid_name(const char * text) {
+    if (strlen(text) >= MAX_NAME || !(isalpha((unsigned char) text[0]) || text[0] == '_')) {
+        return 0;
+    }
+    for (const char * p = text; *p != '\0'; p++) {
+        if (!isalnum((unsigned char) *p) && *p != '_') {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/*
+ * read_schema
+ *
+ * Purpose: Reads one schema file into schemas[]
+ *
+ * Returns:
+ *   0 on success, -1 on an error (reported with the file and line)
+ */
+static int read_schema(const char * path) {
+    FILE * in = fopen(path, "r");
+    if (in == NULL) {
+        fprintf(stderr, "mkschema: Could not open %s\n", path);
+        return -1;
+    }
+    char line[256];
+    int line_number = 0;
+    schema_def * current = NULL;
+    int status = 0;
+
+    while (status == 0 && fgets(line, sizeof(line), in) != NULL) {
+        char word[3][64];
+        char extra[2];
+        line_number++;
+        char * hash = strchr(line, '#');
+        if (hash != NULL) {
+            *hash = '\0';
+        }
+        int n = sscanf(line, "%63s %63s %63s %1s", word[0], word[1], word[2], extra);
+        if (n <= 0) {
+            continue;
+        }
+
+        if (n == 2 && strcmp(word[0], "schema") == 0 && valid_name(word[1])) {
+            for (size_t i = 0; i < num_schemas; i++) {
+                if (strcmp(schemas[i].name, word[1]) == 0) {
+                    fprintf(stderr, "mkschema: %s:%d: schema %s is defined twice\n", path, line_number, word[1]);
+                    status = -1;
+                }
+            }
+            if (status == 0 && num_schemas == MAX_SCHEMAS) {
+                fprintf(stderr, "mkschema: %s:%d: more than %d schemas\n", path, line_number, MAX_SCHEMAS);
+                status = -1;
+            }
+            if (status == 0) {
+                current = &schemas[num_schemas++];
+                strcpy(current->name, word[1]);
+            }
+            continue;
+        }
+
+        char * end = NULL;
+        unsigned long size = n == 3 ? strtoul(word[2], &end, 10) : 0;
+        const char * type = strcmp(word[0], "string") == 0 ? "string" :
+                            strcmp(word[0], "int") == 0 ? "int" :
+                            strcmp(word[0], "double") == 0 ? "double" : NULL;
+        if (current == NULL || n != 3 || type == NULL || !valid_name(word[1]) ||
+            *end != '\0' || size == 0 || size > 65536) {
+            fprintf(stderr, "mkschema: %s:%d: expected \"schema NAME\" or \"string|int|double NAME SIZE\"\n",
+                    path, line_number);
+            status = -1;
+            break;
+        }
+        for (size_t i = 0; i < current->num_fields; i++) {
+            if (strcmp(current->fields[i].name, word[1]) == 0) {
+                fprintf(stderr, "mkschema: %s:%d: field %s is defined twice\n", path, line_number, word[1]);
+                status = -1;
+            }
+        }
+        if (status == 0 && current->num_fields == MAX_FIELDS) {
+            fprintf(stderr, "mkschema: %s:%d: more than %d fields\n", path, line_number, MAX_FIELDS);
+            status = -1;
+        }
+        if (status == 0) {
+            field_def * f = &current->fields[current->num_fields++];
+            strcpy(f->name, word[1]);
+            f->type = type;
+            f->offset = current->size;
+            f->width = type[0] == 's' ? size : type[0] == 'i' ? 4 : 8;
+            f->count = type[0] == 's' ? 1 : size;
+            current->size += f->width * f->count;
+        }
+    }
+    fclose(in);
+
+    for (size_t i = 0; status == 0 && i < num_schemas; i++) {
+        if (schemas[i].num_fields == 0) {
+            fprintf(stderr, "mkschema: schema %s has no fields\n", schemas[i].name);
+            status = -1;
+        }
+    }
+    return status;
+}
+
+/* Writes the field table and the decoder of one schema */
+static void write_schema(FILE * out, const schema_def * s) {
+    fprintf(out, "/* %s: %zu bytes per record */\n", s->name, s->size);
+    fprintf(out, "static const schema_field schema_%s_fields[] = {\n", s->name);
+    for (size_t i = 0; i < s->num_fields; i++) {
+        const field_def * f = &s->fields[i];
+        fprintf(out, "    { \"%s\", SCHEMA_%s, %zu, %zu, %zu },\n", f->name,
+                f->type[0] == 's' ? "STRING" : f->type[0] == 'i' ? "INT" : "DOUBLE",
+                f->offset, f->width, f->count);
+    }
+    fprintf(out, "};\n\n");
+
+    fprintf(out, "static void schema_%s_decode(const decode_ctx * ctx, char * records, size_t count, int shift) {\n", s->name);
+    int strings = 0;
+    for (size_t i = 0; i < s->num_fields; i++) {
+        strings += s->fields[i].type[0] == 's';
+    }
+    if (strings == 0) {
+        fprintf(out, "    (void) ctx;\n    (void) records;\n    (void) count;\n    (void) shift;\n");
+    } else {
+        fprintf(out, "    for (size_t i = 0; i < count; i++) {\n");
+        fprintf(out, "        char * r = records + i * %zu;\n", s->size);
+        for (size_t i = 0; i < s->num_fields; i++) {
+            const field_def * f = &s->fields[i];
+            if (f->type[0] == 's') {
+                fprintf(out, "        schema_decode_string(ctx, r + %zu, %zu, shift);   /* %s */\n",
+                        f->offset, f->width, f->name);
+            }
+        }
+        fprintf(out, "    }\n");
+    }
+    fprintf(out, "}\n\n");
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "Usage: %s schema_table.h file.schema ...\n", argv[0]);
+        return 1;
+    }
+    for (int i = 2; i < argc; i++) {
+        if (read_schema(argv[i]) != 0) {
+            return 1;
+        }
+    }
+    FILE * out = fopen(argv[1], "w");
+    if (out == NULL) {
+        fprintf(stderr, "mkschema: Could not create %s\n", argv[1]);
+        return 1;
+    }
+
+    fprintf(out, "/* Generated by mkschema from");
+    for (int i = 2; i < argc; i++) {
+        const char * base = strrchr(argv[i], '/');
+        fprintf(out, " %s", base != NULL ? base + 1 : argv[i]);
+    }
+    fprintf(out, "; do not edit */\n\n");
+    for (size_t i = 0; i < num_schemas; i++) {
+        write_schema(out, &schemas[i]);
+    }
+    fprintf(out, "static const record_schema schema_table[] = {\n");
+    for (size_t i = 0; i < num_schemas; i++) {
+        fprintf(out, "    { \"%s\", %zu, schema_%s_fields, %zu, schema_%s_decode },\n",
+                schemas[i].name, schemas[i].size, schemas[i].name, schemas[i].num_fields, schemas[i].name);
+    }
+    fprintf(out, "};\n\n#define SCHEMA_COUNT %zu\n", num_schemas);
+
+    int failed = ferror(out);
+    if (fclose(out) != 0 || failed) {
+        fprintf(stderr, "mkschema: Could not write %s\n", argv[1]);
+        remove(argv[1]);
+        return 1;
+    }
+    return 0;
+}
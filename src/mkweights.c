@@ -0,0 +1,61 @@
+/*
+ * mkweights.c
+ *
+ * This is a build-time tool: it turns the English letter frequencies
+ * (english.h) into the fixed-point scoring tables that decode_lib.c
+ * compiles in (english_weights.h), so English scoring needs no floating
+ * point and no set-up at run time.
+ *
+ * Usage:
+ *   ./mkweights english_weights.h
+ *
+ * Key Implementation Details:
+ * 1. Rotations: Row s of the table holds the weights rotated by s, so the
+ *    score of shift s is the dot product of the text's squared shares with
+ *    row s, and the 26 x 26 scores are one matrix-vector product. Rows are
+ *    padded with zeros to DECODE_ROW entries
+ * 2. Same arithmetic: The weights and the constant come from
+ *    decode_fixed_weight() and decode_fixed_bias() in decode_fixed.h, which
+ *    decode_lib.c also uses for loaded profiles
+ */
+
+#include "decode_fixed.h"  /* For the fixed-point format */
+#include "english.h"       /* For ENGLISH_FREQUENCIES */
+#include <stdio.h>         /* For file operations */
+
+int main(int argc, char ** argv) {
+    static const double english[26] = ENGLISH_FREQUENCIES;
+
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s english_weights.h\n", argv[0]);
+        return 1;
+    }
+    FILE * out = fopen(argv[1], "w");
+    if (out == NULL) {
+        fprintf(stderr, "mkweights: Could not create %s\n", argv[1]);
+        return 1;
+    }
+
+    fprintf(out, "/* Generated by mkweights from english.h; do not edit */\n\n");
+    fprintf(out, "/* Constant term of the English scores (see decode_fixed.h) */\n");
+    fprintf(out, "#define ENGLISH_BIAS (%lldLL)\n\n", (long long) decode_fixed_bias(english));
+    fprintf(out, "/* english_weights[s][c]: weight of letter c - s, for the score of shift s */\n");
+    fprintf(out, "static const uint32_t english_weights[26][DECODE_ROW] = {\n");
+    for (int s = 0; s < 26; s++) {
+        fprintf(out, "    {");
+        for (int c = 0; c < DECODE_ROW; c++) {
+            unsigned long weight = c < 26 ? (unsigned long) decode_fixed_weight(english[(c - s + 26) % 26]) : 0;
+            fprintf(out, "%s%lu%s", c % 14 == 0 ? "\n        " : " ", weight, c < DECODE_ROW - 1 ? "," : "");
+        }
+        fprintf(out, "\n    },\n");
+    }
+    fprintf(out, "};\n");
+
+    int failed = ferror(out);
+    if (fclose(out) != 0 || failed) {
+        fprintf(stderr, "mkweights: Could not write %s\n", argv[1]);
+        remove(argv[1]);
+        return 1;
+    }
+    return 0;
+}
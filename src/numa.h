@@ -0,0 +1,51 @@
+/*
+ * numa.h
+ *
+ * This header file defines the machine topology used to place the threads
+ * of the parallel modes. On a machine with several NUMA nodes (sockets),
+ * a thread that reads memory attached to another node pays for every
+ * cache miss twice, so parallel_run() keeps each thread on one CPU and
+ * gives neighbouring slices of the work to CPUs of the same node.
+ *
+ * Key Features:
+ * 1. Topology: Read once from /sys/devices/system/node (each node's
+ *    cpulist), limited to the CPUs the process may run on (taskset,
+ *    cgroups); without it all CPUs form a single node
+ * 2. Placement: Slice i of n goes to the CPU at position i * cpus / n in
+ *    node order, so contiguous slices of the input share a node and each
+ *    node gets work in proportion to its CPUs
+ * 3. Memory: Buffers are placed by first touch: a thread's buffers are
+ *    allocated or first written by the pinned thread itself, so the kernel
+ *    takes their pages from its node
+ * 4. Control: CAESAR_PIN=0 turns pinning off (for shared hosts where the
+ *    scheduler should be free to move threads)
+ */
+
+#ifndef NUMA_H
+#define NUMA_H
+
+/* Most nodes described */
+#define NUMA_MAX_NODES 64
+
+/* Most CPUs described */
+#define NUMA_MAX_CPUS 1024
+
+/* The CPUs the process may use, grouped by node */
+typedef struct numa_topology {
+    int num_nodes;                          /* Nodes with at least one usable CPU */
+    int num_cpus;                           /* Usable CPUs */
+    int node_id[NUMA_MAX_NODES];            /* Kernel number of each node */
+    int node_first[NUMA_MAX_NODES + 1];     /* Node k's CPUs are cpus[node_first[k]] up to node_first[k + 1] */
+    int cpus[NUMA_MAX_CPUS];                /* CPU numbers, node by node */
+} numa_topology;
+
+/* Returns the topology, reading it on the first call (thread-safe) */
+const numa_topology * numa_topology_get(void);
+
+/* Returns non-zero if threads should be pinned (more than one CPU, CAESAR_PIN not 0) */
+int numa_pinning(void);
+
+/* Returns the CPU slice i of n should run on */
+int numa_slice_cpu(int i, int n);
+
+#endif
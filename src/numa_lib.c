@@ -0,0 +1,177 @@
+/*
+ * numa_lib.c
+ *
+ * This file implements the topology and placement declared in numa.h.
+ *
+ * Key Implementation Details:
+ * 1. Reading: Each /sys/devices/system/node/nodeN/cpulist ("0-3,8-11") is
+ *    parsed into a set, intersected with sched_getaffinity(), and nodes
+ *    are kept in order of N; a CPU listed by no node (or no sysfs at all)
+ *    ends up in one extra node so that no usable CPU is lost
+ * 2. Once: The topology is read under pthread_once() and never changes,
+ *    so any thread may ask for a placement at any time
+ */
+
+#define _GNU_SOURCE   /* For sched_getaffinity() and the CPU_* macros */
+
+#include "numa.h"
+#include <stdio.h>      /* For fopen() and snprintf() */
+#include <stdlib.h>     /* For getenv() and strtol() */
+#include <string.h>     /* For strcmp() */
+#include <dirent.h>     /* For opendir() */
+#include <pthread.h>    /* For pthread_once() */
+#include <sched.h>      /* For cpu_set_t */
+
+#define NUMA_SYSFS "/sys/devices/system/node"
+
+static numa_topology topology;
+static pthread_once_t topology_once = PTHREAD_ONCE_INIT;
+
+/*
+ * numa_parse_cpulist
+ *
+ * Purpose: Reads a node's CPU list ("0-3,8-11") into a set
+ *
+ * Returns:
+ *   0 on success, -1 if the file is missing or malformed
+ */
+static int numa_parse_cpulist(const char * path, cpu_set_t * set) {
+    FILE * in = fopen(path, "r");
+    if (in == NULL) {
+        return -1;
+    }
+    char line[4096];
+    int status = fgets(line, sizeof(line), in) != NULL ? 0 : -1;
+    fclose(in);
+
+    CPU_ZERO(set);
+    char * p = line;
+    while (status == 0 && *p != '\0' && *p != '\n') {
+        char * end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p) {
+            return -1;
+        }
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p) {
+                return -1;
+            }
+        }
+        for (long cpu = first; cpu <= last && cpu < NUMA_MAX_CPUS; cpu++) {
+            CPU_SET((int) cpu, set);
+        }
+        p = *end == ',' ? end + 1 : end;
+    }
+    return status;
+}
+
+/* Adds the usable CPUs of set as a node numbered id, and removes them from usable */
+static void numa_add_node(int id, const cpu_set_t * set, cpu_set_t * usable) {
+    numa_topology * t = &topology;
+    int first = t->num_cpus;
+    for (int cpu = 0; cpu < NUMA_MAX_CPUS; cpu++) {
+        if (CPU_ISSET(cpu, set) && CPU_ISSET(cpu, usable)) {
+            t->cpus[t->num_cpus++] = cpu;
+            CPU_CLR(cpu, usable);
+        }
+    }
+    if (t->num_cpus > first) {
+        t->node_id[t->num_nodes] = id;
+        t->node_first[t->num_nodes++] = first;
+        t->node_first[t->num_nodes] = t->num_cpus;
+    }
+}
+
+/*
+ * numa_read
+ *
+ * Purpose: Fills in topology (run once)
+ *
+ * How it works:
+ * 1. Takes the usable CPUs from sched_getaffinity() (all if that fails)
+ * 2. Finds the nodeN directories and adds the nodes in order of N
+ * 3. Puts any usable CPU no node claimed into a last node
+ */
+static void numa_read(void) {
+    cpu_set_t usable;
+    if (sched_getaffinity(0, sizeof(usable), &usable) != 0) {
+        CPU_ZERO(&usable);
+        for (int cpu = 0; cpu < NUMA_MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+            CPU_SET(cpu, &usable);
+        }
+    }
+
+    /* Node numbers, sorted (readdir() returns them in any order); one slot
+       is kept for the catch-all node */
+    int ids[NUMA_MAX_NODES];
+    int num_ids = 0;
+    DIR * dir = opendir(NUMA_SYSFS);
+    struct dirent * entry;
+    while (dir != NULL && (entry = readdir(dir)) != NULL && num_ids < NUMA_MAX_NODES - 1) {
+        char * end;
+        if (strncmp(entry->d_name, "node", 4) != 0 || entry->d_name[4] == '\0') {
+            continue;
+        }
+        long id = strtol(entry->d_name + 4, &end, 10);
+        if (*end != '\0' || id < 0) {
+            continue;
+        }
+        int at = num_ids++;
+        while (at > 0 && ids[at - 1] > id) {
+            ids[at] = ids[at - 1];
+            at--;
+        }
+        ids[at] = (int) id;
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+
+    for (int i = 0; i < num_ids; i++) {
+        char path[128];
+        cpu_set_t set;
+        snprintf(path, sizeof(path), NUMA_SYSFS "/node%d/cpulist", ids[i]);
+        if (numa_parse_cpulist(path, &set) == 0) {
+            numa_add_node(ids[i], &set, &usable);
+        }
+    }
+    if (CPU_COUNT(&usable) > 0) {
+        numa_add_node(topology.num_nodes > 0 ? -1 : 0, &usable, &usable);
+    }
+    if (topology.num_cpus == 0) {
+        /* No usable CPU could be named: one node with CPU 0 */
+        topology.num_nodes = 1;
+        topology.num_cpus = 1;
+        topology.node_id[0] = 0;
+        topology.node_first[0] = 0;
+        topology.node_first[1] = 1;
+        topology.cpus[0] = 0;
+    }
+}
+
+/* Returns the topology, reading it on the first call */
+const numa_topology * numa_topology_get(void) {
+    pthread_once(&topology_once, numa_read);
+    return &topology;
+}
+
+/* Pinning is on unless CAESAR_PIN is 0, and pointless with one CPU */
+int numa_pinning(void) {
+    const char * setting = getenv("CAESAR_PIN");
+    if (setting != NULL && strcmp(setting, "0") == 0) {
+        return 0;
+    }
+    return numa_topology_get()->num_cpus > 1;
+}
+
+/* Returns the CPU slice i of n should run on: position i * cpus / n, node by node */
+int numa_slice_cpu(int i, int n) {
+    const numa_topology * t = numa_topology_get();
+    if (n < 1 || i < 0) {
+        return t->cpus[0];
+    }
+    return t->cpus[(long long) (i % n) * t->num_cpus / n];
+}
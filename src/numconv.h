@@ -0,0 +1,56 @@
+/*
+ * numconv.h
+ *
+ * This header file defines fast conversions between numbers and text, used
+ * to export record archives to CSV/NDJSON and import them back.
+ *
+ * Key Features:
+ * 1. Shortest Round-Trip Doubles: format_double() writes the fewest digits
+ *    that read back as exactly the same double (the Schubfach algorithm),
+ *    so exports are both compact and bit-exact
+ * 2. Fast Parsing: parse_double() converts up to 19 significant digits with
+ *    one 64x128-bit multiplication (the Eisel-Lemire algorithm), falling
+ *    back to strtod() only for the rare inputs it cannot decide
+ * 3. No Locale: Neither direction depends on the C locale or on printf
+ *
+ * Both algorithms share one table of 128-bit powers of ten, computed exactly
+ * with integer arithmetic the first time it is needed.
+ */
+
+#ifndef NUMCONV_H
+#define NUMCONV_H
+
+#include <stddef.h>   /* For size_t */
+#include <stdint.h>   /* For fixed-width integers */
+
+/* Longest text written by format_double() */
+#define NUMCONV_DOUBLE_MAX 32
+
+/* Longest text written by format_int() */
+#define NUMCONV_INT_MAX 11
+
+/*
+ * Writes the shortest text that reads back as exactly v (no terminating
+ * NUL) and returns its length. Infinities are written as "inf"/"-inf" and
+ * NaNs as "nan", or "nan(0x...)" with the payload when it is not the
+ * default one, so that every bit pattern round-trips.
+ */
+size_t format_double(char * buf, double v);
+
+/* Writes v in decimal (no terminating NUL) and returns its length */
+size_t format_int(char * buf, int32_t v);
+
+/*
+ * Parses a double from [p, end). Accepts decimal and exponent notation and
+ * the specials written by format_double(). Returns a pointer just past the
+ * number, or NULL if there is no valid number at p.
+ */
+const char * parse_double(const char * p, const char * end, double * out);
+
+/*
+ * Parses a 32-bit signed integer from [p, end). Returns a pointer just past
+ * it, or NULL if there is no integer at p or it is out of range.
+ */
+const char * parse_int(const char * p, const char * end, int32_t * out);
+
+#endif
@@ -0,0 +1,641 @@
+/*
+ * numconv_lib.c
+ *
+ * This file implements the number/text conversions declared in numconv.h.
+ *
+ * Key Implementation Details:
+ * 1. Power Table: For each q in [POW10_MIN, POW10_MAX] the table holds the
+ *    top 128 bits of 10^q (truncated) and floor(log2(10^q)). It is built
+ *    once with a small bignum: positive powers by repeated multiplication,
+ *    negative ones by repeated division of a large power of two
+ * 2. Formatting: Schubfach finds the shortest decimal inside the rounding
+ *    interval of the double, using the table entry for 10^-k rounded up to
+ *    126 bits
+ * 3. Parsing: Eisel-Lemire multiplies the normalised digits by the table
+ *    entry for 10^q. The exact product differs from the computed one by
+ *    less than 2^64, so the result is only in doubt when the low bits lie
+ *    within that distance of a rounding boundary; those inputs (and
+ *    subnormals, overflows and inputs with more than 19 digits) go to
+ *    strtod()
+ */
+
+#include "numconv.h"
+#include <stdlib.h>    /* For strtod() */
+#include <string.h>    /* For memcpy() and memset() */
+#include <pthread.h>   /* For pthread_once() */
+
+typedef unsigned __int128 u128;
+
+#define POW10_MIN (-342)
+#define POW10_MAX 324
+
+/* Top 128 bits of 10^q and floor(log2(10^q)) */
+typedef struct pow10_entry {
+    uint64_t hi;
+    uint64_t lo;
+    int32_t exp2;
+} pow10_entry;
+
+static pow10_entry pow10_table[POW10_MAX - POW10_MIN + 1];
+static pthread_once_t pow10_once = PTHREAD_ONCE_INIT;
+
+/* Unsigned integer of up to BIG_LIMBS 32-bit limbs, least significant first */
+#define BIG_LIMBS 44
+
+typedef struct bignum {
+    uint32_t limb[BIG_LIMBS];
+    int used;
+} bignum;
+
+/* Number of significant bits */
+static int big_bits(const bignum * b) {
+    return 32 * (b->used - 1) + 32 - __builtin_clz(b->limb[b->used - 1]);
+}
+
+/* Top 128 bits, truncated (bits below zero read as 0) */
+static void big_top128(const bignum * b, pow10_entry * entry) {
+    int bits = big_bits(b);
+    u128 t = 0;
+    for (int i = bits - 1; i >= bits - 128; i--) {
+        t <<= 1;
+        if (i >= 0) {
+            t |= (b->limb[i / 32] >> (i % 32)) & 1;
+        }
+    }
+    entry->hi = (uint64_t) (t >> 64);
+    entry->lo = (uint64_t) t;
+}
+
+static void big_mul10(bignum * b) {
+    uint64_t carry = 0;
+    for (int i = 0; i < b->used; i++) {
+        uint64_t x = (uint64_t) b->limb[i] * 10 + carry;
+        b->limb[i] = (uint32_t) x;
+        carry = x >> 32;
+    }
+    if (carry != 0) {
+        b->limb[b->used++] = (uint32_t) carry;
+    }
+}
+
+static void big_div10(bignum * b) {
+    uint64_t rem = 0;
+    for (int i = b->used - 1; i >= 0; i--) {
+        uint64_t x = (rem << 32) | b->limb[i];
+        b->limb[i] = (uint32_t) (x / 10);
+        rem = x % 10;
+    }
+    while (b->used > 1 && b->limb[b->used - 1] == 0) {
+        b->used--;
+    }
+}
+
+/*
+ * pow10_init
+ *
+ * Purpose: Fills pow10_table
+ *
+ * How it works:
+ * 1. 10^q for q >= 0 is computed exactly by repeated multiplication
+ * 2. For q < 0, floor(2^M / 10^-q) is computed by repeated division of
+ *    2^M; with M large enough this has well over 128 significant bits, and
+ *    truncating a truncated quotient gives the same bits as truncating the
+ *    exact one
+ */
+static void pow10_init(void) {
+    bignum b;
+    const int m = BIG_LIMBS * 32 - 1;
+
+    memset(&b, 0, sizeof(b));
+    b.limb[0] = 1;
+    b.used = 1;
+    for (int q = 0; q <= POW10_MAX; q++) {
+        pow10_entry * entry = &pow10_table[q - POW10_MIN];
+        big_top128(&b, entry);
+        entry->exp2 = big_bits(&b) - 1;
+        big_mul10(&b);
+    }
+
+    memset(&b, 0, sizeof(b));
+    b.limb[BIG_LIMBS - 1] = 1u << 31;
+    b.used = BIG_LIMBS;
+    for (int q = -1; q >= POW10_MIN; q--) {
+        pow10_entry * entry = &pow10_table[q - POW10_MIN];
+        big_div10(&b);
+        big_top128(&b, entry);
+        entry->exp2 = big_bits(&b) - 1 - m;
+    }
+}
+
+/* Returns the table entry for 10^q */
+static const pow10_entry * pow10_get(int q) {
+    pthread_once(&pow10_once, pow10_init);
+    return &pow10_table[q - POW10_MIN];
+}
+
+/* floor(e * log10(2)), floor(e * log10(3/4 * 2)) and floor(e * log2(10)) */
+static int flog10pow2(int e) {
+    return (int) ((int64_t) e * 661971961083LL >> 41);
+}
+
+static int flog10_three_quarters_pow2(int e) {
+    return (int) (((int64_t) e * 661971961083LL - 274743187321LL) >> 41);
+}
+
+static int flog2pow10(int e) {
+    return (int) ((int64_t) e * 913124641741LL >> 38);
+}
+
+/* Round to odd of g * cp / 2^127, where g = g1 * 2^63 + g0 */
+static uint64_t round_odd(uint64_t g1, uint64_t g0, uint64_t cp) {
+    const uint64_t mask63 = (1ULL << 63) - 1;
+    uint64_t x1 = (uint64_t) (((u128) g0 * cp) >> 64);
+    u128 y = (u128) g1 * cp;
+    uint64_t z = ((uint64_t) y >> 1) + x1;
+    uint64_t vbp = (uint64_t) (y >> 64) + (z >> 63);
+    return vbp | (((z & mask63) + mask63) >> 63);
+}
+
+/*
+ * shortest_decimal
+ *
+ * Purpose: Finds the shortest decimal f * 10^e that rounds to c * 2^q
+ *
+ * Parameters:
+ *   q, c - The double as an integer significand and binary exponent
+ *   f, e - Receive the decimal significand and exponent
+ *
+ * How it works:
+ *   The rounding interval of the double is scaled by 10^-k so that it
+ *   spans a few units; the candidates are then the multiples of 10 inside
+ *   it, or failing that the two integers either side of the double, with
+ *   ties going to the even one (Giulietti's Schubfach)
+ */
+static void shortest_decimal(int q, uint64_t c, uint64_t * f, int * e) {
+    const uint64_t mask63 = (1ULL << 63) - 1;
+    uint64_t out = c & 1;
+    uint64_t cb = c << 2;
+    uint64_t cbr = cb + 2;
+    uint64_t cbl;
+    int k;
+
+    if (c != (1ULL << 52) || q == -1074) {
+        cbl = cb - 2;
+        k = flog10pow2(q);
+    } else {
+        cbl = cb - 1;
+        k = flog10_three_quarters_pow2(q);
+    }
+    int h = q + flog2pow10(-k) + 2;
+
+    const pow10_entry * entry = pow10_get(-k);
+    u128 g = ((((u128) entry->hi << 64) | entry->lo) >> 2) + 1;
+    uint64_t g1 = (uint64_t) (g >> 63);
+    uint64_t g0 = (uint64_t) g & mask63;
+
+    uint64_t vb = round_odd(g1, g0, cb << h);
+    uint64_t vbl = round_odd(g1, g0, cbl << h);
+    uint64_t vbr = round_odd(g1, g0, cbr << h);
+
+    uint64_t s = vb >> 2;
+    if (s >= 100) {
+        uint64_t sp10 = 10 * (uint64_t) (((u128) s * 1844674407370955168ULL) >> 64);
+        uint64_t tp10 = sp10 + 10;
+        int upin = vbl + out <= sp10 << 2;
+        int wpin = (tp10 << 2) + out <= vbr;
+        if (upin != wpin) {
+            *f = upin ? sp10 : tp10;
+            *e = k;
+            return;
+        }
+    }
+    uint64_t t = s + 1;
+    int uin = vbl + out <= s << 2;
+    int win = (t << 2) + out <= vbr;
+    *e = k;
+    if (uin != win) {
+        *f = uin ? s : t;
+        return;
+    }
+    int64_t cmp = (int64_t) (vb - ((s + t) << 1));
+    *f = cmp < 0 || (cmp == 0 && (s & 1) == 0) ? s : t;
+}
+
+/* Writes the digits of f * 10^e in plain or exponent notation */
+static size_t write_decimal(char * buf, uint64_t f, int e) {
+    char digits[20];
+    int n = 0;
+    char * p = buf;
+
+    while (f % 10 == 0) {
+        f /= 10;
+        e++;
+    }
+    while (f != 0) {
+        digits[n++] = (char) ('0' + f % 10);
+        f /= 10;
+    }
+    /* digits[] is least significant first; pos is the place of the point */
+    int pos = n + e;
+
+    if (pos > 0 && pos <= 17) {
+        for (int i = 0; i < pos; i++) {
+            *p++ = i < n ? digits[n - 1 - i] : '0';
+        }
+        if (pos < n) {
+            *p++ = '.';
+            for (int i = pos; i < n; i++) {
+                *p++ = digits[n - 1 - i];
+            }
+        }
+    } else if (pos <= 0 && pos > -5) {
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = pos; i < 0; i++) {
+            *p++ = '0';
+        }
+        for (int i = 0; i < n; i++) {
+            *p++ = digits[n - 1 - i];
+        }
+    } else {
+        *p++ = digits[n - 1];
+        if (n > 1) {
+            *p++ = '.';
+            for (int i = 1; i < n; i++) {
+                *p++ = digits[n - 1 - i];
+            }
+        }
+        int x = pos - 1;
+        *p++ = 'e';
+        *p++ = x < 0 ? '-' : '+';
+        x = x < 0 ? -x : x;
+        if (x >= 100) {
+            *p++ = (char) ('0' + x / 100);
+        }
+        if (x >= 10) {
+            *p++ = (char) ('0' + x / 10 % 10);
+        }
+        *p++ = (char) ('0' + x % 10);
+    }
+    return p - buf;
+}
+
+/*
+ * format_double
+ *
+ * Purpose: Writes the shortest round-trip text for a double
+ *
+ * How it works:
+ * 1. Zeros, infinities and NaNs are written directly
+ * 2. Integers below 2^53 are written as integers
+ * 3. Everything else goes through shortest_decimal()
+ */
+size_t format_double(char * buf, double v) {
+    static const char hex[] = "0123456789abcdef";
+    uint64_t bits;
+    char * p = buf;
+
+    memcpy(&bits, &v, sizeof(bits));
+    uint64_t t = bits & ((1ULL << 52) - 1);
+    int bq = (int) (bits >> 52) & 0x7ff;
+
+    if (bits >> 63) {
+        *p++ = '-';
+    }
+    if (bq == 0x7ff) {
+        if (t == 0) {
+            memcpy(p, "inf", 3);
+            return p + 3 - buf;
+        }
+        memcpy(p, "nan", 3);
+        p += 3;
+        if (t != (1ULL << 51)) {
+            char digits[13];
+            int n = 0;
+            while (t != 0) {
+                digits[n++] = hex[t & 15];
+                t >>= 4;
+            }
+            *p++ = '(';
+            *p++ = '0';
+            *p++ = 'x';
+            while (n > 0) {
+                *p++ = digits[--n];
+            }
+            *p++ = ')';
+        }
+        return p - buf;
+    }
+    if (bq == 0 && t == 0) {
+        *p++ = '0';
+        return p - buf;
+    }
+
+    uint64_t f;
+    int e;
+    if (bq != 0) {
+        int mq = 1075 - bq;
+        uint64_t c = (1ULL << 52) | t;
+        if (mq > 0 && mq < 53 && ((c >> mq) << mq) == c) {
+            f = c >> mq;
+            e = 0;
+        } else {
+            shortest_decimal(-mq, c, &f, &e);
+        }
+    } else if (t < 3) {
+        /* The two smallest subnormals: 5e-324 and 1e-323 */
+        f = t == 1 ? 5 : 1;
+        e = t == 1 ? -324 : -323;
+    } else {
+        shortest_decimal(-1074, t, &f, &e);
+    }
+    return (p - buf) + write_decimal(p, f, e);
+}
+
+/*
+ * format_int
+ *
+ * Purpose: Writes a 32-bit integer in decimal, two digits at a time
+ */
+size_t format_int(char * buf, int32_t v) {
+    static const char pairs[] =
+        "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+        "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+        "8081828384858687888990919293949596979899";
+    char digits[10];
+    int n = 10;
+    uint32_t u = v < 0 ? 0u - (uint32_t) v : (uint32_t) v;
+    char * p = buf;
+
+    while (u >= 100) {
+        uint32_t r = u % 100;
+        u /= 100;
+        digits[--n] = pairs[2 * r + 1];
+        digits[--n] = pairs[2 * r];
+    }
+    if (u >= 10) {
+        digits[--n] = pairs[2 * u + 1];
+        digits[--n] = pairs[2 * u];
+    } else {
+        digits[--n] = (char) ('0' + u);
+    }
+    if (v < 0) {
+        *p++ = '-';
+    }
+    memcpy(p, digits + n, 10 - n);
+    return (p - buf) + (10 - n);
+}
+
+/* Case-insensitive match of a lower-case word at [p, end) */
+static int match_word(const char * p, const char * end, const char * word) {
+    size_t n = strlen(word);
+    if ((size_t) (end - p) < n) {
+        return 0;
+    }
+    for (size_t i = 0; i < n; i++) {
+        if ((p[i] | 0x20) != word[i]) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Parses [start, end) with strtod(); used when the fast path cannot decide */
+static const char * parse_double_slow(const char * start, const char * end, double * out) {
+    char text[768];
+    size_t n = end - start;
+    if (n >= sizeof(text)) {
+        return NULL;
+    }
+    memcpy(text, start, n);
+    text[n] = '\0';
+    *out = strtod(text, NULL);
+    return end;
+}
+
+/*
+ * eisel_lemire
+ *
+ * Purpose: Converts w * 10^q (w != 0) to the nearest double
+ *
+ * Returns:
+ *   1 on success, 0 if the caller must fall back to strtod()
+ *
+ * How it works:
+ * 1. w is normalised so its top bit is set and multiplied by the 128-bit
+ *    power, giving a 192-bit product P
+ * 2. The top 53 bits of P are the significand; the bits below decide the
+ *    rounding
+ * 3. For 0 <= q <= 55 the table entry is exact, so P is exact and ties are
+ *    broken to even. Otherwise the true product lies in [P, P + 2^64), and
+ *    if a rounding boundary falls in that range the result is undecided
+ */
+static int eisel_lemire(uint64_t w, int q, int negative, double * out) {
+    const pow10_entry * entry = pow10_get(q);
+    int lz = __builtin_clzll(w);
+    uint64_t wn = w << lz;
+
+    u128 low = (u128) wn * entry->lo;
+    u128 high = (u128) wn * entry->hi;
+    u128 mid = (low >> 64) + (uint64_t) high;
+    uint64_t p0 = (uint64_t) low;
+    uint64_t p1 = (uint64_t) mid;
+    uint64_t p2 = (uint64_t) (high >> 64) + (uint64_t) (mid >> 64);
+
+    int upper = (int) (p2 >> 63);
+    int shift = 10 + upper;
+    uint64_t m = p2 >> shift;
+    uint64_t rest = p2 & ((1ULL << shift) - 1);
+    uint64_t half = 1ULL << (shift - 1);
+    int round_up;
+
+    if (q >= 0 && q <= 55) {
+        if (rest != half || (p1 | p0) != 0) {
+            round_up = rest >= half;
+        } else {
+            round_up = (int) (m & 1);
+        }
+    } else {
+        if ((rest == half - 1 && p1 == UINT64_MAX) || (rest == half && (p1 | p0) == 0)) {
+            return 0;
+        }
+        round_up = rest >= half;
+    }
+
+    int exponent = 63 + upper + entry->exp2 - lz;
+    m += round_up;
+    if (m == (1ULL << 53)) {
+        m >>= 1;
+        exponent++;
+    }
+    if (exponent < -1022 || exponent > 1023) {
+        return 0;
+    }
+
+    uint64_t bits = ((uint64_t) negative << 63) | ((uint64_t) (exponent + 1023) << 52) |
+                    (m & ((1ULL << 52) - 1));
+    memcpy(out, &bits, sizeof(bits));
+    return 1;
+}
+
+/*
+ * parse_double
+ *
+ * Purpose: Parses a double
+ *
+ * How it works:
+ * 1. Specials ("inf", "nan", "nan(0x...)") are decoded to their exact bits
+ * 2. Up to 19 significant digits are gathered into an integer w, with the
+ *    decimal exponent q adjusted for the point and any exponent part
+ * 3. w * 10^q is converted by eisel_lemire(), or by strtod() if it cannot
+ *    decide or there are more digits than fit in w
+ */
+const char * parse_double(const char * p, const char * end, double * out) {
+    const char * start = p;
+    int negative = 0;
+
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    if (match_word(p, end, "inf")) {
+        p += 3;
+        if (match_word(p, end, "inity")) {
+            p += 5;
+        }
+        uint64_t bits = ((uint64_t) negative << 63) | (0x7ffULL << 52);
+        memcpy(out, &bits, sizeof(bits));
+        return p;
+    }
+    if (match_word(p, end, "nan")) {
+        uint64_t payload = 1ULL << 51;
+        p += 3;
+        if (p < end && *p == '(') {
+            if (!match_word(p + 1, end, "0x")) {
+                return NULL;
+            }
+            payload = 0;
+            for (p += 3; p < end && *p != ')'; p++) {
+                int d = *p >= '0' && *p <= '9' ? *p - '0' :
+                        (*p | 0x20) >= 'a' && (*p | 0x20) <= 'f' ? (*p | 0x20) - 'a' + 10 : -1;
+                if (d < 0 || payload >> 48 != 0) {
+                    return NULL;
+                }
+                payload = payload << 4 | d;
+            }
+            if (p == end || payload == 0 || payload >> 52 != 0) {
+                return NULL;
+            }
+            p++;
+        }
+        uint64_t bits = ((uint64_t) negative << 63) | (0x7ffULL << 52) | payload;
+        memcpy(out, &bits, sizeof(bits));
+        return p;
+    }
+
+    uint64_t w = 0;
+    int digits = 0;
+    int any = 0;
+    int too_many = 0;
+    int64_t q = 0;
+
+    while (p < end && *p == '0') {
+        p++;
+        any = 1;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        if (digits < 19) {
+            w = w * 10 + (*p - '0');
+            digits++;
+        } else {
+            too_many = 1;
+        }
+        p++;
+        any = 1;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        if (digits == 0) {
+            while (p < end && *p == '0') {
+                q--;
+                p++;
+                any = 1;
+            }
+        }
+        while (p < end && *p >= '0' && *p <= '9') {
+            if (digits < 19) {
+                w = w * 10 + (*p - '0');
+                digits++;
+                q--;
+            } else {
+                too_many = 1;
+            }
+            p++;
+            any = 1;
+        }
+    }
+    if (!any) {
+        return NULL;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char * x = p + 1;
+        int sign = 1;
+        int64_t value = 0;
+        if (x < end && (*x == '-' || *x == '+')) {
+            sign = *x == '-' ? -1 : 1;
+            x++;
+        }
+        if (x < end && *x >= '0' && *x <= '9') {
+            while (x < end && *x >= '0' && *x <= '9') {
+                if (value < 100000) {
+                    value = value * 10 + (*x - '0');
+                }
+                x++;
+            }
+            q += sign * value;
+            p = x;
+        }
+    }
+
+    if (too_many) {
+        return parse_double_slow(start, p, out);
+    }
+    if (w == 0) {
+        *out = negative ? -0.0 : 0.0;
+        return p;
+    }
+    if (q < POW10_MIN || q > 308 || !eisel_lemire(w, (int) q, negative, out)) {
+        return parse_double_slow(start, p, out);
+    }
+    return p;
+}
+
+/*
+ * parse_int
+ *
+ * Purpose: Parses a 32-bit signed integer
+ */
+const char * parse_int(const char * p, const char * end, int32_t * out) {
+    int negative = 0;
+    uint64_t value = 0;
+    const char * digits;
+
+    if (p < end && *p == '-') {
+        negative = 1;
+        p++;
+    }
+    digits = p;
+    while (p < end && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p - '0');
+        if (value > 2147483648ULL) {
+            return NULL;
+        }
+        p++;
+    }
+    if (p == digits || value > 2147483647ULL + negative) {
+        return NULL;
+    }
+    *out = negative ? (int32_t) (0 - value) : (int32_t) value;
+    return p;
+}
@@ -0,0 +1,51 @@
+/*
+ * output.h
+ *
+ * This header file defines the output stage of decode: a buffer is
+ * transformed (decoded) block by block in place and each finished block is
+ * written straight from the buffer by a second thread, so writing one block
+ * overlaps with decoding the next.
+ *
+ * Key Features:
+ * 1. No stdio: Bytes go out with system calls and an explicit length, so
+ *    the output is exactly the buffer (NUL bytes included) and nothing is
+ *    formatted or copied into a stdio buffer
+ * 2. Per destination: A pipe is fed with vmsplice(), which hands the
+ *    buffer's pages to the pipe instead of copying them; a regular file gets
+ *    pwrite() of whole blocks at their own offsets; anything else (a
+ *    terminal, a socket) gets plain write()
+ * 3. Overlap: The caller's thread transforms block n + 1 while the writer
+ *    thread writes block n; blocks start at OUTPUT_BLOCK-aligned addresses,
+ *    so every block but the first and last is whole pages
+ *
+ * Because a pipe may still refer to the buffer's pages after vmsplice()
+ * returns, the buffer must not be changed once written; decode writes it
+ * once and exits.
+ */
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <stddef.h>   /* For size_t */
+
+/* Bytes transformed and written at a time */
+#define OUTPUT_BLOCK (1024 * 1024)
+
+/* Transforms length bytes at block in place before they are written */
+typedef void (*output_fill)(char * block, size_t length, void * arg);
+
+/*
+ * Runs fill (if not NULL) over data block by block and writes the result to
+ * fd, at its current offset. Returns 0 on success, -1 on a write error (a
+ * message is printed to stderr).
+ */
+int output_stream(int fd, char * data, size_t length, output_fill fill, void * arg);
+
+/*
+ * Writes length bytes to fd with plain write(), for a buffer that will be
+ * reused (which vmsplice() does not allow). Returns 0 on success, -1 on a
+ * write error (a message is printed to stderr).
+ */
+int output_write(int fd, const char * data, size_t length);
+
+#endif
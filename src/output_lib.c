@@ -0,0 +1,232 @@
+/*
+ * output_lib.c
+ *
+ * This file implements the output stage, declared in output.h.
+ *
+ * Key Implementation Details:
+ * 1. Destination: fstat() decides between vmsplice() (a pipe), pwrite() (a
+ *    regular file not opened for appending, whose offsets are honoured) and
+ *    write() (everything else). If vmsplice() turns out not to work on the
+ *    descriptor, the rest goes out with write()
+ * 2. Hand-over: The caller's thread publishes how far the buffer is ready;
+ *    the writer thread writes from where it stopped up to that mark and
+ *    waits on a condition variable when it has caught up
+ * 3. Small outputs: A buffer of at most two blocks is transformed and
+ *    written on the calling thread, where a second thread would only add
+ *    its start-up cost
+ * 4. Offset: For a file, the descriptor's offset is moved past the data at
+ *    the end, as write() would have left it
+ */
+
+#define _GNU_SOURCE   /* For vmsplice() */
+
+#include "output.h"
+#include <stdio.h>        /* For fprintf() */
+#include <stdint.h>       /* For uintptr_t */
+#include <errno.h>        /* For EINTR */
+#include <fcntl.h>        /* For vmsplice() and fcntl() */
+#include <pthread.h>      /* For the writer thread */
+#include <unistd.h>       /* For write(), pwrite() and lseek() */
+#include <sys/stat.h>     /* For fstat() */
+#include <sys/uio.h>      /* For struct iovec */
+
+/* How bytes reach the descriptor */
+typedef enum output_mode {
+    OUTPUT_WRITE,        /* write() */
+    OUTPUT_PWRITE,       /* pwrite() at offset + position */
+    OUTPUT_SPLICE        /* vmsplice() into a pipe */
+} output_mode;
+
+/* State shared by the caller's thread and the writer */
+typedef struct output_state {
+    int fd;
+    output_mode mode;
+    char * data;
+    size_t length;
+    off_t offset;             /* File offset of data[0] (OUTPUT_PWRITE) */
+    pthread_mutex_t lock;
+    pthread_cond_t ready_cond;
+    size_t ready;             /* Bytes transformed so far (guarded by lock) */
+    int failed;               /* Set by the writer on an error (guarded by lock) */
+} output_state;
+
+/* Picks the way to write to fd */
+static output_mode choose_mode(int fd, off_t * offset) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return OUTPUT_WRITE;
+    }
+    if (S_ISFIFO(st.st_mode)) {
+        return OUTPUT_SPLICE;
+    }
+    if (S_ISREG(st.st_mode)) {
+        int flags = fcntl(fd, F_GETFL);
+        *offset = lseek(fd, 0, SEEK_CUR);
+        if (flags >= 0 && !(flags & O_APPEND) && *offset >= 0) {
+            return OUTPUT_PWRITE;
+        }
+    }
+    return OUTPUT_WRITE;
+}
+
+/*
+ * write_range
+ *
+ * Purpose: Writes data[from, to) to the descriptor, however many calls it takes
+ *
+ * Returns:
+ *   0, or -1 on an error
+ */
+static int write_range(output_state * st, size_t from, size_t to) {
+    while (from < to) {
+        ssize_t n;
+        if (st->mode == OUTPUT_SPLICE) {
+            struct iovec iov;
+            iov.iov_base = st->data + from;
+            iov.iov_len = to - from;
+            n = vmsplice(st->fd, &iov, 1, 0);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS || errno == EBADF)) {
+                /* Not a pipe vmsplice() can feed after all */
+                st->mode = OUTPUT_WRITE;
+                continue;
+            }
+        } else if (st->mode == OUTPUT_PWRITE) {
+            n = pwrite(st->fd, st->data + from, to - from, st->offset + (off_t) from);
+        } else {
+            n = write(st->fd, st->data + from, to - from);
+        }
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        from += (size_t) n;
+    }
+    return 0;
+}
+
+/* Writer thread: writes whatever is ready until the whole buffer is out */
+static void * writer(void * arg) {
+    output_state * st = arg;
+    size_t written = 0;
+    while (written < st->length) {
+        pthread_mutex_lock(&st->lock);
+        while (st->ready == written) {
+            pthread_cond_wait(&st->ready_cond, &st->lock);
+        }
+        size_t upto = st->ready;
+        pthread_mutex_unlock(&st->lock);
+
+        if (write_range(st, written, upto) != 0) {
+            pthread_mutex_lock(&st->lock);
+            st->failed = 1;
+            pthread_mutex_unlock(&st->lock);
+            break;
+        }
+        written = upto;
+    }
+    return NULL;
+}
+
+/* Returns the end of the block starting at from: the next OUTPUT_BLOCK-aligned address */
+static size_t block_end(const output_state * st, size_t from) {
+    uintptr_t address = (uintptr_t) (st->data + from);
+    size_t end = from + (OUTPUT_BLOCK - address % OUTPUT_BLOCK);
+    return end < st->length ? end : st->length;
+}
+
+/*
+ * output_stream
+ *
+ * Purpose: Transforms a buffer block by block and writes it as it goes
+ *
+ * How it works:
+ * 1. Chooses vmsplice(), pwrite() or write() for fd
+ * 2. Starts the writer thread (unless the buffer is small, or no thread
+ *    can be started, in which case each block is written in turn)
+ * 3. Transforms each block and moves the ready mark past it, stopping
+ *    early if the writer has failed
+ * 4. Waits for the writer and leaves a file's offset after the data
+ */
+int output_stream(int fd, char * data, size_t length, output_fill fill, void * arg) {
+    output_state st;
+    st.fd = fd;
+    st.offset = 0;
+    st.mode = choose_mode(fd, &st.offset);
+    st.data = data;
+    st.length = length;
+    st.ready = 0;
+    st.failed = 0;
+
+    pthread_t thread;
+    int threaded = length > 2 * (size_t) OUTPUT_BLOCK;
+    if (threaded) {
+        pthread_mutex_init(&st.lock, NULL);
+        pthread_cond_init(&st.ready_cond, NULL);
+        if (pthread_create(&thread, NULL, writer, &st) != 0) {
+            pthread_mutex_destroy(&st.lock);
+            pthread_cond_destroy(&st.ready_cond);
+            threaded = 0;
+        }
+    }
+
+    int failed = 0;
+    for (size_t from = 0; from < length && !failed; ) {
+        size_t to = block_end(&st, from);
+        if (fill != NULL) {
+            fill(data + from, to - from, arg);
+        }
+        if (threaded) {
+            pthread_mutex_lock(&st.lock);
+            st.ready = to;
+            failed = st.failed;
+            pthread_cond_signal(&st.ready_cond);
+            pthread_mutex_unlock(&st.lock);
+        } else {
+            failed = write_range(&st, from, to) != 0;
+        }
+        from = to;
+    }
+
+    if (threaded) {
+        /* After a failure the writer has already stopped */
+        pthread_join(thread, NULL);
+        failed = st.failed;
+        pthread_mutex_destroy(&st.lock);
+        pthread_cond_destroy(&st.ready_cond);
+    }
+    if (!failed && st.mode == OUTPUT_PWRITE) {
+        lseek(fd, st.offset + (off_t) length, SEEK_SET);
+    }
+    if (failed) {
+        fprintf(stderr, "Could not write decoded text\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * output_write
+ *
+ * Purpose: Writes a buffer the caller is going to reuse
+ *
+ * How it works:
+ *   write() copies the bytes before it returns, so the buffer is free
+ *   again at once; it is called until everything is out
+ */
+int output_write(int fd, const char * data, size_t length) {
+    while (length > 0) {
+        ssize_t n = write(fd, data, length);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "Could not write decoded text\n");
+            return -1;
+        }
+        data += n;
+        length -= (size_t) n;
+    }
+    return 0;
+}
@@ -0,0 +1,37 @@
+/*
+ * parallel.h
+ *
+ * This header file defines a small helper for running the same function on
+ * several threads at once. The parallel modes of the programs (such as
+ * verifying an archive across cores) split their work into one argument
+ * structure per thread and hand them to parallel_run().
+ *
+ * Threads are pinned to CPUs chosen from the machine's NUMA topology
+ * (numa.h): neighbouring slices run on the same node, so a slice's buffers,
+ * allocated or first written by its own thread, stay in local memory.
+ */
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <stddef.h>   /* For size_t */
+
+/*
+ * Size of a cache line. Per-thread structures whose results are written
+ * while other threads run end with this much padding, so that two threads
+ * never write to the same line
+ */
+#define PARALLEL_CACHE_LINE 64
+
+/* Returns the number of online CPUs (at least 1) */
+int parallel_threads(void);
+
+/*
+ * Runs fn on n threads. Thread i receives args + i * stride, so args is
+ * normally an array of n per-thread structures and stride is their size.
+ * Thread i is pinned to numa_slice_cpu(i, n) unless pinning is off.
+ * Falls back to the calling thread if threads cannot be created.
+ */
+int parallel_run(int n, void * (*fn)(void *), void * args, size_t stride);
+
+#endif
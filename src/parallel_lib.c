@@ -0,0 +1,82 @@
+/*
+ * parallel_lib.c
+ *
+ * This file implements the thread helpers declared in parallel.h using
+ * POSIX threads.
+ */
+
+#define _GNU_SOURCE   /* For sysconf(_SC_NPROCESSORS_ONLN) and pthread_attr_setaffinity_np() */
+
+#include "parallel.h"
+#include "numa.h"     /* For numa_slice_cpu() */
+#include <sched.h>    /* For cpu_set_t */
+#include <pthread.h>  /* For pthread_create() and pthread_join() */
+#include <stdlib.h>   /* For malloc() and free() */
+#include <unistd.h>   /* For sysconf() */
+
+/*
+ * parallel_threads
+ *
+ * Purpose: Returns how many threads the parallel modes should use by default
+ *
+ * Returns:
+ *   The number of online CPUs, or 1 if it cannot be determined
+ */
+int parallel_threads(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int) n : 1;
+}
+
+/*
+ * parallel_run
+ *
+ * Purpose: Runs fn on n threads and waits for all of them to finish
+ *
+ * Parameters:
+ *   n      - Number of threads (1 runs fn on the calling thread)
+ *   fn     - Function each thread runs
+ *   args   - Start of an array of per-thread arguments
+ *   stride - Size of one element of that array
+ *
+ * Returns:
+ *   0 once every slice has run
+ *
+ * Note: If threads cannot be created, the remaining slices are run on the
+ * calling thread so that no work is ever skipped. A thread that cannot be
+ * pinned (the CPU went offline) is started unpinned instead.
+ */
+int parallel_run(int n, void * (*fn)(void *), void * args, size_t stride) {
+    char * base = args;
+
+    pthread_t * threads = n > 1 ? malloc(sizeof(pthread_t) * n) : NULL;
+    int pin = threads != NULL && numa_pinning();
+
+    int started = 0;
+    for (int i = 0; threads != NULL && i < n; i++) {
+        int created = -1;
+        pthread_attr_t attr;
+        if (pin && pthread_attr_init(&attr) == 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(numa_slice_cpu(i, n), &cpus);
+            if (pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus) == 0) {
+                created = pthread_create(&threads[i], &attr, fn, base + i * stride);
+            }
+            pthread_attr_destroy(&attr);
+        }
+        if (created != 0 && pthread_create(&threads[i], NULL, fn, base + i * stride) != 0) {
+            break;
+        }
+        started++;
+    }
+    /* Run anything that did not get its own thread */
+    for (int i = started; i < n; i++) {
+        fn(base + i * stride);
+    }
+    for (int i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+    return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * profile.h
+ *
+ * This header file defines the interface for language frequency profiles:
+ * the expected share of each letter in a language, which decode compares
+ * a text against. English is built in (english.h, EF[] in decode_lib.c); other
+ * languages are loaded from profile files, which frequency_table --train
+ * builds from a corpus.
+ *
+ * Profile File Format (plain text):
+ *   # Lines starting with '#' are comments
+ *   language french
+ *   a 0.07636
+ *   b 0.00901
+ *   ... one line per letter, in any order, upper or lower case
+ * Every letter must appear with a positive value. Values are scaled to
+ * sum to 1, so raw counts work as well as frequencies.
+ *
+ * Key Features:
+ * 1. Parallel Training: The corpus is split into one byte range per
+ *    thread, each thread builds its own histogram with freq_hist_update()
+ *    and the histograms are merged at the end
+ * 2. Smoothing: Letters missing from a corpus get a small share instead of
+ *    zero, so chi-squared scores stay finite
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "frequency_table.h"  /* For freq_hist */
+#include <stdio.h>            /* For FILE */
+
+/* Longest language name, including the terminating NUL */
+#define PROFILE_NAME_MAX 32
+
+/* Letter frequencies of one language */
+typedef struct freq_profile {
+    char name[PROFILE_NAME_MAX];
+    double expected[26];     /* Share of each letter (positive, summing to 1) */
+} freq_profile;
+
+/* Errors of profile_read */
+#define PROFILE_ERR_OPEN   -1   /* The file could not be opened */
+#define PROFILE_ERR_FORMAT -2   /* The file is not a valid profile */
+
+/*
+ * Reads a profile file, describing any error (with the file and line) on
+ * errors, or nowhere if errors is NULL. Returns 0, PROFILE_ERR_OPEN or
+ * PROFILE_ERR_FORMAT.
+ */
+int profile_read(const char * path, freq_profile * profile, FILE * errors);
+
+/* Reads a profile file; returns 0, or -1 if it cannot be read or is invalid (a message is printed to stderr) */
+int profile_load(const char * path, freq_profile * profile);
+
+/* Writes a profile in the file format above; returns 0, or -1 on a write error */
+int profile_write(FILE * out, const freq_profile * profile);
+
+/* Builds a smoothed profile from letter counts; returns 0, or -1 if the name is too long */
+int profile_from_hist(const freq_hist * hist, const char * name, freq_profile * profile);
+
+/*
+ * Counts the letters of a whole corpus into *hist, using up to threads
+ * threads when in is a regular file (other inputs are read sequentially).
+ * Returns 0, or -1 on a read or memory error.
+ */
+int profile_train(FILE * in, int threads, freq_hist * hist);
+
+#endif
@@ -0,0 +1,255 @@
+/*
+ * profile_lib.c
+ *
+ * This file implements the language frequency profiles declared in
+ * profile.h.
+ *
+ * Key Implementation Details:
+ * 1. Parsing: Profile files are read line by line with fgets(); errors name
+ *    the file and line, and go to the stream the caller gives (stderr for
+ *    the programs, none for libcaesar.so)
+ * 2. Training: Each thread reads its own byte range of the corpus with
+ *    pread() into a private buffer, so threads share no file position and
+ *    no counters. Counting bytes does not depend on where a range starts,
+ *    so the merged histogram is the same as a single pass over the file
+ * 3. Smoothing: Additive smoothing, (count + 0.5) / (letters + 13)
+ */
+
+#define _GNU_SOURCE   /* For pread() */
+
+#include "profile.h"
+#include "parallel.h"   /* For parallel_run() */
+#include <stdarg.h>     /* For va_list */
+#include <stdlib.h>     /* For memory management and strtod() */
+#include <string.h>     /* For string operations */
+#include <ctype.h>      /* For isspace() */
+#include <unistd.h>     /* For pread() and lseek() */
+#include <sys/stat.h>   /* For fstat() */
+
+/* Bytes read at a time while training */
+#define TRAIN_CHUNK (1 << 20)
+
+/* Work of one training thread */
+typedef struct train_task {
+    int fd;
+    off_t start;          /* First byte of the range */
+    off_t end;            /* One past the last byte */
+    freq_hist hist;       /* Counts of the range */
+    int failed;
+    char pad[PARALLEL_CACHE_LINE];   /* Keeps neighbouring tasks' histograms apart */
+} train_task;
+
+/* Describes a profile error on errors, if there is one to describe it on */
+static void profile_error(FILE * errors, const char * format, ...) {
+    va_list args;
+    if (errors == NULL) {
+        return;
+    }
+    va_start(args, format);
+    vfprintf(errors, format, args);
+    va_end(args);
+}
+
+/*
+ * profile_read
+ *
+ * Purpose: Reads a profile file
+ *
+ * How it works:
+ * 1. Skips blank lines and comments
+ * 2. "language <name>" sets the name; any other line is a letter and a value
+ * 3. Checks that every letter was given a positive value, then scales the
+ *    values to sum to 1
+ * A file without a language line is named after the file.
+ */
+int profile_read(const char * path, freq_profile * profile, FILE * errors) {
+    FILE * fp = fopen(path, "r");
+    if (fp == NULL) {
+        profile_error(errors, "Could not open profile %s\n", path);
+        return PROFILE_ERR_OPEN;
+    }
+
+    int seen[26] = {0};
+    char line[256];
+    int line_number = 0;
+    int failed = 0;
+    memset(profile, 0, sizeof(*profile));
+
+    while (!failed && fgets(line, sizeof(line), fp) != NULL) {
+        line_number++;
+        char * p = line;
+        while (isspace((unsigned char) *p)) {
+            p++;
+        }
+        if (*p == '\0' || *p == '#') {
+            continue;
+        }
+
+        if (strncmp(p, "language", 8) == 0 && isspace((unsigned char) p[8])) {
+            p += 8;
+            while (isspace((unsigned char) *p)) {
+                p++;
+            }
+            size_t len = strcspn(p, " \t\r\n");
+            if (len == 0 || len >= PROFILE_NAME_MAX) {
+                profile_error(errors, "%s:%d: Language name must be 1 to %d characters\n",
+                              path, line_number, PROFILE_NAME_MAX - 1);
+                failed = 1;
+                break;
+            }
+            memcpy(profile->name, p, len);
+            profile->name[len] = '\0';
+            continue;
+        }
+
+        int letter = (*p | 0x20) - 'a';
+        char * end;
+        double value = (letter >= 0 && letter < 26 && isspace((unsigned char) p[1]))
+                       ? strtod(p + 1, &end) : -1;
+        if (value <= 0 || !(value < 1e300)) {
+            profile_error(errors, "%s:%d: Expected a letter and a positive frequency\n", path, line_number);
+            failed = 1;
+            break;
+        }
+        profile->expected[letter] = value;
+        seen[letter] = 1;
+    }
+    fclose(fp);
+
+    for (int ch = 0; ch < 26 && !failed; ch++) {
+        if (!seen[ch]) {
+            profile_error(errors, "%s: No frequency for letter %c\n", path, 'a' + ch);
+            failed = 1;
+        }
+    }
+    if (failed) {
+        return PROFILE_ERR_FORMAT;
+    }
+
+    double total = 0;
+    for (int ch = 0; ch < 26; ch++) {
+        total += profile->expected[ch];
+    }
+    for (int ch = 0; ch < 26; ch++) {
+        profile->expected[ch] /= total;
+    }
+    if (profile->name[0] == '\0') {
+        const char * base = strrchr(path, '/');
+        base = base != NULL ? base + 1 : path;
+        size_t len = strcspn(base, ".");
+        if (len >= PROFILE_NAME_MAX) {
+            len = PROFILE_NAME_MAX - 1;
+        }
+        memcpy(profile->name, base, len);
+        profile->name[len] = '\0';
+    }
+    return 0;
+}
+
+int profile_load(const char * path, freq_profile * profile) {
+    return profile_read(path, profile, stderr) == 0 ? 0 : -1;
+}
+
+int profile_write(FILE * out, const freq_profile * profile) {
+    fprintf(out, "# Letter frequency profile\n");
+    fprintf(out, "language %s\n", profile->name);
+    for (int ch = 0; ch < 26; ch++) {
+        fprintf(out, "%c %.8f\n", 'a' + ch, profile->expected[ch]);
+    }
+    return ferror(out) ? -1 : 0;
+}
+
+int profile_from_hist(const freq_hist * hist, const char * name, freq_profile * profile) {
+    if (strlen(name) == 0 || strlen(name) >= PROFILE_NAME_MAX || strpbrk(name, " \t\r\n") != NULL) {
+        return -1;
+    }
+    strcpy(profile->name, name);
+    double total = (double) hist->letters + 13.0;
+    for (int ch = 0; ch < 26; ch++) {
+        profile->expected[ch] = ((double) hist->counts[ch] + 0.5) / total;
+    }
+    return 0;
+}
+
+/* Thread body: counts the letters of one byte range */
+static void * train_range(void * arg) {
+    train_task * task = arg;
+    char * buffer = malloc(TRAIN_CHUNK);
+    freq_hist_clear(&task->hist);
+    if (buffer == NULL) {
+        task->failed = 1;
+        return NULL;
+    }
+
+    off_t pos = task->start;
+    while (pos < task->end) {
+        size_t want = task->end - pos < TRAIN_CHUNK ? (size_t) (task->end - pos) : TRAIN_CHUNK;
+        ssize_t got = pread(task->fd, buffer, want, pos);
+        if (got <= 0) {
+            task->failed = got < 0;   /* A file that shrank just ends early */
+            break;
+        }
+        freq_hist_update(&task->hist, buffer, (size_t) got);
+        pos += got;
+    }
+    free(buffer);
+    return NULL;
+}
+
+/*
+ * profile_train
+ *
+ * Purpose: Counts the letters of a corpus, in parallel where possible
+ *
+ * How it works:
+ * 1. A regular file is split into equal byte ranges (at least one chunk
+ *    each), counted by train_range() on separate threads and merged
+ * 2. Anything else (a pipe, a terminal) is read chunk by chunk on the
+ *    calling thread
+ */
+int profile_train(FILE * in, int threads, freq_hist * hist) {
+    int fd = fileno(in);
+    struct stat st;
+    freq_hist_clear(hist);
+
+    off_t start = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) ? lseek(fd, 0, SEEK_CUR) : -1;
+    if (start >= 0) {
+        off_t size = st.st_size > start ? st.st_size - start : 0;
+        if (threads < 1) {
+            threads = 1;
+        }
+        if ((off_t) threads > size / TRAIN_CHUNK + 1) {
+            threads = (int) (size / TRAIN_CHUNK + 1);
+        }
+        train_task * tasks = calloc((size_t) threads, sizeof(train_task));
+        if (tasks == NULL) {
+            return -1;
+        }
+        for (int t = 0; t < threads; t++) {
+            tasks[t].fd = fd;
+            tasks[t].start = start + size * t / threads;
+            tasks[t].end = start + size * (t + 1) / threads;
+        }
+        parallel_run(threads, train_range, tasks, sizeof(train_task));
+
+        int failed = 0;
+        for (int t = 0; t < threads; t++) {
+            freq_hist_merge(hist, &tasks[t].hist);
+            failed |= tasks[t].failed;
+        }
+        free(tasks);
+        return failed ? -1 : 0;
+    }
+
+    char * buffer = malloc(TRAIN_CHUNK);
+    if (buffer == NULL) {
+        return -1;
+    }
+    size_t got;
+    while ((got = fread(buffer, 1, TRAIN_CHUNK, in)) > 0) {
+        freq_hist_update(hist, buffer, got);
+    }
+    int failed = ferror(in);
+    free(buffer);
+    return failed ? -1 : 0;
+}
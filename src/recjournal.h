@@ -0,0 +1,89 @@
+/*
+ * recjournal.h
+ *
+ * This header file defines the progress journal of a restartable copy,
+ * used by copyrecords --checkpoint and --resume.
+ *
+ * A long copy periodically makes its output durable up to a checksum block
+ * boundary and records how far it got in a small file next to the output
+ * (output name + .journal). If the run dies, --resume truncates the output
+ * to the last checkpoint and carries on from there, forward or with -r,
+ * instead of starting again.
+ *
+ * Key Features:
+ * 1. Contents: The input's identity (size, inode, modification time), the
+ *    records copied so far, the input and output offsets, the decoding
+ *    shift and direction, and the state of the output's checksum writer
+ *    (-C). The CRCs of finished blocks are not in the journal but appended
+ *    to the output's sidecar (a checksum stream, see checksum.h), so a
+ *    checkpoint costs the same however far the copy has got
+ * 2. Safety: The output and the sidecar are fdatasync()ed before the journal is written,
+ *    and the journal is replaced atomically (a temporary file, fsync() and
+ *    rename()), so a journal never claims more than is on disk
+ * 3. Checks: --resume refuses an input that changed, different options,
+ *    or an output whose last checkpointed stretch does not match the CRC32C
+ *    kept for it
+ */
+
+#ifndef RECJOURNAL_H
+#define RECJOURNAL_H
+
+#include <stdio.h>        /* For FILE */
+#include <stdint.h>       /* For uint64_t */
+#include "checksum.h"     /* For checksum_writer and checksum_stream */
+
+/* What a journal records */
+typedef struct copy_journal {
+    uint64_t input_size;        /* Identity of the input */
+    uint64_t input_inode;
+    int64_t input_mtime_sec;
+    int64_t input_mtime_nsec;
+    uint64_t num_records;       /* Records in the input */
+    uint64_t blocks_done;       /* Checksum blocks copied, in copy order */
+    uint64_t input_offset;      /* Forward: where reading continues; -r: where it stopped */
+    uint64_t output_offset;     /* Bytes of output that are durable */
+    uint64_t last_offset;       /* Start of the stretch written since the previous checkpoint */
+    uint32_t last_crc;          /* CRC32C of the output from last_offset to output_offset */
+    int32_t shift;              /* Decoding shift */
+    int32_t reverse;            /* Non-zero for -r */
+    int32_t sums;               /* Non-zero if output checksums (-C) are kept */
+    uint64_t interval_blocks;   /* Checksum blocks between checkpoints */
+} copy_journal;
+
+/* Returns the journal name for an output (output + ".journal"; caller frees), or NULL */
+char * journal_path(const char * output);
+
+/* Fills in the identity of the input open on fd; returns 0, or -1 if it cannot be read */
+int journal_identify(int fd, copy_journal * journal);
+
+/* Returns non-zero if the input open on fd is the one the journal was written for */
+int journal_same_input(int fd, const copy_journal * journal);
+
+/*
+ * Makes the output durable and records a checkpoint: flushes and
+ * fdatasync()s out, and if journal->sums is set appends the newly
+ * finished CRCs of sums to sidecar; then atomically replaces the journal
+ * at path with journal, the running state of sums and the length of the
+ * sidecar. Returns 0, or -1 on failure (a message is printed to stderr).
+ */
+int journal_checkpoint(FILE * out, const char * path, const copy_journal * journal,
+                       const checksum_writer * sums, checksum_stream * sidecar);
+
+/*
+ * Reads a journal. If it kept output checksums, the running state of the
+ * writer is restored into sums (which must be initialised) and the
+ * sidecar's CRC count and CRC into sidecar, ready for
+ * checksum_stream_resume(). Returns 0, or -1 if the journal is missing or
+ * damaged.
+ */
+int journal_load(const char * path, copy_journal * journal, checksum_writer * sums, checksum_stream * sidecar);
+
+/*
+ * Checks that out (opened for reading and writing) holds at least
+ * journal->output_offset bytes and that the last checkpointed stretch
+ * matches, then truncates it to journal->output_offset and positions it
+ * there. Returns 0, or -1 with a message on stderr.
+ */
+int journal_rewind(FILE * out, const copy_journal * journal);
+
+#endif
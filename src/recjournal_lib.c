@@ -0,0 +1,263 @@
+/*
+ * recjournal_lib.c
+ *
+ * This file implements the progress journal declared in recjournal.h.
+ *
+ * Key Implementation Details:
+ * 1. Format: A small fixed-size binary file like the .crc sidecar: a
+ *    magic and version, the copy_journal fields, the checksum writer's
+ *    state (its running CRC, the records in its unfinished block and the
+ *    number of finished blocks, with a CRC32C of their CRCs, which are in
+ *    the sidecar) and a trailing CRC32C over all of it
+ * 2. Atomic replacement: The journal is written to path + ".tmp",
+ *    fsync()ed and renamed over the old one; the directory is fsync()ed
+ *    too, so the rename itself survives a crash
+ * 3. Stretch check: Earlier stretches were made durable before a later
+ *    journal was written; only the last one could have been lost, so
+ *    --resume rereads just that stretch and compares its CRC
+ */
+
+#define _POSIX_C_SOURCE 200809L   /* For fileno(), fseeko() and fdatasync() */
+
+#include "recjournal.h"
+#include "crc32c.h"       /* For crc32c_update() */
+#include <stdlib.h>       /* For memory management */
+#include <string.h>       /* For memcmp() */
+#include <fcntl.h>        /* For open() */
+#include <unistd.h>       /* For fsync() and ftruncate() */
+#include <sys/stat.h>     /* For fstat() */
+#include <sys/types.h>    /* For off_t */
+
+#define JOURNAL_MAGIC "RJNL"
+#define JOURNAL_VERSION 2
+
+/* Bytes reread at a time when checking the last stretch */
+#define JOURNAL_CHECK_BYTES (1024 * 1024)
+
+/* Contents of a journal, before its trailing CRC */
+typedef struct journal_header {
+    char magic[4];
+    uint32_t version;
+    copy_journal journal;
+    uint32_t sum_crc;          /* Running CRC of the unfinished output block */
+    uint32_t sum_filled;       /* Records in that block */
+    uint64_t sum_records;      /* Records added to the checksums */
+    uint64_t sum_blocks;       /* Finished blocks (CRCs in the sidecar) */
+    uint32_t sum_blocks_crc;   /* CRC32C of those CRCs */
+    uint32_t reserved;
+} journal_header;
+
+/* Builds output + ".journal" */
+char * journal_path(const char * output) {
+    char * path = malloc(strlen(output) + strlen(".journal") + 1);
+    if (path != NULL) {
+        strcpy(path, output);
+        strcat(path, ".journal");
+    }
+    return path;
+}
+
+/* Records the input's size, inode and modification time */
+int journal_identify(int fd, copy_journal * journal) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return -1;
+    }
+    journal->input_size = (uint64_t) st.st_size;
+    journal->input_inode = (uint64_t) st.st_ino;
+    journal->input_mtime_sec = (int64_t) st.st_mtim.tv_sec;
+    journal->input_mtime_nsec = (int64_t) st.st_mtim.tv_nsec;
+    return 0;
+}
+
+/* Compares the input's identity with the journal's */
+int journal_same_input(int fd, const copy_journal * journal) {
+    copy_journal now;
+    if (journal_identify(fd, &now) != 0) {
+        return 0;
+    }
+    return now.input_size == journal->input_size && now.input_inode == journal->input_inode &&
+           now.input_mtime_sec == journal->input_mtime_sec && now.input_mtime_nsec == journal->input_mtime_nsec;
+}
+
+/* fsync()s the directory holding path, so a rename into it is durable */
+static void journal_sync_directory(const char * path) {
+    const char * slash = strrchr(path, '/');
+    char * dir = slash == NULL ? NULL : malloc((size_t) (slash - path) + 2);
+    if (slash != NULL && dir == NULL) {
+        return;
+    }
+    if (dir != NULL) {
+        size_t length = slash == path ? 1 : (size_t) (slash - path);
+        memcpy(dir, path, length);
+        dir[length] = '\0';
+    }
+    int fd = open(dir != NULL ? dir : ".", O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    free(dir);
+}
+
+/*
+ * journal_checkpoint
+ *
+ * Purpose: Makes the output durable and records how far the copy got
+ *
+ * Parameters:
+ *   out     - Output being written (positioned at journal->output_offset)
+ *   path    - Journal file name
+ *   journal - Progress to record
+ *   sums    - Output checksum state, saved if journal->sums is set
+ *   sidecar - Checksum stream receiving the finished block CRCs of sums
+ *
+ * Returns:
+ *   0 on success, -1 on failure
+ *
+ * How it works:
+ * 1. Flushes the stream and fdatasync()s the output, and appends the CRCs
+ *    finished since the last checkpoint to the sidecar, also made durable
+ * 2. Writes the header and a trailing CRC to a temporary file, fsync()s it
+ *    and renames it over the journal
+ */
+int journal_checkpoint(FILE * out, const char * path, const copy_journal * journal,
+                       const checksum_writer * sums, checksum_stream * sidecar) {
+    if (fflush(out) != 0 || fdatasync(fileno(out)) != 0) {
+        fprintf(stderr, "Could not make the output durable for a checkpoint\n");
+        return -1;
+    }
+    if (journal->sums && checksum_stream_sync(sidecar, sums) != 0) {
+        fprintf(stderr, "Could not make the output checksums durable for a checkpoint\n");
+        return -1;
+    }
+
+    journal_header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, JOURNAL_MAGIC, 4);
+    header.version = JOURNAL_VERSION;
+    header.journal = *journal;
+    if (journal->sums) {
+        header.sum_crc = sums->crc;
+        header.sum_filled = sums->filled;
+        header.sum_records = sums->table.num_records;
+        header.sum_blocks = sidecar->blocks;
+        header.sum_blocks_crc = sidecar->crc;
+    }
+    uint32_t crc = crc32c_update(0, &header, sizeof(header));
+
+    char * temp = malloc(strlen(path) + strlen(".tmp") + 1);
+    if (temp == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        return -1;
+    }
+    strcpy(temp, path);
+    strcat(temp, ".tmp");
+    FILE * fp = fopen(temp, "wb");
+    int ok = fp != NULL &&
+             fwrite(&header, sizeof(header), 1, fp) == 1 &&
+             fwrite(&crc, sizeof(crc), 1, fp) == 1 &&
+             fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    if (fp != NULL && fclose(fp) != 0) {
+        ok = 0;
+    }
+    if (ok && rename(temp, path) != 0) {
+        ok = 0;
+    }
+    if (!ok) {
+        fprintf(stderr, "Could not write the journal %s\n", path);
+        remove(temp);
+    } else {
+        journal_sync_directory(path);
+    }
+    free(temp);
+    return ok ? 0 : -1;
+}
+
+/*
+ * journal_load
+ *
+ * Purpose: Reads a journal back
+ *
+ * How it works:
+ *   Only the writer's running state comes from the journal; the caller
+ *   reads the finished CRCs back from the sidecar with
+ *   checksum_stream_resume(), which checks them against sidecar->crc
+ *
+ * Returns:
+ *   0 on success, -1 if it is missing, truncated or fails its CRC
+ */
+int journal_load(const char * path, copy_journal * journal, checksum_writer * sums, checksum_stream * sidecar) {
+    journal_header header;
+    uint32_t stored;
+    FILE * fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return -1;
+    }
+    int ok = fread(&header, sizeof(header), 1, fp) == 1 && fread(&stored, sizeof(stored), 1, fp) == 1;
+    fclose(fp);
+    if (!ok || memcmp(header.magic, JOURNAL_MAGIC, 4) != 0 || header.version != JOURNAL_VERSION ||
+        header.sum_blocks > header.journal.num_records || crc32c_update(0, &header, sizeof(header)) != stored) {
+        return -1;
+    }
+
+    *journal = header.journal;
+    if (journal->sums) {
+        sums->table.num_records = header.sum_records;
+        sums->crc = header.sum_crc;
+        sums->filled = header.sum_filled;
+        sidecar->fp = NULL;
+        sidecar->blocks = header.sum_blocks;
+        sidecar->crc = header.sum_blocks_crc;
+    }
+    return 0;
+}
+
+/*
+ * journal_rewind
+ *
+ * Purpose: Puts the output back to the last checkpoint
+ *
+ * How it works:
+ * 1. Checks the output is at least as long as the checkpoint says
+ * 2. Rereads the stretch written since the previous checkpoint and
+ *    compares its CRC32C with the journal's
+ * 3. Cuts off anything written after the checkpoint and seeks to its end
+ */
+int journal_rewind(FILE * out, const copy_journal * journal) {
+    struct stat st;
+    int fd = fileno(out);
+    if (fstat(fd, &st) != 0 || (uint64_t) st.st_size < journal->output_offset) {
+        fprintf(stderr, "The output is shorter than the journal's last checkpoint.\n");
+        return -1;
+    }
+
+    char * buffer = malloc(JOURNAL_CHECK_BYTES);
+    if (buffer == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        return -1;
+    }
+    uint32_t crc = 0;
+    int status = fseeko(out, (off_t) journal->last_offset, SEEK_SET);
+    for (uint64_t at = journal->last_offset; status == 0 && at < journal->output_offset; ) {
+        size_t want = journal->output_offset - at < JOURNAL_CHECK_BYTES ? (size_t) (journal->output_offset - at) : JOURNAL_CHECK_BYTES;
+        if (fread(buffer, 1, want, out) != want) {
+            status = -1;
+            break;
+        }
+        crc = crc32c_update(crc, buffer, want);
+        at += want;
+    }
+    free(buffer);
+    if (status != 0 || crc != journal->last_crc) {
+        fprintf(stderr, "The output does not match the journal's last checkpoint.\n");
+        return -1;
+    }
+
+    if (ftruncate(fd, (off_t) journal->output_offset) != 0 ||
+        fseeko(out, (off_t) journal->output_offset, SEEK_SET) != 0) {
+        fprintf(stderr, "Could not truncate the output to the last checkpoint.\n");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+/*
+ * recpack.h
+ *
+ * This header file defines the interface for packed record archives, a
+ * compressed container written by copyrecords --pack and read back
+ * transparently by copyrecords and copyrecords --verify.
+ *
+ * A plain archive spends most of its bytes on NUL padding in str1/str2 and
+ * on numbers that change little from one record to the next. A packed
+ * archive stores each block of PACK_BLOCK_RECORDS records field by field:
+ * - str1, str2: Length of the string (up to its last non-NUL byte) as a
+ *   varint, then its bytes; the padding is not stored
+ * - dbl[k]: XOR with the same column of the previous record, stored as a
+ *   byte giving the position and number of its non-zero bytes, then those
+ *   bytes (repeated values cost one byte)
+ * - nums[k]: Difference from the previous record, zigzag encoded as a
+ *   varint
+ *
+ * File Layout:
+ * - Header: "RPAK" magic, format version, record size, block size
+ * - Blocks: Each one decodable on its own (nothing refers to other blocks)
+ * - Index: Offset, length, record count and CRC32C of every block
+ * - Footer: Index offset, block and record counts, CRC32C of the index and
+ *   the magic again
+ *
+ * Because every block is independent and indexed, blocks can be encoded
+ * and decoded on several threads and any block can be read on its own.
+ * Decoding is bit-exact: unpacking gives back the original records.
+ */
+
+#ifndef RECPACK_H
+#define RECPACK_H
+
+#include "copyrecords.h"   /* For record */
+#include "checksum.h"      /* For CHECKSUM_BLOCK_RECORDS */
+#include <stdio.h>         /* For FILE */
+#include <stdint.h>        /* For fixed-width integers */
+
+/* Records in one packed block (a whole number of checksum blocks) */
+#define PACK_BLOCK_RECORDS (16 * CHECKSUM_BLOCK_RECORDS)
+
+/* Index entry for one block */
+typedef struct pack_entry {
+    uint64_t offset;     /* Position of the block in the file */
+    uint32_t length;     /* Encoded length in bytes */
+    uint32_t records;    /* Records in the block */
+    uint32_t crc;        /* CRC32C of the encoded block */
+    uint32_t reserved;
+} pack_entry;
+
+/* Writes a packed archive; records are added in order */
+typedef struct pack_writer {
+    FILE * fp;
+    int threads;               /* Blocks encoded at once */
+    record * pending;          /* Records waiting to be encoded */
+    size_t filled;             /* Records in pending */
+    unsigned char * encoded;   /* One encoding buffer per thread */
+    pack_entry * index;        /* Entries of the blocks written so far */
+    uint64_t num_blocks;
+    uint64_t capacity;         /* Allocated entries in index */
+    uint64_t num_records;
+    uint64_t offset;           /* Where the next block goes */
+} pack_writer;
+
+/* An open packed archive */
+typedef struct pack_reader {
+    int fd;
+    uint32_t block_records;
+    uint64_t num_blocks;
+    uint64_t num_records;
+    pack_entry * index;
+} pack_reader;
+
+/* Returns non-zero if the file is a packed archive */
+int pack_is_packed(const char * path);
+
+/* Starts a packed archive on fp; returns 0, or -1 if out of memory or on a write error */
+int pack_writer_init(pack_writer * writer, FILE * fp, int threads);
+
+/* Adds records in order; returns 0, or -1 on a write error */
+int pack_writer_add(pack_writer * writer, const record * records, size_t count);
+
+/* Writes the remaining records, the index and the footer; returns 0 or -1 */
+int pack_writer_finish(pack_writer * writer);
+
+/* Releases the writer's buffers */
+void pack_writer_free(pack_writer * writer);
+
+/* Opens a packed archive and reads its index; returns 0, or -1 if invalid */
+int pack_open(pack_reader * reader, const char * path);
+
+/* Closes the archive and releases the index */
+void pack_close(pack_reader * reader);
+
+/*
+ * Decodes count blocks starting at first into out (block i of the range
+ * goes to out + i * PACK_BLOCK_RECORDS), using up to threads threads.
+ * Returns the number of records decoded, or -1 if a block is unreadable,
+ * fails its CRC or is malformed (a message is printed to stderr).
+ */
+int64_t pack_read_blocks(const pack_reader * reader, uint64_t first, uint64_t count,
+                         record * out, int threads);
+
+/*
+ * Checks every block's CRC and that it decodes, using several threads.
+ * Returns the number of bad blocks (each reported on report if not NULL),
+ * or -1 on an I/O or memory error.
+ */
+long pack_verify(const pack_reader * reader, int threads, FILE * report);
+
+#endif
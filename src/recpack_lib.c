@@ -0,0 +1,612 @@
+/*
+ * recpack_lib.c
+ *
+ * This file implements the packed record archives declared in recpack.h.
+ *
+ * Key Implementation Details:
+ * 1. Encoding: Within a block the fields are stored column by column
+ *    (all str1, then each dbl column, all str2, then each nums column), so
+ *    each column is compared with the same column of the previous record
+ * 2. Writing: Records are gathered until there is one full block per
+ *    thread; the blocks are then encoded in parallel, each into its own
+ *    buffer, and written in order
+ * 3. Reading: Blocks are fetched with pread(), checked against their CRC
+ *    and decoded straight into the caller's record array, several blocks
+ *    at once on different threads
+ */
+
+#define _GNU_SOURCE   /* For pread() */
+
+#include "recpack.h"
+#include "crc32c.h"     /* For crc32c() */
+#include "parallel.h"   /* For parallel_run() */
+#include <stdio.h>      /* For file operations */
+#include <stdlib.h>     /* For memory management */
+#include <string.h>     /* For memcpy() and memset() */
+#include <fcntl.h>      /* For open() */
+#include <unistd.h>     /* For pread() and close() */
+#include <sys/stat.h>   /* For fstat() */
+
+#define PACK_MAGIC "RPAK"
+#define PACK_VERSION 1
+
+/*
+ * Largest encoding of one record: string lengths take at most 2 varint
+ * bytes, a dbl at most 9 bytes and a nums difference at most 5
+ */
+#define PACK_RECORD_MAX ((2 + 24) + (2 + 144) + 24 * 9 + 12 * 5)
+
+/* Largest encoding of one block */
+#define PACK_BLOCK_MAX ((size_t) PACK_BLOCK_RECORDS * PACK_RECORD_MAX)
+
+/* Fixed-size start of a packed archive */
+typedef struct pack_header {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t block_records;
+    uint64_t reserved[2];
+} pack_header;
+
+/* Fixed-size end of a packed archive */
+typedef struct pack_footer {
+    uint64_t index_offset;
+    uint64_t num_blocks;
+    uint64_t num_records;
+    uint32_t index_crc;
+    char magic[4];
+} pack_footer;
+
+/* Work for one encoding thread */
+typedef struct encode_task {
+    const record * records;
+    size_t count;
+    unsigned char * out;
+    size_t length;
+    uint32_t crc;
+} encode_task;
+
+/* Work for one decoding or verifying thread */
+typedef struct decode_task {
+    const pack_reader * reader;
+    uint64_t first;          /* First block of the thread's range */
+    uint64_t end;            /* One past the last block */
+    record * out;            /* Destination of the first block, or NULL to verify */
+    FILE * report;           /* Where bad blocks are reported when verifying */
+    int64_t records;         /* Records decoded */
+    long bad;                /* Blocks that failed */
+    int failed;              /* Non-zero on an I/O or memory error */
+} decode_task;
+
+static unsigned char * put_varint(unsigned char * p, uint64_t v) {
+    while (v >= 0x80) {
+        *p++ = (unsigned char) (v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char) v;
+    return p;
+}
+
+static const unsigned char * get_varint(const unsigned char * p, const unsigned char * end,
+                                        uint64_t * v) {
+    uint64_t x = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end) {
+            return NULL;
+        }
+        unsigned char b = *p++;
+        x |= (uint64_t) (b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            *v = x;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+/* Length of a string field up to its last non-NUL byte */
+static size_t string_length(const char * s, size_t size) {
+    while (size > 0 && s[size - 1] == '\0') {
+        size--;
+    }
+    return size;
+}
+
+/*
+ * encode_block
+ *
+ * Purpose: Encodes n records (see recpack.h for the field encodings)
+ *
+ * Returns:
+ *   Bytes written to out (at most n * PACK_RECORD_MAX)
+ */
+static size_t encode_block(const record * r, size_t n, unsigned char * out) {
+    unsigned char * p = out;
+
+    for (size_t i = 0; i < n; i++) {
+        size_t len = string_length(r[i].str1, sizeof(r[i].str1));
+        p = put_varint(p, len);
+        memcpy(p, r[i].str1, len);
+        p += len;
+    }
+    for (int c = 0; c < 24; c++) {
+        uint64_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t bits;
+            memcpy(&bits, &r[i].dbl[c], sizeof(bits));
+            uint64_t x = bits ^ prev;
+            prev = bits;
+            if (x == 0) {
+                *p++ = 0;
+                continue;
+            }
+            int tz = __builtin_ctzll(x) / 8;
+            int bytes = 8 - __builtin_clzll(x) / 8 - tz;
+            *p++ = (unsigned char) (tz << 4 | bytes);
+            x >>= 8 * tz;
+            for (int b = 0; b < bytes; b++) {
+                *p++ = (unsigned char) x;
+                x >>= 8;
+            }
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        size_t len = string_length(r[i].str2, sizeof(r[i].str2));
+        p = put_varint(p, len);
+        memcpy(p, r[i].str2, len);
+        p += len;
+    }
+    for (int c = 0; c < 12; c++) {
+        int64_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            int64_t d = (int64_t) r[i].nums[c] - prev;
+            prev = r[i].nums[c];
+            p = put_varint(p, ((uint64_t) d << 1) ^ (uint64_t) -(d < 0));
+        }
+    }
+    return p - out;
+}
+
+/* Decodes a string column; returns the position after it, or NULL if malformed */
+static const unsigned char * decode_strings(const unsigned char * p, const unsigned char * end,
+                                            record * r, size_t n, size_t field) {
+    for (size_t i = 0; p != NULL && i < n; i++) {
+        char * s = field == 0 ? r[i].str1 : r[i].str2;
+        size_t size = field == 0 ? sizeof(r[i].str1) : sizeof(r[i].str2);
+        uint64_t len;
+        p = get_varint(p, end, &len);
+        if (p == NULL || len > size || len > (uint64_t) (end - p)) {
+            return NULL;
+        }
+        memcpy(s, p, len);
+        memset(s + len, 0, size - len);
+        p += len;
+    }
+    return p;
+}
+
+/*
+ * decode_block
+ *
+ * Purpose: Decodes n records encoded by encode_block()
+ *
+ * Returns:
+ *   0 on success, -1 if the data is malformed or has bytes left over
+ */
+static int decode_block(const unsigned char * p, size_t length, record * r, size_t n) {
+    const unsigned char * end = p + length;
+
+    p = decode_strings(p, end, r, n, 0);
+    for (int c = 0; p != NULL && c < 24; c++) {
+        uint64_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (p == end) {
+                return -1;
+            }
+            int tz = *p >> 4;
+            int bytes = *p++ & 15;
+            uint64_t x = 0;
+            if (bytes + tz > 8 || bytes > end - p || (bytes == 0 && tz != 0)) {
+                return -1;
+            }
+            for (int b = bytes - 1; b >= 0; b--) {
+                x = x << 8 | p[b];
+            }
+            p += bytes;
+            prev ^= x << (8 * tz);
+            memcpy(&r[i].dbl[c], &prev, sizeof(prev));
+        }
+    }
+    p = p != NULL ? decode_strings(p, end, r, n, 1) : NULL;
+    for (int c = 0; p != NULL && c < 12; c++) {
+        int64_t prev = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint64_t z;
+            p = get_varint(p, end, &z);
+            if (p == NULL) {
+                return -1;
+            }
+            prev += (int64_t) (z >> 1) ^ -(int64_t) (z & 1);
+            r[i].nums[c] = (int) prev;
+        }
+    }
+    return p == end ? 0 : -1;
+}
+
+/*
+ * pack_is_packed
+ *
+ * Purpose: Checks whether a file starts with the packed archive magic
+ */
+int pack_is_packed(const char * path) {
+    char magic[4];
+    FILE * fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return 0;
+    }
+    int packed = fread(magic, sizeof(magic), 1, fp) == 1 && memcmp(magic, PACK_MAGIC, 4) == 0;
+    fclose(fp);
+    return packed;
+}
+
+/*
+ * pack_writer_init
+ *
+ * Purpose: Starts a packed archive and writes its header
+ */
+int pack_writer_init(pack_writer * writer, FILE * fp, int threads) {
+    pack_header header;
+
+    memset(writer, 0, sizeof(*writer));
+    writer->fp = fp;
+    writer->threads = threads > 0 ? threads : 1;
+    writer->pending = malloc(sizeof(record) * PACK_BLOCK_RECORDS * writer->threads);
+    writer->encoded = malloc(PACK_BLOCK_MAX * writer->threads);
+    if (writer->pending == NULL || writer->encoded == NULL) {
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PACK_MAGIC, 4);
+    header.version = PACK_VERSION;
+    header.record_size = sizeof(record);
+    header.block_records = PACK_BLOCK_RECORDS;
+    if (fwrite(&header, sizeof(header), 1, fp) != 1) {
+        return -1;
+    }
+    writer->offset = sizeof(header);
+    return 0;
+}
+
+static void * encode_worker(void * arg) {
+    encode_task * task = arg;
+    task->length = encode_block(task->records, task->count, task->out);
+    task->crc = crc32c(task->out, task->length);
+    return NULL;
+}
+
+/*
+ * pack_flush
+ *
+ * Purpose: Encodes the pending records (one block per thread) and writes
+ *          the blocks in order
+ */
+static int pack_flush(pack_writer * writer) {
+    size_t blocks = (writer->filled + PACK_BLOCK_RECORDS - 1) / PACK_BLOCK_RECORDS;
+    encode_task * tasks = calloc(blocks, sizeof(encode_task));
+    int status = 0;
+
+    if (tasks == NULL) {
+        return -1;
+    }
+    for (size_t b = 0; b < blocks; b++) {
+        size_t first = b * PACK_BLOCK_RECORDS;
+        tasks[b].records = writer->pending + first;
+        tasks[b].count = writer->filled - first < PACK_BLOCK_RECORDS ? writer->filled - first : PACK_BLOCK_RECORDS;
+        tasks[b].out = writer->encoded + b * PACK_BLOCK_MAX;
+    }
+    parallel_run((int) blocks, encode_worker, tasks, sizeof(encode_task));
+
+    for (size_t b = 0; status == 0 && b < blocks; b++) {
+        if (writer->num_blocks == writer->capacity) {
+            uint64_t capacity = writer->capacity == 0 ? 64 : writer->capacity * 2;
+            pack_entry * index = realloc(writer->index, sizeof(pack_entry) * capacity);
+            if (index == NULL) {
+                status = -1;
+                break;
+            }
+            writer->index = index;
+            writer->capacity = capacity;
+        }
+        pack_entry * entry = &writer->index[writer->num_blocks++];
+        entry->offset = writer->offset;
+        entry->length = (uint32_t) tasks[b].length;
+        entry->records = (uint32_t) tasks[b].count;
+        entry->crc = tasks[b].crc;
+        entry->reserved = 0;
+        if (fwrite(tasks[b].out, 1, tasks[b].length, writer->fp) != tasks[b].length) {
+            status = -1;
+        }
+        writer->offset += tasks[b].length;
+        writer->num_records += tasks[b].count;
+    }
+    writer->filled = 0;
+    free(tasks);
+    return status;
+}
+
+/*
+ * pack_writer_add
+ *
+ * Purpose: Adds records, encoding and writing blocks as they fill up
+ */
+int pack_writer_add(pack_writer * writer, const record * records, size_t count) {
+    size_t capacity = (size_t) PACK_BLOCK_RECORDS * writer->threads;
+    while (count > 0) {
+        size_t take = capacity - writer->filled < count ? capacity - writer->filled : count;
+        memcpy(writer->pending + writer->filled, records, sizeof(record) * take);
+        writer->filled += take;
+        records += take;
+        count -= take;
+        if (writer->filled == capacity && pack_flush(writer) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * pack_writer_finish
+ *
+ * Purpose: Writes the last (possibly short) block, the index and the footer
+ */
+int pack_writer_finish(pack_writer * writer) {
+    pack_footer footer;
+
+    if (writer->filled > 0 && pack_flush(writer) != 0) {
+        return -1;
+    }
+    memset(&footer, 0, sizeof(footer));
+    footer.index_offset = writer->offset;
+    footer.num_blocks = writer->num_blocks;
+    footer.num_records = writer->num_records;
+    footer.index_crc = crc32c(writer->index, sizeof(pack_entry) * writer->num_blocks);
+    memcpy(footer.magic, PACK_MAGIC, 4);
+    if ((writer->num_blocks > 0 &&
+         fwrite(writer->index, sizeof(pack_entry), writer->num_blocks, writer->fp) != writer->num_blocks) ||
+        fwrite(&footer, sizeof(footer), 1, writer->fp) != 1) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * pack_writer_free
+ *
+ * Purpose: Releases the writer's buffers and index
+ */
+void pack_writer_free(pack_writer * writer) {
+    free(writer->pending);
+    free(writer->encoded);
+    free(writer->index);
+    writer->pending = NULL;
+    writer->encoded = NULL;
+    writer->index = NULL;
+}
+
+/* Reads exactly length bytes at offset; returns 0 or -1 */
+static int read_at(int fd, void * buf, size_t length, off_t offset) {
+    size_t got = 0;
+    while (got < length) {
+        ssize_t r = pread(fd, (char *) buf + got, length - got, offset + (off_t) got);
+        if (r <= 0) {
+            return -1;
+        }
+        got += r;
+    }
+    return 0;
+}
+
+/*
+ * pack_open
+ *
+ * Purpose: Opens a packed archive and loads its index
+ *
+ * How it works:
+ * 1. The header must match this build's record and block size
+ * 2. The footer gives the index position, which must end right before it
+ * 3. The index must pass its CRC, and every entry must lie inside the
+ *    block area and account for all the records
+ */
+int pack_open(pack_reader * reader, const char * path) {
+    pack_header header;
+    pack_footer footer;
+    struct stat st;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = open(path, O_RDONLY);
+    if (reader->fd < 0) {
+        return -1;
+    }
+    if (fstat(reader->fd, &st) != 0 || st.st_size < (off_t) (sizeof(header) + sizeof(footer)) ||
+        read_at(reader->fd, &header, sizeof(header), 0) != 0 ||
+        read_at(reader->fd, &footer, sizeof(footer), st.st_size - (off_t) sizeof(footer)) != 0 ||
+        memcmp(header.magic, PACK_MAGIC, 4) != 0 || memcmp(footer.magic, PACK_MAGIC, 4) != 0 ||
+        header.version != PACK_VERSION || header.record_size != sizeof(record) ||
+        header.block_records != PACK_BLOCK_RECORDS ||
+        footer.index_offset < sizeof(header) ||
+        footer.num_blocks > (uint64_t) st.st_size / sizeof(pack_entry) ||
+        footer.index_offset + footer.num_blocks * sizeof(pack_entry) + sizeof(footer) != (uint64_t) st.st_size) {
+        pack_close(reader);
+        return -1;
+    }
+
+    reader->block_records = header.block_records;
+    reader->num_blocks = footer.num_blocks;
+    reader->num_records = footer.num_records;
+    reader->index = malloc(sizeof(pack_entry) * (footer.num_blocks + 1));
+    if (reader->index == NULL ||
+        read_at(reader->fd, reader->index, sizeof(pack_entry) * footer.num_blocks, (off_t) footer.index_offset) != 0 ||
+        crc32c(reader->index, sizeof(pack_entry) * footer.num_blocks) != footer.index_crc) {
+        pack_close(reader);
+        return -1;
+    }
+
+    uint64_t records = 0;
+    for (uint64_t b = 0; b < reader->num_blocks; b++) {
+        const pack_entry * entry = &reader->index[b];
+        if (entry->records == 0 || entry->records > reader->block_records ||
+            (entry->records != reader->block_records && b + 1 != reader->num_blocks) ||
+            entry->length > PACK_BLOCK_MAX || entry->offset < sizeof(header) ||
+            entry->offset + entry->length > footer.index_offset) {
+            pack_close(reader);
+            return -1;
+        }
+        records += entry->records;
+    }
+    if (records != reader->num_records) {
+        pack_close(reader);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * pack_close
+ *
+ * Purpose: Closes a packed archive
+ */
+void pack_close(pack_reader * reader) {
+    if (reader->fd >= 0) {
+        close(reader->fd);
+    }
+    free(reader->index);
+    reader->fd = -1;
+    reader->index = NULL;
+}
+
+/*
+ * decode_worker
+ *
+ * Purpose: Reads, checks and decodes one thread's range of blocks
+ *
+ * When out is NULL the blocks are only verified: each bad block is counted
+ * and reported, and checking continues with the next one.
+ */
+static void * decode_worker(void * arg) {
+    decode_task * task = arg;
+    const pack_reader * reader = task->reader;
+    unsigned char * scratch = malloc(PACK_BLOCK_MAX);
+    record * verify_buffer = task->out == NULL ? malloc(sizeof(record) * PACK_BLOCK_RECORDS) : NULL;
+
+    if (scratch == NULL || (task->out == NULL && verify_buffer == NULL)) {
+        task->failed = 1;
+    }
+    for (uint64_t b = task->first; !task->failed && b < task->end; b++) {
+        const pack_entry * entry = &reader->index[b];
+        record * out = task->out != NULL ? task->out + (b - task->first) * PACK_BLOCK_RECORDS : verify_buffer;
+
+        if (read_at(reader->fd, scratch, entry->length, (off_t) entry->offset) != 0) {
+            fprintf(stderr, "Could not read packed block %llu.\n", (unsigned long long) b);
+            task->failed = 1;
+        } else if (crc32c(scratch, entry->length) != entry->crc ||
+                   decode_block(scratch, entry->length, out, entry->records) != 0) {
+            if (task->out != NULL) {
+                fprintf(stderr, "Packed block %llu is damaged.\n", (unsigned long long) b);
+                task->failed = 1;
+            } else {
+                if (task->report != NULL) {
+                    fprintf(task->report, "Bad block %llu (records %llu-%llu)\n",
+                            (unsigned long long) b,
+                            (unsigned long long) (b * reader->block_records),
+                            (unsigned long long) (b * reader->block_records + entry->records - 1));
+                }
+                task->bad++;
+            }
+        } else {
+            task->records += entry->records;
+        }
+    }
+    free(scratch);
+    free(verify_buffer);
+    return NULL;
+}
+
+/*
+ * run_decode
+ *
+ * Purpose: Splits blocks [first, first + count) into one contiguous range
+ *          per thread and runs decode_worker on them
+ *
+ * Returns:
+ *   0 on success, -1 if any thread failed; records and bad blocks are
+ *   added up into *records and *bad
+ */
+static int run_decode(const pack_reader * reader, uint64_t first, uint64_t count, record * out,
+                      int threads, FILE * report, int64_t * records, long * bad) {
+    if (threads < 1) {
+        threads = 1;
+    }
+    if ((uint64_t) threads > count) {
+        threads = count > 0 ? (int) count : 1;
+    }
+    decode_task * tasks = calloc(threads, sizeof(decode_task));
+    if (tasks == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < threads; i++) {
+        tasks[i].reader = reader;
+        tasks[i].first = first + count * i / threads;
+        tasks[i].end = first + count * (i + 1) / threads;
+        tasks[i].out = out != NULL ? out + (tasks[i].first - first) * PACK_BLOCK_RECORDS : NULL;
+        tasks[i].report = report;
+    }
+    parallel_run(threads, decode_worker, tasks, sizeof(decode_task));
+
+    int status = 0;
+    *records = 0;
+    *bad = 0;
+    for (int i = 0; i < threads; i++) {
+        if (tasks[i].failed) {
+            status = -1;
+        }
+        *records += tasks[i].records;
+        *bad += tasks[i].bad;
+    }
+    free(tasks);
+    return status;
+}
+
+/*
+ * pack_read_blocks
+ *
+ * Purpose: Decodes a range of blocks into a record array
+ */
+int64_t pack_read_blocks(const pack_reader * reader, uint64_t first, uint64_t count,
+                         record * out, int threads) {
+    int64_t records;
+    long bad;
+
+    if (first > reader->num_blocks || count > reader->num_blocks - first) {
+        return -1;
+    }
+    if (run_decode(reader, first, count, out, threads, NULL, &records, &bad) != 0) {
+        return -1;
+    }
+    return records;
+}
+
+/*
+ * pack_verify
+ *
+ * Purpose: Checks every block of a packed archive
+ */
+long pack_verify(const pack_reader * reader, int threads, FILE * report) {
+    int64_t records;
+    long bad;
+
+    if (run_decode(reader, 0, reader->num_blocks, NULL, threads, report, &records, &bad) != 0) {
+        return -1;
+    }
+    return bad;
+}
@@ -0,0 +1,66 @@
+/*
+ * recpart.h
+ *
+ * This header file defines the interface for copying a record archive in
+ * parallel partitions, used by copyrecords --partitioned.
+ *
+ * A plain copy reads and writes one checksum block at a time through one
+ * stdio stream, so a fast array of SSDs sees a single request at a time.
+ * Here the output is cut into large partitions, and every worker thread
+ * copies a partition at a time on its own: one pread() of the input range
+ * that becomes the partition, the -D decode of str1 and str2, and one
+ * pwrite() at the partition's place in the output. With -j threads there
+ * are -j requests in flight.
+ *
+ * Key Features:
+ * 1. Offsets, not seeks: Partition k is records k * P to (k + 1) * P of
+ *    the output. Forward it is the same records of the input; with -r it
+ *    is the mirrored range, ending k * P records before the end of the
+ *    input, and the partition is reversed in memory. No file position is
+ *    shared and nothing is sought
+ * 2. Alignment: P is a multiple of PART_ALIGN_RECORDS, so every partition
+ *    starts on a page boundary of the output (and, forward, of the input)
+ *    and on a checksum block boundary
+ * 3. Checksums: Input blocks are checked (-r rereads the few records of
+ *    the blocks a mirrored range cuts through) and the output's CRCs (-C)
+ *    are computed by the workers, one output block at a time
+ */
+
+#ifndef RECPART_H
+#define RECPART_H
+
+#include "copyrecords.h"   /* For record */
+#include "checksum.h"      /* For checksum_table */
+#include "decode_lib.h"    /* For decode_ctx */
+
+/* Fewest records filling whole 4096-byte pages and checksum blocks (512 * 408 = 51 * 4096) */
+#define PART_ALIGN_RECORDS 512
+
+/* Records per partition by default (about 6.7 MB) */
+#define PART_DEFAULT_RECORDS (32 * PART_ALIGN_RECORDS)
+
+/* How to copy */
+typedef struct part_options {
+    int threads;                       /* Workers (and requests in flight) */
+    size_t partition_records;          /* Records per partition (a multiple of PART_ALIGN_RECORDS) */
+    int reverse;                       /* Non-zero for -r */
+    const decode_ctx * ctx;            /* Holds the shift tables */
+    int shift;                         /* Decoding shift (0 for none) */
+    const checksum_table * verify;     /* Input checksums to check, or NULL */
+    checksum_table * sums;             /* Receives the output's checksums, or NULL */
+} part_options;
+
+/* Returns the partition size for about megabytes MB, rounded down to PART_ALIGN_RECORDS (at least one) */
+size_t part_records_for(long megabytes);
+
+/*
+ * Copies num_records records of the archive in_fd to output (created or
+ * truncated). If options->sums is not NULL it is filled in (it must start
+ * empty) with the output's complete checksum table, ready for
+ * checksum_writer_adopt().
+ * Returns 0 on success, -1 on an I/O, checksum or memory error (a message
+ * is printed to stderr).
+ */
+int part_copy(int in_fd, int64_t num_records, const part_options * options, const char * output);
+
+#endif
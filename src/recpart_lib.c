@@ -0,0 +1,293 @@
+/*
+ * recpart_lib.c
+ *
+ * This file implements the partitioned copy declared in recpart.h.
+ *
+ * Key Implementation Details:
+ * 1. Hand-out: Partitions are taken in output order from a shared counter,
+ *    so neighbouring partitions are in flight together and the devices
+ *    see a few sequential streams rather than scattered requests
+ * 2. Buffers: Each worker owns one partition buffer (plus a checksum
+ *    block on either side for -r), allocated by the worker itself so its
+ *    pages come from its own NUMA node (see numa.h)
+ * 3. Output: The file is created and given its final size before any
+ *    worker starts; each partition is then a single pwrite() into it, in
+ *    whatever order the partitions finish
+ * 4. Failure: The first error stops the other workers at their next
+ *    partition, and the output is left truncated to nothing rather than
+ *    with holes that read as zero records
+ */
+
+#define _GNU_SOURCE   /* For pread() and pwrite() */
+
+#include "recpart.h"
+#include "crc32c.h"     /* For crc32c() */
+#include "parallel.h"   /* For parallel_run() */
+#include <stdio.h>      /* For fprintf() */
+#include <stdlib.h>     /* For memory management */
+#include <string.h>     /* For memset() */
+#include <errno.h>      /* For EINTR */
+#include <fcntl.h>      /* For open() */
+#include <pthread.h>    /* For the hand-out lock */
+#include <unistd.h>     /* For pread(), pwrite(), ftruncate() and close() */
+
+/* A partition must cover whole checksum blocks (the page alignment is in the value itself) */
+typedef char part_align_check[PART_ALIGN_RECORDS % CHECKSUM_BLOCK_RECORDS == 0 ? 1 : -1];
+
+/* State shared by all workers */
+typedef struct part_state {
+    int in_fd;                         /* Input archive */
+    int out_fd;                        /* Output archive, already at its final size */
+    int64_t num_records;               /* Records in the input (and the output) */
+    const part_options * options;
+    int64_t num_partitions;
+    pthread_mutex_t lock;
+    int64_t next_partition;            /* Next partition to hand out (guarded by lock) */
+    int failed;                        /* Set on any error (guarded by lock) */
+} part_state;
+
+/* Reads exactly length bytes at offset; returns 0, or -1 on an error or a short file */
+static int read_full(int fd, void * buffer, size_t length, off_t offset) {
+    size_t got = 0;
+    while (got < length) {
+        ssize_t n = pread(fd, (char *) buffer + got, length - got, offset + (off_t) got);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        got += (size_t) n;
+    }
+    return 0;
+}
+
+/* Writes exactly length bytes at offset; returns 0, or -1 on an error */
+static int write_full(int fd, const void * buffer, size_t length, off_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pwrite(fd, (const char *) buffer + done, length - done, offset + (off_t) done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += (size_t) n;
+    }
+    return 0;
+}
+
+/* Marks the copy as failed, so the other workers stop */
+static void part_fail(part_state * st) {
+    pthread_mutex_lock(&st->lock);
+    st->failed = 1;
+    pthread_mutex_unlock(&st->lock);
+}
+
+size_t part_records_for(long megabytes) {
+    uint64_t records = (uint64_t) megabytes * 1024 * 1024 / sizeof(record);
+    records = records / PART_ALIGN_RECORDS * PART_ALIGN_RECORDS;
+    return records > 0 ? (size_t) records : PART_ALIGN_RECORDS;
+}
+
+/*
+ * copy_partition
+ *
+ * Purpose: Reads, checks, decodes and writes one partition
+ *
+ * Parameters:
+ *   st        - Shared state
+ *   partition - Partition number (its place in the output)
+ *   buffer    - Room for a partition and a checksum block on either side
+ *
+ * Returns:
+ *   0 on success, -1 on a read, checksum or write error
+ *
+ * How it works:
+ * 1. The output range is out_first to out_first + count; the input range
+ *    is the same forward, and mirrored from the end of the input with -r
+ * 2. With input checksums, the read is widened to whole input blocks,
+ *    which only changes anything for -r when the record count is not a
+ *    multiple of the block size
+ * 3. After the decode (and the reversal for -r) the buffer is exactly the
+ *    output range, whose blocks are aligned, so their CRCs go straight into
+ *    the output table
+ */
+static int copy_partition(part_state * st, int64_t partition, record * buffer) {
+    const part_options * options = st->options;
+    int64_t out_first = partition * (int64_t) options->partition_records;
+    size_t count = st->num_records - out_first < (int64_t) options->partition_records ?
+                   (size_t) (st->num_records - out_first) : options->partition_records;
+    int64_t in_first = options->reverse ? st->num_records - out_first - (int64_t) count : out_first;
+
+    int64_t read_first = in_first;
+    int64_t read_end = in_first + (int64_t) count;
+    if (options->verify != NULL) {
+        read_first = read_first / CHECKSUM_BLOCK_RECORDS * CHECKSUM_BLOCK_RECORDS;
+        read_end = (read_end + CHECKSUM_BLOCK_RECORDS - 1) / CHECKSUM_BLOCK_RECORDS * CHECKSUM_BLOCK_RECORDS;
+        if (read_end > st->num_records) {
+            read_end = st->num_records;
+        }
+    }
+    size_t read_count = (size_t) (read_end - read_first);
+
+    if (read_full(st->in_fd, buffer, read_count * sizeof(record), (off_t) read_first * (off_t) sizeof(record)) != 0) {
+        fprintf(stderr, "Could not read records %lld-%lld.\n",
+                (long long) read_first, (long long) (read_end - 1));
+        return -1;
+    }
+    for (size_t b = 0; options->verify != NULL && b < read_count; b += CHECKSUM_BLOCK_RECORDS) {
+        size_t n = read_count - b < CHECKSUM_BLOCK_RECORDS ? read_count - b : CHECKSUM_BLOCK_RECORDS;
+        uint64_t block = (uint64_t) (read_first + (int64_t) b) / CHECKSUM_BLOCK_RECORDS;
+        if (!checksum_block_ok(options->verify, block, buffer + b, n)) {
+            fprintf(stderr, "Checksum mismatch in block %llu (records %lld-%lld).\n", (unsigned long long) block,
+                    (long long) (read_first + (int64_t) b), (long long) (read_first + (int64_t) (b + n) - 1));
+            return -1;
+        }
+    }
+
+    record * records = buffer + (in_first - read_first);
+    decode_records(options->ctx, records, count, options->shift);
+    if (options->reverse) {
+        for (size_t j = 0; j < count / 2; j++) {
+            record swap = records[j];
+            records[j] = records[count - 1 - j];
+            records[count - 1 - j] = swap;
+        }
+    }
+    if (options->sums != NULL) {
+        for (size_t b = 0; b < count; b += CHECKSUM_BLOCK_RECORDS) {
+            size_t n = count - b < CHECKSUM_BLOCK_RECORDS ? count - b : CHECKSUM_BLOCK_RECORDS;
+            options->sums->crcs[(out_first + (int64_t) b) / CHECKSUM_BLOCK_RECORDS] = crc32c(records + b, n * sizeof(record));
+        }
+    }
+
+    if (write_full(st->out_fd, records, count * sizeof(record), (off_t) out_first * (off_t) sizeof(record)) != 0) {
+        fprintf(stderr, "Could not write records %lld-%lld.\n",
+                (long long) out_first, (long long) (out_first + (int64_t) count - 1));
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * part_worker
+ *
+ * Purpose: Copies partitions until there are none left or something fails
+ */
+static void * part_worker(void * arg) {
+    part_state * st = *(part_state **) arg;
+    record * buffer = malloc(sizeof(record) * (st->options->partition_records + 2 * CHECKSUM_BLOCK_RECORDS));
+
+    if (buffer == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        part_fail(st);
+    }
+    for (;;) {
+        pthread_mutex_lock(&st->lock);
+        int64_t partition = st->next_partition;
+        int stop = st->failed || partition >= st->num_partitions;
+        if (!stop) {
+            st->next_partition++;
+        }
+        pthread_mutex_unlock(&st->lock);
+        if (stop) {
+            break;
+        }
+
+        if (copy_partition(st, partition, buffer) != 0) {
+            part_fail(st);
+            break;
+        }
+    }
+    free(buffer);
+    return NULL;
+}
+
+/*
+ * part_copy
+ *
+ * Purpose: Copies an archive partition by partition on several threads
+ *
+ * Parameters:
+ *   in_fd       - Input archive, open for reading
+ *   num_records - Records to copy
+ *   options     - Threads, partition size, direction, decoding, checksums
+ *   output      - Output archive name
+ *
+ * Returns:
+ *   0 on success, -1 on failure
+ *
+ * How it works:
+ * 1. Creates the output and sets its final size, and sizes the output
+ *    checksum table, so no worker ever extends either
+ * 2. Runs part_worker on every thread
+ * 3. Closes the output, reporting any error the close reveals
+ */
+int part_copy(int in_fd, int64_t num_records, const part_options * options, const char * output) {
+    int threads = options->threads > 0 ? options->threads : 1;
+    part_state st;
+    int status = 0;
+
+    memset(&st, 0, sizeof(st));
+    st.in_fd = in_fd;
+    st.num_records = num_records;
+    st.options = options;
+    st.num_partitions = (num_records + (int64_t) options->partition_records - 1) / (int64_t) options->partition_records;
+    if (threads > st.num_partitions) {
+        threads = st.num_partitions > 0 ? (int) st.num_partitions : 1;
+    }
+
+    st.out_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (st.out_fd < 0) {
+        fprintf(stderr, "Could not open output file %s\n", output);
+        return -1;
+    }
+    if (ftruncate(st.out_fd, (off_t) num_records * (off_t) sizeof(record)) != 0) {
+        fprintf(stderr, "Could not size output file %s\n", output);
+        close(st.out_fd);
+        return -1;
+    }
+
+    uint64_t num_blocks = ((uint64_t) num_records + CHECKSUM_BLOCK_RECORDS - 1) / CHECKSUM_BLOCK_RECORDS;
+    if (options->sums != NULL) {
+        options->sums->block_records = CHECKSUM_BLOCK_RECORDS;
+        options->sums->record_size = sizeof(record);
+    }
+    if (options->sums != NULL && num_blocks > 0) {
+        options->sums->crcs = malloc(sizeof(uint32_t) * num_blocks);
+        if (options->sums->crcs == NULL) {
+            fprintf(stderr, "Out of memory.\n");
+            close(st.out_fd);
+            return -1;
+        }
+        options->sums->num_blocks = num_blocks;
+        options->sums->num_records = (uint64_t) num_records;
+    }
+
+    part_state ** tasks = malloc(sizeof(part_state *) * threads);
+    if (tasks == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        status = -1;
+    }
+    if (status == 0 && st.num_partitions > 0) {
+        pthread_mutex_init(&st.lock, NULL);
+        for (int i = 0; i < threads; i++) {
+            tasks[i] = &st;
+        }
+        parallel_run(threads, part_worker, tasks, sizeof(part_state *));
+        status = st.failed ? -1 : 0;
+        pthread_mutex_destroy(&st.lock);
+    }
+    free(tasks);
+
+    if (status != 0 && ftruncate(st.out_fd, 0) != 0) {
+        fprintf(stderr, "Could not clear output file %s\n", output);
+    }
+    if (close(st.out_fd) != 0 && status == 0) {
+        fprintf(stderr, "Could not write output file %s\n", output);
+        status = -1;
+    }
+    return status;
+}
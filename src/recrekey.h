@@ -0,0 +1,42 @@
+/*
+ * recrekey.h
+ *
+ * This header file defines the interface for changing the Caesar key of a
+ * record archive in place, used by copyrecords --rekey --in-place.
+ *
+ * Strings encoded with one shift are re-encoded with another without an
+ * output file: the decode and the encode are composed into one shift, and
+ * only the str1 and str2 bytes of each record are changed, through a
+ * shared writable mapping of the archive.
+ *
+ * Key Features:
+ * 1. String bytes only: The dbl and nums fields (288 of every 408 bytes)
+ *    are never read or written, so only the cache lines holding strings
+ *    are touched and written back
+ * 2. Parallel: Each thread re-keys a range of whole checksum blocks
+ * 3. Checksums: A .crc sidecar is brought up to date without reading the
+ *    numeric fields, because a CRC changes by the CRC of the bytes that
+ *    changed (see recrekey_lib.c)
+ */
+
+#ifndef RECREKEY_H
+#define RECREKEY_H
+
+#include "copyrecords.h"   /* For record */
+#include "decode_lib.h"    /* For decode_ctx */
+
+/* Parses "from:to" (two encoding shifts, 0-25); returns 0 on success, -1 if invalid */
+int rekey_parse(const char * text, int * from, int * to);
+
+/* Returns the single shift that undoes shift from and applies shift to */
+int rekey_shift(int from, int to);
+
+/*
+ * Applies shift to the strings of every record of archive in place, on
+ * threads threads, and updates its checksum sidecar if it has one.
+ * Returns 0 on success, -1 on an I/O or memory error, or if the sidecar
+ * does not match the archive (a message is printed to stderr).
+ */
+int rekey_archive(const char * archive, const decode_ctx * ctx, int shift, int threads);
+
+#endif
@@ -0,0 +1,251 @@
+/*
+ * recrekey_lib.c
+ *
+ * This file implements the in-place re-keying declared in recrekey.h.
+ *
+ * Key Implementation Details:
+ * 1. Mapping: The archive is mapped MAP_SHARED with read and write access,
+ *    so changed string bytes go back to the file through the page cache;
+ *    msync() makes sure they are on disk before the sidecar is rewritten
+ * 2. Strings: Each field is changed up to its first NUL, exactly as
+ *    decode_records() does when copying, so re-keying in place and
+ *    copying with --rekey give the same bytes
+ * 3. Checksums: CRC32C is affine over equal-length messages:
+ *        crc(new) = crc(old) ^ crc(old ^ new) ^ crc(zeros)
+ *    old ^ new is zero outside the strings, so each thread builds it in a
+ *    private, otherwise zero block buffer as it changes the strings, and
+ *    the block's new CRC comes from its stored one without reading the
+ *    numeric fields. A block that did not match before still does not
+ *    match afterwards, so no corruption is hidden
+ */
+
+#define _GNU_SOURCE   /* For madvise() */
+
+#include "recrekey.h"
+#include "checksum.h"   /* For the sidecar */
+#include "crc32c.h"     /* For crc32c() */
+#include "parallel.h"   /* For parallel_run() */
+#include <stddef.h>     /* For offsetof() */
+#include <stdio.h>      /* For fprintf() */
+#include <stdlib.h>     /* For memory management */
+#include <string.h>     /* For memchr() and memcpy() */
+#include <fcntl.h>      /* For open() */
+#include <unistd.h>     /* For close() */
+#include <sys/mman.h>   /* For mmap() */
+#include <sys/stat.h>   /* For fstat() */
+
+/* Work for one thread */
+typedef struct rekey_task {
+    record * records;          /* Start of the mapped archive */
+    int64_t first;             /* First record of the range (a block boundary) */
+    int64_t end;               /* One past the last record */
+    const decode_ctx * ctx;
+    int shift;
+    checksum_table * sums;     /* Sidecar to update, or NULL */
+    unsigned char * delta;     /* Zeroed block buffer for the changes (with sums) */
+} rekey_task;
+
+/* Parses "from:to" */
+int rekey_parse(const char * text, int * from, int * to) {
+    char extra = 0;
+    if (sscanf(text, "%d:%d%c", from, to, &extra) != 2) {
+        return -1;
+    }
+    return *from >= 0 && *from < 26 && *to >= 0 && *to < 26 ? 0 : -1;
+}
+
+/* Decoding from is shifting by 26 - from; encoding to is shifting by to */
+int rekey_shift(int from, int to) {
+    return (to - from + 26) % 26;
+}
+
+/*
+ * rekey_field
+ *
+ * Purpose: Re-keys one string field and records which bits changed
+ *
+ * Parameters:
+ *   field - The field in the mapping
+ *   size  - Size of the field
+ *   delta - Where the field's bytes sit in the block's change buffer, or
+ *           NULL if no checksums are kept
+ */
+static void rekey_field(const rekey_task * task, char * field, size_t size, unsigned char * delta) {
+    const char * nul = memchr(field, '\0', size);
+    size_t length = nul != NULL ? (size_t) (nul - field) : size;
+
+    if (delta == NULL) {
+        decode_apply(task->ctx, field, length, task->shift);
+        return;
+    }
+    memcpy(delta, field, length);
+    decode_apply(task->ctx, field, length, task->shift);
+    for (size_t i = 0; i < length; i++) {
+        delta[i] ^= (unsigned char) field[i];
+    }
+}
+
+/*
+ * rekey_worker
+ *
+ * Purpose: Re-keys one thread's range of blocks
+ *
+ * How it works:
+ * 1. Without checksums, the strings are changed record by record
+ * 2. With them, each block's changes are gathered in the zeroed buffer,
+ *    the stored CRC is corrected, and the string regions of the buffer
+ *    are cleared again for the next block
+ */
+static void * rekey_worker(void * arg) {
+    rekey_task * task = arg;
+    unsigned char * delta = task->delta;
+    uint32_t zero_crc = delta != NULL ? crc32c(delta, CHECKSUM_BLOCK_RECORDS * sizeof(record)) : 0;
+
+    madvise((char *) (task->records + task->first), (task->end - task->first) * sizeof(record), MADV_SEQUENTIAL);
+
+    for (int64_t first = task->first; first < task->end; first += CHECKSUM_BLOCK_RECORDS) {
+        size_t count = task->end - first < CHECKSUM_BLOCK_RECORDS ? (size_t) (task->end - first) : CHECKSUM_BLOCK_RECORDS;
+        record * r = task->records + first;
+
+        for (size_t i = 0; i < count; i++) {
+            unsigned char * d = delta != NULL ? delta + i * sizeof(record) : NULL;
+            rekey_field(task, r[i].str1, sizeof(r[i].str1), d != NULL ? d + offsetof(record, str1) : NULL);
+            rekey_field(task, r[i].str2, sizeof(r[i].str2), d != NULL ? d + offsetof(record, str2) : NULL);
+        }
+        if (delta != NULL) {
+            size_t bytes = count * sizeof(record);
+            uint32_t zeros = count == CHECKSUM_BLOCK_RECORDS ? zero_crc : 0;
+            uint32_t changes = crc32c(delta, bytes);
+            for (size_t i = 0; i < count; i++) {
+                memset(delta + i * sizeof(record) + offsetof(record, str1), 0, sizeof(r[i].str1));
+                memset(delta + i * sizeof(record) + offsetof(record, str2), 0, sizeof(r[i].str2));
+            }
+            if (count != CHECKSUM_BLOCK_RECORDS) {
+                zeros = crc32c(delta, bytes);
+            }
+            task->sums->crcs[first / CHECKSUM_BLOCK_RECORDS] ^= changes ^ zeros;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * rekey_archive
+ *
+ * Purpose: Re-keys the strings of an archive where it lies
+ *
+ * Parameters:
+ *   archive - Archive file name
+ *   ctx     - Context holding the shift tables
+ *   shift   - Shift to apply (rekey_shift(from, to))
+ *   threads - Threads to use
+ *
+ * Returns:
+ *   0 on success, -1 on failure
+ *
+ * How it works:
+ * 1. Loads the sidecar, if any, and checks it describes this archive
+ * 2. Maps the archive and splits it into one range of whole blocks per
+ *    thread; all memory is allocated before anything is changed, so the
+ *    archive is never left with some ranges re-keyed and others not
+ * 3. Re-keys every range, flushes the mapping and saves the updated sidecar
+ */
+int rekey_archive(const char * archive, const decode_ctx * ctx, int shift, int threads) {
+    struct stat st;
+    checksum_table sums;
+    int status = 0;
+
+    if (threads < 1) {
+        threads = 1;
+    }
+    int fd = open(archive, O_RDWR);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Could not open %s for writing\n", archive);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    int64_t num_records = st.st_size / (off_t) sizeof(record);
+    int64_t num_blocks = (num_records + CHECKSUM_BLOCK_RECORDS - 1) / CHECKSUM_BLOCK_RECORDS;
+
+    char * sum_path = checksum_path(archive);
+    int have_sums = sum_path != NULL && checksum_load(sum_path, &sums) == 0;
+    if (have_sums && (sums.record_size != sizeof(record) || sums.num_records != (uint64_t) num_records ||
+                      sums.block_records != CHECKSUM_BLOCK_RECORDS)) {
+        fprintf(stderr, "Checksums for %s do not match the archive.\n", archive);
+        checksum_free(&sums);
+        free(sum_path);
+        close(fd);
+        return -1;
+    }
+    if (num_records == 0 || shift % 26 == 0) {
+        /* Nothing changes */
+        if (have_sums) {
+            checksum_free(&sums);
+        }
+        free(sum_path);
+        close(fd);
+        return 0;
+    }
+
+    size_t map_bytes = (size_t) num_records * sizeof(record);
+    record * records = mmap(NULL, map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (records == MAP_FAILED) {
+        fprintf(stderr, "Could not map %s\n", archive);
+        status = -1;
+    }
+
+    if (status == 0) {
+        if (threads > num_blocks) {
+            threads = (int) num_blocks;
+        }
+        rekey_task * tasks = calloc(threads, sizeof(rekey_task));
+        if (tasks == NULL) {
+            fprintf(stderr, "Out of memory.\n");
+            status = -1;
+        }
+        for (int i = 0; status == 0 && i < threads; i++) {
+            tasks[i].records = records;
+            tasks[i].first = num_blocks * i / threads * CHECKSUM_BLOCK_RECORDS;
+            tasks[i].end = num_blocks * (i + 1) / threads * CHECKSUM_BLOCK_RECORDS;
+            if (tasks[i].end > num_records) {
+                tasks[i].end = num_records;
+            }
+            tasks[i].ctx = ctx;
+            tasks[i].shift = shift;
+            tasks[i].sums = have_sums ? &sums : NULL;
+            if (have_sums) {
+                tasks[i].delta = calloc(CHECKSUM_BLOCK_RECORDS, sizeof(record));
+                if (tasks[i].delta == NULL) {
+                    fprintf(stderr, "Out of memory.\n");
+                    status = -1;
+                }
+            }
+        }
+        if (status == 0) {
+            parallel_run(threads, rekey_worker, tasks, sizeof(rekey_task));
+        }
+        for (int i = 0; tasks != NULL && i < threads; i++) {
+            free(tasks[i].delta);
+        }
+        free(tasks);
+
+        if (msync(records, map_bytes, MS_SYNC) != 0) {
+            fprintf(stderr, "Could not write %s\n", archive);
+            status = -1;
+        }
+        munmap(records, map_bytes);
+    }
+    close(fd);
+
+    if (have_sums) {
+        if (status == 0 && checksum_save(sum_path, &sums) != 0) {
+            fprintf(stderr, "Could not write checksums for %s\n", archive);
+            status = -1;
+        }
+        checksum_free(&sums);
+    }
+    free(sum_path);
+    return status;
+}
@@ -0,0 +1,75 @@
+/*
+ * recshard.h
+ *
+ * This header file defines the interface for splitting a record archive
+ * into shards, used by copyrecords --shard.
+ *
+ * Every record goes to one of N output archives, chosen by a hash of a key
+ * field, in a single pass over the input: nothing is copied first and split
+ * afterwards.
+ *
+ * Key Features:
+ * 1. Keys: str1 (up to its NUL), an element of nums, or the record's
+ *    position in the archive; equal keys always land in the same shard
+ * 2. Parallel: Threads take chunks of the input in turn, read them with
+ *    pread(), decode them (-D) and partition them by shard on their own
+ * 3. Large writes: A partitioned chunk holds one contiguous run per shard,
+ *    each written with a single pwrite() at an offset reserved for it
+ * 4. Order: Offsets are reserved in chunk order, so every shard holds its
+ *    records in the order they had in the input, whatever the thread count
+ */
+
+#ifndef RECSHARD_H
+#define RECSHARD_H
+
+#include "copyrecords.h"   /* For record */
+#include "checksum.h"      /* For checksum_table */
+#include "decode_lib.h"    /* For decode_ctx */
+
+/* Most shards one run can write (each is an open file) */
+#define SHARD_MAX 1024
+
+/* What a record's shard is chosen by */
+typedef enum shard_field {
+    SHARD_STR1,    /* str1, up to its first NUL */
+    SHARD_NUMS,    /* nums[index] */
+    SHARD_INDEX    /* Position of the record in the input */
+} shard_field;
+
+/* Which field to shard by */
+typedef struct shard_key {
+    shard_field field;
+    int index;           /* Element of nums (unused otherwise) */
+} shard_key;
+
+/* How to shard */
+typedef struct shard_options {
+    shard_key key;                     /* Field to hash */
+    int shards;                        /* Number of output archives (1 to SHARD_MAX) */
+    int threads;                       /* Threads to use */
+    const decode_ctx * ctx;            /* Used to decode strings before hashing */
+    int shift;                         /* Decoding shift (0 for none) */
+    const checksum_table * verify;     /* Input checksums to check, or NULL */
+} shard_options;
+
+/* Parses "str1", "nums[k]" (k 0-11) or "index"; returns 0 on success, -1 if invalid */
+int shard_key_parse(const char * text, shard_key * key);
+
+/* Returns the shard (0 to shards - 1) of record r, at position index of the input */
+int shard_of(const shard_key * key, int shards, const record * r, uint64_t index);
+
+/*
+ * Returns a newly allocated name for shard i of the output prefix
+ * ("prefix.i"), or NULL if out of memory
+ */
+char * shard_path(const char * prefix, int i);
+
+/*
+ * Splits num_records records of the archive in_fd into options->shards
+ * archives named by shard_path(prefix, i). Returns 0 on success, -1 on an
+ * I/O, checksum or memory error (a message is printed to stderr).
+ */
+int shard_records(int in_fd, int64_t num_records, const shard_options * options,
+                  const char * prefix);
+
+#endif
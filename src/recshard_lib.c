@@ -0,0 +1,417 @@
+/*
+ * recshard_lib.c
+ *
+ * This file implements the archive sharding declared in recshard.h.
+ *
+ * Key Implementation Details:
+ * 1. Hashing: The key is mixed into 64 bits (str1 a word at a time, nums
+ *    and positions with one multiply-xorshift finaliser) and the top 32
+ *    bits are scaled to the shard count, so no division is needed
+ * 2. Chunks: A chunk is a whole number of checksum blocks, large enough
+ *    that each shard's run in it averages SHARD_RUN_RECORDS records; chunks
+ *    are handed out in order from a shared counter
+ * 3. Partitioning: A counting pass sizes each shard's run and a second pass
+ *    copies every record into its run, keeping input order within a run
+ * 4. Reservation: After partitioning chunk c, a thread waits until chunk
+ *    c - 1 has reserved its space, reserves the next counts[s] records of
+ *    every shard s and writes its runs outside the lock, so the writes of
+ *    different chunks overlap
+ */
+
+#define _GNU_SOURCE   /* For pread() and pwrite() */
+
+#include "recshard.h"
+#include "parallel.h"   /* For parallel_run() */
+#include <stdio.h>      /* For fprintf() and snprintf() */
+#include <stdlib.h>     /* For memory management */
+#include <string.h>     /* For memchr() and memcpy() */
+#include <errno.h>      /* For EINTR */
+#include <fcntl.h>      /* For open() */
+#include <pthread.h>    /* For the reservation lock */
+#include <unistd.h>     /* For pread(), pwrite() and close() */
+
+/* Smallest chunk handed to a thread */
+#define SHARD_MIN_CHUNK (16 * CHECKSUM_BLOCK_RECORDS)
+
+/* Average records per shard run in a chunk */
+#define SHARD_RUN_RECORDS 64
+
+/* State shared by all threads */
+typedef struct shard_state {
+    int in_fd;                         /* Input archive */
+    int64_t num_records;               /* Records in the input */
+    const shard_options * options;
+    int * out_fds;                     /* One output archive per shard */
+    size_t chunk_records;              /* Records per chunk */
+    int64_t num_chunks;                /* Chunks in the input */
+    pthread_mutex_t lock;
+    pthread_cond_t turn_cond;          /* Signalled when a chunk reserves its space */
+    int64_t next_chunk;                /* Next chunk to hand out (guarded by lock) */
+    int64_t reserved;                  /* Chunks that have reserved space (guarded by lock) */
+    uint64_t * shard_records;          /* Records reserved in each shard (guarded by lock) */
+    int failed;                        /* Set on any error (guarded by lock) */
+} shard_state;
+
+/* multiply-xorshift finaliser: every input bit affects every output bit */
+static inline uint64_t shard_mix(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/*
+ * shard_key_parse
+ *
+ * Purpose: Reads a shard key from the command line
+ *
+ * Parameters:
+ *   text - "str1", "nums[k]" (k 0-11) or "index"
+ *   key  - Receives the parsed key
+ *
+ * Returns:
+ *   0 on success, -1 if the name is not a key records can be sharded by
+ */
+int shard_key_parse(const char * text, shard_key * key) {
+    int index = 0;
+    char close = 0;
+
+    key->index = 0;
+    if (strcmp(text, "str1") == 0) {
+        key->field = SHARD_STR1;
+        return 0;
+    }
+    if (strcmp(text, "index") == 0) {
+        key->field = SHARD_INDEX;
+        return 0;
+    }
+    if (sscanf(text, "nums[%d%c", &index, &close) == 2 && close == ']' &&
+        index >= 0 && index < 12 && strchr(text, ']')[1] == '\0') {
+        key->field = SHARD_NUMS;
+        key->index = index;
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * shard_of
+ *
+ * Purpose: Chooses the shard of a record
+ *
+ * How it works:
+ * - str1: the bytes up to the NUL, zero-padded to three 64-bit words, are
+ *   folded in one word at a time, so bytes after the NUL never matter
+ * - nums: the integer alone
+ * - index: the record's position
+ *   The mixed hash's top 32 bits times shards, shifted down 32, is evenly
+ *   spread over 0 to shards - 1.
+ */
+int shard_of(const shard_key * key, int shards, const record * r, uint64_t index) {
+    uint64_t h;
+
+    switch (key->field) {
+        case SHARD_STR1: {
+            uint64_t words[3] = { 0, 0, 0 };
+            const char * nul = memchr(r->str1, '\0', sizeof(r->str1));
+            memcpy(words, r->str1, nul != NULL ? (size_t) (nul - r->str1) : sizeof(r->str1));
+            h = 0;
+            for (int i = 0; i < 3; i++) {
+                h = shard_mix(h ^ words[i]);
+            }
+            break;
+        }
+        case SHARD_NUMS:
+            h = shard_mix((uint32_t) r->nums[key->index]);
+            break;
+        default:
+            h = shard_mix(index);
+            break;
+    }
+    return (int) (((h >> 32) * (uint64_t) shards) >> 32);
+}
+
+/* Returns "prefix.i" in newly allocated memory */
+char * shard_path(const char * prefix, int i) {
+    size_t size = strlen(prefix) + 16;
+    char * path = malloc(size);
+    if (path != NULL) {
+        snprintf(path, size, "%s.%d", prefix, i);
+    }
+    return path;
+}
+
+/* Reads exactly length bytes at offset; returns 0, or -1 on an error or a short file */
+static int read_full(int fd, void * buffer, size_t length, off_t offset) {
+    size_t got = 0;
+    while (got < length) {
+        ssize_t n = pread(fd, (char *) buffer + got, length - got, offset + (off_t) got);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        got += (size_t) n;
+    }
+    return 0;
+}
+
+/* Writes exactly length bytes at offset; returns 0, or -1 on an error */
+static int write_full(int fd, const void * buffer, size_t length, off_t offset) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t n = pwrite(fd, (const char *) buffer + done, length - done, offset + (off_t) done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        done += (size_t) n;
+    }
+    return 0;
+}
+
+/* Marks the run as failed and wakes every thread waiting for its turn */
+static void shard_fail(shard_state * st) {
+    pthread_mutex_lock(&st->lock);
+    st->failed = 1;
+    pthread_cond_broadcast(&st->turn_cond);
+    pthread_mutex_unlock(&st->lock);
+}
+
+/*
+ * process_chunk
+ *
+ * Purpose: Reads, checks, decodes and partitions one chunk
+ *
+ * Parameters:
+ *   st     - Shared state
+ *   chunk  - Chunk number
+ *   in     - Buffer for the chunk as read
+ *   out    - Receives the chunk ordered by shard
+ *   ids    - Scratch: the shard of each record
+ *   starts - Receives the first record of each shard's run in out
+ *            (shards + 1 entries; the last is the chunk's length)
+ *
+ * Returns:
+ *   0 on success, -1 on a read or checksum error
+ */
+static int process_chunk(shard_state * st, int64_t chunk, record * in, record * out,
+                         uint16_t * ids, size_t * starts) {
+    const shard_options * options = st->options;
+    int64_t first = chunk * (int64_t) st->chunk_records;
+    size_t n = st->num_records - first < (int64_t) st->chunk_records ?
+               (size_t) (st->num_records - first) : st->chunk_records;
+
+    if (read_full(st->in_fd, in, n * sizeof(record), (off_t) first * (off_t) sizeof(record)) != 0) {
+        fprintf(stderr, "Could not read records to shard.\n");
+        return -1;
+    }
+    if (options->verify != NULL) {
+        for (size_t b = 0; b < n; b += CHECKSUM_BLOCK_RECORDS) {
+            size_t count = n - b < CHECKSUM_BLOCK_RECORDS ? n - b : CHECKSUM_BLOCK_RECORDS;
+            uint64_t block = (first + b) / CHECKSUM_BLOCK_RECORDS;
+            if (!checksum_block_ok(options->verify, block, in + b, count)) {
+                fprintf(stderr, "Checksum mismatch in block %llu while sharding.\n",
+                        (unsigned long long) block);
+                return -1;
+            }
+        }
+    }
+    decode_records(options->ctx, in, n, options->shift);
+
+    memset(starts, 0, sizeof(size_t) * (options->shards + 1));
+    for (size_t i = 0; i < n; i++) {
+        ids[i] = (uint16_t) shard_of(&options->key, options->shards, &in[i], (uint64_t) (first + i));
+        starts[ids[i] + 1]++;
+    }
+    for (int s = 0; s < options->shards; s++) {
+        starts[s + 1] += starts[s];
+    }
+    /* starts[s] is used as the fill position of run s, then restored */
+    for (size_t i = 0; i < n; i++) {
+        out[starts[ids[i]]++] = in[i];
+    }
+    for (int s = options->shards; s > 0; s--) {
+        starts[s] = starts[s - 1];
+    }
+    starts[0] = 0;
+    return 0;
+}
+
+/*
+ * shard_worker
+ *
+ * Purpose: Shards chunks until the input is done or something fails
+ *
+ * How it works:
+ * 1. Takes the next chunk number and partitions the chunk
+ * 2. Waits for the previous chunk to reserve its space, then reserves the
+ *    space of each of its runs at the end of its shard
+ * 3. Writes each run to its shard with one pwrite() at the reserved offset
+ */
+static void * shard_worker(void * arg) {
+    shard_state * st = *(shard_state **) arg;
+    int shards = st->options->shards;
+    record * in = malloc(sizeof(record) * st->chunk_records);
+    record * out = malloc(sizeof(record) * st->chunk_records);
+    uint16_t * ids = malloc(sizeof(uint16_t) * st->chunk_records);
+    size_t * starts = malloc(sizeof(size_t) * (shards + 1));
+    uint64_t * offsets = malloc(sizeof(uint64_t) * shards);
+
+    if (in == NULL || out == NULL || ids == NULL || starts == NULL || offsets == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        shard_fail(st);
+    }
+    for (;;) {
+        pthread_mutex_lock(&st->lock);
+        int64_t chunk = st->next_chunk;
+        int stop = st->failed || chunk >= st->num_chunks;
+        if (!stop) {
+            st->next_chunk++;
+        }
+        pthread_mutex_unlock(&st->lock);
+        if (stop) {
+            break;
+        }
+
+        if (process_chunk(st, chunk, in, out, ids, starts) != 0) {
+            shard_fail(st);
+            break;
+        }
+
+        pthread_mutex_lock(&st->lock);
+        while (st->reserved != chunk && !st->failed) {
+            pthread_cond_wait(&st->turn_cond, &st->lock);
+        }
+        stop = st->failed;
+        if (!stop) {
+            for (int s = 0; s < shards; s++) {
+                offsets[s] = st->shard_records[s];
+                st->shard_records[s] += starts[s + 1] - starts[s];
+            }
+            st->reserved++;
+            pthread_cond_broadcast(&st->turn_cond);
+        }
+        pthread_mutex_unlock(&st->lock);
+        if (stop) {
+            break;
+        }
+
+        for (int s = 0; s < shards; s++) {
+            size_t count = starts[s + 1] - starts[s];
+            if (count > 0 && write_full(st->out_fds[s], out + starts[s], count * sizeof(record),
+                                        (off_t) offsets[s] * (off_t) sizeof(record)) != 0) {
+                fprintf(stderr, "Could not write shard %d.\n", s);
+                shard_fail(st);
+                break;
+            }
+        }
+    }
+
+    free(in);
+    free(out);
+    free(ids);
+    free(starts);
+    free(offsets);
+    return NULL;
+}
+
+/*
+ * shard_records
+ *
+ * Purpose: Splits an archive into shards in one pass
+ *
+ * Parameters:
+ *   in_fd       - Input archive, open for reading
+ *   num_records - Records in the input
+ *   options     - Key, shard count, threads, decoding and checksums
+ *   prefix      - Output name; shard i is written to "prefix.i"
+ *
+ * Returns:
+ *   0 on success, -1 on failure
+ *
+ * How it works:
+ * 1. Creates (or truncates) every shard and removes any old checksum
+ *    sidecar of it, which would no longer match
+ * 2. Sizes the chunks and runs shard_worker on every thread
+ * 3. Closes the shards, reporting any error the close reveals
+ */
+int shard_records(int in_fd, int64_t num_records, const shard_options * options,
+                  const char * prefix) {
+    int shards = options->shards;
+    int threads = options->threads > 0 ? options->threads : 1;
+    shard_state st;
+    int status = 0;
+
+    memset(&st, 0, sizeof(st));
+    st.in_fd = in_fd;
+    st.num_records = num_records;
+    st.options = options;
+    st.chunk_records = (size_t) shards * SHARD_RUN_RECORDS;
+    if (st.chunk_records < SHARD_MIN_CHUNK) {
+        st.chunk_records = SHARD_MIN_CHUNK;
+    }
+    st.chunk_records = (st.chunk_records + CHECKSUM_BLOCK_RECORDS - 1) / CHECKSUM_BLOCK_RECORDS * CHECKSUM_BLOCK_RECORDS;
+    st.num_chunks = (num_records + (int64_t) st.chunk_records - 1) / (int64_t) st.chunk_records;
+    if (threads > st.num_chunks) {
+        threads = st.num_chunks > 0 ? (int) st.num_chunks : 1;
+    }
+
+    st.out_fds = malloc(sizeof(int) * shards);
+    st.shard_records = calloc(shards, sizeof(uint64_t));
+    shard_state ** tasks = malloc(sizeof(shard_state *) * threads);
+    if (st.out_fds == NULL || st.shard_records == NULL || tasks == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        free(st.out_fds);
+        free(st.shard_records);
+        free(tasks);
+        return -1;
+    }
+
+    int opened = 0;
+    for (; opened < shards; opened++) {
+        char * path = shard_path(prefix, opened);
+        char * sum_path = path != NULL ? checksum_path(path) : NULL;
+        st.out_fds[opened] = path != NULL ? open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666) : -1;
+        if (st.out_fds[opened] < 0) {
+            fprintf(stderr, "Could not open output file %s\n", path != NULL ? path : prefix);
+            free(path);
+            free(sum_path);
+            status = -1;
+            break;
+        }
+        if (sum_path != NULL) {
+            remove(sum_path);
+        }
+        free(path);
+        free(sum_path);
+    }
+
+    if (status == 0) {
+        pthread_mutex_init(&st.lock, NULL);
+        pthread_cond_init(&st.turn_cond, NULL);
+        for (int i = 0; i < threads; i++) {
+            tasks[i] = &st;
+        }
+        parallel_run(threads, shard_worker, tasks, sizeof(shard_state *));
+        status = st.failed ? -1 : 0;
+        pthread_mutex_destroy(&st.lock);
+        pthread_cond_destroy(&st.turn_cond);
+    }
+
+    for (int s = 0; s < opened; s++) {
+        if (close(st.out_fds[s]) != 0 && status == 0) {
+            fprintf(stderr, "Could not write shard %d.\n", s);
+            status = -1;
+        }
+    }
+    free(st.out_fds);
+    free(st.shard_records);
+    free(tasks);
+    return status;
+}
@@ -0,0 +1,66 @@
+/*
+ * recsort.h
+ *
+ * This header file defines the interface for sorting record archives by a
+ * field, used by copyrecords --sort-by.
+ *
+ * Archives may be far larger than memory, so the sort is an external merge
+ * sort:
+ * 1. The input is read in runs that fit in the memory budget
+ * 2. Each run is sorted in memory on several threads, using a compact
+ *    array of (key, index) entries instead of moving 408-byte records
+ * 3. Sorted runs are spilled to temporary files
+ * 4. All runs are merged in one pass with a loser tree, reading each run
+ *    through a large buffer so the I/O stays sequential
+ *
+ * An archive that fits in one run is sorted in memory and never spilled.
+ * The sort is stable: records with equal keys keep their input order.
+ */
+
+#ifndef RECSORT_H
+#define RECSORT_H
+
+#include "copyrecords.h"   /* For record */
+#include "checksum.h"      /* For checksum_table */
+#include "decode_lib.h"    /* For decode_ctx */
+
+/* Fields a sort key can come from */
+typedef enum sort_field {
+    SORT_STR1,   /* str1, compared byte by byte */
+    SORT_NUMS,   /* nums[index], compared as signed integers */
+    SORT_DBL     /* dbl[index], compared numerically (NaNs last) */
+} sort_field;
+
+/* Which field to sort by */
+typedef struct sort_key {
+    sort_field field;
+    int index;           /* Element of nums or dbl (unused for str1) */
+} sort_key;
+
+/* How to sort */
+typedef struct sort_options {
+    sort_key key;                      /* Field to sort by */
+    int descending;                    /* Non-zero for largest first */
+    size_t memory;                     /* Memory budget for a run, in bytes */
+    int threads;                       /* Threads used to sort each run */
+    const char * tmp_dir;              /* Where run files are created */
+    const decode_ctx * ctx;            /* Used to decode strings before sorting */
+    int shift;                         /* Decoding shift (0 for none) */
+    const checksum_table * verify;     /* Input checksums to check, or NULL */
+} sort_options;
+
+/* Default memory budget for one run */
+#define SORT_DEFAULT_MEMORY (256 * 1024 * 1024)
+
+/* Parses "str1", "nums[k]" or "dbl[k]"; returns 0 on success, -1 if invalid */
+int sort_key_parse(const char * text, sort_key * key);
+
+/*
+ * Sorts num_records records read sequentially from in and passes them, in
+ * order, to sink. Returns 0 on success, -1 on an I/O, checksum or memory
+ * error (a message is printed to stderr).
+ */
+int sort_records(FILE * in, int64_t num_records, const sort_options * options,
+                 record_sink sink, void * sink_arg);
+
+#endif
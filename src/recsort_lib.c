@@ -0,0 +1,626 @@
+/*
+ * recsort_lib.c
+ *
+ * This file implements the external merge sort declared in recsort.h.
+ *
+ * Key Implementation Details:
+ * 1. Keys: Every record gets a 64-bit key whose unsigned order matches the
+ *    field's order (big-endian string prefix, sign-flipped integers and
+ *    doubles), so most comparisons are a single integer compare
+ * 2. Entries: Runs are sorted as 16-byte (key, sequence) entries; the
+ *    sequence number is the record's position in the archive, which makes
+ *    the sort stable and locates the record when it is written out
+ * 3. Parallel Runs: Each thread merge-sorts a slice of the entries and the
+ *    slices are combined by the same loser tree used for the runs
+ * 4. Loser Tree: Merging k sources costs log2(k) comparisons per record
+ */
+
+#define _GNU_SOURCE   /* For mkstemp(), fdopen() and unlink() */
+
+#include "recsort.h"
+#include "arena.h"      /* For run buffers */
+#include "parallel.h"   /* For parallel_run() */
+#include <stdio.h>      /* For file operations */
+#include <stdlib.h>     /* For memory management */
+#include <string.h>     /* For string operations */
+#include <math.h>       /* For isnan() */
+#include <unistd.h>     /* For unlink() */
+
+/* Records handed to the sink at a time */
+#define SORT_OUTPUT_BATCH 256
+
+/* Smallest read buffer given to each run while merging */
+#define SORT_MIN_RUN_BUFFER (64 * 1024)
+
+/* Slices shorter than this are sorted by insertion sort first */
+#define SORT_INSERTION_RUN 32
+
+/* One record's place in a run */
+typedef struct sort_entry {
+    uint64_t key;     /* Order-preserving key of the sort field */
+    uint64_t seq;     /* Position of the record in the input archive */
+} sort_entry;
+
+/* What comparisons need to know */
+typedef struct sort_ctx {
+    sort_key key;             /* Field being sorted on */
+    int descending;           /* Non-zero for largest first */
+    const record * base;      /* Records of the run in memory */
+    uint64_t base_seq;        /* Sequence number of base[0] */
+} sort_ctx;
+
+/* A sorted stream of records being merged: a slice in memory or a run file */
+typedef struct merge_source {
+    sort_entry head;              /* Key and sequence of the current record */
+    const record * rec;           /* Current record */
+    int done;                     /* Non-zero once the source is empty */
+    const sort_entry * next;      /* Memory: next entry */
+    const sort_entry * end;       /* Memory: end of the slice */
+    FILE * fp;                    /* File: the run */
+    record * buffer;              /* File: read buffer */
+    size_t buffer_size;           /* File: capacity of buffer in records */
+    size_t buffer_count;          /* File: records in buffer */
+    size_t buffer_pos;            /* File: position of rec in buffer */
+    int64_t remaining;            /* File: records not yet read */
+} merge_source;
+
+/* Loser tree over k sources; index k is a sentinel that beats everything */
+typedef struct loser_tree {
+    int k;
+    int * tree;                   /* tree[0] is the winner, the rest losers */
+    merge_source * sources;
+    const sort_ctx * ctx;
+} loser_tree;
+
+/* A run written to a temporary file */
+typedef struct sort_run {
+    FILE * fp;
+    int64_t count;
+} sort_run;
+
+/* Collects merged records and passes them to a sink in batches */
+typedef struct sort_output {
+    record batch[SORT_OUTPUT_BATCH];
+    size_t count;
+    record_sink sink;
+    void * sink_arg;
+} sort_output;
+
+/* Work for one thread sorting a slice of a run */
+typedef struct sort_task {
+    sort_entry * entries;
+    sort_entry * scratch;
+    size_t count;
+    const sort_ctx * ctx;
+} sort_task;
+
+/*
+ * sort_key_parse
+ *
+ * Purpose: Reads a field name from the command line
+ *
+ * Parameters:
+ *   text - "str1", "nums[k]" (k 0-11) or "dbl[k]" (k 0-23)
+ *   key  - Receives the parsed field
+ *
+ * Returns:
+ *   0 on success, -1 if the name is not a sortable field
+ */
+int sort_key_parse(const char * text, sort_key * key) {
+    int index = 0;
+    char close = 0;
+
+    if (strcmp(text, "str1") == 0) {
+        key->field = SORT_STR1;
+        key->index = 0;
+        return 0;
+    }
+    if (sscanf(text, "nums[%d%c", &index, &close) == 2 && close == ']' &&
+        index >= 0 && index < 12 && strchr(text, ']')[1] == '\0') {
+        key->field = SORT_NUMS;
+        key->index = index;
+        return 0;
+    }
+    if (sscanf(text, "dbl[%d%c", &index, &close) == 2 && close == ']' &&
+        index >= 0 && index < 24 && strchr(text, ']')[1] == '\0') {
+        key->field = SORT_DBL;
+        key->index = index;
+        return 0;
+    }
+    return -1;
+}
+
+/*
+ * record_key
+ *
+ * Purpose: Builds the 64-bit key of a record
+ *
+ * How it works:
+ * - str1: the first 8 bytes (up to the NUL) as a big-endian number
+ * - nums: the integer with its sign bit flipped
+ * - dbl:  the bit pattern, with every bit flipped for negatives and the
+ *         sign bit set for positives; NaNs always sort last
+ * For descending order every bit is flipped.
+ */
+static uint64_t record_key(const sort_ctx * ctx, const record * r) {
+    uint64_t k = 0;
+
+    switch (ctx->key.field) {
+        case SORT_STR1: {
+            int ended = 0;
+            for (int i = 0; i < 8; i++) {
+                unsigned char c = ended ? 0 : (unsigned char) r->str1[i];
+                ended = ended || c == 0;
+                k = (k << 8) | c;
+            }
+            break;
+        }
+        case SORT_NUMS:
+            k = (uint32_t) r->nums[ctx->key.index] ^ 0x80000000u;
+            break;
+        case SORT_DBL: {
+            double d = r->dbl[ctx->key.index];
+            if (isnan(d)) {
+                return UINT64_MAX;
+            }
+            memcpy(&k, &d, sizeof(k));
+            k = (k >> 63) ? ~k : k | (UINT64_C(1) << 63);
+            break;
+        }
+    }
+    return ctx->descending ? ~k : k;
+}
+
+/*
+ * entry_before
+ *
+ * Purpose: Decides whether record a comes before record b
+ *
+ * How it works:
+ * 1. Different keys decide immediately
+ * 2. For str1, equal prefixes fall back to comparing the whole string
+ * 3. Otherwise the earlier record in the input comes first (stability)
+ */
+static int entry_before(const sort_ctx * ctx, const sort_entry * a, const record * ra,
+                        const sort_entry * b, const record * rb) {
+    if (a->key != b->key) {
+        return a->key < b->key;
+    }
+    if (ctx->key.field == SORT_STR1) {
+        int c = strncmp(ra->str1, rb->str1, sizeof(ra->str1));
+        if (ctx->descending) {
+            c = -c;
+        }
+        if (c != 0) {
+            return c < 0;
+        }
+    }
+    return a->seq < b->seq;
+}
+
+/* Record of an in-memory entry */
+static const record * entry_record(const sort_ctx * ctx, const sort_entry * e) {
+    return ctx->base + (e->seq - ctx->base_seq);
+}
+
+/* Compares two in-memory entries */
+static int memory_before(const sort_ctx * ctx, const sort_entry * a, const sort_entry * b) {
+    return entry_before(ctx, a, entry_record(ctx, a), b, entry_record(ctx, b));
+}
+
+/*
+ * sort_entries
+ *
+ * Purpose: Stable sort of a slice of entries
+ *
+ * How it works:
+ * 1. Short stretches are put in order by insertion sort
+ * 2. Stretches are then merged pairwise, doubling in length each pass,
+ *    alternating between the slice and the scratch array
+ */
+static void sort_entries(const sort_ctx * ctx, sort_entry * a, sort_entry * scratch, size_t n) {
+    for (size_t lo = 0; lo < n; lo += SORT_INSERTION_RUN) {
+        size_t hi = lo + SORT_INSERTION_RUN < n ? lo + SORT_INSERTION_RUN : n;
+        for (size_t i = lo + 1; i < hi; i++) {
+            sort_entry e = a[i];
+            size_t j = i;
+            while (j > lo && memory_before(ctx, &e, &a[j - 1])) {
+                a[j] = a[j - 1];
+                j--;
+            }
+            a[j] = e;
+        }
+    }
+
+    sort_entry * src = a;
+    sort_entry * dst = scratch;
+    for (size_t width = SORT_INSERTION_RUN; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = lo + width < n ? lo + width : n;
+            size_t hi = lo + 2 * width < n ? lo + 2 * width : n;
+            size_t i = lo, j = mid, out = lo;
+            while (i < mid && j < hi) {
+                dst[out++] = memory_before(ctx, &src[j], &src[i]) ? src[j++] : src[i++];
+            }
+            while (i < mid) {
+                dst[out++] = src[i++];
+            }
+            while (j < hi) {
+                dst[out++] = src[j++];
+            }
+        }
+        sort_entry * swap = src;
+        src = dst;
+        dst = swap;
+    }
+    if (src != a) {
+        memcpy(a, src, n * sizeof(sort_entry));
+    }
+}
+
+/* Thread entry point: sorts one slice */
+static void * sort_worker(void * arg) {
+    sort_task * task = arg;
+    sort_entries(task->ctx, task->entries, task->scratch, task->count);
+    return NULL;
+}
+
+/*
+ * source_advance
+ *
+ * Purpose: Moves a merge source on to its next record
+ *
+ * Returns:
+ *   0 on success, -1 if a run file could not be read
+ */
+static int source_advance(const sort_ctx * ctx, merge_source * s) {
+    if (s->fp == NULL) {
+        if (s->next == s->end) {
+            s->done = 1;
+            return 0;
+        }
+        s->head = *s->next++;
+        s->rec = entry_record(ctx, &s->head);
+        return 0;
+    }
+
+    if (++s->buffer_pos >= s->buffer_count) {
+        if (s->remaining == 0) {
+            s->done = 1;
+            return 0;
+        }
+        size_t want = s->remaining < (int64_t) s->buffer_size ? (size_t) s->remaining : s->buffer_size;
+        if (fread(s->buffer, sizeof(record), want, s->fp) != want) {
+            return -1;
+        }
+        s->remaining -= want;
+        s->buffer_count = want;
+        s->buffer_pos = 0;
+    }
+    s->rec = &s->buffer[s->buffer_pos];
+    s->head.key = record_key(ctx, s->rec);
+    return 0;
+}
+
+/* True if source a should be taken before source b; the sentinel k always wins */
+static int tree_before(const loser_tree * t, int a, int b) {
+    if (a == t->k) {
+        return 1;
+    }
+    if (b == t->k) {
+        return 0;
+    }
+    const merge_source * sa = &t->sources[a];
+    const merge_source * sb = &t->sources[b];
+    if (sa->done || sb->done) {
+        return !sa->done;
+    }
+    return entry_before(t->ctx, &sa->head, sa->rec, &sb->head, sb->rec);
+}
+
+/*
+ * tree_adjust
+ *
+ * Purpose: Replays the matches on the path from leaf i to the root
+ *
+ * How it works:
+ *   At each node the stored loser plays the current winner; the loser of
+ *   that match stays at the node and the winner moves up
+ */
+static void tree_adjust(loser_tree * t, int i) {
+    int winner = i;
+    for (int node = (i + t->k) / 2; node > 0; node /= 2) {
+        if (tree_before(t, t->tree[node], winner)) {
+            int swap = t->tree[node];
+            t->tree[node] = winner;
+            winner = swap;
+        }
+    }
+    t->tree[0] = winner;
+}
+
+/* Passes the batched records on to the sink */
+static int output_flush(sort_output * out) {
+    int status = out->count > 0 ? out->sink(out->sink_arg, out->batch, out->count) : 0;
+    out->count = 0;
+    return status;
+}
+
+/*
+ * merge_sources
+ *
+ * Purpose: Merges k sorted sources into the output
+ *
+ * Returns:
+ *   0 on success, -1 on a read or sink error
+ */
+static int merge_sources(const sort_ctx * ctx, merge_source * sources, int k, sort_output * out) {
+    loser_tree t;
+    t.k = k;
+    t.sources = sources;
+    t.ctx = ctx;
+    t.tree = malloc(sizeof(int) * (k > 0 ? k : 1));
+    if (t.tree == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < k; i++) {
+        t.tree[i] = k;
+    }
+    for (int i = k - 1; i >= 0; i--) {
+        tree_adjust(&t, i);
+    }
+
+    int status = 0;
+    while (k > 0 && status == 0) {
+        merge_source * s = &sources[t.tree[0]];
+        if (s->done) {
+            break;   /* The best source is empty, so all of them are */
+        }
+        out->batch[out->count++] = *s->rec;
+        if (out->count == SORT_OUTPUT_BATCH) {
+            status = output_flush(out);
+        }
+        if (status == 0) {
+            status = source_advance(ctx, s);
+        }
+        tree_adjust(&t, t.tree[0]);
+    }
+
+    free(t.tree);
+    return status == 0 ? output_flush(out) : -1;
+}
+
+/* Sink that appends records to a run file */
+static int run_sink(void * arg, const record * records, size_t count) {
+    return fwrite(records, sizeof(record), count, arg) == count ? 0 : -1;
+}
+
+/*
+ * run_create
+ *
+ * Purpose: Opens an anonymous temporary file for a run
+ *
+ * How it works:
+ *   The file is created with mkstemp() in the temporary directory and
+ *   unlinked at once, so it disappears when closed even after a crash
+ */
+static FILE * run_create(const char * dir) {
+    char * path = malloc(strlen(dir) + strlen("/recsort.XXXXXX") + 1);
+    if (path == NULL) {
+        return NULL;
+    }
+    strcpy(path, dir);
+    strcat(path, "/recsort.XXXXXX");
+
+    FILE * fp = NULL;
+    int fd = mkstemp(path);
+    if (fd >= 0) {
+        unlink(path);
+        fp = fdopen(fd, "w+b");
+        if (fp == NULL) {
+            close(fd);
+        }
+    }
+    free(path);
+    return fp;
+}
+
+/*
+ * sort_run_in_memory
+ *
+ * Purpose: Sorts one run and writes it, in order, to out
+ *
+ * How it works:
+ * 1. Builds an entry for every record
+ * 2. Splits the entries into one slice per thread and sorts the slices
+ * 3. Merges the slices with the loser tree straight into the output
+ */
+static int sort_run_in_memory(sort_ctx * ctx, record * records, size_t n, uint64_t first_seq,
+                              sort_entry * entries, sort_entry * scratch, int threads,
+                              sort_output * out) {
+    ctx->base = records;
+    ctx->base_seq = first_seq;
+    for (size_t i = 0; i < n; i++) {
+        entries[i].key = record_key(ctx, &records[i]);
+        entries[i].seq = first_seq + i;
+    }
+
+    if ((size_t) threads > n / 1024 + 1) {
+        threads = (int) (n / 1024 + 1);
+    }
+    sort_task * tasks = malloc(sizeof(sort_task) * threads);
+    merge_source * sources = calloc(threads, sizeof(merge_source));
+    if (tasks == NULL || sources == NULL) {
+        free(tasks);
+        free(sources);
+        return -1;
+    }
+    for (int i = 0; i < threads; i++) {
+        size_t lo = n * i / threads;
+        size_t hi = n * (i + 1) / threads;
+        tasks[i].entries = entries + lo;
+        tasks[i].scratch = scratch + lo;
+        tasks[i].count = hi - lo;
+        tasks[i].ctx = ctx;
+    }
+    parallel_run(threads, sort_worker, tasks, sizeof(sort_task));
+
+    for (int i = 0; i < threads; i++) {
+        sources[i].next = tasks[i].entries;
+        sources[i].end = tasks[i].entries + tasks[i].count;
+        source_advance(ctx, &sources[i]);
+    }
+    int status = merge_sources(ctx, sources, threads, out);
+
+    free(tasks);
+    free(sources);
+    return status;
+}
+
+/*
+ * sort_records
+ *
+ * Purpose: Sorts an archive of any size
+ *
+ * Parameters:
+ *   in          - Input archive, positioned at its first record
+ *   num_records - Records in the archive
+ *   options     - Key, order, memory budget, threads and decoding
+ *   sink        - Receives the sorted records
+ *   sink_arg    - Passed to sink
+ *
+ * Returns:
+ *   0 on success, -1 on failure
+ *
+ * How it works:
+ * 1. Run size is the memory budget divided by the per-record cost (the
+ *    record plus two entries), rounded to whole checksum blocks
+ * 2. If everything fits in one run it is sorted straight into the sink
+ * 3. Otherwise every run is sorted into a temporary file, the run memory
+ *    is released, and the files are merged through large read buffers
+ */
+int sort_records(FILE * in, int64_t num_records, const sort_options * options,
+                 record_sink sink, void * sink_arg) {
+    size_t per_record = sizeof(record) + 2 * sizeof(sort_entry);
+    size_t run_size = options->memory / per_record;
+    run_size -= run_size % CHECKSUM_BLOCK_RECORDS;
+    if (run_size < CHECKSUM_BLOCK_RECORDS) {
+        run_size = CHECKSUM_BLOCK_RECORDS;
+    }
+    if ((int64_t) run_size > num_records) {
+        run_size = num_records > 0 ? (size_t) num_records : 1;
+    }
+    int64_t num_runs = (num_records + run_size - 1) / run_size;
+
+    sort_ctx ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.key = options->key;
+    ctx.descending = options->descending;
+
+    sort_output * out = malloc(sizeof(sort_output));
+    sort_run * runs = calloc(num_runs > 0 ? num_runs : 1, sizeof(sort_run));
+    arena mem;
+    arena_init(&mem, 0);
+    record * records = arena_alloc(&mem, run_size * sizeof(record));
+    sort_entry * entries = arena_alloc(&mem, run_size * sizeof(sort_entry));
+    sort_entry * scratch = arena_alloc(&mem, run_size * sizeof(sort_entry));
+    int status = 0;
+
+    if (out == NULL || runs == NULL || records == NULL || entries == NULL || scratch == NULL) {
+        fprintf(stderr, "Out of memory while sorting.\n");
+        free(out);
+        free(runs);
+        arena_free(&mem);
+        return -1;
+    }
+    out->count = 0;
+
+    /* Phase 1: sort each run */
+    for (int64_t r = 0; r < num_runs && status == 0; r++) {
+        int64_t first = r * (int64_t) run_size;
+        size_t n = num_records - first < (int64_t) run_size ? (size_t) (num_records - first) : run_size;
+
+        if (fread(records, sizeof(record), n, in) != n) {
+            fprintf(stderr, "Could not read records to sort.\n");
+            status = -1;
+            break;
+        }
+        for (size_t b = 0; options->verify != NULL && b < n; b += CHECKSUM_BLOCK_RECORDS) {
+            size_t count = n - b < CHECKSUM_BLOCK_RECORDS ? n - b : CHECKSUM_BLOCK_RECORDS;
+            uint64_t block = (first + b) / CHECKSUM_BLOCK_RECORDS;
+            if (!checksum_block_ok(options->verify, block, records + b, count)) {
+                fprintf(stderr, "Checksum mismatch in block %llu while sorting.\n",
+                        (unsigned long long) block);
+                status = -1;
+            }
+        }
+        if (status != 0) {
+            break;
+        }
+        decode_records(options->ctx, records, n, options->shift);
+
+        if (num_runs == 1) {
+            out->sink = sink;
+            out->sink_arg = sink_arg;
+        } else {
+            runs[r].fp = run_create(options->tmp_dir);
+            runs[r].count = n;
+            if (runs[r].fp == NULL) {
+                fprintf(stderr, "Could not create a temporary file in %s\n", options->tmp_dir);
+                status = -1;
+                break;
+            }
+            out->sink = run_sink;
+            out->sink_arg = runs[r].fp;
+        }
+        status = sort_run_in_memory(&ctx, records, n, first, entries, scratch,
+                                    options->threads > 0 ? options->threads : 1, out);
+    }
+    arena_reset(&mem);
+
+    /* Phase 2: merge the spilled runs */
+    if (status == 0 && num_runs > 1) {
+        size_t buffer_bytes = options->memory / (num_runs + 1);
+        if (buffer_bytes < SORT_MIN_RUN_BUFFER) {
+            buffer_bytes = SORT_MIN_RUN_BUFFER;
+        }
+        merge_source * sources = calloc(num_runs, sizeof(merge_source));
+        if (sources == NULL) {
+            status = -1;
+        }
+        for (int64_t r = 0; status == 0 && r < num_runs; r++) {
+            merge_source * s = &sources[r];
+            s->fp = runs[r].fp;
+            s->buffer_size = buffer_bytes / sizeof(record);
+            s->buffer = arena_alloc(&mem, s->buffer_size * sizeof(record));
+            s->remaining = runs[r].count;
+            s->buffer_pos = 0;
+            s->buffer_count = 0;
+            s->head.seq = r;   /* Equal keys: the earlier run came first in the input */
+            if (s->buffer == NULL || fflush(s->fp) != 0 || fseeko(s->fp, 0, SEEK_SET) != 0 ||
+                source_advance(&ctx, s) != 0) {
+                status = -1;
+            }
+        }
+        if (status == 0) {
+            out->sink = sink;
+            out->sink_arg = sink_arg;
+            status = merge_sources(&ctx, sources, (int) num_runs, out);
+        }
+        if (status != 0) {
+            fprintf(stderr, "Could not merge sorted runs.\n");
+        }
+        free(sources);
+    }
+
+    for (int64_t r = 0; r < num_runs; r++) {
+        if (runs[r].fp != NULL) {
+            fclose(runs[r].fp);
+        }
+    }
+    free(runs);
+    free(out);
+    arena_free(&mem);
+    return status;
+}
@@ -0,0 +1,73 @@
+/*
+ * recstats.h
+ *
+ * This header file defines the interface for summarising the numeric
+ * fields of a record archive, used by copyrecords --stats.
+ *
+ * For each of the 24 dbl columns and 12 nums columns it computes the
+ * count, sum, minimum, maximum, mean and variance over the whole archive,
+ * optionally grouped by the value of one nums column.
+ *
+ * Key Features:
+ * 1. Vectorised: Records are processed a block at a time with AVX2 when
+ *    the CPU has it (four columns per instruction), with a scalar fallback
+ *    that performs the same operations in the same order
+ * 2. Parallel: Each thread summarises a contiguous range of the archive;
+ *    the partial results are merged at the end
+ * 3. Accurate: Block sums are combined with Kahan summation, and variance
+ *    uses the pairwise (Chan et al.) update, so neither loses precision on
+ *    long archives
+ */
+
+#ifndef RECSTATS_H
+#define RECSTATS_H
+
+#include "copyrecords.h"   /* For record */
+#include "checksum.h"      /* For checksum_table */
+
+/* Summary of one column; partial summaries can be merged */
+typedef struct column_stats {
+    uint64_t count;        /* Values seen */
+    double sum;            /* Running sum */
+    double compensation;   /* Kahan correction for sum */
+    double min;            /* Smallest value */
+    double max;            /* Largest value */
+    double mean;           /* Mean of the values seen */
+    double m2;             /* Sum of squared differences from the mean */
+} column_stats;
+
+/* Summary of every numeric column for one group of records */
+typedef struct record_stats {
+    int32_t group;                 /* Value of the group-by column (0 if not grouping) */
+    column_stats dbl[24];          /* One per dbl column */
+    column_stats nums[12];         /* One per nums column */
+    int64_t nums_sum[12];          /* Exact integer sums of the nums columns */
+} record_stats;
+
+/* How to summarise */
+typedef struct stats_options {
+    int group_by;                      /* nums column to group by, or -1 */
+    int threads;                       /* Threads to use */
+    const checksum_table * verify;     /* Input checksums to check, or NULL */
+} stats_options;
+
+/* Result: one entry per group, ordered by group value */
+typedef struct stats_result {
+    record_stats * groups;
+    size_t count;
+} stats_result;
+
+/*
+ * Summarises num_records records of an archive. Returns 0 on success, or
+ * -1 on a read, checksum or memory error (a message is printed to stderr).
+ */
+int stats_compute(const char * archive, int64_t num_records,
+                  const stats_options * options, stats_result * result);
+
+/* Prints a result as a table, one block per group */
+void stats_print(FILE * out, const stats_result * result, const stats_options * options);
+
+/* Releases a result */
+void stats_free(stats_result * result);
+
+#endif
@@ -0,0 +1,641 @@
+/*
+ * recstats_lib.c
+ *
+ * This file implements the archive summaries declared in recstats.h.
+ *
+ * Key Implementation Details:
+ * 1. Blocks: Records are summarised CHECKSUM_BLOCK_RECORDS at a time. A
+ *    block is small enough to stay in cache, so its mean is found first and
+ *    the squared differences from it are summed in a second pass. The
+ *    double sums of a block are already Kahan-compensated, one column (one
+ *    vector lane) at a time
+ * 2. Kernels: The AVX2 kernel loads the 24 doubles of a record as six
+ *    vectors and the 12 ints as three; the scalar kernel does the same
+ *    arithmetic column by column, so both give identical results
+ * 3. Merging: Block results are merged into running totals with Kahan
+ *    summation and the pairwise variance update; thread results are
+ *    merged the same way, always in thread order
+ * 4. Infinities: Once a sum is not finite its compensation is dropped
+ *    (inf - inf would make it NaN), so a column holding +inf sums to +inf
+ *    and its mean is +inf; its variance is undefined and printed as nan
+ * 5. Grouping: With a group-by column, each block's records are ordered by
+ *    group and each run of equal groups is summarised as a small block
+ */
+
+#define _GNU_SOURCE   /* For pread() */
+
+#include "recstats.h"
+#include "parallel.h"   /* For parallel_run() */
+#include <stdio.h>      /* For output */
+#include <stdlib.h>     /* For memory management */
+#include <string.h>     /* For memset() and memcpy() */
+#include <math.h>       /* For isfinite() and fabs() */
+#include <fcntl.h>      /* For open() */
+#include <unistd.h>     /* For pread() and close() */
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>  /* For AVX2 intrinsics */
+#define STATS_HAVE_AVX2 1
+#endif
+
+/* Records read by one pread() */
+#define STATS_READ_RECORDS (16 * CHECKSUM_BLOCK_RECORDS)
+
+/* Groups of one thread, found by an open-addressing hash table */
+typedef struct group_table {
+    record_stats * stats;   /* One entry per group, in order of discovery */
+    size_t count;           /* Groups in stats */
+    size_t capacity;        /* Allocated entries in stats */
+    size_t * slots;         /* Hash slots holding index + 1 (0 is empty) */
+    size_t slot_count;      /* Number of slots (a power of two) */
+} group_table;
+
+/* A record's group and position, used to order a block by group */
+typedef struct group_entry {
+    int32_t group;
+    uint32_t index;
+} group_entry;
+
+/* Work for one thread */
+typedef struct stats_task {
+    int fd;                           /* Archive, opened read-only */
+    const stats_options * options;
+    int64_t first;                    /* First record of the range */
+    int64_t end;                      /* One past the last record */
+    int use_avx2;                     /* Non-zero to use the AVX2 kernel */
+    group_table groups;               /* Result */
+    int failed;                       /* Non-zero on error */
+    char pad[PARALLEL_CACHE_LINE];    /* Keeps neighbouring tasks' results apart */
+} stats_task;
+
+/* Per-column partial results of one block */
+typedef struct block_sums {
+    double dbl_sum[24], dbl_comp[24], dbl_min[24], dbl_max[24], dbl_m2[24];
+    int64_t nums_sum[12];
+    int32_t nums_min[12], nums_max[12];
+    double nums_m2[12];
+} block_sums;
+
+/*
+ * kernel_scalar
+ *
+ * Purpose: Summarises a block of records one column at a time
+ *
+ * How it works:
+ * 1. First pass: Kahan-compensated sum, minimum and maximum of every column
+ * 2. Second pass: sum of squared differences from the block mean
+ */
+static void kernel_scalar(const record * r, size_t n, block_sums * b) {
+    for (int c = 0; c < 24; c++) {
+        b->dbl_sum[c] = b->dbl_min[c] = b->dbl_max[c] = r[0].dbl[c];
+        b->dbl_comp[c] = 0;
+        b->dbl_m2[c] = 0;
+    }
+    for (int c = 0; c < 12; c++) {
+        b->nums_sum[c] = b->nums_min[c] = b->nums_max[c] = r[0].nums[c];
+        b->nums_m2[c] = 0;
+    }
+
+    for (size_t i = 1; i < n; i++) {
+        for (int c = 0; c < 24; c++) {
+            double x = r[i].dbl[c];
+            double y = x - b->dbl_comp[c];
+            double t = b->dbl_sum[c] + y;
+            b->dbl_comp[c] = t - t == 0 ? (t - b->dbl_sum[c]) - y : 0;
+            b->dbl_sum[c] = t;
+            b->dbl_min[c] = b->dbl_min[c] < x ? b->dbl_min[c] : x;
+            b->dbl_max[c] = b->dbl_max[c] > x ? b->dbl_max[c] : x;
+        }
+        for (int c = 0; c < 12; c++) {
+            int32_t x = r[i].nums[c];
+            b->nums_sum[c] += x;
+            b->nums_min[c] = b->nums_min[c] < x ? b->nums_min[c] : x;
+            b->nums_max[c] = b->nums_max[c] > x ? b->nums_max[c] : x;
+        }
+    }
+
+    double dbl_mean[24], nums_mean[12];
+    for (int c = 0; c < 24; c++) {
+        dbl_mean[c] = (b->dbl_sum[c] - b->dbl_comp[c]) / (double) n;
+    }
+    for (int c = 0; c < 12; c++) {
+        nums_mean[c] = (double) b->nums_sum[c] / (double) n;
+    }
+    for (size_t i = 0; i < n; i++) {
+        for (int c = 0; c < 24; c++) {
+            double d = r[i].dbl[c] - dbl_mean[c];
+            b->dbl_m2[c] += d * d;
+        }
+        for (int c = 0; c < 12; c++) {
+            double d = (double) r[i].nums[c] - nums_mean[c];
+            b->nums_m2[c] += d * d;
+        }
+    }
+}
+
+#ifdef STATS_HAVE_AVX2
+/*
+ * kernel_avx2
+ *
+ * Purpose: Summarises a block of records four columns at a time
+ *
+ * How it works:
+ *   The same two passes as kernel_scalar, with the 24 doubles of each
+ *   record held in six 256-bit registers and the 12 ints in three 128-bit
+ *   registers (widened to 64 bits for the sums). Each lane keeps its own
+ *   Kahan compensation, with the same operations as the scalar kernel
+ */
+__attribute__((target("avx2")))
+static void kernel_avx2(const record * r, size_t n, block_sums * b) {
+    __m256d sum[6], comp[6], lo[6], hi[6], m2[6], mean[6];
+    const __m256d zero = _mm256_setzero_pd();
+    __m256i isum[3];
+    __m128i ilo[3], ihi[3];
+    __m256d im2[3], imean[3];
+
+    for (int v = 0; v < 6; v++) {
+        sum[v] = lo[v] = hi[v] = _mm256_loadu_pd(&r[0].dbl[4 * v]);
+        comp[v] = _mm256_setzero_pd();
+        m2[v] = _mm256_setzero_pd();
+    }
+    for (int v = 0; v < 3; v++) {
+        __m128i x = _mm_loadu_si128((const __m128i *) &r[0].nums[4 * v]);
+        isum[v] = _mm256_cvtepi32_epi64(x);
+        ilo[v] = ihi[v] = x;
+        im2[v] = _mm256_setzero_pd();
+    }
+
+    for (size_t i = 1; i < n; i++) {
+        for (int v = 0; v < 6; v++) {
+            __m256d x = _mm256_loadu_pd(&r[i].dbl[4 * v]);
+            __m256d y = _mm256_sub_pd(x, comp[v]);
+            __m256d t = _mm256_add_pd(sum[v], y);
+            __m256d finite = _mm256_cmp_pd(_mm256_sub_pd(t, t), zero, _CMP_EQ_OQ);
+            comp[v] = _mm256_and_pd(finite, _mm256_sub_pd(_mm256_sub_pd(t, sum[v]), y));
+            sum[v] = t;
+            lo[v] = _mm256_min_pd(lo[v], x);
+            hi[v] = _mm256_max_pd(hi[v], x);
+        }
+        for (int v = 0; v < 3; v++) {
+            __m128i x = _mm_loadu_si128((const __m128i *) &r[i].nums[4 * v]);
+            isum[v] = _mm256_add_epi64(isum[v], _mm256_cvtepi32_epi64(x));
+            ilo[v] = _mm_min_epi32(ilo[v], x);
+            ihi[v] = _mm_max_epi32(ihi[v], x);
+        }
+    }
+
+    for (int v = 0; v < 6; v++) {
+        _mm256_storeu_pd(&b->dbl_sum[4 * v], sum[v]);
+        _mm256_storeu_pd(&b->dbl_comp[4 * v], comp[v]);
+        _mm256_storeu_pd(&b->dbl_min[4 * v], lo[v]);
+        _mm256_storeu_pd(&b->dbl_max[4 * v], hi[v]);
+        mean[v] = _mm256_div_pd(_mm256_sub_pd(sum[v], comp[v]), _mm256_set1_pd((double) n));
+    }
+    for (int v = 0; v < 3; v++) {
+        _mm256_storeu_si256((__m256i *) &b->nums_sum[4 * v], isum[v]);
+        _mm_storeu_si128((__m128i *) &b->nums_min[4 * v], ilo[v]);
+        _mm_storeu_si128((__m128i *) &b->nums_max[4 * v], ihi[v]);
+    }
+    for (int c = 0; c < 3; c++) {
+        imean[c] = _mm256_set_pd((double) b->nums_sum[4 * c + 3] / (double) n,
+                                 (double) b->nums_sum[4 * c + 2] / (double) n,
+                                 (double) b->nums_sum[4 * c + 1] / (double) n,
+                                 (double) b->nums_sum[4 * c] / (double) n);
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        for (int v = 0; v < 6; v++) {
+            __m256d d = _mm256_sub_pd(_mm256_loadu_pd(&r[i].dbl[4 * v]), mean[v]);
+            m2[v] = _mm256_add_pd(m2[v], _mm256_mul_pd(d, d));
+        }
+        for (int v = 0; v < 3; v++) {
+            __m128i x = _mm_loadu_si128((const __m128i *) &r[i].nums[4 * v]);
+            __m256d d = _mm256_sub_pd(_mm256_cvtepi32_pd(x), imean[v]);
+            im2[v] = _mm256_add_pd(im2[v], _mm256_mul_pd(d, d));
+        }
+    }
+
+    for (int v = 0; v < 6; v++) {
+        _mm256_storeu_pd(&b->dbl_m2[4 * v], m2[v]);
+    }
+    for (int v = 0; v < 3; v++) {
+        _mm256_storeu_pd(&b->nums_m2[4 * v], im2[v]);
+    }
+}
+#endif
+
+/*
+ * column_merge
+ *
+ * Purpose: Adds the summary b into the summary a
+ *
+ * How it works:
+ * 1. Sums are combined with Kahan summation, carrying b's own correction;
+ *    a sum that is no longer finite keeps no correction
+ * 2. Means and squared differences use the pairwise update:
+ *    delta = mean_b - mean_a
+ *    mean  = mean_a + delta * n_b / n
+ *    m2    = m2_a + m2_b + delta² * n_a * n_b / n
+ *    unless a mean is infinite, when the means are simply added (giving
+ *    the infinity, or NaN for +inf and -inf) instead of taking inf - inf
+ */
+static void column_merge(column_stats * a, const column_stats * b) {
+    if (b->count == 0) {
+        return;
+    }
+    if (a->count == 0) {
+        *a = *b;
+        return;
+    }
+
+    double na = (double) a->count;
+    double nb = (double) b->count;
+    double n = na + nb;
+    if (isfinite(a->mean) && isfinite(b->mean)) {
+        double delta = b->mean - a->mean;
+        a->mean += delta * nb / n;
+        a->m2 += b->m2 + delta * delta * (na * nb / n);
+    } else {
+        a->mean += b->mean;
+        a->m2 += b->m2;
+    }
+
+    double y = (b->sum - b->compensation) - a->compensation;
+    double t = a->sum + y;
+    a->compensation = isfinite(t) ? (t - a->sum) - y : 0;
+    a->sum = t;
+
+    a->min = b->min < a->min ? b->min : a->min;
+    a->max = b->max > a->max ? b->max : a->max;
+    a->count += b->count;
+}
+
+/* Adds every column of b into a */
+static void stats_merge(record_stats * a, const record_stats * b) {
+    for (int c = 0; c < 24; c++) {
+        column_merge(&a->dbl[c], &b->dbl[c]);
+    }
+    for (int c = 0; c < 12; c++) {
+        column_merge(&a->nums[c], &b->nums[c]);
+        a->nums_sum[c] += b->nums_sum[c];
+    }
+}
+
+/*
+ * summarise_block
+ *
+ * Purpose: Summarises n contiguous records and merges them into stats
+ */
+static void summarise_block(const stats_task * task, const record * r, size_t n, record_stats * stats) {
+    block_sums b;
+    record_stats block;
+
+#ifdef STATS_HAVE_AVX2
+    if (task->use_avx2) {
+        kernel_avx2(r, n, &b);
+    } else {
+        kernel_scalar(r, n, &b);
+    }
+#else
+    kernel_scalar(r, n, &b);
+#endif
+
+    memset(&block, 0, sizeof(block));
+    for (int c = 0; c < 24; c++) {
+        column_stats * col = &block.dbl[c];
+        col->count = n;
+        col->sum = b.dbl_sum[c];
+        col->compensation = b.dbl_comp[c];
+        col->min = b.dbl_min[c];
+        col->max = b.dbl_max[c];
+        col->mean = (b.dbl_sum[c] - b.dbl_comp[c]) / (double) n;
+        col->m2 = b.dbl_m2[c];
+    }
+    for (int c = 0; c < 12; c++) {
+        column_stats * col = &block.nums[c];
+        col->count = n;
+        col->sum = (double) b.nums_sum[c];
+        col->min = b.nums_min[c];
+        col->max = b.nums_max[c];
+        col->mean = (double) b.nums_sum[c] / (double) n;
+        col->m2 = b.nums_m2[c];
+        block.nums_sum[c] = b.nums_sum[c];
+    }
+    stats_merge(stats, &block);
+}
+
+/*
+ * group_find
+ *
+ * Purpose: Finds the summary of a group, creating it if it is new
+ *
+ * Returns:
+ *   The group's summary, or NULL if out of memory
+ */
+static record_stats * group_find(group_table * t, int32_t group) {
+    if (t->count * 2 >= t->slot_count) {
+        /* Keep the table at most half full */
+        size_t slot_count = t->slot_count == 0 ? 64 : t->slot_count * 2;
+        size_t * slots = calloc(slot_count, sizeof(size_t));
+        if (slots == NULL) {
+            return NULL;
+        }
+        for (size_t i = 0; i < t->count; i++) {
+            size_t h = ((uint32_t) t->stats[i].group * 2654435761u) & (slot_count - 1);
+            while (slots[h] != 0) {
+                h = (h + 1) & (slot_count - 1);
+            }
+            slots[h] = i + 1;
+        }
+        free(t->slots);
+        t->slots = slots;
+        t->slot_count = slot_count;
+    }
+
+    size_t h = ((uint32_t) group * 2654435761u) & (t->slot_count - 1);
+    while (t->slots[h] != 0) {
+        if (t->stats[t->slots[h] - 1].group == group) {
+            return &t->stats[t->slots[h] - 1];
+        }
+        h = (h + 1) & (t->slot_count - 1);
+    }
+
+    if (t->count == t->capacity) {
+        size_t capacity = t->capacity == 0 ? 16 : t->capacity * 2;
+        record_stats * stats = realloc(t->stats, sizeof(record_stats) * capacity);
+        if (stats == NULL) {
+            return NULL;
+        }
+        t->stats = stats;
+        t->capacity = capacity;
+    }
+    record_stats * s = &t->stats[t->count];
+    memset(s, 0, sizeof(*s));
+    s->group = group;
+    t->slots[h] = ++t->count;
+    return s;
+}
+
+/* Orders group entries by group, then by position */
+static int group_entry_cmp(const void * a, const void * b) {
+    const group_entry * x = a;
+    const group_entry * y = b;
+    if (x->group != y->group) {
+        return x->group < y->group ? -1 : 1;
+    }
+    return x->index < y->index ? -1 : x->index > y->index;
+}
+
+/*
+ * summarise_records
+ *
+ * Purpose: Adds up to one checksum block of records to a thread's groups
+ *
+ * Returns:
+ *   0 on success, -1 if out of memory
+ */
+static int summarise_records(stats_task * task, const record * r, size_t n,
+                             group_entry * order, record * scratch) {
+    int column = task->options->group_by;
+
+    if (column < 0) {
+        record_stats * stats = group_find(&task->groups, 0);
+        if (stats == NULL) {
+            return -1;
+        }
+        summarise_block(task, r, n, stats);
+        return 0;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        order[i].group = r[i].nums[column];
+        order[i].index = (uint32_t) i;
+    }
+    qsort(order, n, sizeof(group_entry), group_entry_cmp);
+
+    for (size_t i = 0; i < n; ) {
+        size_t run = 0;
+        int32_t group = order[i].group;
+        while (i < n && order[i].group == group) {
+            scratch[run++] = r[order[i++].index];
+        }
+        record_stats * stats = group_find(&task->groups, group);
+        if (stats == NULL) {
+            return -1;
+        }
+        summarise_block(task, scratch, run, stats);
+    }
+    return 0;
+}
+
+/*
+ * stats_worker
+ *
+ * Purpose: Summarises one thread's range of the archive
+ *
+ * How it works:
+ *   Reads STATS_READ_RECORDS records at a time with pread(), checks their
+ *   checksums if the archive has them, and summarises each block
+ */
+static void * stats_worker(void * arg) {
+    stats_task * task = arg;
+    record * buffer = malloc(sizeof(record) * STATS_READ_RECORDS);
+    record * scratch = malloc(sizeof(record) * CHECKSUM_BLOCK_RECORDS);
+    group_entry * order = malloc(sizeof(group_entry) * CHECKSUM_BLOCK_RECORDS);
+
+    if (buffer == NULL || scratch == NULL || order == NULL) {
+        task->failed = 1;
+    }
+    for (int64_t pos = task->first; !task->failed && pos < task->end; pos += STATS_READ_RECORDS) {
+        size_t n = task->end - pos < STATS_READ_RECORDS ? (size_t) (task->end - pos) : STATS_READ_RECORDS;
+        size_t want = n * sizeof(record);
+        size_t got = 0;
+        while (got < want) {
+            ssize_t r = pread(task->fd, (char *) buffer + got, want - got,
+                              (off_t) pos * (off_t) sizeof(record) + (off_t) got);
+            if (r <= 0) {
+                fprintf(stderr, "Could not read records for statistics.\n");
+                task->failed = 1;
+                break;
+            }
+            got += r;
+        }
+
+        for (size_t b = 0; !task->failed && b < n; b += CHECKSUM_BLOCK_RECORDS) {
+            size_t count = n - b < CHECKSUM_BLOCK_RECORDS ? n - b : CHECKSUM_BLOCK_RECORDS;
+            uint64_t block = (pos + b) / CHECKSUM_BLOCK_RECORDS;
+            if (task->options->verify != NULL &&
+                !checksum_block_ok(task->options->verify, block, buffer + b, count)) {
+                fprintf(stderr, "Checksum mismatch in block %llu.\n", (unsigned long long) block);
+                task->failed = 1;
+            } else if (summarise_records(task, buffer + b, count, order, scratch) != 0) {
+                task->failed = 1;
+            }
+        }
+    }
+
+    free(buffer);
+    free(scratch);
+    free(order);
+    return NULL;
+}
+
+/* Orders final groups by their value */
+static int group_cmp(const void * a, const void * b) {
+    const record_stats * x = a;
+    const record_stats * y = b;
+    return x->group < y->group ? -1 : x->group > y->group;
+}
+
+/*
+ * stats_compute
+ *
+ * Purpose: Summarises the numeric columns of an archive
+ *
+ * Parameters:
+ *   archive     - Archive file name
+ *   num_records - Records in the archive
+ *   options     - Grouping, threads and checksums
+ *   result      - Receives one summary per group (free with stats_free)
+ *
+ * Returns:
+ *   0 on success, -1 on failure
+ *
+ * How it works:
+ * 1. The archive is split into one range of whole blocks per thread
+ * 2. Each thread builds its own table of group summaries
+ * 3. The tables are merged in thread order and sorted by group value
+ */
+int stats_compute(const char * archive, int64_t num_records,
+                  const stats_options * options, stats_result * result) {
+    int threads = options->threads > 0 ? options->threads : 1;
+    int64_t num_blocks = (num_records + CHECKSUM_BLOCK_RECORDS - 1) / CHECKSUM_BLOCK_RECORDS;
+    int use_avx2 = 0;
+
+    memset(result, 0, sizeof(*result));
+#ifdef STATS_HAVE_AVX2
+    __builtin_cpu_init();
+    use_avx2 = __builtin_cpu_supports("avx2");
+#endif
+
+    int fd = open(archive, O_RDONLY);
+    if (fd < 0) {
+        fprintf(stderr, "Could not open %s\n", archive);
+        return -1;
+    }
+    if (threads > num_blocks) {
+        threads = num_blocks > 0 ? (int) num_blocks : 1;
+    }
+    stats_task * tasks = calloc(threads, sizeof(stats_task));
+    if (tasks == NULL) {
+        close(fd);
+        return -1;
+    }
+    for (int i = 0; i < threads; i++) {
+        tasks[i].fd = fd;
+        tasks[i].options = options;
+        tasks[i].first = num_blocks * i / threads * CHECKSUM_BLOCK_RECORDS;
+        tasks[i].end = num_blocks * (i + 1) / threads * CHECKSUM_BLOCK_RECORDS;
+        if (tasks[i].end > num_records) {
+            tasks[i].end = num_records;
+        }
+        tasks[i].use_avx2 = use_avx2;
+    }
+
+    parallel_run(threads, stats_worker, tasks, sizeof(stats_task));
+
+    int status = 0;
+    group_table * total = &tasks[0].groups;
+    for (int i = 0; i < threads; i++) {
+        if (tasks[i].failed) {
+            status = -1;
+        }
+    }
+    for (int i = 1; status == 0 && i < threads; i++) {
+        for (size_t g = 0; g < tasks[i].groups.count; g++) {
+            record_stats * into = group_find(total, tasks[i].groups.stats[g].group);
+            if (into == NULL) {
+                status = -1;
+                break;
+            }
+            stats_merge(into, &tasks[i].groups.stats[g]);
+        }
+    }
+
+    if (status == 0) {
+        if (total->count > 0) {
+            qsort(total->stats, total->count, sizeof(record_stats), group_cmp);
+        }
+        result->groups = total->stats;
+        result->count = total->count;
+        total->stats = NULL;
+    }
+    for (int i = 0; i < threads; i++) {
+        free(tasks[i].groups.stats);
+        free(tasks[i].groups.slots);
+    }
+    free(tasks);
+    close(fd);
+    return status;
+}
+
+/* inf - inf gives a NaN with the sign bit set on x86; print every NaN as "nan" */
+static double unsigned_nan(double x) {
+    return isnan(x) ? fabs(x) : x;
+}
+
+/* Prints one column's summary line */
+static void print_column(FILE * out, const char * name, int index, const column_stats * c) {
+    char label[16];
+    double variance = c->count > 1 ? c->m2 / (double) (c->count - 1) : 0;
+
+    snprintf(label, sizeof(label), "%s[%d]", name, index);
+    fprintf(out, "%-9s %12llu %22.15g %18.10g %18.10g %18.10g %18.10g\n", label,
+            (unsigned long long) c->count, unsigned_nan(c->sum - c->compensation), c->min, c->max,
+            unsigned_nan(c->mean), unsigned_nan(variance));
+}
+
+/*
+ * stats_print
+ *
+ * Purpose: Prints the summaries as a table
+ *
+ * Variance is the sample variance (squared differences divided by n - 1).
+ * The sums of nums columns are printed from the exact integer totals.
+ */
+void stats_print(FILE * out, const stats_result * result, const stats_options * options) {
+    if (result->count == 0) {
+        fprintf(out, "No records.\n");
+        return;
+    }
+    for (size_t g = 0; g < result->count; g++) {
+        const record_stats * s = &result->groups[g];
+        if (options->group_by >= 0) {
+            fprintf(out, "Group nums[%d] = %d (%llu records)\n", options->group_by, s->group,
+                    (unsigned long long) s->dbl[0].count);
+        }
+        fprintf(out, "%-9s %12s %22s %18s %18s %18s %18s\n",
+                "Column", "Count", "Sum", "Min", "Max", "Mean", "Variance");
+        for (int c = 0; c < 24; c++) {
+            print_column(out, "dbl", c, &s->dbl[c]);
+        }
+        for (int c = 0; c < 12; c++) {
+            column_stats exact = s->nums[c];
+            exact.sum = (double) s->nums_sum[c];
+            exact.compensation = 0;
+            print_column(out, "nums", c, &exact);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+/*
+ * stats_free
+ *
+ * Purpose: Releases a result
+ */
+void stats_free(stats_result * result) {
+    free(result->groups);
+    result->groups = NULL;
+    result->count = 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * rectext.h
+ *
+ * This header file defines the interface for exporting record archives to
+ * text and importing them back, used by copyrecords --export and --import.
+ *
+ * Formats:
+ * - CSV: A header line, then one line per record with the columns
+ *   str1, dbl0..dbl23, str2, nums0..nums11. Strings containing a comma,
+ *   quote or line break are quoted, with quotes doubled (RFC 4180)
+ * - NDJSON: One JSON object per line:
+ *   {"str1":"...","dbl":[24 numbers],"str2":"...","nums":[12 integers]}
+ *   Infinities and NaNs, which JSON numbers cannot hold, are written as
+ *   strings ("inf", "nan", ...). String bytes below 0x20 or above 0x7F
+ *   are written as \u00XX, so every line is valid UTF-8 whatever the
+ *   archive holds; on import, \u0000 to \u00FF are read back as those
+ *   single bytes and larger code points as UTF-8
+ *
+ * Doubles are written with the fewest digits that read back exactly, so an
+ * export followed by an import reproduces every double bit for bit.
+ *
+ * Key Features:
+ * 1. Parallel: Records are formatted (or parsed) in chunks on several
+ *    threads, each into its own large buffer
+ * 2. Ordered: Chunks are written (or passed on) in archive order
+ * 3. No printf/strtod: Numbers go through numconv.h
+ */
+
+#ifndef RECTEXT_H
+#define RECTEXT_H
+
+#include "copyrecords.h"   /* For record and record_sink */
+#include "checksum.h"      /* For checksum_table */
+#include "decode_lib.h"    /* For decode_ctx */
+
+/* Text formats */
+typedef enum text_format {
+    TEXT_CSV,
+    TEXT_NDJSON
+} text_format;
+
+/* How to export */
+typedef struct export_options {
+    text_format format;
+    int threads;                       /* Threads formatting records */
+    const decode_ctx * ctx;            /* Used to decode strings before writing */
+    int shift;                         /* Decoding shift (0 for none) */
+    const checksum_table * verify;     /* Input checksums to check, or NULL */
+} export_options;
+
+/* How to import */
+typedef struct import_options {
+    text_format format;
+    int threads;                       /* Threads parsing records */
+} import_options;
+
+/* Parses "csv", "json" or "ndjson"; returns 0 on success, -1 if unknown */
+int text_format_parse(const char * name, text_format * format);
+
+/*
+ * Writes num_records records read sequentially from in to out as text.
+ * Returns 0 on success, -1 on an I/O, checksum or memory error (a message
+ * is printed to stderr).
+ */
+int export_records(FILE * in, int64_t num_records, const export_options * options, FILE * out);
+
+/*
+ * Parses text records from in and passes them, in order, to sink. The
+ * number of records imported is stored in *count. Returns 0 on success, -1
+ * on a syntax, I/O or memory error (a message naming the record is printed
+ * to stderr).
+ */
+int import_records(FILE * in, const import_options * options,
+                   record_sink sink, void * sink_arg, int64_t * count);
+
+#endif
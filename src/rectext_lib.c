@@ -0,0 +1,783 @@
+/*
+ * rectext_lib.c
+ *
+ * This file implements the CSV/NDJSON export and import declared in
+ * rectext.h.
+ *
+ * Key Implementation Details:
+ * 1. Export: The main thread reads up to EXPORT_CHUNK_RECORDS records per
+ *    thread; each thread verifies, decodes and formats its chunk into its
+ *    own buffer (sized for the worst case, so formatting never checks for
+ *    room), and the buffers are written in order with one fwrite() each
+ * 2. Import: The main thread reads a large buffer and finds the end of the
+ *    last complete record (a newline, outside quotes for CSV). The complete
+ *    part is cut at record boundaries into one piece per thread; each
+ *    thread parses its piece into records, which are passed on in order.
+ *    The incomplete tail is moved to the front of the buffer for the next
+ *    round
+ */
+
+#include "rectext.h"
+#include "numconv.h"    /* For number formatting and parsing */
+#include "parallel.h"   /* For parallel_run() */
+#include <stdio.h>      /* For file I/O */
+#include <stdlib.h>     /* For memory management */
+#include <string.h>     /* For memcpy(), memchr() and memset() */
+#include <math.h>       /* For isfinite() */
+
+/* Records formatted by one thread at a time */
+#define EXPORT_CHUNK_RECORDS (4 * CHECKSUM_BLOCK_RECORDS)
+
+/*
+ * Most text one record can need: every string byte escaped as \u00XX, every
+ * double at full length in quotes, plus separators and keys
+ */
+#define TEXT_RECORD_MAX ((24 + 144) * 6 + 24 * (NUMCONV_DOUBLE_MAX + 3) + \
+                         12 * (NUMCONV_INT_MAX + 1) + 64)
+
+/* Bytes of input per thread read in one round of an import */
+#define IMPORT_BUFFER (4 * 1024 * 1024)
+
+/* Work for one export thread */
+typedef struct export_task {
+    const export_options * options;
+    record * records;     /* Chunk to format (decoded in place) */
+    size_t count;         /* Records in the chunk */
+    int64_t first;        /* Index of the first record in the archive */
+    char * text;          /* Output buffer (count * TEXT_RECORD_MAX bytes) */
+    size_t length;        /* Bytes of text produced */
+    int failed;           /* Non-zero if a checksum did not match */
+} export_task;
+
+/* Work for one import thread */
+typedef struct import_task {
+    const import_options * options;
+    const char * text;    /* Piece of whole records to parse */
+    size_t length;
+    record * records;     /* Parsed records */
+    size_t count;
+    size_t capacity;
+    size_t failed_at;     /* 1-based index of a record that did not parse, or 0 */
+    int no_memory;        /* Non-zero if records could not be allocated */
+} import_task;
+
+int text_format_parse(const char * name, text_format * format) {
+    if (strcmp(name, "csv") == 0) {
+        *format = TEXT_CSV;
+    } else if (strcmp(name, "json") == 0 || strcmp(name, "ndjson") == 0) {
+        *format = TEXT_NDJSON;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+/* Length of a string field: up to its first NUL or the end of the field */
+static size_t field_length(const char * s, size_t size) {
+    const char * nul = memchr(s, '\0', size);
+    return nul != NULL ? (size_t) (nul - s) : size;
+}
+
+static char * put_csv_string(char * p, const char * s, size_t size) {
+    size_t n = field_length(s, size);
+    int quote = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] == ',' || s[i] == '"' || s[i] == '\n' || s[i] == '\r') {
+            quote = 1;
+            break;
+        }
+    }
+    if (!quote) {
+        memcpy(p, s, n);
+        return p + n;
+    }
+    *p++ = '"';
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] == '"') {
+            *p++ = '"';
+        }
+        *p++ = s[i];
+    }
+    *p++ = '"';
+    return p;
+}
+
+static char * put_json_string(char * p, const char * s, size_t size) {
+    static const char hex[] = "0123456789abcdef";
+    size_t n = field_length(s, size);
+
+    *p++ = '"';
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = (unsigned char) s[i];
+        if (c == '"' || c == '\\') {
+            *p++ = '\\';
+            *p++ = (char) c;
+        } else if (c == '\n') {
+            *p++ = '\\';
+            *p++ = 'n';
+        } else if (c == '\r') {
+            *p++ = '\\';
+            *p++ = 'r';
+        } else if (c == '\t') {
+            *p++ = '\\';
+            *p++ = 't';
+        } else if (c < 0x20 || c >= 0x80) {
+            /* Control bytes, and bytes that may not be valid UTF-8 */
+            memcpy(p, "\\u00", 4);
+            p[4] = hex[c >> 4];
+            p[5] = hex[c & 15];
+            p += 6;
+        } else {
+            *p++ = (char) c;
+        }
+    }
+    *p++ = '"';
+    return p;
+}
+
+/* Writes a double; in JSON, infinities and NaNs are quoted */
+static char * put_double(char * p, double v, int json) {
+    if (json && !isfinite(v)) {
+        *p++ = '"';
+        p += format_double(p, v);
+        *p++ = '"';
+        return p;
+    }
+    return p + format_double(p, v);
+}
+
+/* Writes one record as a line of text and returns the end of the line */
+static char * format_record(char * p, const record * r, text_format format) {
+    if (format == TEXT_CSV) {
+        p = put_csv_string(p, r->str1, sizeof(r->str1));
+        for (int c = 0; c < 24; c++) {
+            *p++ = ',';
+            p = put_double(p, r->dbl[c], 0);
+        }
+        *p++ = ',';
+        p = put_csv_string(p, r->str2, sizeof(r->str2));
+        for (int c = 0; c < 12; c++) {
+            *p++ = ',';
+            p += format_int(p, r->nums[c]);
+        }
+    } else {
+        memcpy(p, "{\"str1\":", 8);
+        p = put_json_string(p + 8, r->str1, sizeof(r->str1));
+        memcpy(p, ",\"dbl\":[", 8);
+        p += 8;
+        for (int c = 0; c < 24; c++) {
+            if (c > 0) {
+                *p++ = ',';
+            }
+            p = put_double(p, r->dbl[c], 1);
+        }
+        memcpy(p, "],\"str2\":", 9);
+        p = put_json_string(p + 9, r->str2, sizeof(r->str2));
+        memcpy(p, ",\"nums\":[", 9);
+        p += 9;
+        for (int c = 0; c < 12; c++) {
+            if (c > 0) {
+                *p++ = ',';
+            }
+            p += format_int(p, r->nums[c]);
+        }
+        *p++ = ']';
+        *p++ = '}';
+    }
+    *p++ = '\n';
+    return p;
+}
+
+/*
+ * export_worker
+ *
+ * Purpose: Verifies, decodes and formats one chunk of records
+ */
+static void * export_worker(void * arg) {
+    export_task * task = arg;
+    const export_options * options = task->options;
+    char * p = task->text;
+
+    if (options->verify != NULL) {
+        for (size_t b = 0; b < task->count; b += CHECKSUM_BLOCK_RECORDS) {
+            size_t count = task->count - b < CHECKSUM_BLOCK_RECORDS ? task->count - b : CHECKSUM_BLOCK_RECORDS;
+            uint64_t block = (task->first + b) / CHECKSUM_BLOCK_RECORDS;
+            if (!checksum_block_ok(options->verify, block, task->records + b, count)) {
+                fprintf(stderr, "Checksum mismatch in block %llu.\n", (unsigned long long) block);
+                task->failed = 1;
+                return NULL;
+            }
+        }
+    }
+    decode_records(options->ctx, task->records, task->count, options->shift);
+    for (size_t i = 0; i < task->count; i++) {
+        p = format_record(p, &task->records[i], options->format);
+    }
+    task->length = p - task->text;
+    return NULL;
+}
+
+/*
+ * export_records
+ *
+ * Purpose: Writes an archive as CSV or NDJSON
+ *
+ * How it works:
+ * 1. Each round reads one chunk per thread (chunks start on checksum
+ *    block boundaries)
+ * 2. The chunks are formatted in parallel
+ * 3. The text of each chunk is written in archive order
+ */
+int export_records(FILE * in, int64_t num_records, const export_options * options, FILE * out) {
+    int threads = options->threads > 0 ? options->threads : 1;
+    export_task * tasks = calloc(threads, sizeof(export_task));
+    record * records = malloc(sizeof(record) * EXPORT_CHUNK_RECORDS * threads);
+    char * text = malloc((size_t) TEXT_RECORD_MAX * EXPORT_CHUNK_RECORDS * threads);
+    int status = 0;
+
+    if (tasks == NULL || records == NULL || text == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        status = -1;
+    }
+    if (status == 0 && options->format == TEXT_CSV) {
+        fputs("str1", out);
+        for (int c = 0; c < 24; c++) {
+            fprintf(out, ",dbl%d", c);
+        }
+        fputs(",str2", out);
+        for (int c = 0; c < 12; c++) {
+            fprintf(out, ",nums%d", c);
+        }
+        fputc('\n', out);
+    }
+
+    for (int64_t pos = 0; status == 0 && pos < num_records; ) {
+        int used = 0;
+        for (; used < threads && pos < num_records; used++) {
+            export_task * task = &tasks[used];
+            size_t count = num_records - pos < EXPORT_CHUNK_RECORDS ? (size_t) (num_records - pos) : EXPORT_CHUNK_RECORDS;
+            task->options = options;
+            task->records = records + (size_t) used * EXPORT_CHUNK_RECORDS;
+            task->text = text + (size_t) used * EXPORT_CHUNK_RECORDS * TEXT_RECORD_MAX;
+            task->first = pos;
+            task->count = count;
+            task->failed = 0;
+            if (fread(task->records, sizeof(record), count, in) != count) {
+                fprintf(stderr, "Could not read records for export.\n");
+                status = -1;
+                break;
+            }
+            pos += count;
+        }
+        if (status != 0) {
+            break;
+        }
+
+        parallel_run(used, export_worker, tasks, sizeof(export_task));
+
+        for (int i = 0; i < used; i++) {
+            if (tasks[i].failed) {
+                status = -1;
+                break;
+            }
+            if (fwrite(tasks[i].text, 1, tasks[i].length, out) != tasks[i].length) {
+                fprintf(stderr, "Could not write exported records.\n");
+                status = -1;
+                break;
+            }
+        }
+    }
+
+    free(tasks);
+    free(records);
+    free(text);
+    return status;
+}
+
+/* Returns p + 1 if p points at c, otherwise NULL (NULL stays NULL) */
+static const char * expect(const char * p, const char * end, char c) {
+    return p != NULL && p < end && *p == c ? p + 1 : NULL;
+}
+
+/* Skips spaces and tabs inside a JSON line */
+static const char * skip_space(const char * p, const char * end) {
+    while (p != NULL && p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+/* Accepts the end of a line ("\n", "\r\n" or the end of the text) */
+static const char * end_of_line(const char * p, const char * end) {
+    if (p == NULL) {
+        return NULL;
+    }
+    if (p < end && *p == '\r') {
+        p++;
+    }
+    if (p == end) {
+        return p;
+    }
+    return *p == '\n' ? p + 1 : NULL;
+}
+
+/* Parses a CSV string field into a zero-filled record field */
+static const char * csv_string(const char * p, const char * end, char * field, size_t size) {
+    size_t n = 0;
+
+    if (p == NULL) {
+        return NULL;
+    }
+    memset(field, 0, size);
+    if (p < end && *p == '"') {
+        p++;
+        for (;;) {
+            char c;
+            if (p == end) {
+                return NULL;
+            }
+            if (*p == '"') {
+                if (p + 1 < end && p[1] == '"') {
+                    p += 2;
+                    c = '"';
+                } else {
+                    return p + 1;
+                }
+            } else {
+                c = *p++;
+            }
+            if (n == size) {
+                return NULL;
+            }
+            field[n++] = c;
+        }
+    }
+    while (p < end && *p != ',' && *p != '\n' && *p != '\r') {
+        if (n == size) {
+            return NULL;
+        }
+        field[n++] = *p++;
+    }
+    return p;
+}
+
+/* Parses CSV numbers, each preceded by a comma */
+static const char * csv_doubles(const char * p, const char * end, double * values, int n) {
+    for (int i = 0; p != NULL && i < n; i++) {
+        p = expect(p, end, ',');
+        p = p != NULL ? parse_double(p, end, &values[i]) : NULL;
+    }
+    return p;
+}
+
+static const char * csv_ints(const char * p, const char * end, int * values, int n) {
+    for (int i = 0; p != NULL && i < n; i++) {
+        int32_t v = 0;
+        p = expect(p, end, ',');
+        p = p != NULL ? parse_int(p, end, &v) : NULL;
+        values[i] = v;
+    }
+    return p;
+}
+
+/* Parses one CSV line into a record */
+static const char * csv_record(const char * p, const char * end, record * r) {
+    p = csv_string(p, end, r->str1, sizeof(r->str1));
+    p = csv_doubles(p, end, r->dbl, 24);
+    p = csv_string(expect(p, end, ','), end, r->str2, sizeof(r->str2));
+    p = csv_ints(p, end, r->nums, 12);
+    return end_of_line(p, end);
+}
+
+/* Appends a code point to a field as UTF-8 */
+static int put_utf8(char * field, size_t size, size_t * n, unsigned long cp) {
+    char bytes[4];
+    size_t len;
+
+    if (cp < 0x80) {
+        bytes[0] = (char) cp;
+        len = 1;
+    } else if (cp < 0x800) {
+        bytes[0] = (char) (0xc0 | cp >> 6);
+        bytes[1] = (char) (0x80 | (cp & 0x3f));
+        len = 2;
+    } else if (cp < 0x10000) {
+        bytes[0] = (char) (0xe0 | cp >> 12);
+        bytes[1] = (char) (0x80 | (cp >> 6 & 0x3f));
+        bytes[2] = (char) (0x80 | (cp & 0x3f));
+        len = 3;
+    } else {
+        bytes[0] = (char) (0xf0 | cp >> 18);
+        bytes[1] = (char) (0x80 | (cp >> 12 & 0x3f));
+        bytes[2] = (char) (0x80 | (cp >> 6 & 0x3f));
+        bytes[3] = (char) (0x80 | (cp & 0x3f));
+        len = 4;
+    }
+    if (*n + len > size) {
+        return -1;
+    }
+    memcpy(field + *n, bytes, len);
+    *n += len;
+    return 0;
+}
+
+/* Parses the 4 hex digits of a \u escape */
+static const char * json_hex4(const char * p, const char * end, unsigned long * cp) {
+    if (end - p < 4) {
+        return NULL;
+    }
+    *cp = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = p[i];
+        int d = c >= '0' && c <= '9' ? c - '0' :
+                (c | 0x20) >= 'a' && (c | 0x20) <= 'f' ? (c | 0x20) - 'a' + 10 : -1;
+        if (d < 0) {
+            return NULL;
+        }
+        *cp = *cp << 4 | d;
+    }
+    return p + 4;
+}
+
+/* Parses a JSON string into a zero-filled field */
+static const char * json_string(const char * p, const char * end, char * field, size_t size) {
+    size_t n = 0;
+
+    p = expect(p, end, '"');
+    if (p == NULL) {
+        return NULL;
+    }
+    memset(field, 0, size);
+    while (p < end && *p != '"') {
+        unsigned long cp;
+        if (*p != '\\') {
+            if (n == size) {
+                return NULL;
+            }
+            field[n++] = *p++;
+            continue;
+        }
+        if (++p == end) {
+            return NULL;
+        }
+        switch (*p++) {
+            case '"': cp = '"'; break;
+            case '\\': cp = '\\'; break;
+            case '/': cp = '/'; break;
+            case 'b': cp = '\b'; break;
+            case 'f': cp = '\f'; break;
+            case 'n': cp = '\n'; break;
+            case 'r': cp = '\r'; break;
+            case 't': cp = '\t'; break;
+            case 'u':
+                p = json_hex4(p, end, &cp);
+                if (p != NULL && cp >= 0xd800 && cp < 0xdc00) {
+                    /* High surrogate: must be followed by a low one */
+                    unsigned long low;
+                    p = expect(expect(p, end, '\\'), end, 'u');
+                    p = p != NULL ? json_hex4(p, end, &low) : NULL;
+                    if (p == NULL || low < 0xdc00 || low >= 0xe000) {
+                        return NULL;
+                    }
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                } else if (p != NULL && cp >= 0xdc00 && cp < 0xe000) {
+                    return NULL;
+                }
+                if (p == NULL) {
+                    return NULL;
+                }
+                break;
+            default:
+                return NULL;
+        }
+        if (cp < 0x100) {
+            /* \u0000-\u00ff stand for single bytes (see rectext.h) */
+            if (n == size) {
+                return NULL;
+            }
+            field[n++] = (char) cp;
+        } else if (put_utf8(field, size, &n, cp) != 0) {
+            return NULL;
+        }
+    }
+    return expect(p, end, '"');
+}
+
+/* Parses a JSON number, or a quoted special ("nan", "inf", ...) */
+static const char * json_double(const char * p, const char * end, double * v) {
+    if (p < end && *p == '"') {
+        p = parse_double(p + 1, end, v);
+        return p != NULL && isfinite(*v) ? NULL : expect(p, end, '"');
+    }
+    return parse_double(p, end, v);
+}
+
+/* Parses one NDJSON line into a record; keys may come in any order */
+static const char * json_record(const char * p, const char * end, record * r) {
+    int seen = 0;
+
+    p = skip_space(expect(skip_space(p, end), end, '{'), end);
+    while (p != NULL) {
+        char key[8];
+        p = json_string(p, end, key, sizeof(key) - 1);
+        key[sizeof(key) - 1] = '\0';
+        p = skip_space(expect(skip_space(p, end), end, ':'), end);
+        if (p == NULL) {
+            return NULL;
+        }
+        if (strcmp(key, "str1") == 0) {
+            p = json_string(p, end, r->str1, sizeof(r->str1));
+            seen |= 1;
+        } else if (strcmp(key, "str2") == 0) {
+            p = json_string(p, end, r->str2, sizeof(r->str2));
+            seen |= 2;
+        } else if (strcmp(key, "dbl") == 0) {
+            p = expect(p, end, '[');
+            for (int c = 0; p != NULL && c < 24; c++) {
+                p = skip_space(p, end);
+                if (c > 0) {
+                    p = skip_space(expect(p, end, ','), end);
+                }
+                p = p != NULL ? json_double(p, end, &r->dbl[c]) : NULL;
+            }
+            p = expect(skip_space(p, end), end, ']');
+            seen |= 4;
+        } else if (strcmp(key, "nums") == 0) {
+            p = expect(p, end, '[');
+            for (int c = 0; p != NULL && c < 12; c++) {
+                int32_t v = 0;
+                p = skip_space(p, end);
+                if (c > 0) {
+                    p = skip_space(expect(p, end, ','), end);
+                }
+                p = p != NULL ? parse_int(p, end, &v) : NULL;
+                r->nums[c] = v;
+            }
+            p = expect(skip_space(p, end), end, ']');
+            seen |= 8;
+        } else {
+            return NULL;
+        }
+        p = skip_space(p, end);
+        if (p != NULL && p < end && *p == '}') {
+            p++;
+            break;
+        }
+        p = skip_space(expect(p, end, ','), end);
+    }
+    if (seen != 15) {
+        return NULL;
+    }
+    return end_of_line(skip_space(p, end), end);
+}
+
+/*
+ * import_worker
+ *
+ * Purpose: Parses one piece of text into records, skipping blank lines
+ */
+static void * import_worker(void * arg) {
+    import_task * task = arg;
+    const char * p = task->text;
+    const char * end = p + task->length;
+    size_t lines = 1;
+
+    for (const char * q = p; (q = memchr(q, '\n', end - q)) != NULL; q++) {
+        lines++;
+    }
+    if (lines > task->capacity) {
+        record * records = realloc(task->records, sizeof(record) * lines);
+        if (records == NULL) {
+            task->no_memory = 1;
+            return NULL;
+        }
+        task->records = records;
+        task->capacity = lines;
+    }
+
+    task->count = 0;
+    while (p < end) {
+        if (*p == '\n') {
+            p++;
+            continue;
+        }
+        if (*p == '\r' && p + 1 < end && p[1] == '\n') {
+            p += 2;
+            continue;
+        }
+        record * r = &task->records[task->count];
+        memset(r, 0, sizeof(*r));
+        p = task->options->format == TEXT_CSV ? csv_record(p, end, r) : json_record(p, end, r);
+        if (p == NULL) {
+            task->failed_at = task->count + 1;
+            return NULL;
+        }
+        task->count++;
+    }
+    return NULL;
+}
+
+/*
+ * split_records
+ *
+ * Purpose: Finds the complete records in a buffer and cuts them into pieces
+ *
+ * Parameters:
+ *   format - Text format (CSV quotes may hide newlines)
+ *   buf    - Buffered text
+ *   len    - Bytes in buf
+ *   eof    - Non-zero if no more text follows (the tail is then complete)
+ *   cuts   - Receives the end of each piece
+ *   pieces - Number of pieces
+ *
+ * Returns:
+ *   Bytes of complete records (the end of the last piece)
+ *
+ * Each piece ends at the first record boundary at or after its share of
+ * buf, so pieces are roughly equal and never split a record.
+ */
+static size_t split_records(text_format format, const char * buf, size_t len, int eof,
+                            size_t * cuts, int pieces) {
+    size_t complete = 0;
+    int quoted = 0;
+    int next = 0;
+
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] == '"' && format == TEXT_CSV) {
+            quoted = !quoted;
+        } else if (buf[i] == '\n' && !quoted) {
+            complete = i + 1;
+            while (next < pieces - 1 && complete >= len / pieces * (next + 1)) {
+                cuts[next++] = complete;
+            }
+        }
+    }
+    if (eof) {
+        complete = len;
+    }
+    while (next < pieces) {
+        cuts[next++] = complete;
+    }
+    for (int i = 0; i < pieces; i++) {
+        if (cuts[i] > complete) {
+            cuts[i] = complete;
+        }
+    }
+    return complete;
+}
+
+/*
+ * import_records
+ *
+ * Purpose: Reads CSV or NDJSON records and passes them on in order
+ *
+ * How it works:
+ * 1. A CSV header line (starting "str1,") is skipped
+ * 2. Each round fills the buffer, splits its complete records into one
+ *    piece per thread and parses the pieces in parallel
+ * 3. A record longer than the whole buffer doubles the buffer
+ */
+int import_records(FILE * in, const import_options * options,
+                   record_sink sink, void * sink_arg, int64_t * count) {
+    int threads = options->threads > 0 ? options->threads : 1;
+    size_t capacity = (size_t) IMPORT_BUFFER * threads;
+    char * buf = malloc(capacity);
+    import_task * tasks = calloc(threads, sizeof(import_task));
+    size_t * cuts = calloc(threads, sizeof(size_t));
+    const char * name = options->format == TEXT_CSV ? "CSV" : "NDJSON";
+    size_t have = 0;
+    int eof = 0;
+    int header = options->format == TEXT_CSV;
+    int status = 0;
+
+    *count = 0;
+    if (buf == NULL || tasks == NULL || cuts == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        status = -1;
+    }
+    while (status == 0) {
+        if (!eof) {
+            size_t want = capacity - have;
+            size_t got = fread(buf + have, 1, want, in);
+            have += got;
+            if (got < want) {
+                if (ferror(in)) {
+                    fprintf(stderr, "Could not read %s input.\n", name);
+                    status = -1;
+                    break;
+                }
+                eof = 1;
+            }
+        }
+        if (header) {
+            char * nl = memchr(buf, '\n', have);
+            if (nl == NULL && !eof) {
+                /* Wait for the whole header line */
+            } else {
+                if (have >= 5 && memcmp(buf, "str1,", 5) == 0) {
+                    size_t skip = nl != NULL ? (size_t) (nl + 1 - buf) : have;
+                    memmove(buf, buf + skip, have - skip);
+                    have -= skip;
+                }
+                header = 0;
+            }
+        }
+        if (have == 0 && eof) {
+            break;
+        }
+
+        size_t complete = header ? 0 : split_records(options->format, buf, have, eof, cuts, threads);
+        if (complete == 0) {
+            char * grown = have == capacity ? realloc(buf, capacity * 2) : buf;
+            if (grown == NULL) {
+                fprintf(stderr, "Out of memory.\n");
+                status = -1;
+                break;
+            }
+            if (have == capacity) {
+                capacity *= 2;
+            }
+            buf = grown;
+            continue;
+        }
+
+        for (int i = 0; i < threads; i++) {
+            size_t start = i == 0 ? 0 : cuts[i - 1];
+            tasks[i].options = options;
+            tasks[i].text = buf + start;
+            tasks[i].length = cuts[i] - start;
+            tasks[i].count = 0;
+            tasks[i].failed_at = 0;
+            tasks[i].no_memory = 0;
+        }
+        parallel_run(threads, import_worker, tasks, sizeof(import_task));
+
+        for (int i = 0; status == 0 && i < threads; i++) {
+            if (tasks[i].no_memory) {
+                fprintf(stderr, "Out of memory.\n");
+                status = -1;
+            } else if (tasks[i].failed_at != 0) {
+                fprintf(stderr, "Invalid %s at record %lld.\n", name,
+                        (long long) (*count + tasks[i].failed_at));
+                status = -1;
+            } else if (tasks[i].count > 0 && sink(sink_arg, tasks[i].records, tasks[i].count) != 0) {
+                fprintf(stderr, "Could not write imported records.\n");
+                status = -1;
+            } else {
+                *count += tasks[i].count;
+            }
+        }
+
+        memmove(buf, buf + complete, have - complete);
+        have -= complete;
+    }
+
+    for (int i = 0; tasks != NULL && i < threads; i++) {
+        free(tasks[i].records);
+    }
+    free(tasks);
+    free(cuts);
+    free(buf);
+    return status;
+}
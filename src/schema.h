@@ -0,0 +1,118 @@
+/*
+ * schema.h
+ *
+ * This header file defines record schemas: descriptions of fixed-size
+ * record layouts other than struct record, so that copyrecords can copy,
+ * decode and filter archives from other feeds (--schema, --where).
+ *
+ * A schema is a small text file in src/schemas, one field per line:
+ *     schema events
+ *     string source 16     (a 16-byte string)
+ *     int id 2             (two 32-bit integers)
+ *     double value 4       (four doubles)
+ * Fields are stored back to back in the order given, with no padding, in
+ * the machine's byte order. default.schema describes struct record.
+ *
+ * Key Features:
+ * 1. Generated: mkschema turns the schema files into C at build time
+ *    (schema_table.h); each schema gets a decoder with its string offsets
+ *    and widths as constants, so nothing is interpreted per field at run time
+ * 2. Filters: "field[k] op value" on an int or double field (or
+ *    "field == text" on a string) is resolved to an offset and a comparison
+ *    once, then applied by a loop specialised for the type and the operator
+ * 3. Checksums: Archives of any schema have .crc sidecars like the default
+ *    one, recording the schema's record size
+ */
+
+#ifndef SCHEMA_H
+#define SCHEMA_H
+
+#include <stdio.h>         /* For FILE */
+#include <string.h>        /* For memchr() */
+#include "checksum.h"      /* For checksum_table */
+#include "decode_lib.h"    /* For decode_ctx and decode_apply() */
+
+/* What a field holds */
+typedef enum schema_type {
+    SCHEMA_STRING,   /* Text, NUL-padded; one element of width bytes */
+    SCHEMA_INT,      /* 32-bit signed integers */
+    SCHEMA_DOUBLE    /* Doubles */
+} schema_type;
+
+/* One field of a schema */
+typedef struct schema_field {
+    const char * name;
+    schema_type type;
+    size_t offset;      /* Byte offset in the record */
+    size_t width;       /* Bytes per element */
+    size_t count;       /* Elements (1 for a string) */
+} schema_field;
+
+/* Decodes the strings of count records in place */
+typedef void (*schema_decoder)(const decode_ctx * ctx, char * records, size_t count, int shift);
+
+/* A record layout */
+typedef struct record_schema {
+    const char * name;
+    size_t record_size;
+    const schema_field * fields;
+    size_t num_fields;
+    schema_decoder decode;   /* Generated for this schema */
+} record_schema;
+
+/* Comparison of a filter */
+typedef enum schema_op {
+    SCHEMA_LT, SCHEMA_LE, SCHEMA_GT, SCHEMA_GE, SCHEMA_EQ, SCHEMA_NE
+} schema_op;
+
+/* A parsed --where condition */
+typedef struct schema_filter {
+    schema_type type;    /* Type of the field compared */
+    size_t offset;       /* Offset of the element compared */
+    size_t width;        /* Width of a string field */
+    schema_op op;        /* Only SCHEMA_EQ and SCHEMA_NE for strings */
+    double value;        /* Compared with ints (exactly) and doubles */
+    const char * text;   /* Compared with a string field */
+    size_t text_length;
+} schema_filter;
+
+/* How to copy an archive of a schema */
+typedef struct schema_copy_options {
+    const decode_ctx * ctx;            /* Used to decode strings */
+    int shift;                         /* Decoding shift (0 for none) */
+    int reverse;                       /* Non-zero to write the records in reverse order */
+    const schema_filter * filter;      /* Records to keep, or NULL for all */
+    const checksum_table * verify;     /* Input checksums to check, or NULL */
+    checksum_writer * sums;            /* Receives the output's checksums, or NULL */
+} schema_copy_options;
+
+/*
+ * Decodes a string field up to its first NUL; with a constant width (as in
+ * the generated decoders) the compiler specialises it per field
+ */
+static inline void schema_decode_string(const decode_ctx * ctx, char * field, size_t width, int shift) {
+    const char * nul = memchr(field, '\0', width);
+    decode_apply(ctx, field, nul != NULL ? (size_t) (nul - field) : width, shift);
+}
+
+/* Returns the schema called name, or NULL if there is none */
+const record_schema * schema_find(const char * name);
+
+/* Lists the schemas, one "name (size bytes)" per line */
+void schema_list(FILE * out);
+
+/* Parses "field op value" or "field[k] op value" for schema; returns 0, or -1 if invalid */
+int schema_filter_parse(const record_schema * schema, const char * text, schema_filter * filter);
+
+/* Moves the records of a block that pass filter to its front; returns how many there are */
+size_t schema_filter_apply(const schema_filter * filter, size_t record_size, char * records, size_t count);
+
+/*
+ * Copies num_records records of schema from in to out, filtering,
+ * decoding and reversing them as options say. Returns 0 on success, -1 on
+ * an I/O, checksum or memory error (a message is printed to stderr).
+ */
+int schema_copy(FILE * in, FILE * out, int64_t num_records, const record_schema * schema,
+                const schema_copy_options * options);
+
+#endif
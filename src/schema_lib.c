@@ -0,0 +1,307 @@
+/*
+ * schema_lib.c
+ *
+ * This file implements the record schemas declared in schema.h. The
+ * schemas themselves, with their field tables and decoders, come from
+ * schema_table.h, which mkschema generates from src/schemas at build time.
+ *
+ * Key Implementation Details:
+ * 1. Filters: A condition is parsed once into a field offset and a
+ *    comparison; schema_filter_apply() then runs one of a set of loops,
+ *    one per field type and operator, each reading the value at a fixed
+ *    offset with memcpy() (fields are packed, so they may be unaligned)
+ * 2. Copying: Records are read a checksum block at a time; each block is
+ *    checked against the input's sidecar before anything else, then
+ *    filtered, decoded by the schema's generated decoder, reversed for -r
+ *    and written, with the output's checksums taken from what is written
+ */
+
+#define _POSIX_C_SOURCE 200809L  /* For fseeko() */
+
+#include "schema.h"
+#include <ctype.h>      /* For isspace() */
+#include <stdlib.h>     /* For malloc() and strtod() */
+#include <string.h>     /* For strcmp() and memcpy() */
+#include <stdint.h>     /* For int32_t */
+#include <sys/types.h>  /* For off_t */
+#include "schema_table.h"
+
+/* Returns the schema called name, or NULL if there is none */
+const record_schema * schema_find(const char * name) {
+    for (size_t i = 0; i < SCHEMA_COUNT; i++) {
+        if (strcmp(schema_table[i].name, name) == 0) {
+            return &schema_table[i];
+        }
+    }
+    return NULL;
+}
+
+/* Lists the schemas, one "name (size bytes)" per line */
+void schema_list(FILE * out) {
+    for (size_t i = 0; i < SCHEMA_COUNT; i++) {
+        fprintf(out, "  %s (%zu bytes)\n", schema_table[i].name, schema_table[i].record_size);
+    }
+}
+
+/* Returns p moved past any whitespace */
+static const char * skip_space(const char * p) {
+    while (isspace((unsigned char) *p)) {
+        p++;
+    }
+    return p;
+}
+
+/* Length of the first length bytes of p without trailing whitespace */
+static size_t trim_length(const char * p, size_t length) {
+    while (length > 0 && isspace((unsigned char) p[length - 1])) {
+        length--;
+    }
+    return length;
+}
+
+/*
+ * schema_filter_parse
+ *
+ * Purpose: Turns a --where condition into a schema_filter
+ *
+ * Parameters:
+ *   schema - Schema of the records to filter
+ *   text   - "field op value" or "field[k] op value", op being one of
+ *            < <= > >= == !=; a string field takes "field == text" or
+ *            "field != text". Whitespace around the field, index,
+ *            operator and value is ignored. The filter points into text,
+ *            which must outlive it
+ *   filter - Receives the parsed condition
+ *
+ * Returns:
+ *   0 on success, -1 if the field, index, operator or value is not valid
+ *   for the schema (a message is printed to stderr)
+ */
+int schema_filter_parse(const record_schema * schema, const char * text, schema_filter * filter) {
+    static const struct { const char * symbol; schema_op op; } ops[] = {
+        { "<=", SCHEMA_LE }, { ">=", SCHEMA_GE }, { "==", SCHEMA_EQ },
+        { "!=", SCHEMA_NE }, { "<", SCHEMA_LT }, { ">", SCHEMA_GT }
+    };
+    text = skip_space(text);
+    size_t name_length = strcspn(text, "[<>=! \t\n\v\f\r");
+    const char * p = skip_space(text + name_length);
+    const schema_field * field = NULL;
+    for (size_t i = 0; i < schema->num_fields; i++) {
+        if (strlen(schema->fields[i].name) == name_length &&
+            strncmp(schema->fields[i].name, text, name_length) == 0) {
+            field = &schema->fields[i];
+        }
+    }
+    if (field == NULL) {
+        fprintf(stderr, "Schema %s has no field %.*s\n", schema->name, (int) name_length, text);
+        return -1;
+    }
+
+    size_t index = 0;
+    if (*p == '[') {
+        char * end = NULL;
+        index = (size_t) strtoul(p + 1, &end, 10);
+        if (end == p + 1 || *skip_space(end) != ']' || index >= field->count) {
+            fprintf(stderr, "Field %s has elements 0-%zu\n", field->name, field->count - 1);
+            return -1;
+        }
+        p = skip_space(skip_space(end) + 1);
+    }
+    else if (field->count > 1) {
+        fprintf(stderr, "Field %s has %zu elements; say which, as %s[k]\n", field->name, field->count, field->name);
+        return -1;
+    }
+
+    size_t o = 0;
+    while (o < sizeof(ops) / sizeof(ops[0]) && strncmp(p, ops[o].symbol, strlen(ops[o].symbol)) != 0) {
+        o++;
+    }
+    if (o == sizeof(ops) / sizeof(ops[0])) {
+        fprintf(stderr, "Cannot filter with %s (use <, <=, >, >=, == or !=)\n", text);
+        return -1;
+    }
+    p = skip_space(p + strlen(ops[o].symbol));
+
+    filter->type = field->type;
+    filter->offset = field->offset + index * field->width;
+    filter->width = field->width;
+    filter->op = ops[o].op;
+    filter->value = 0;
+    filter->text = NULL;
+    filter->text_length = 0;
+
+    if (field->type == SCHEMA_STRING) {
+        if (filter->op != SCHEMA_EQ && filter->op != SCHEMA_NE) {
+            fprintf(stderr, "String field %s can only be compared with == or !=\n", field->name);
+            return -1;
+        }
+        filter->text = p;
+        filter->text_length = trim_length(p, strlen(p));
+        return 0;
+    }
+    char * end = NULL;
+    filter->value = strtod(p, &end);
+    if (end == p || *skip_space(end) != '\0') {
+        fprintf(stderr, "Cannot compare %s with %s\n", field->name, p);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * A filter loop for one type and operator: each record whose value at
+ * offset compares true is moved down to the next kept position
+ */
+#define SCHEMA_FILTER_LOOP(ctype, cmp)                                          \
+    for (size_t i = 0; i < count; i++) {                                        \
+        ctype v;                                                                \
+        memcpy(&v, records + i * record_size + offset, sizeof(v));              \
+        if ((double) v cmp value) {                                             \
+            if (kept != i) {                                                    \
+                memcpy(records + kept * record_size, records + i * record_size, \
+                       record_size);                                            \
+            }                                                                   \
+            kept++;                                                             \
+        }                                                                       \
+    }
+
+/* The loops of one type, one per operator */
+#define SCHEMA_FILTER_OPS(ctype)                                                \
+    switch (filter->op) {                                                       \
+    case SCHEMA_LT: SCHEMA_FILTER_LOOP(ctype, <)  break;                        \
+    case SCHEMA_LE: SCHEMA_FILTER_LOOP(ctype, <=) break;                        \
+    case SCHEMA_GT: SCHEMA_FILTER_LOOP(ctype, >)  break;                        \
+    case SCHEMA_GE: SCHEMA_FILTER_LOOP(ctype, >=) break;                        \
+    case SCHEMA_EQ: SCHEMA_FILTER_LOOP(ctype, ==) break;                        \
+    case SCHEMA_NE: SCHEMA_FILTER_LOOP(ctype, !=) break;                        \
+    }
+
+/* Returns non-zero if a string field holds exactly the filter's text */
+static int schema_string_equal(const schema_filter * filter, const char * field) {
+    if (filter->text_length > filter->width) {
+        return 0;
+    }
+    return memcmp(field, filter->text, filter->text_length) == 0 &&
+           (filter->text_length == filter->width || field[filter->text_length] == '\0');
+}
+
+/*
+ * schema_filter_apply
+ *
+ * Purpose: Keeps the records of a block that pass a filter
+ *
+ * Parameters:
+ *   filter      - Parsed condition
+ *   record_size - Size of one record
+ *   records     - The block, changed in place
+ *   count       - Records in the block
+ *
+ * Returns:
+ *   The number of records kept, which now fill the front of the block in
+ *   their original order
+ */
+size_t schema_filter_apply(const schema_filter * filter, size_t record_size, char * records, size_t count) {
+    size_t kept = 0;
+    size_t offset = filter->offset;
+    double value = filter->value;
+
+    switch (filter->type) {
+    case SCHEMA_INT:
+        SCHEMA_FILTER_OPS(int32_t)
+        break;
+    case SCHEMA_DOUBLE:
+        SCHEMA_FILTER_OPS(double)
+        break;
+    case SCHEMA_STRING: {
+        int want = filter->op == SCHEMA_EQ;
+        for (size_t i = 0; i < count; i++) {
+            if (schema_string_equal(filter, records + i * record_size + offset) == want) {
+                if (kept != i) {
+                    memcpy(records + kept * record_size, records + i * record_size, record_size);
+                }
+                kept++;
+            }
+        }
+        break;
+    }
+    }
+    return kept;
+}
+
+/* Reverses the order of count records */
+static void schema_reverse(char * records, size_t record_size, size_t count, char * swap) {
+    for (size_t j = 0; j < count / 2; j++) {
+        char * a = records + j * record_size;
+        char * b = records + (count - 1 - j) * record_size;
+        memcpy(swap, a, record_size);
+        memcpy(a, b, record_size);
+        memcpy(b, swap, record_size);
+    }
+}
+
+/*
+ * schema_copy
+ *
+ * Purpose: Copies an archive of any schema, a checksum block at a time
+ *
+ * Parameters:
+ *   in          - Input archive
+ *   out         - Output archive
+ *   num_records - Records in the input
+ *   schema      - Layout of the records
+ *   options     - Decoding shift, -r, filter and checksums
+ *
+ * Returns:
+ *   0 on success, -1 on failure
+ *
+ * How it works:
+ *   For -r the blocks are read from the end of the input and each one is
+ *   reversed after filtering, so the output is the kept records in reverse
+ *   order, just as for the default layout
+ */
+int schema_copy(FILE * in, FILE * out, int64_t num_records, const record_schema * schema,
+                const schema_copy_options * options) {
+    size_t size = schema->record_size;
+    char * batch = malloc(size * (CHECKSUM_BLOCK_RECORDS + 1));
+    if (batch == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        return -1;
+    }
+    char * swap = batch + size * CHECKSUM_BLOCK_RECORDS;
+    int64_t num_blocks = (num_records + CHECKSUM_BLOCK_RECORDS - 1) / CHECKSUM_BLOCK_RECORDS;
+    int status = 0;
+
+    for (int64_t done = 0; status == 0 && done < num_blocks; done++) {
+        int64_t block = options->reverse ? num_blocks - 1 - done : done;
+        int64_t first = block * CHECKSUM_BLOCK_RECORDS;
+        size_t count = num_records - first < CHECKSUM_BLOCK_RECORDS ? (size_t) (num_records - first) : CHECKSUM_BLOCK_RECORDS;
+
+        if (fseeko(in, (off_t) first * (off_t) size, SEEK_SET) != 0 || fread(batch, size, count, in) != count) {
+            fprintf(stderr, "Could not read records\n");
+            status = -1;
+            break;
+        }
+        if (options->verify != NULL && !checksum_block_ok(options->verify, block, batch, count)) {
+            fprintf(stderr, "Checksum mismatch in block %lld (records %lld-%lld)\n",
+                    (long long) block, (long long) first, (long long) (first + count - 1));
+            status = -1;
+            break;
+        }
+        if (options->filter != NULL) {
+            count = schema_filter_apply(options->filter, size, batch, count);
+        }
+        if (options->shift != 0) {
+            schema->decode(options->ctx, batch, count, options->shift);
+        }
+        if (options->reverse) {
+            schema_reverse(batch, size, count, swap);
+        }
+        if (fwrite(batch, size, count, out) != count ||
+            (options->sums != NULL && checksum_writer_add(options->sums, batch, count) != 0)) {
+            fprintf(stderr, "Could not write records\n");
+            status = -1;
+        }
+    }
+    free(batch);
+    return status;
+}
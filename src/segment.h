@@ -0,0 +1,59 @@
+/*
+ * segment.h
+ *
+ * This header file defines the interface for segmentation mode (decode
+ * --segment), for streams whose shift changes part way through: captures
+ * that concatenate texts encoded with different shifts, or that mix
+ * plaintext with ciphertext.
+ *
+ * A window of the last `window` bytes slides over the input with a letter
+ * histogram that is updated in O(1) per byte (the byte entering is added,
+ * the byte leaving removed). Every `stride` bytes the window is scored and
+ * labelled with its best (language, shift), or "none" if nothing fits.
+ * When a new label holds for `confirm` scorings in a row, a segment
+ * boundary is placed where the split between the old and new label
+ * explains the text best, and each segment is decoded with its own shift.
+ *
+ * Key Features:
+ * 1. Single pass: Every byte is read, counted and written once; only the
+ *    last few windows are kept in memory, so input size does not matter
+ * 2. Boundary placement: Within the window where the change was seen, the
+ *    boundary is put at the split that maximises the likelihood of the
+ *    letters before it under the old label plus those after it under the
+ *    new one (a prefix-sum argmax, linear in the window)
+ * 3. Segments shorter than about a window are merged into their
+ *    neighbours; an input shorter than a window is one segment
+ */
+
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include "decode_lib.h"   /* For decode_ctx */
+#include <stdio.h>        /* For FILE */
+#include <stdint.h>       /* For uint64_t */
+
+/* Defaults for decode --segment */
+#define SEGMENT_WINDOW 512
+#define SEGMENT_STRIDE 64
+
+/* How to segment */
+typedef struct segment_options {
+    size_t window;                 /* Bytes in the sliding window */
+    size_t stride;                 /* Bytes between scorings (at most window) */
+    int confirm;                   /* Scorings a new label must hold for; 0 for window / (2 * stride) */
+    decode_ctx * const * ctxs;     /* Languages to try */
+    int languages;
+} segment_options;
+
+/* Called once per segment, in order: bytes [start, end) have the shift and language given (-1 if none fits) */
+typedef void (*segment_report)(uint64_t start, uint64_t end, int shift, int language, void * arg);
+
+/*
+ * Decodes in segment by segment to out (NULL to only find the segments),
+ * calling report (if not NULL) for each segment. Returns 0 on success, -1
+ * on an I/O or memory error (a message is printed to stderr).
+ */
+int decode_segments(FILE * in, FILE * out, const segment_options * options,
+                    segment_report report, void * report_arg);
+
+#endif
@@ -0,0 +1,317 @@
+/*
+ * segment_lib.c
+ *
+ * This file implements segmentation mode, declared in segment.h.
+ *
+ * Key Implementation Details:
+ * 1. Labels: A window's label is language * 26 + shift from
+ *    decode_best_language(), or -1 if no language fits
+ * 2. Buffer: Holds the input from the oldest byte still needed (the start
+ *    of the window, or the first byte not yet written) to the newest; older
+ *    bytes are dropped before each read, so memory is a few windows plus
+ *    one read chunk
+ * 3. Output: Bytes are written once no later boundary can fall before
+ *    them, decoded through a scratch buffer so the window's bytes stay as
+ *    they were read
+ * 4. Candidates: A label different from the current one becomes the
+ *    candidate; it is confirmed after `confirm` scorings in a row (plus a
+ *    window's worth for "none"), and any other label in between replaces it
+ */
+
+#include "segment.h"
+#include "frequency_table.h"  /* For freq_hist */
+#include <stdlib.h>           /* For memory management */
+#include <string.h>           /* For memcpy() and memmove() */
+#include <math.h>             /* For log() */
+
+/* Bytes read at a time */
+#define SEGMENT_CHUNK (1 << 20)
+
+/* State of one pass */
+typedef struct seg_state {
+    const segment_options * options;
+    int confirm;                  /* Scorings a new label must hold for */
+    FILE * out;
+    segment_report report;
+    void * report_arg;
+    unsigned char * buffer;       /* Input bytes [base, pos) */
+    size_t capacity;
+    char * scratch;               /* Decoded bytes on their way out */
+    uint64_t base;                /* Stream offset of buffer[0] */
+    uint64_t pos;                 /* Bytes counted so far (the end of the window) */
+    uint64_t flushed;             /* Bytes written so far */
+    freq_hist hist;               /* Letters in [pos - window, pos) */
+    int have_label;               /* Non-zero once the first window was scored */
+    int label;                    /* Label of the current segment */
+    uint64_t seg_start;           /* Where the current segment began */
+    int cand;                     /* Candidate label */
+    int cand_count;               /* Scorings it has held for (0 if none) */
+    uint64_t cand_first;          /* Window end when it was first seen */
+    int failed;
+} seg_state;
+
+/* Letter index of a byte, or 26 or more for anything else (as in freq_hist_update) */
+static unsigned int letter_of(unsigned char c) {
+    return (unsigned int) ((c | 0x20) - 'a');
+}
+
+static int label_shift(int label) {
+    return label < 0 ? 0 : label % 26;
+}
+
+static int label_language(int label) {
+    return label < 0 ? -1 : label / 26;
+}
+
+/* Labels the current window */
+static int score_window(const seg_state * st) {
+    int language;
+    int shift = decode_best_language(st->options->ctxs, st->options->languages, &st->hist, &language);
+    return language < 0 ? -1 : language * 26 + shift;
+}
+
+/* Share of letters among the bytes of text, and of anything that fits no label */
+#define TEXT_LETTERS 0.8
+#define OTHER_LETTERS 0.5
+
+/*
+ * label_logs
+ *
+ * Purpose: Log-probability of each observed byte class under a label
+ * (logs[0..25] for the letters, logs[26] for any other byte)
+ *
+ * How it works:
+ *   Under a language label a letter is shifted back and looked up in the
+ *   language's frequencies, and text is assumed to be TEXT_LETTERS
+ *   letters. "None" gives every letter the same probability and fewer
+ *   letters overall, so a run of digits or punctuation counts as evidence
+ *   for it. Between two language labels the non-letter terms cancel.
+ */
+static void label_logs(const seg_state * st, int label, double logs[27]) {
+    if (label < 0) {
+        for (int c = 0; c < 26; c++) {
+            logs[c] = log(OTHER_LETTERS / 26);
+        }
+        logs[26] = log(1 - OTHER_LETTERS);
+        return;
+    }
+    const double * expected = decode_ctx_expected(st->options->ctxs[label_language(label)]);
+    int shift = label_shift(label);
+    for (int c = 0; c < 26; c++) {
+        logs[c] = log(TEXT_LETTERS * expected[(c - shift + 26) % 26]);
+    }
+    logs[26] = log(1 - TEXT_LETTERS);
+}
+
+/*
+ * write_range
+ *
+ * Purpose: Decodes bytes [from, to) with a label's shift and writes them
+ */
+static void write_range(seg_state * st, uint64_t from, uint64_t to, int label) {
+    while (st->out != NULL && from < to && !st->failed) {
+        size_t n = to - from < SEGMENT_CHUNK ? (size_t) (to - from) : SEGMENT_CHUNK;
+        memcpy(st->scratch, st->buffer + (from - st->base), n);
+        decode_apply(st->options->ctxs[0], st->scratch, n, to_decode(label_shift(label)));
+        if (fwrite(st->scratch, 1, n, st->out) != n) {
+            fprintf(stderr, "Could not write decoded text\n");
+            st->failed = 1;
+        }
+        from += n;
+    }
+}
+
+/* Ends the current segment at boundary, writing and reporting it */
+static void end_segment(seg_state * st, uint64_t boundary) {
+    write_range(st, st->flushed, boundary, st->label);
+    st->flushed = boundary;
+    if (boundary > st->seg_start && st->report != NULL) {
+        st->report(st->seg_start, boundary, label_shift(st->label),
+                   label_language(st->label), st->report_arg);
+    }
+    st->seg_start = boundary;
+}
+
+/*
+ * place_boundary
+ *
+ * Purpose: Finds where the confirmed candidate took over
+ *
+ * How it works:
+ *   The change happened within the window that first showed the
+ *   candidate. For every split b of that window the likelihood of the text
+ *   is (old label before b) + (new label from b on), which differs from a
+ *   constant by the running sum of log P_old - log P_new over the bytes
+ *   before b. The boundary is the last b where that sum is largest, so
+ *   spaces between two texts go with the old segment.
+ */
+static uint64_t place_boundary(const seg_state * st) {
+    uint64_t lo = st->cand_first >= st->options->window ? st->cand_first - st->options->window : 0;
+    if (lo < st->seg_start) {
+        lo = st->seg_start;
+    }
+    if (lo < st->flushed) {
+        lo = st->flushed;
+    }
+    double old_logs[27];
+    double new_logs[27];
+    label_logs(st, st->label, old_logs);
+    label_logs(st, st->cand, new_logs);
+
+    uint64_t best = lo;
+    double sum = 0;
+    double best_sum = 0;
+    for (uint64_t i = lo; i < st->cand_first; i++) {
+        unsigned int c = letter_of(st->buffer[i - st->base]);
+        if (c > 26) {
+            c = 26;
+        }
+        sum += old_logs[c] - new_logs[c];
+        if (sum >= best_sum) {
+            best_sum = sum;
+            best = i + 1;
+        }
+    }
+    return best;
+}
+
+/* Handles the label of the window ending at pos */
+static void observe(seg_state * st, int label) {
+    if (!st->have_label) {
+        st->have_label = 1;
+        st->label = label;
+        return;
+    }
+    if (label == st->label) {
+        st->cand_count = 0;
+        return;
+    }
+    if (st->cand_count == 0 || label != st->cand) {
+        st->cand = label;
+        st->cand_count = 0;
+        st->cand_first = st->pos;
+    }
+    /*
+     * Windows straddling a boundary often fit no label at all, so "none"
+     * must also outlast a whole window before it becomes a segment
+     */
+    int needed = st->confirm;
+    if (label < 0) {
+        needed += (int) (st->options->window / st->options->stride);
+    }
+    if (++st->cand_count >= needed) {
+        end_segment(st, place_boundary(st));
+        st->label = st->cand;
+        st->cand_count = 0;
+    }
+}
+
+/* Counts buffered bytes [pos, pos + n) into the window, scoring every stride */
+static void slide(seg_state * st, size_t n) {
+    size_t window = st->options->window;
+    size_t stride = st->options->stride;
+    for (size_t k = 0; k < n && !st->failed; k++) {
+        unsigned int c = letter_of(st->buffer[st->pos - st->base]);
+        if (c < 26) {
+            st->hist.counts[c]++;
+            st->hist.letters++;
+        }
+        if (st->pos >= window) {
+            unsigned int old = letter_of(st->buffer[st->pos - window - st->base]);
+            if (old < 26) {
+                st->hist.counts[old]--;
+                st->hist.letters--;
+            }
+        }
+        st->pos++;
+        if (st->pos >= window && st->pos % stride == 0) {
+            observe(st, score_window(st));
+        }
+    }
+}
+
+/*
+ * decode_segments
+ *
+ * Purpose: Runs segmentation mode over a whole stream
+ *
+ * How it works:
+ * 1. Drops buffered bytes that are both written and out of the window,
+ *    then reads the next chunk after the rest
+ * 2. Slides the window over the new bytes (scoring and placing boundaries)
+ * 3. Writes everything no future boundary can precede: up to a window
+ *    before the candidate's first sighting, or a window before pos
+ * 4. At the end of input, writes the rest as the last segment
+ */
+int decode_segments(FILE * in, FILE * out, const segment_options * options,
+                    segment_report report, void * report_arg) {
+    seg_state st;
+    memset(&st, 0, sizeof(st));
+    st.options = options;
+    st.confirm = options->confirm > 0 ? options->confirm : (int) (options->window / (2 * options->stride));
+    if (st.confirm < 1) {
+        st.confirm = 1;
+    }
+    st.out = out;
+    st.report = report;
+    st.report_arg = report_arg;
+    st.capacity = options->window + SEGMENT_CHUNK;
+    st.buffer = malloc(st.capacity);
+    st.scratch = malloc(SEGMENT_CHUNK);
+    if (st.buffer == NULL || st.scratch == NULL) {
+        free(st.buffer);
+        free(st.scratch);
+        fprintf(stderr, "Out of memory.\n");
+        return -1;
+    }
+
+    while (!st.failed) {
+        uint64_t keep = st.pos >= options->window ? st.pos - options->window : 0;
+        if (st.flushed < keep) {
+            keep = st.flushed;
+        }
+        memmove(st.buffer, st.buffer + (keep - st.base), (size_t) (st.pos - keep));
+        st.base = keep;
+        size_t held = (size_t) (st.pos - st.base);
+        if (held + SEGMENT_CHUNK > st.capacity) {
+            unsigned char * bigger = realloc(st.buffer, 2 * held + SEGMENT_CHUNK);
+            if (bigger == NULL) {
+                fprintf(stderr, "Out of memory.\n");
+                st.failed = 1;
+                break;
+            }
+            st.buffer = bigger;
+            st.capacity = 2 * held + SEGMENT_CHUNK;
+        }
+
+        size_t got = fread(st.buffer + held, 1, SEGMENT_CHUNK, in);
+        if (got == 0) {
+            if (ferror(in)) {
+                fprintf(stderr, "Could not read input\n");
+                st.failed = 1;
+            }
+            break;
+        }
+        slide(&st, got);
+
+        if (st.have_label) {
+            uint64_t from = st.cand_count > 0 ? st.cand_first : st.pos;
+            uint64_t limit = from >= options->window ? from - options->window : 0;
+            if (limit > st.flushed) {
+                write_range(&st, st.flushed, limit, st.label);
+                st.flushed = limit;
+            }
+        }
+    }
+
+    if (!st.failed && st.pos > 0) {
+        if (!st.have_label) {
+            /* Shorter than a window (or than its first scoring): one segment */
+            observe(&st, score_window(&st));
+        }
+        end_segment(&st, st.pos);
+    }
+    free(st.buffer);
+    free(st.scratch);
+    return st.failed ? -1 : 0;
+}
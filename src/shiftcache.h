@@ -0,0 +1,79 @@
+/*
+ * shiftcache.h
+ *
+ * This header file defines the interface for the shift analysis cache, an
+ * on-disk store of results that decode and copyrecords -D would otherwise
+ * recompute every time they see the same text.
+ *
+ * An entry holds everything the programs print about a text: the detected
+ * encoding shift, the chi-squared value of all 26 shifts and the letter
+ * histogram. Entries are found by a 64-bit key, which is either:
+ * - A content key: an xxHash64 of the text itself, or
+ * - A file key: a hash of a regular file's identity (device, inode, size,
+ *   modification and change times), which can be checked without reading
+ *   the file at all
+ * Both are seeded with a hash of the expected letter frequencies, so a
+ * result is only reused for the same language profiles.
+ *
+ * Cache Location and Size:
+ * - $CAESAR_CACHE_DIR, else $XDG_CACHE_HOME/caesar, else ~/.cache/caesar
+ * - At most $CAESAR_CACHE_SIZE bytes (default SHIFT_CACHE_DEFAULT_SIZE);
+ *   the least recently used entries are removed first. A size of 0
+ *   disables the cache
+ *
+ * Key Features:
+ * 1. Safe to share: Entries are written to a temporary file and renamed
+ *    into place, so other processes see a whole entry or none
+ * 2. Self-checking: Each entry carries its key and a CRC32C; a damaged or
+ *    mismatched entry is a miss
+ * 3. Best effort: Any cache error is a miss, never a failure of the program
+ */
+
+#ifndef SHIFTCACHE_H
+#define SHIFTCACHE_H
+
+#include "decode_lib.h"       /* For decode_ctx */
+#include "frequency_table.h"  /* For freq_hist */
+#include <stddef.h>           /* For size_t */
+#include <stdint.h>           /* For fixed-width integers */
+
+/* Cache size limit in bytes when $CAESAR_CACHE_SIZE is not set */
+#define SHIFT_CACHE_DEFAULT_SIZE (4 * 1024 * 1024)
+
+/* Result of analysing one text */
+typedef struct shift_analysis {
+    int shift;            /* Most likely encoding shift */
+    int language;         /* Index of the best language, or -1 if none fits */
+    double scores[26];    /* Chi-squared value of every shift (best language) */
+    freq_hist hist;       /* Letter counts of the text */
+} shift_analysis;
+
+/* xxHash64 of length bytes of data */
+uint64_t cache_hash64(const void * data, size_t length, uint64_t seed);
+
+/* Key seed for a set of language contexts (a hash of their expected frequencies) */
+uint64_t shift_cache_seed(decode_ctx * const * ctxs, int count);
+
+/* Stores the file key of an open regular file in *key; returns 0, or -1 if fd is not a regular file */
+int shift_cache_file_key(int fd, uint64_t seed, uint64_t * key);
+
+/* Looks up a key; returns 0 and fills *analysis on a hit, -1 on a miss */
+int shift_cache_lookup(uint64_t key, shift_analysis * analysis);
+
+/* Stores an analysis under a key and trims the cache to its size limit */
+void shift_cache_store(uint64_t key, const shift_analysis * analysis);
+
+/* Analyses length bytes of text against count languages without the cache */
+void shift_analyse(decode_ctx * const * ctxs, int count, const char * text, size_t length,
+                   shift_analysis * analysis);
+
+/*
+ * Analyses text through the cache: the content key is looked up and, on a
+ * miss, the result is computed and stored under it and under *file_key
+ * (if file_key is not NULL). Returns 1 if the result came from the cache,
+ * 0 if it was computed.
+ */
+int shift_analyse_cached(decode_ctx * const * ctxs, int count, const char * text, size_t length,
+                         const uint64_t * file_key, shift_analysis * analysis);
+
+#endif
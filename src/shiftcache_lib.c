@@ -0,0 +1,518 @@
+/*
+ * shiftcache_lib.c
+ *
+ * This file implements the shift analysis cache declared in shiftcache.h.
+ *
+ * Key Implementation Details:
+ * 1. Hashing: xxHash64 (four 64-bit lanes over 32-byte stripes, then an
+ *    avalanche), fast enough that hashing costs less than the analysis
+ * 2. Entries: One small file per key, named by the key in hex, holding a
+ *    fixed-size cache_entry with a CRC32C
+ * 3. Atomic Updates: An entry is written to a mkstemp() file in the cache
+ *    directory and renamed over its final name. Readers open the name and
+ *    get either the old or the new file, both complete
+ * 4. LRU Eviction: A hit sets the entry's modification time to now; after
+ *    each store the directory is scanned and, if it is over its limit, the
+ *    entries with the oldest times are removed until it is 3/4 full.
+ *    Processes trimming at the same time may remove the same file, which
+ *    is harmless
+ * 5. Racy Files: A file whose status changed in the last couple of seconds
+ *    gets no file key, because a further write in the same timestamp tick
+ *    would not change its identity
+ */
+
+#define _GNU_SOURCE   /* For st_mtim, futimens() and fstatat() */
+
+#include "shiftcache.h"
+#include "crc32c.h"     /* For crc32c() */
+#include <stdio.h>      /* For snprintf() and rename() */
+#include <stdlib.h>     /* For getenv(), mkstemp() and qsort() */
+#include <string.h>     /* For string operations */
+#include <errno.h>      /* For errno */
+#include <time.h>       /* For time() */
+#include <fcntl.h>      /* For open() */
+#include <unistd.h>     /* For read(), write() and close() */
+#include <dirent.h>     /* For opendir() and readdir() */
+#include <sys/stat.h>   /* For fstat(), mkdir() and futimens() */
+
+#define CACHE_MAGIC "SHC1"
+#define CACHE_VERSION 2
+#define CACHE_SUFFIX ".sc"
+
+/* Temporary files older than this (seconds) were left by a dead writer */
+#define CACHE_STALE_TMP 60
+
+/* Files changed this recently (seconds) get no file key */
+#define CACHE_RACY_SECONDS 2
+
+/* xxHash64 primes */
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+/* Layout of an entry file */
+typedef struct cache_entry {
+    char magic[4];
+    uint32_t version;
+    uint64_t key;             /* Key the entry was stored under */
+    int32_t shift;
+    int32_t language;
+    double scores[26];
+    uint64_t counts[26];
+    uint64_t letters;
+    uint64_t bytes;
+    uint32_t crc;             /* CRC32C of everything above */
+    uint32_t reserved2;
+} cache_entry;
+
+/* A file seen while trimming the cache */
+typedef struct cache_file {
+    int64_t mtime;            /* Last use, in nanoseconds */
+    uint64_t size;            /* Space used on disk */
+    char name[32];
+} cache_file;
+
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t read64(const unsigned char * p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t read32(const unsigned char * p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * PRIME64_2;
+    acc = rotl64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t lane) {
+    acc ^= xxh_round(0, lane);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+/*
+ * cache_hash64
+ *
+ * Purpose: Hashes a buffer with xxHash64
+ *
+ * How it works:
+ * 1. Inputs of 32 bytes or more are consumed in 32-byte stripes by four
+ *    independent accumulators, which are then merged
+ * 2. The remaining 8-, 4- and 1-byte pieces are mixed in one at a time
+ * 3. A final avalanche spreads every input bit over the whole result
+ */
+uint64_t cache_hash64(const void * data, size_t length, uint64_t seed) {
+    const unsigned char * p = data;
+    const unsigned char * end = p + length;
+    uint64_t h;
+
+    if (length >= 32) {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        const unsigned char * limit = end - 32;
+        do {
+            v1 = xxh_round(v1, read64(p));
+            v2 = xxh_round(v2, read64(p + 8));
+            v3 = xxh_round(v3, read64(p + 16));
+            v4 = xxh_round(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+    h += (uint64_t) length;
+
+    while (end - p >= 8) {
+        h ^= xxh_round(0, read64(p));
+        h = rotl64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (end - p >= 4) {
+        h ^= (uint64_t) read32(p) * PRIME64_1;
+        h = rotl64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (uint64_t) *p * PRIME64_5;
+        h = rotl64(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t shift_cache_seed(decode_ctx * const * ctxs, int count) {
+    uint64_t seed = CACHE_VERSION;
+    for (int l = 0; l < count; l++) {
+        seed = cache_hash64(decode_ctx_expected(ctxs[l]), 26 * sizeof(double), seed);
+    }
+    return seed;
+}
+
+/*
+ * shift_cache_file_key
+ *
+ * Purpose: Derives a key from a regular file's identity, so that a file
+ * seen before can be recognised without reading it
+ *
+ * Returns:
+ *   0 with *key set, or -1 if fd is not a regular file or was changed too
+ *   recently for its identity to be trusted
+ */
+int shift_cache_file_key(int fd, uint64_t seed, uint64_t * key) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return -1;
+    }
+    time_t now = time(NULL);
+    if (st.st_mtim.tv_sec + CACHE_RACY_SECONDS >= now ||
+        st.st_ctim.tv_sec + CACHE_RACY_SECONDS >= now) {
+        return -1;
+    }
+
+    uint64_t identity[7];
+    identity[0] = (uint64_t) st.st_dev;
+    identity[1] = (uint64_t) st.st_ino;
+    identity[2] = (uint64_t) st.st_size;
+    identity[3] = (uint64_t) st.st_mtim.tv_sec;
+    identity[4] = (uint64_t) st.st_mtim.tv_nsec;
+    identity[5] = (uint64_t) st.st_ctim.tv_sec;
+    identity[6] = (uint64_t) st.st_ctim.tv_nsec;
+    /* A different seed keeps file keys apart from content keys */
+    *key = cache_hash64(identity, sizeof(identity), ~seed);
+    return 0;
+}
+
+/*
+ * cache_limit
+ *
+ * Purpose: Reads the size limit from $CAESAR_CACHE_SIZE (bytes, with an
+ * optional K, M or G suffix)
+ */
+static uint64_t cache_limit(void) {
+    const char * text = getenv("CAESAR_CACHE_SIZE");
+    if (text == NULL || *text == '\0') {
+        return SHIFT_CACHE_DEFAULT_SIZE;
+    }
+    char * end;
+    unsigned long long limit = strtoull(text, &end, 10);
+    if (end == text) {
+        return SHIFT_CACHE_DEFAULT_SIZE;
+    }
+    switch (*end) {
+        case 'G': case 'g': limit <<= 10; /* fall through */
+        case 'M': case 'm': limit <<= 10; /* fall through */
+        case 'K': case 'k': limit <<= 10; break;
+    }
+    return limit;
+}
+
+/*
+ * make_dirs
+ *
+ * Purpose: Creates a directory and any missing parents (like mkdir -p)
+ *
+ * Returns:
+ *   0 if the directory exists afterwards, -1 otherwise
+ */
+static int make_dirs(char * path) {
+    for (char * p = path + 1; *p != '\0'; p++) {
+        if (*p == '/') {
+            *p = '\0';
+            int failed = mkdir(path, 0700) != 0 && errno != EEXIST;
+            *p = '/';
+            if (failed) {
+                return -1;
+            }
+        }
+    }
+    if (mkdir(path, 0700) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * cache_dir
+ *
+ * Purpose: Finds (and creates) the cache directory
+ *
+ * Returns:
+ *   0 with the directory in path, or -1 if the cache is disabled or
+ *   cannot be created
+ */
+static int cache_dir(char * path, size_t size) {
+    if (cache_limit() == 0) {
+        return -1;
+    }
+    const char * dir = getenv("CAESAR_CACHE_DIR");
+    const char * base = getenv("XDG_CACHE_HOME");
+    const char * home = getenv("HOME");
+    int n;
+    if (dir != NULL && *dir != '\0') {
+        n = snprintf(path, size, "%s", dir);
+    } else if (base != NULL && *base == '/') {
+        n = snprintf(path, size, "%s/caesar", base);
+    } else if (home != NULL && *home != '\0') {
+        n = snprintf(path, size, "%s/.cache/caesar", home);
+    } else {
+        return -1;
+    }
+    if (n < 0 || (size_t) n >= size) {
+        return -1;
+    }
+    return make_dirs(path);
+}
+
+static uint32_t entry_crc(const cache_entry * entry) {
+    return crc32c(entry, offsetof(cache_entry, crc));
+}
+
+/*
+ * shift_cache_lookup
+ *
+ * Purpose: Reads the entry for a key
+ *
+ * How it works:
+ * 1. Opens the entry file named after the key and reads it whole
+ * 2. Checks the magic, version, key and CRC; anything wrong is a miss
+ * 3. Marks the entry as recently used by setting its times to now
+ *
+ * Returns:
+ *   0 on a hit (with *analysis filled in), -1 on a miss
+ */
+int shift_cache_lookup(uint64_t key, shift_analysis * analysis) {
+    char dir[4096];
+    char path[4096 + 32];
+    if (cache_dir(dir, sizeof(dir)) != 0) {
+        return -1;
+    }
+    snprintf(path, sizeof(path), "%s/%016llx" CACHE_SUFFIX, dir, (unsigned long long) key);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    cache_entry entry;
+    ssize_t got = read(fd, &entry, sizeof(entry));
+    if (got != (ssize_t) sizeof(entry) || memcmp(entry.magic, CACHE_MAGIC, 4) != 0 ||
+        entry.version != CACHE_VERSION || entry.key != key ||
+        entry.crc != entry_crc(&entry) || entry.shift < 0 || entry.shift > 25 ||
+        entry.language < -1 || entry.language >= DECODE_MAX_LANGUAGES) {
+        close(fd);
+        return -1;
+    }
+    futimens(fd, NULL);
+    close(fd);
+
+    analysis->shift = entry.shift;
+    analysis->language = entry.language;
+    memcpy(analysis->scores, entry.scores, sizeof(entry.scores));
+    memcpy(analysis->hist.counts, entry.counts, sizeof(entry.counts));
+    analysis->hist.letters = entry.letters;
+    analysis->hist.bytes = entry.bytes;
+    return 0;
+}
+
+static int compare_age(const void * a, const void * b) {
+    const cache_file * x = a;
+    const cache_file * y = b;
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+/*
+ * cache_trim
+ *
+ * Purpose: Keeps the cache directory under its size limit
+ *
+ * How it works:
+ * 1. Lists the entry files and temporary files left by dead writers, with
+ *    their last use time and the space they take on disk
+ * 2. If the total is over the limit, removes files oldest first until the
+ *    total is at most 3/4 of the limit, so that the next few stores do not
+ *    each have to trim again
+ */
+static void cache_trim(const char * dir_path, uint64_t limit) {
+    DIR * dir = opendir(dir_path);
+    if (dir == NULL) {
+        return;
+    }
+    int fd = dirfd(dir);
+    int64_t now = (int64_t) time(NULL);
+
+    cache_file * files = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    uint64_t total = 0;
+    struct dirent * item;
+    while ((item = readdir(dir)) != NULL) {
+        size_t len = strlen(item->d_name);
+        int is_entry = len > strlen(CACHE_SUFFIX) && len < sizeof(files->name) &&
+                       strcmp(item->d_name + len - strlen(CACHE_SUFFIX), CACHE_SUFFIX) == 0;
+        int is_tmp = strncmp(item->d_name, "tmp.", 4) == 0 && len < sizeof(files->name);
+        if (!is_entry && !is_tmp) {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(fd, item->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) {
+            continue;
+        }
+        if (is_tmp && st.st_mtim.tv_sec + CACHE_STALE_TMP > now) {
+            continue;   /* Probably still being written */
+        }
+        if (count == capacity) {
+            size_t grown = capacity == 0 ? 256 : capacity * 2;
+            cache_file * bigger = realloc(files, grown * sizeof(cache_file));
+            if (bigger == NULL) {
+                break;
+            }
+            files = bigger;
+            capacity = grown;
+        }
+        files[count].mtime = (int64_t) st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+        files[count].size = (uint64_t) st.st_blocks * 512;
+        strcpy(files[count].name, item->d_name);
+        total += files[count].size;
+        count++;
+    }
+
+    if (total > limit) {
+        qsort(files, count, sizeof(cache_file), compare_age);
+        uint64_t target = limit - limit / 4;
+        for (size_t i = 0; i < count && total > target; i++) {
+            unlinkat(fd, files[i].name, 0);
+            total -= files[i].size;
+        }
+    }
+    free(files);
+    closedir(dir);
+}
+
+/*
+ * shift_cache_store
+ *
+ * Purpose: Adds or replaces the entry for a key
+ *
+ * How it works:
+ * 1. Writes the entry to a new temporary file in the cache directory
+ * 2. Renames it over the entry's name (atomic, so concurrent readers and
+ *    writers never see a partial entry; the last rename wins)
+ * 3. Trims the cache to its size limit
+ * Failures are silent: the result simply is not cached.
+ */
+void shift_cache_store(uint64_t key, const shift_analysis * analysis) {
+    char dir[4096];
+    char tmp[4096 + 32];
+    char path[4096 + 32];
+    if (cache_dir(dir, sizeof(dir)) != 0) {
+        return;
+    }
+    snprintf(tmp, sizeof(tmp), "%s/tmp.XXXXXX", dir);
+    snprintf(path, sizeof(path), "%s/%016llx" CACHE_SUFFIX, dir, (unsigned long long) key);
+
+    cache_entry entry;
+    memset(&entry, 0, sizeof(entry));
+    memcpy(entry.magic, CACHE_MAGIC, 4);
+    entry.version = CACHE_VERSION;
+    entry.key = key;
+    entry.shift = analysis->shift;
+    entry.language = analysis->language;
+    memcpy(entry.scores, analysis->scores, sizeof(entry.scores));
+    memcpy(entry.counts, analysis->hist.counts, sizeof(entry.counts));
+    entry.letters = analysis->hist.letters;
+    entry.bytes = analysis->hist.bytes;
+    entry.crc = entry_crc(&entry);
+
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        return;
+    }
+    int ok = write(fd, &entry, sizeof(entry)) == (ssize_t) sizeof(entry);
+    if (close(fd) != 0) {
+        ok = 0;
+    }
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return;
+    }
+    cache_trim(dir, cache_limit());
+}
+
+/*
+ * shift_analyse
+ *
+ * Purpose: Analyses a text without the cache
+ *
+ * How it works:
+ *   A single language is scored exactly as before profiles existed
+ *   (decode_best_shift); several are scored together with
+ *   decode_best_language, keeping the scores of the winner (or of the
+ *   first language if none fits)
+ */
+void shift_analyse(decode_ctx * const * ctxs, int count, const char * text, size_t length,
+                   shift_analysis * analysis) {
+    freq_hist_clear(&analysis->hist);
+    freq_hist_update(&analysis->hist, text, length);
+    if (count == 1) {
+        analysis->shift = decode_best_shift(ctxs[0], &analysis->hist);
+        analysis->language = 0;
+        decode_scores(ctxs[0], &analysis->hist, analysis->scores);
+        return;
+    }
+    analysis->shift = decode_best_language(ctxs, count, &analysis->hist, &analysis->language);
+    decode_scores(ctxs[analysis->language >= 0 ? analysis->language : 0],
+                  &analysis->hist, analysis->scores);
+}
+
+/*
+ * shift_analyse_cached
+ *
+ * Purpose: Analyses a text, reusing an earlier result for the same text
+ *
+ * Parameters:
+ *   ctxs     - One context per language (their profiles are part of the key)
+ *   count    - Number of languages
+ *   text     - The text and its length in bytes
+ *   file_key - File key the caller looked up and missed, or NULL; the
+ *              result is stored under it too
+ *   analysis - Receives the result
+ *
+ * Returns:
+ *   1 if the result came from the cache, 0 if it was computed
+ */
+int shift_analyse_cached(decode_ctx * const * ctxs, int count, const char * text, size_t length,
+                         const uint64_t * file_key, shift_analysis * analysis) {
+    uint64_t key = cache_hash64(text, length, shift_cache_seed(ctxs, count));
+    int hit = shift_cache_lookup(key, analysis) == 0;
+    if (!hit) {
+        shift_analyse(ctxs, count, text, length, analysis);
+        shift_cache_store(key, analysis);
+    }
+    if (file_key != NULL) {
+        shift_cache_store(*file_key, analysis);
+    }
+    return hit;
+}
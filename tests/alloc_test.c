@@ -0,0 +1,144 @@
+/*
+ * alloc_test.c
+ *
+ * Checks that the hot path of the analysis API makes no heap allocations
+ * (make check). The test is linked with -Wl,--wrap=malloc (and calloc,
+ * realloc), so every allocation made by decode_lib.o and frequency_lib.o
+ * goes through the counting wrappers below.
+ *
+ * Contexts are created first, where allocating is allowed; the counter is
+ * then reset and the counting, scoring and transform functions are run on
+ * a text many times. Any allocation fails the test.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "decode_lib.h"
+#include "frequency_table.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Allocations seen since the counter was last reset */
+static unsigned long allocations = 0;
+
+void * __real_malloc(size_t size);
+void * __real_calloc(size_t count, size_t size);
+void * __real_realloc(void * ptr, size_t size);
+
+void * __wrap_malloc(size_t size) {
+    allocations++;
+    return __real_malloc(size);
+}
+
+void * __wrap_calloc(size_t count, size_t size) {
+    allocations++;
+    return __real_calloc(count, size);
+}
+
+void * __wrap_realloc(void * ptr, size_t size) {
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+static int failures = 0;
+
+/* Reports whether the calls since the last reset allocated */
+static void expect_none(const char * what) {
+    if (allocations != 0) {
+        printf("FAIL: %s made %lu heap allocations\n", what, allocations);
+        failures++;
+    } else {
+        printf("ok: %s makes no heap allocations\n", what);
+    }
+    allocations = 0;
+}
+
+int main(void) {
+    static const char sample[] =
+        "Aol thpu mvyt vm mvvk wyvkbjapvu pu zbjo zvjplaplz pz aol khpsf jvssljapvu vm dpsk wshuaz "
+        "huk aol obuapun vm dpsk hupthsz. Obualy-nhaolylyz tvcl hyvbuk jvuzahuasf pu zlhyjo vm mvvk.";
+    double flat[26];
+    for (int ch = 0; ch < 26; ch++) {
+        flat[ch] = 1.0 / 26;
+    }
+
+    /* Setup may allocate */
+    decode_ctx * english = decode_ctx_new();
+    decode_ctx * other = decode_ctx_new_profile(flat);
+    if (english == NULL || other == NULL) {
+        printf("FAIL: could not create the contexts\n");
+        return 1;
+    }
+    decode_ctx * ctxs[2] = { english, other };
+    char * text = malloc(sizeof(sample));
+    memcpy(text, sample, sizeof(sample));
+    size_t length = strlen(text);
+    allocations = 0;
+
+    freq_hist hist;
+    freq_hist hists[4];
+    double scores[26];
+    double matrix[2 * 26];
+    int64_t fixed[26];
+    int shifts[4];
+    int languages[4];
+    int language = -1;
+    int shift = 0;
+
+    for (int round = 0; round < 1000; round++) {
+        freq_hist_clear(&hist);
+        freq_hist_update(&hist, text, length);
+        for (int i = 0; i < 4; i++) {
+            freq_hist_clear(&hists[i]);
+            freq_hist_update(&hists[i], text + i * (length / 4), length / 4);
+        }
+        freq_hist_merge(&hists[0], &hists[1]);
+    }
+    expect_none("freq_hist_clear/update/merge");
+
+    for (int round = 0; round < 1000; round++) {
+        decode_scores(english, &hist, scores);
+        decode_scores_fixed(english, &hist, fixed);
+        decode_chi_sq(english, &hist, round % 26);
+        shift = decode_best_shift(english, &hist);
+    }
+    expect_none("decode_scores/decode_scores_fixed/decode_chi_sq/decode_best_shift");
+
+    for (int round = 0; round < 1000; round++) {
+        decode_scores_matrix(ctxs, 2, &hist, matrix);
+        decode_best_language(ctxs, 2, &hist, &language);
+        decode_best_languages(ctxs, 2, hists, 4, shifts, languages);
+    }
+    expect_none("decode_scores_matrix/decode_best_language/decode_best_languages");
+
+    for (int round = 0; round < 1000; round++) {
+        decode_apply(english, text, length, to_decode(shift));
+        decode_apply(english, text, length, shift);
+    }
+    expect_none("decode_apply");
+
+    /* The older wrappers share a context built on first use, so warm it up */
+    encode_shift(text);
+    allocations = 0;
+    for (int round = 0; round < 100; round++) {
+        encode_shift(text);
+        chi_sq(text, round % 26);
+    }
+    expect_none("encode_shift/chi_sq");
+
+    if (shift != 7 || language != 0 || memcmp(text, sample, sizeof(sample)) != 0) {
+        printf("FAIL: wrong results (shift %d, language %d)\n", shift, language);
+        failures++;
+    }
+
+    free(text);
+    decode_ctx_free(english);
+    decode_ctx_free(other);
+    if (failures != 0) {
+        printf("%d allocation check(s) failed\n", failures);
+        return 1;
+    }
+    printf("All allocation checks passed\n");
+    return 0;
+}
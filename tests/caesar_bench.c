@@ -0,0 +1,160 @@
+/*
+ * caesar_bench.c
+ *
+ * Measures libcaesar.so from many threads at once (make bench), the way a
+ * service decoding requests in-process would call it.
+ *
+ * Every thread shares one context and works on its own copy of an English
+ * text encoded with shift 7. Two workloads are timed for 1, 2, 4, ... up
+ * to the given number of threads:
+ * - Bulk: count, find the shift and decode a large buffer (MB/s)
+ * - Requests: the same for a short message at a time (messages/s), where
+ *   the per-call cost matters more than the per-byte one
+ * With no shared mutable state the totals should grow with the threads up
+ * to the number of CPUs.
+ *
+ * Usage: ./caesar_bench [max_threads [megabytes]]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "caesar.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Bytes in one request of the second workload */
+#define BENCH_MESSAGE 256
+
+/* Requests each thread handles */
+#define BENCH_MESSAGES 200000
+
+static const char sample[] =
+    "Aol mvyt vm mvvk wyvkbjapvu pu zbjo zvjplaplz pz aol khpsf jvssljapvu vm dpsk wshuaz "
+    "huk aol obuapun vm dpsk hupthsz. Obualy-nhaolylyz tvcl hyvbuk jvuzahuasf pu zlhyjo vm "
+    "mvvk. Hz h ylzbsa, aolf kv uva ibpsk wlythulua cpsshnlz vy jylhal h dpkl chyplaf vm hyapmhjaz. ";
+
+static caesar_ctx * shared;
+static size_t bulk_length;
+
+/* Work and results of one thread */
+typedef struct bench_task {
+    int messages;                     /* Non-zero for the request workload */
+    char * buffer;                    /* The thread's own text */
+    long bad;                         /* Shifts found other than 7 */
+} bench_task;
+
+/* Wall-clock seconds */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* Counts, scores and decodes one piece of text, then encodes it again for the next pass */
+static void bench_one(bench_task * task, char * text, size_t length) {
+    caesar_hist hist;
+    caesar_hist_init(&hist);
+    caesar_hist_update(&hist, text, length);
+    int shift = caesar_best_shift(shared, &hist, NULL);
+    if (shift != 7) {
+        task->bad++;
+    }
+    caesar_transform(shared, text, length, caesar_decode_shift(shift));
+    caesar_transform(shared, text, length, shift);
+}
+
+static void * bench_worker(void * arg) {
+    bench_task * task = arg;
+    if (task->messages) {
+        for (int m = 0; m < BENCH_MESSAGES; m++) {
+            size_t at = (size_t) m * BENCH_MESSAGE % (bulk_length - BENCH_MESSAGE);
+            bench_one(task, task->buffer + at, BENCH_MESSAGE);
+        }
+    } else {
+        bench_one(task, task->buffer, bulk_length);
+    }
+    return NULL;
+}
+
+/* Runs one workload on threads threads; returns the seconds it took, or -1 */
+static double bench_run(int threads, int messages, bench_task * tasks, pthread_t * ids) {
+    double start = now();
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        tasks[t].messages = messages;
+        if (pthread_create(&ids[t], NULL, bench_worker, &tasks[t]) != 0) {
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+    return started == threads ? now() - start : -1;
+}
+
+int main(int argc, char * argv[]) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = argc > 1 ? atoi(argv[1]) : (cpus > 1 ? (int) cpus * 2 : 4);
+    long megabytes = argc > 2 ? atol(argv[2]) : 16;
+
+    if (max_threads < 1 || megabytes < 1) {
+        fprintf(stderr, "Usage: %s [max_threads [megabytes]]\n", argv[0]);
+        return 2;
+    }
+    shared = caesar_ctx_new();
+    bulk_length = (size_t) megabytes * 1024 * 1024;
+    bench_task * tasks = calloc((size_t) max_threads, sizeof(bench_task));
+    pthread_t * ids = calloc((size_t) max_threads, sizeof(pthread_t));
+    if (shared == NULL || tasks == NULL || ids == NULL) {
+        fprintf(stderr, "Out of memory.\n");
+        return 1;
+    }
+    for (int t = 0; t < max_threads; t++) {
+        tasks[t].buffer = malloc(bulk_length);
+        if (tasks[t].buffer == NULL) {
+            fprintf(stderr, "Out of memory.\n");
+            return 1;
+        }
+        for (size_t at = 0; at < bulk_length; at += sizeof(sample) - 1) {
+            size_t n = bulk_length - at < sizeof(sample) - 1 ? bulk_length - at : sizeof(sample) - 1;
+            memcpy(tasks[t].buffer + at, sample, n);
+        }
+    }
+
+    printf("libcaesar %d, %ld CPU(s), %ld MB per thread, %d-byte messages\n",
+           caesar_version(), cpus, megabytes, BENCH_MESSAGE);
+    printf("Threads\tBulk MB/s\tMessages/s\n");
+    printf("-------\t---------\t----------\n");
+    long bad = 0;
+    for (int threads = 1; ; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+        double bulk = bench_run(threads, 0, tasks, ids);
+        double small = bench_run(threads, 1, tasks, ids);
+        if (bulk < 0 || small < 0) {
+            fprintf(stderr, "Could not start %d threads\n", threads);
+            return 1;
+        }
+        printf("%d\t%.1f\t\t%.0f\n", threads, threads * (double) megabytes / bulk,
+               threads * (double) BENCH_MESSAGES / small);
+        if (threads == max_threads) {
+            break;
+        }
+    }
+
+    for (int t = 0; t < max_threads; t++) {
+        bad += tasks[t].bad;
+        free(tasks[t].buffer);
+    }
+    free(tasks);
+    free(ids);
+    caesar_ctx_free(shared);
+    if (bad != 0) {
+        printf("%ld call(s) found the wrong shift\n", bad);
+        return 1;
+    }
+    return 0;
+}
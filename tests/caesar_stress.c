@@ -0,0 +1,249 @@
+/*
+ * caesar_stress.c
+ *
+ * Checks that libcaesar.so can be called from many threads at once (make
+ * check). The test links against the shared library itself, as a program
+ * embedding it would.
+ *
+ * One context is built on the main thread and shared by every worker.
+ * Each worker encodes a known English text with a shift of its own, counts
+ * it in chunks and merges the counts, asks for the best shift, checks the
+ * chi-squared scores against ones computed before the threads started and
+ * decodes the text and a batch of records back. Now and then a worker also
+ * builds and frees a context of its own, so contexts are created while
+ * others are in use. Any result that differs from the single-threaded one
+ * fails the test.
+ *
+ * Usage: ./caesar_stress [threads [rounds]]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "caesar.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Records decoded in each round */
+#define STRESS_RECORDS 8
+
+static const char plaintext[] =
+    "The form of food production in such societies is the daily collection of wild plants "
+    "and the hunting of wild animals. Hunter-gatherers move around constantly in search of "
+    "food. As a result, they do not build permanent villages or create a wide variety of "
+    "artifacts, and usually only form small groups such as bands and tribes. It is a way of "
+    "life that lasted for most of human history, and some people still live this way today, "
+    "in the deserts, forests and ice fields where farming has never been possible. Their "
+    "knowledge of the land, of the seasons and of the habits of every animal is remarkable.";
+
+/* Shared by every worker; built before they start and then only read */
+static caesar_ctx * shared;
+static size_t text_length;
+static double reference[26][26];      /* English scores of the text encoded with each shift */
+static unsigned char records[STRESS_RECORDS * CAESAR_RECORD_SIZE];
+
+/* Work and results of one thread */
+typedef struct stress_task {
+    int id;
+    int rounds;
+    long failures;
+    char message[160];                /* First failure seen */
+} stress_task;
+
+/* Records a failure, keeping the first message */
+static void stress_fail(stress_task * task, const char * what, int shift) {
+    if (task->failures++ == 0) {
+        snprintf(task->message, sizeof(task->message), "%s (shift %d)", what, shift);
+    }
+}
+
+/* Fills the record batch: pieces of the text in str1 and str2, a counter everywhere else */
+static void make_records(void) {
+    for (size_t i = 0; i < sizeof(records); i++) {
+        records[i] = (unsigned char) i;
+    }
+    for (int r = 0; r < STRESS_RECORDS; r++) {
+        unsigned char * record = records + r * CAESAR_RECORD_SIZE;
+        memcpy(record + CAESAR_RECORD_STR1_OFFSET, plaintext + r * 7, CAESAR_RECORD_STR1_SIZE - 1);
+        record[CAESAR_RECORD_STR1_OFFSET + CAESAR_RECORD_STR1_SIZE - 1] = '\0';
+        memcpy(record + CAESAR_RECORD_STR2_OFFSET, plaintext + r * 31, CAESAR_RECORD_STR2_SIZE - 1 - r);
+        record[CAESAR_RECORD_STR2_OFFSET + CAESAR_RECORD_STR2_SIZE - 1 - r] = '\0';
+    }
+}
+
+/* Returns non-zero if byte i of a record is in str1 or str2 */
+static int in_string(size_t i) {
+    return (i >= CAESAR_RECORD_STR1_OFFSET && i < CAESAR_RECORD_STR1_OFFSET + CAESAR_RECORD_STR1_SIZE) ||
+           (i >= CAESAR_RECORD_STR2_OFFSET && i < CAESAR_RECORD_STR2_OFFSET + CAESAR_RECORD_STR2_SIZE);
+}
+
+/* One round of a worker: the text and the records encoded with shift and decoded again */
+static void stress_round(stress_task * task, const caesar_ctx * ctx, int shift, char * text, unsigned char * batch) {
+    caesar_hist whole;
+    caesar_hist parts[4];
+    caesar_hist merged;
+    double scores[26];
+    int profile = -2;
+
+    memcpy(text, plaintext, text_length);
+    caesar_transform(ctx, text, text_length, shift);
+
+    caesar_hist_init(&whole);
+    caesar_hist_update(&whole, text, text_length);
+    caesar_hist_init(&merged);
+    for (int p = 0; p < 4; p++) {
+        size_t first = text_length * p / 4;
+        size_t end = text_length * (p + 1) / 4;
+        caesar_hist_init(&parts[p]);
+        for (size_t at = first; at < end; at += 13) {
+            caesar_hist_update(&parts[p], text + at, end - at < 13 ? end - at : 13);
+        }
+        caesar_hist_merge(&merged, &parts[p]);
+    }
+    if (memcmp(&whole, &merged, sizeof(whole)) != 0) {
+        stress_fail(task, "merged histogram differs from the whole one", shift);
+    }
+
+    int best = caesar_best_shift(ctx, &merged, &profile);
+    if (best != shift || profile != 0) {
+        stress_fail(task, "wrong best shift or profile", shift);
+    }
+    if (caesar_score(ctx, 0, &merged, scores) != 0 || memcmp(scores, reference[shift], sizeof(scores)) != 0) {
+        stress_fail(task, "scores differ from the single-threaded ones", shift);
+    }
+    caesar_transform(ctx, text, text_length, caesar_decode_shift(best));
+    if (memcmp(text, plaintext, text_length) != 0) {
+        stress_fail(task, "text does not decode back", shift);
+    }
+
+    memcpy(batch, records, sizeof(records));
+    caesar_transform_records(ctx, batch, STRESS_RECORDS, shift);
+    for (size_t i = 0; i < sizeof(records); i++) {
+        if (!in_string(i % CAESAR_RECORD_SIZE) && batch[i] != records[i]) {
+            stress_fail(task, "a record's numeric fields changed", shift);
+            break;
+        }
+    }
+    caesar_transform_records(ctx, batch, STRESS_RECORDS, caesar_decode_shift(shift));
+    if (memcmp(batch, records, sizeof(records)) != 0) {
+        stress_fail(task, "records do not decode back", shift);
+    }
+}
+
+/*
+ * stress_worker
+ *
+ * Purpose: Runs the rounds of one thread, mostly on the shared context
+ * and every 50th round on a context of its own
+ */
+static void * stress_worker(void * arg) {
+    stress_task * task = arg;
+    char * text = malloc(text_length);
+    unsigned char * batch = malloc(sizeof(records));
+    double flat[26];
+
+    if (text == NULL || batch == NULL) {
+        stress_fail(task, "out of memory", 0);
+        free(text);
+        free(batch);
+        return NULL;
+    }
+    for (int ch = 0; ch < 26; ch++) {
+        flat[ch] = 1.0;
+    }
+
+    for (int round = 0; round < task->rounds; round++) {
+        int shift = (task->id + round) % 26;
+        if (round % 50 == 49) {
+            caesar_ctx * own = caesar_ctx_new();
+            if (own == NULL || caesar_ctx_add_profile(own, "flat", flat) != 1) {
+                stress_fail(task, "could not build a context", shift);
+            } else {
+                stress_round(task, own, shift, text, batch);
+            }
+            caesar_ctx_free(own);
+        } else {
+            stress_round(task, shared, shift, text, batch);
+        }
+    }
+    free(text);
+    free(batch);
+    return NULL;
+}
+
+int main(int argc, char * argv[]) {
+    int threads = argc > 1 ? atoi(argv[1]) : 16;
+    int rounds = argc > 2 ? atoi(argv[2]) : 500;
+    double flat[26];
+    char text[sizeof(plaintext)];
+
+    if (threads < 1 || rounds < 1) {
+        fprintf(stderr, "Usage: %s [threads [rounds]]\n", argv[0]);
+        return 2;
+    }
+    if (caesar_version() / 10000 != CAESAR_VERSION_MAJOR) {
+        printf("FAIL: library version %d does not match the header's %d\n", caesar_version(), CAESAR_VERSION);
+        return 1;
+    }
+
+    /* The shared context: English and a second profile, added before any thread starts */
+    for (int ch = 0; ch < 26; ch++) {
+        flat[ch] = 1.0;
+    }
+    shared = caesar_ctx_new();
+    if (shared == NULL || caesar_ctx_add_profile(shared, "flat", flat) != 1) {
+        printf("FAIL: could not build the shared context\n");
+        return 1;
+    }
+    text_length = strlen(plaintext);
+    make_records();
+    for (int shift = 0; shift < 26; shift++) {
+        caesar_hist hist;
+        memcpy(text, plaintext, text_length);
+        caesar_transform(shared, text, text_length, shift);
+        caesar_hist_init(&hist);
+        caesar_hist_update(&hist, text, text_length);
+        caesar_score(shared, 0, &hist, reference[shift]);
+    }
+
+    stress_task * tasks = calloc((size_t) threads, sizeof(stress_task));
+    pthread_t * ids = calloc((size_t) threads, sizeof(pthread_t));
+    if (tasks == NULL || ids == NULL) {
+        printf("FAIL: out of memory\n");
+        return 1;
+    }
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        tasks[t].id = t;
+        tasks[t].rounds = rounds;
+        if (pthread_create(&ids[t], NULL, stress_worker, &tasks[t]) != 0) {
+            break;
+        }
+        started++;
+    }
+    for (int t = 0; t < started; t++) {
+        pthread_join(ids[t], NULL);
+    }
+
+    long failures = 0;
+    for (int t = 0; t < started; t++) {
+        if (tasks[t].failures != 0) {
+            printf("FAIL: thread %d: %ld failure(s), first: %s\n", t, tasks[t].failures, tasks[t].message);
+            failures += tasks[t].failures;
+        }
+    }
+    if (started < threads) {
+        printf("FAIL: could only start %d of %d threads\n", started, threads);
+        failures++;
+    }
+    caesar_ctx_free(shared);
+    free(tasks);
+    free(ids);
+    if (failures != 0) {
+        return 1;
+    }
+    printf("ok: %d threads x %d rounds on a shared context agree with the single-threaded results\n",
+           threads, rounds);
+    return 0;
+}
@@ -0,0 +1,92 @@
+#!/bin/sh
+#
+# large_files.sh
+#
+# Checks that copyrecords and frequency_table handle files larger than
+# 2 GiB (make check-large). Run from the directory holding the programs.
+#
+# The inputs are sparse files made with truncate, so they take almost no
+# disk space; the copies are real files of the same size (about 2.2 GB
+# each, one at a time). A marker record and a few letters are written past
+# the 2 GiB offset, where a 32-bit size or offset would lose them.
+
+set -u
+
+BIN=$(pwd)
+WORK=$(mktemp -d "${TMPDIR:-/tmp}/caesar-large.XXXXXX") || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+RECORD=408
+RECORDS=5300000                      # 2,162,400,000 bytes, past 2^31
+SIZE=$((RECORD * RECORDS))
+TEXT_SIZE=2200000000
+TEXT_AT=2150000000                   # Letters past 2^31 = 2147483648
+
+failures=0
+
+fail() {
+    echo "FAIL: $1"
+    failures=$((failures + 1))
+}
+
+pass() {
+    echo "ok: $1"
+}
+
+# bytes_at FILE OFFSET COUNT prints COUNT bytes of FILE at OFFSET
+bytes_at() {
+    dd if="$1" bs=1 skip="$2" count="$3" 2>/dev/null
+}
+
+# A sparse archive of zero records with "Marker" in str1 of the last one
+truncate -s "$SIZE" "$WORK/big.rec"
+printf 'Marker' | dd of="$WORK/big.rec" bs=1 seek=$((SIZE - RECORD)) conv=notrunc 2>/dev/null
+
+# Forward copy with checksums: every record arrives, the marker stays last
+if "$BIN/copyrecords" -C -F "$WORK/big.rec" -O "$WORK/copy.rec"; then
+    size=$(stat -c %s "$WORK/copy.rec")
+    [ "$size" -eq "$SIZE" ] && pass "forward copy has $RECORDS records" ||
+        fail "forward copy has $((size / RECORD)) records, expected $RECORDS"
+    [ "$(bytes_at "$WORK/copy.rec" $((SIZE - RECORD)) 6)" = "Marker" ] && pass "forward copy keeps the last record last" ||
+        fail "forward copy lost the record past 2 GiB"
+    "$BIN/copyrecords" --verify -j 4 -F "$WORK/copy.rec" >/dev/null && pass "--verify accepts the copy" ||
+        fail "--verify rejects the copy"
+else
+    fail "forward copy failed"
+fi
+rm -f "$WORK/copy.rec" "$WORK/copy.rec.crc"
+
+# Reverse copy: the record from past 2 GiB comes first
+if "$BIN/copyrecords" -r -F "$WORK/big.rec" -O "$WORK/copy.rec"; then
+    size=$(stat -c %s "$WORK/copy.rec")
+    [ "$size" -eq "$SIZE" ] && pass "-r copy has $RECORDS records" ||
+        fail "-r copy has $((size / RECORD)) records, expected $RECORDS"
+    [ "$(bytes_at "$WORK/copy.rec" 0 6)" = "Marker" ] && pass "-r copy puts the last record first" ||
+        fail "-r copy lost the record past 2 GiB"
+else
+    fail "-r copy failed"
+fi
+rm -f "$WORK/copy.rec"
+
+# A sparse text file with "hello" past 2 GiB: the letters and the total
+# byte count must both be right
+truncate -s "$TEXT_SIZE" "$WORK/big.txt"
+printf 'hello' | dd of="$WORK/big.txt" bs=1 seek="$TEXT_AT" conv=notrunc 2>/dev/null
+
+out=$("$BIN/frequency_table" -F "$WORK/big.txt")
+echo "$out" | grep -qx "Letter Count: 5" && pass "frequency_table counts letters past 2 GiB" ||
+    fail "frequency_table letter count: $(echo "$out" | grep 'Letter Count')"
+echo "$out" | grep -qx "Character Count: $TEXT_SIZE" && pass "frequency_table counts $TEXT_SIZE bytes" ||
+    fail "frequency_table byte count: $(echo "$out" | grep 'Character Count')"
+echo "$out" | grep -qx "L	2" && pass "frequency_table per-letter counts" ||
+    fail "frequency_table count of L: $(echo "$out" | grep '^L')"
+
+out=$("$BIN/frequency_table" --bytes -j 4 -F "$WORK/big.txt")
+echo "$out" | grep -qx "Letters: 5" && pass "frequency_table --bytes counts letters past 2 GiB" ||
+    fail "frequency_table --bytes: $(echo "$out" | grep 'Letters')"
+
+if [ "$failures" -ne 0 ]; then
+    echo "$failures large-file check(s) failed"
+    exit 1
+fi
+echo "All large-file checks passed"